@@ -9,6 +9,10 @@
 #include "compiler.h"
 #include "compilerfp.h"
 
+extern "C" {
+#include "nvfx/nvfx_disasm.h"
+}
+
 #if !defined(WIN32)
 #include <dlfcn.h>
 #endif
@@ -39,6 +43,7 @@ void usage()
   std::cerr << "\t-f\t\tInput is fragment program\n" << std::endl;
   std::cerr << "\t-v\t\tInput is vertex program\n" << std::endl;
   std::cerr << "\t-o <filename>\tWrite output to <filename> instead of to stdout\n" << std::endl;
+  std::cerr << "\t-d\t\tDisassemble the output, and estimate its cost, to stderr\n" << std::endl;
 }
 
 std::string
@@ -69,7 +74,7 @@ readinput(std::istream & in)
 }
 
 
-int compileVP(std::istream & in,std::ostream & out)
+int compileVP(std::istream & in,std::ostream & out,bool disassemble)
 {
   std::string prg = readinput(in);
 
@@ -205,6 +210,12 @@ int compileVP(std::istream & in,std::ostream & out)
       const uint32_t opcode = (vpi[i].data[1] & NV40_VP_INST_VEC_OPCODE_MASK) >> NV40_VP_INST_VEC_OPCODE_SHIFT;
     }
 
+    if(disassemble) {
+      struct nvfx_program_cost cost;
+      nvfx_vertprog_disasm((const uint32_t *)vpi,compiler.GetInstructionCount(),stderr,&cost);
+      nvfx_program_cost_dump(stderr,"vertex program",&cost);
+    }
+
     out.write((const char *)vertexprogram,lastoff);
 
     if(out.good()) {
@@ -219,7 +230,7 @@ int compileVP(std::istream & in,std::ostream & out)
   }
 }
 
-int compileFP(std::istream & in,std::ostream & out)
+int compileFP(std::istream & in,std::ostream & out,bool disassemble)
 {
   std::string prg = readinput(in);
 
@@ -378,6 +389,13 @@ int compileFP(std::istream & in,std::ostream & out)
 	(fpi[i].data[3] & NVFX_FP_OP_INPUT_SRC_MASK) >> NVFX_FP_OP_INPUT_SRC_SHIFT
       };
     }
+
+    // fpi is in the driver's order, before the half-words are swapped:
+    if(disassemble) {
+      struct nvfx_program_cost cost;
+      nvfx_fragprog_disasm((const uint32_t *)fpi,compiler.GetInstructionCount() * 4,stderr,&cost);
+      nvfx_program_cost_dump(stderr,"fragment program",&cost);
+    }
     
     out.write((const char *)fragmentprogram,lastoff);
 
@@ -401,7 +419,9 @@ int main(int argc,char * const argv[])
 
   const char * output_filename = 0;
 
-  while((opt = getopt(argc,argv,"vfo:h")) != -1) {
+  bool disassemble = false;
+
+  while((opt = getopt(argc,argv,"vfo:dh")) != -1) {
     // set the program type:
     if(opt == 'v' || opt == 'f') {
       type = opt;
@@ -410,6 +430,10 @@ int main(int argc,char * const argv[])
     else if(opt == 'o') {
       output_filename = optarg;
     }
+    // print the disassembly & cost estimate:
+    else if(opt == 'd') {
+      disassemble = true;
+    }
     else if(opt == 'h') {
       usage();
       return 0;
@@ -442,11 +466,11 @@ int main(int argc,char * const argv[])
 
   if(type == 'v') {
     return compileVP((argc > 0) ? input_file : std::cin,
-		     (output_filename != 0) ? output_file : std::cout);
+		     (output_filename != 0) ? output_file : std::cout,disassemble);
   }
   else if(type == 'f') {
     return compileFP((argc > 0) ? input_file : std::cin,
-		     (output_filename != 0) ? output_file : std::cout);
+		     (output_filename != 0) ? output_file : std::cout,disassemble);
   }
   else {
     return EXIT_FAILURE;
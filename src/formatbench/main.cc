@@ -0,0 +1,122 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// main.cc - rsxgl-formatbench, which times util_format_translate() against the library's
+// specialized conversion kernels (format_convert.cc) for every pair of formats that has one, and
+// checks that both produce the same texels.
+//
+// Usage:
+//   rsxgl-formatbench [-s size] [-n iterations]
+//
+// Each pair converts a size x size image (default 512) iterations times (default 20). Prints
+// one line per pair: the formats, megatexels per second for each path, and the speedup.
+
+#include "format_convert.h"
+
+#include "util/u_format.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
+
+static const enum pipe_format formats[] = {
+  PIPE_FORMAT_R8G8B8A8_UNORM, PIPE_FORMAT_B8G8R8A8_UNORM, PIPE_FORMAT_A8R8G8B8_UNORM, PIPE_FORMAT_A8B8G8R8_UNORM,
+  PIPE_FORMAT_R8G8B8X8_UNORM, PIPE_FORMAT_B8G8R8X8_UNORM, PIPE_FORMAT_X8R8G8B8_UNORM, PIPE_FORMAT_X8B8G8R8_UNORM,
+  PIPE_FORMAT_R8G8B8_UNORM, PIPE_FORMAT_R8G8_UNORM, PIPE_FORMAT_R8A8_UNORM, PIPE_FORMAT_A8R8_UNORM,
+  PIPE_FORMAT_L8A8_UNORM, PIPE_FORMAT_R8_UNORM, PIPE_FORMAT_L8_UNORM, PIPE_FORMAT_A8_UNORM, PIPE_FORMAT_I8_UNORM,
+  PIPE_FORMAT_R32_FLOAT, PIPE_FORMAT_R32G32_FLOAT, PIPE_FORMAT_R32G32B32_FLOAT, PIPE_FORMAT_R32G32B32A32_FLOAT,
+  PIPE_FORMAT_R16_FLOAT, PIPE_FORMAT_R16G16_FLOAT, PIPE_FORMAT_R16G16B16_FLOAT, PIPE_FORMAT_R16G16B16A16_FLOAT
+};
+
+static double
+now_usec()
+{
+  struct timeval t;
+  gettimeofday(&t,0);
+  return ((double)t.tv_sec * 1.0e6) + (double)t.tv_usec;
+}
+
+int
+main(int argc,char ** argv)
+{
+  unsigned size = 512, iterations = 20;
+
+  for(int i = 1;i < argc;++i) {
+    if(strcmp(argv[i],"-s") == 0 && (i + 1) < argc) {
+      size = strtoul(argv[++i],0,10);
+    }
+    else if(strcmp(argv[i],"-n") == 0 && (i + 1) < argc) {
+      iterations = strtoul(argv[++i],0,10);
+    }
+    else {
+      fprintf(stderr,"usage: %s [-s size] [-n iterations]\n",argv[0]);
+      return 1;
+    }
+  }
+
+  if(size == 0 || iterations == 0) {
+    fprintf(stderr,"size and iterations must be greater than 0\n");
+    return 1;
+  }
+
+  const size_t nformats = sizeof(formats) / sizeof(formats[0]);
+  const double mtexels = (double)size * (double)size * (double)iterations / 1.0e6;
+  int result = 0;
+
+  printf("%-34s %-34s %12s %12s %8s\n","source","destination","translate","kernel","speedup");
+
+  for(size_t i = 0;i < nformats;++i) {
+    for(size_t j = 0;j < nformats;++j) {
+      const enum pipe_format src_format = formats[i], dst_format = formats[j];
+      if(!rsxgl_format_convert_supported(dst_format,src_format)) continue;
+
+      const unsigned src_stride = size * util_format_get_blocksize(src_format);
+      const unsigned dst_stride = size * util_format_get_blocksize(dst_format);
+
+      // Small, finite values, so that floats convert to normal halfs:
+      std::vector< uint8_t > src(src_stride * size);
+      if(util_format_is_float(src_format)) {
+	float * p = (float *)&src[0];
+	for(size_t k = 0,n = src.size() / sizeof(float);k < n;++k) {
+	  p[k] = (float)(rand() % 2000) / 1000.0f - 1.0f;
+	}
+      }
+      else {
+	for(size_t k = 0;k < src.size();++k) {
+	  src[k] = (uint8_t)rand();
+	}
+      }
+
+      std::vector< uint8_t > expected(dst_stride * size), actual(dst_stride * size);
+
+      const double t0 = now_usec();
+      for(unsigned k = 0;k < iterations;++k) {
+	util_format_translate(dst_format,&expected[0],dst_stride,0,0,
+			      src_format,&src[0],src_stride,0,0,size,size);
+      }
+      const double t1 = now_usec();
+      for(unsigned k = 0;k < iterations;++k) {
+	rsxgl_format_convert(dst_format,&actual[0],dst_stride,0,0,
+			     src_format,&src[0],src_stride,0,0,size,size);
+      }
+      const double t2 = now_usec();
+
+      printf("%-34s %-34s %12.1f %12.1f %7.1fx%s\n",
+	     util_format_name(src_format),util_format_name(dst_format),
+	     mtexels / ((t1 - t0) / 1.0e6),mtexels / ((t2 - t1) / 1.0e6),
+	     (t1 - t0) / (t2 - t1),
+	     (expected == actual) ? "" : " MISMATCH");
+
+      if(expected != actual) {
+	result = 1;
+      }
+    }
+  }
+
+  return result;
+}
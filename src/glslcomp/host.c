@@ -0,0 +1,140 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// host.c - Stand-ins for the parts of the nvfx driver that the shader translators consult,
+// so that they can run on the host without an RSX.
+
+#include "nvfx/nvfx_context.h"
+#include "pipe/p_screen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Only the capabilities that mesa's state tracker asks about while translating programs are
+// answered; they match nvfx_screen_get_param() & nvfx_screen_get_shader_param():
+static int
+host_screen_get_param(struct pipe_screen *pscreen, enum pipe_cap param)
+{
+  switch(param) {
+  case PIPE_CAP_TGSI_FS_COORD_ORIGIN_LOWER_LEFT:
+  case PIPE_CAP_TGSI_FS_COORD_PIXEL_CENTER_HALF_INTEGER:
+  case PIPE_CAP_TGSI_FS_COORD_ORIGIN_UPPER_LEFT:
+  case PIPE_CAP_TGSI_FS_COORD_PIXEL_CENTER_INTEGER:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int
+host_screen_get_shader_param(struct pipe_screen *pscreen, unsigned shader, enum pipe_shader_cap param)
+{
+  return 0;
+}
+
+static struct pipe_screen host_screen;
+
+// Returns a context that looks like the one that glLinkProgram() passes to the translators,
+// which is an NV40-class nvfx_context (see nvfx_create(), built with __RSXGL__):
+struct pipe_context *
+rsxglslc_create_pipe(void)
+{
+  host_screen.get_param = host_screen_get_param;
+  host_screen.get_shader_param = host_screen_get_shader_param;
+
+  struct nvfx_context * nvfx = (struct nvfx_context *)calloc(1,sizeof(struct nvfx_context));
+  if(nvfx == 0) return 0;
+
+  nvfx -> pipe.screen = &host_screen;
+  nvfx -> is_nv4x = ~0;
+  nvfx -> use_nv4x = ~0;
+  nvfx -> use_vp_clipping = FALSE;
+
+  return &nvfx -> pipe;
+}
+
+// nvfx_vertprog.c & nvfx_fragprog.c also contain the code that uploads programs to the GPU,
+// which calls into libdrm's nouveau library. rsxglslc never runs it, and isn't linked against
+// libdrm, so these only have to satisfy the linker:
+static void
+host_unreachable(const char * function)
+{
+  fprintf(stderr,"rsxglslc: %s called on the host\n",function);
+  abort();
+}
+
+int
+nouveau_bo_new(struct nouveau_device *dev, uint32_t flags, int align, int size, struct nouveau_bo **bo)
+{
+  host_unreachable(__FUNCTION__);
+  return -1;
+}
+
+int
+nouveau_bo_ref(struct nouveau_bo *ref, struct nouveau_bo **pbo)
+{
+  host_unreachable(__FUNCTION__);
+  return -1;
+}
+
+int
+nouveau_bo_map(struct nouveau_bo *bo, uint32_t flags)
+{
+  host_unreachable(__FUNCTION__);
+  return -1;
+}
+
+void
+nouveau_bo_unmap(struct nouveau_bo *bo)
+{
+  host_unreachable(__FUNCTION__);
+}
+
+int
+nouveau_bo_busy(struct nouveau_bo *bo, uint32_t access)
+{
+  host_unreachable(__FUNCTION__);
+  return -1;
+}
+
+void
+nouveau_grobj_autobind(struct nouveau_grobj *grobj)
+{
+  host_unreachable(__FUNCTION__);
+}
+
+int
+nouveau_pushbuf_flush(struct nouveau_channel *chan, unsigned min)
+{
+  host_unreachable(__FUNCTION__);
+  return -1;
+}
+
+int
+nouveau_pushbuf_marker_emit(struct nouveau_channel *chan, unsigned wait_dwords, unsigned wait_relocs)
+{
+  host_unreachable(__FUNCTION__);
+  return -1;
+}
+
+int
+nouveau_pushbuf_emit_reloc(struct nouveau_channel *chan, void *ptr, struct nouveau_bo *bo,
+			   uint32_t data, uint32_t data2, uint32_t flags, uint32_t vor, uint32_t tor)
+{
+  host_unreachable(__FUNCTION__);
+  return -1;
+}
+
+int
+nouveau_resource_alloc(struct nouveau_resource *heap, unsigned size, void *priv, struct nouveau_resource **res)
+{
+  host_unreachable(__FUNCTION__);
+  return -1;
+}
+
+void
+nouveau_resource_free(struct nouveau_resource **res)
+{
+  host_unreachable(__FUNCTION__);
+}
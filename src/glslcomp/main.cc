@@ -0,0 +1,643 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// main.cc - rsxglslc, which compiles GLSL programs on the host into binaries that
+// glProgramBinary() loads, using the same mesa & nvfx path as glLinkProgram().
+//
+// Usage:
+//   rsxglslc [options] -o program.rsxp shader.vert shader.frag
+//   rsxglslc [options] -o outdir dir...
+//
+// The second form compiles every pair of <name>.vert & <name>.frag files found in each dir
+// into outdir/<name>.rsxp, running up to -j programs at a time. mesa's compiler keeps global
+// state, so each program in a batch is compiled by a separate process.
+//
+// Alongside each binary, a make-style <binary>.d file lists the files that it was built from,
+// including those pulled in by #include "file" directives (which rsxglslc expands itself,
+// since mesa's preprocessor doesn't support them), and records a hash of the options that
+// affect the output. A binary is only rebuilt if it's missing, if any of its dependencies are
+// newer than it, or if the options changed.
+//
+// Each binary is loaded back before it's written, and rejected if glProgramBinary() wouldn't
+// accept it.
+//
+// -S prints each program's microcode, disassembled, to stdout, followed by the same cost
+// estimates that glGetProgramiv() returns for GL_RSX_program_cost.
+
+#include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
+
+#include "compiler_context.h"
+#include "program_translate.h"
+#include "program_binary.h"
+#include "shader_cache.h"
+#include "gl_constants.h"
+
+// mesa:
+#include <main/mtypes.h>
+
+extern "C" {
+#include "nvfx/nvfx_disasm.h"
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+extern "C" struct pipe_context * rsxglslc_create_pipe(void);
+
+namespace {
+
+  // Includes deeper than this are assumed to be recursive:
+  const unsigned int max_include_depth = 32;
+
+  struct options_t {
+    std::vector< std::string > include_dirs;
+    std::vector< std::pair< std::string,unsigned int > > attrib_locations, frag_data_locations;
+    std::vector< std::string > varyings;
+    GLenum varyings_mode;
+    std::string output;
+    unsigned int jobs;
+    bool force, verbose, disassemble;
+
+    options_t() : varyings_mode(GL_INTERLEAVED_ATTRIBS), jobs(1), force(false), verbose(false), disassemble(false) {
+    }
+
+    // Hash of everything that affects the binary, besides the sources:
+    uint64_t hash() const {
+      uint64_t result = rsxgl_shader_cache_hash((uint32_t)RSXGL_SHADER_CACHE_VERSION,
+						rsxgl_shader_cache_hash((uint32_t)RSXGL_PROGRAM_BINARY_VERSION,RSXGL_SHADER_CACHE_HASH_INIT));
+      for(const auto & location : attrib_locations) {
+	result = rsxgl_shader_cache_hash(location.first.c_str(),rsxgl_shader_cache_hash(location.second,rsxgl_shader_cache_hash((uint32_t)GL_VERTEX_SHADER,result)));
+      }
+      for(const auto & location : frag_data_locations) {
+	result = rsxgl_shader_cache_hash(location.first.c_str(),rsxgl_shader_cache_hash(location.second,rsxgl_shader_cache_hash((uint32_t)GL_FRAGMENT_SHADER,result)));
+      }
+      result = rsxgl_shader_cache_hash((uint32_t)varyings.size(),rsxgl_shader_cache_hash((uint32_t)varyings_mode,result));
+      for(const auto & varying : varyings) {
+	result = rsxgl_shader_cache_hash(varying.c_str(),result);
+      }
+      return result;
+    }
+  };
+
+  struct job_t {
+    std::string vert, frag, output;
+  };
+
+  struct pipe_context * host_pipe = 0;
+
+  void usage(const char * argv0) {
+    fprintf(stderr,
+	    "usage: %s [options] -o program.rsxp shader.vert shader.frag\n"
+	    "       %s [options] -o outdir dir...\n"
+	    "options:\n"
+	    "  -o path        output binary, or output directory in batch mode\n"
+	    "  -I dir         search dir for #include \"file\"\n"
+	    "  -a name=index  bind vertex attribute name to index\n"
+	    "  -c name=index  bind fragment output name to color number index\n"
+	    "  -x varying     capture varying with transform feedback (may be repeated)\n"
+	    "  -s             capture varyings into separate buffers\n"
+	    "  -j jobs        compile up to jobs programs at a time in batch mode\n"
+	    "  -f             rebuild even if the output is up to date\n"
+	    "  -S             print each program's disassembly & cost estimate (implies -f)\n"
+	    "  -v             print the library's debugging output\n",
+	    argv0,argv0);
+  }
+
+  void debug_callback(GLsizei n,const GLchar * s) {
+    fwrite(s,1,n,stderr);
+  }
+
+  bool is_directory(const std::string & path) {
+    struct stat st;
+    return stat(path.c_str(),&st) == 0 && S_ISDIR(st.st_mode);
+  }
+
+  bool modification_time(const std::string & path,time_t & t) {
+    struct stat st;
+    if(stat(path.c_str(),&st) != 0) return false;
+    t = st.st_mtime;
+    return true;
+  }
+
+  std::string dirname(const std::string & path) {
+    const size_t i = path.rfind('/');
+    return (i == std::string::npos) ? std::string(".") : path.substr(0,i);
+  }
+
+  bool ends_with(const std::string & s,const char * suffix) {
+    const size_t n = strlen(suffix);
+    return s.size() > n && s.compare(s.size() - n,n,suffix) == 0;
+  }
+
+  bool read_text(const std::string & path,std::string & text) {
+    FILE * f = fopen(path.c_str(),"rb");
+    if(f == 0) return false;
+
+    text.clear();
+    char buffer[4096];
+    size_t n;
+    while((n = fread(buffer,1,sizeof(buffer),f)) > 0) {
+      text.append(buffer,n);
+    }
+
+    const bool result = !ferror(f);
+    fclose(f);
+    return result;
+  }
+
+  // Write to a temporary file, then rename it, so that an interrupted build doesn't leave a
+  // truncated file that looks up to date:
+  bool write_file(const std::string & path,const void * data,const size_t n) {
+    const std::string tmp_path = path + ".tmp";
+
+    FILE * f = fopen(tmp_path.c_str(),"wb");
+    if(f == 0) return false;
+
+    const bool written = (n == 0) || (fwrite(data,n,1,f) == 1);
+    if(fclose(f) != 0 || !written || rename(tmp_path.c_str(),path.c_str()) != 0) {
+      remove(tmp_path.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  // If line is #include "file", returns true and sets file:
+  bool parse_include(const char * p,const char * end,std::string & file) {
+    while(p != end && (*p == ' ' || *p == '\t')) ++p;
+    if(p == end || *p++ != '#') return false;
+    while(p != end && (*p == ' ' || *p == '\t')) ++p;
+    if((size_t)(end - p) < 7 || strncmp(p,"include",7) != 0) return false;
+    p += 7;
+    while(p != end && (*p == ' ' || *p == '\t')) ++p;
+    if(p == end || *p++ != '"') return false;
+
+    const char * q = std::find(p,end,'"');
+    if(q == end) return false;
+
+    file.assign(p,q);
+    return true;
+  }
+
+  // Append the source file at path to source, expanding #include directives. Every file read
+  // is appended to deps; #line directives give each its index in deps as its source string
+  // number, so that the compiler's messages can be traced back to it.
+  bool load_source(const std::string & path,const options_t & options,std::string & source,std::vector< std::string > & deps,const unsigned int depth = 0) {
+    std::string text;
+    if(!read_text(path,text)) {
+      fprintf(stderr,"%s: %s\n",path.c_str(),strerror(errno));
+      return false;
+    }
+
+    const unsigned int index = deps.size();
+    deps.push_back(path);
+
+    unsigned int line = 0;
+    for(const char * p = text.c_str(), * end = p + text.size();p != end;) {
+      const char * eol = std::find(p,end,'\n');
+      ++line;
+
+      std::string file;
+      if(parse_include(p,eol,file)) {
+	if(depth >= max_include_depth) {
+	  fprintf(stderr,"%s:%u: includes nested too deeply\n",path.c_str(),line);
+	  return false;
+	}
+
+	std::string include_path = dirname(path) + "/" + file;
+	for(auto it = options.include_dirs.begin(),it_end = options.include_dirs.end();it != it_end && access(include_path.c_str(),R_OK) != 0;++it) {
+	  include_path = *it + "/" + file;
+	}
+	if(access(include_path.c_str(),R_OK) != 0) {
+	  fprintf(stderr,"%s:%u: cannot find \"%s\"\n",path.c_str(),line,file.c_str());
+	  return false;
+	}
+
+	char directive[64];
+	snprintf(directive,sizeof(directive),"#line 1 %u\n",(unsigned int)deps.size());
+	source += directive;
+
+	if(!load_source(include_path,options,source,deps,depth + 1)) return false;
+
+	snprintf(directive,sizeof(directive),"\n#line %u %u\n",line + 1,index);
+	source += directive;
+      }
+      else {
+	source.append(p,eol);
+	source += '\n';
+      }
+
+      p = (eol == end) ? eol : eol + 1;
+    }
+
+    return true;
+  }
+
+  // Make-style escaping of spaces in file names:
+  std::string escape(const std::string & path) {
+    std::string result;
+    for(const char c : path) {
+      if(c == ' ') result += '\\';
+      result += c;
+    }
+    return result;
+  }
+
+  std::string depfile_header(const options_t & options) {
+    char header[64];
+    snprintf(header,sizeof(header),"# rsxglslc %08x%08x\n",(unsigned int)(options.hash() >> 32),(unsigned int)options.hash());
+    return header;
+  }
+
+  bool write_depfile(const job_t & job,const options_t & options,const std::vector< std::string > & deps) {
+    std::string text = depfile_header(options) + escape(job.output) + ":";
+    for(const auto & dep : deps) {
+      text += " \\\n  " + escape(dep);
+    }
+    text += "\n";
+
+    return write_file(job.output + ".d",text.data(),text.size());
+  }
+
+  // The output is up to date if its .d file was written with the same options, and none of
+  // the files that it lists are newer than the output:
+  bool up_to_date(const job_t & job,const options_t & options) {
+    time_t output_time, dep_time;
+    std::string text;
+    if(!modification_time(job.output,output_time) || !read_text(job.output + ".d",text)) return false;
+
+    const std::string header = depfile_header(options);
+    if(text.compare(0,header.size(),header) != 0) return false;
+
+    const size_t colon = text.find(':',header.size());
+    if(colon == std::string::npos) return false;
+
+    unsigned int num_deps = 0;
+    std::string dep;
+    for(size_t i = colon + 1,n = text.size();i <= n;++i) {
+      const char c = (i < n) ? text[i] : '\n';
+      if(c == '\\' && (i + 1) < n) {
+	const char next = text[++i];
+	if(next != '\n') dep += next;
+      }
+      else if(c == ' ' || c == '\t' || c == '\n') {
+	if(!dep.empty()) {
+	  if(!modification_time(dep,dep_time) || dep_time > output_time) return false;
+	  dep.clear();
+	  ++num_deps;
+	}
+      }
+      else {
+	dep += c;
+      }
+    }
+
+    return num_deps > 0;
+  }
+
+  void print_log(const char * log) {
+    if(log != 0 && log[0] != 0) {
+      fputs(log,stderr);
+      if(log[strlen(log) - 1] != '\n') fputc('\n',stderr);
+    }
+  }
+
+  // The compiler's messages refer to source string numbers; list the files that they are:
+  void print_errors(const gl_shader * shader,const std::vector< std::string > & deps) {
+    fprintf(stderr,"%s: compilation failed\n",deps[0].c_str());
+    print_log(shader -> InfoLog);
+    if(deps.size() > 1) {
+      for(size_t i = 0;i < deps.size();++i) {
+	fprintf(stderr,"  source %u: %s\n",(unsigned int)i,deps[i].c_str());
+      }
+    }
+  }
+
+  void disassemble(const job_t & job,const rsxgl_program_binary_t & binary) {
+    struct nvfx_program_cost vp_cost, fp_cost;
+
+    // The binary holds the fragment program in the RSX's half-word order:
+    std::vector< uint32_t > fp_ucode(binary.fp.ucode.size());
+    for(size_t i = 0,n = fp_ucode.size();i < n;++i) {
+      const uint32_t v = binary.fp.ucode[i];
+      fp_ucode[i] = (v >> 16) | (v << 16);
+    }
+
+    printf("# %s: vertex program\n",job.output.c_str());
+    nvfx_vertprog_disasm(binary.vp.ucode.data(),binary.vp.ucode.size() / 4,stdout,&vp_cost);
+    printf("# %s: fragment program\n",job.output.c_str());
+    nvfx_fragprog_disasm(fp_ucode.data(),fp_ucode.size(),stdout,&fp_cost);
+
+    nvfx_program_cost_dump(stdout,(job.output + ": vertex program").c_str(),&vp_cost);
+    nvfx_program_cost_dump(stdout,(job.output + ": fragment program").c_str(),&fp_cost);
+    fflush(stdout);
+  }
+
+  bool compile(const job_t & job,const options_t & options) {
+    if(!options.force && !options.disassemble && up_to_date(job,options)) return true;
+
+    // Each shader's source strings are numbered from 0:
+    std::vector< std::string > vert_deps, frag_deps;
+    std::string vert_source, frag_source;
+    if(!load_source(job.vert,options,vert_source,vert_deps) || !load_source(job.frag,options,frag_source,frag_deps)) return false;
+
+    compiler_context_t cctx(host_pipe);
+    bool result = false;
+
+    gl_shader * vert = cctx.create_shader(compiler_context_t::kVertex), * frag = cctx.create_shader(compiler_context_t::kFragment);
+    cctx.compile_shader(vert,vert_source.c_str());
+    cctx.compile_shader(frag,frag_source.c_str());
+
+    gl_shader_program * program = 0;
+
+    if(!vert -> CompileStatus || !frag -> CompileStatus) {
+      if(!vert -> CompileStatus) print_errors(vert,vert_deps);
+      if(!frag -> CompileStatus) print_errors(frag,frag_deps);
+      goto end;
+    }
+
+    program = cctx.create_program();
+    cctx.attach_shader(program,vert);
+    cctx.attach_shader(program,frag);
+
+    for(const auto & location : options.attrib_locations) {
+      cctx.bind_attrib_location(program,location.second,location.first.c_str());
+    }
+    for(const auto & location : options.frag_data_locations) {
+      cctx.bind_frag_data_location(program,location.second,location.first.c_str());
+    }
+    if(!options.varyings.empty()) {
+      std::vector< const char * > varyings;
+      for(const auto & varying : options.varyings) {
+	varyings.push_back(varying.c_str());
+      }
+      cctx.transform_feedback_varyings(program,varyings.size(),&varyings[0],options.varyings_mode);
+    }
+
+    cctx.link_program(program);
+
+    if(!program -> LinkStatus) {
+      fprintf(stderr,"%s: linking failed\n",job.output.c_str());
+      print_log(program -> InfoLog);
+      goto end;
+    }
+
+    {
+      rsxgl_program_binary_t binary;
+      nvfx_vertex_program * nvfx_vp = 0, * nvfx_streamvp = 0;
+      nvfx_fragment_program * nvfx_fp = 0, * nvfx_streamfp = 0;
+
+      rsxgl_program_translate(&cctx,program,binary,nvfx_vp,nvfx_fp,nvfx_streamvp,nvfx_streamfp);
+
+      if(nvfx_vp != 0) cctx.destroy_vp(nvfx_vp);
+      if(nvfx_fp != 0) cctx.destroy_fp(nvfx_fp);
+      if(nvfx_streamvp != 0) cctx.destroy_vp(nvfx_streamvp);
+      if(nvfx_streamfp != 0) cctx.destroy_fp(nvfx_streamfp);
+
+      // The same limit that glProgramBinary() checks:
+      const size_t num_insn = binary.vp.ucode.size() / 4;
+      if(num_insn == 0 || binary.fp.ucode.empty()) {
+	fprintf(stderr,"%s: translation failed\n",job.output.c_str());
+	goto end;
+      }
+      if(num_insn > RSXGL__VERTEX__MAX_PROGRAM_INSTRUCTIONS) {
+	fprintf(stderr,"%s: vertex program has %u instructions; the RSX has room for %u\n",
+		job.output.c_str(),(unsigned int)num_insn,(unsigned int)RSXGL__VERTEX__MAX_PROGRAM_INSTRUCTIONS);
+	goto end;
+      }
+
+      std::vector< uint8_t > data(rsxgl_program_binary_size(binary));
+      rsxgl_program_binary_write(binary,&data[0]);
+
+      // Load it back the way that glProgramBinary() will, so that a binary that the library
+      // would reject is never written:
+      {
+	rsxgl_program_binary_t loaded;
+	if(rsxgl_program_binary_read(loaded,&data[0],data.size()) != RSXGL_PROGRAM_BINARY_OK) {
+	  fprintf(stderr,"%s: the program binary doesn't load back\n",job.output.c_str());
+	  goto end;
+	}
+      }
+
+      std::vector< std::string > deps(vert_deps);
+      deps.insert(deps.end(),frag_deps.begin(),frag_deps.end());
+
+      if(!write_file(job.output,&data[0],data.size()) || !write_depfile(job,options,deps)) {
+	fprintf(stderr,"%s: %s\n",job.output.c_str(),strerror(errno));
+	goto end;
+      }
+
+      if(options.disassemble) {
+	disassemble(job,binary);
+      }
+
+      if(options.verbose) {
+	fprintf(stderr,"%s: %u vertex program instructions, %u fragment program instructions, %u bytes\n",
+		job.output.c_str(),(unsigned int)num_insn,(unsigned int)(binary.fp.ucode.size() / 4),(unsigned int)data.size());
+      }
+
+      result = true;
+    }
+
+  end:
+    if(program != 0) cctx.destroy_program(program);
+    cctx.destroy_shader(vert);
+    cctx.destroy_shader(frag);
+
+    return result;
+  }
+
+  // Find pairs of <name>.vert & <name>.frag in dir:
+  bool find_jobs(const std::string & dir,const std::string & outdir,std::vector< job_t > & jobs) {
+    DIR * d = opendir(dir.c_str());
+    if(d == 0) {
+      fprintf(stderr,"%s: %s\n",dir.c_str(),strerror(errno));
+      return false;
+    }
+
+    std::vector< std::string > names;
+    while(struct dirent * entry = readdir(d)) {
+      const std::string name = entry -> d_name;
+      if(ends_with(name,".vert")) {
+	names.push_back(name.substr(0,name.size() - 5));
+      }
+    }
+    closedir(d);
+
+    std::sort(names.begin(),names.end());
+
+    for(const auto & name : names) {
+      job_t job;
+      job.vert = dir + "/" + name + ".vert";
+      job.frag = dir + "/" + name + ".frag";
+      job.output = outdir + "/" + name + ".rsxp";
+
+      if(access(job.frag.c_str(),R_OK) == 0) {
+	jobs.push_back(job);
+      }
+    }
+
+    return true;
+  }
+
+  // Run jobs, up to options.jobs at a time, each in its own process. Returns the number that
+  // failed:
+  unsigned int run(const std::vector< job_t > & jobs,const options_t & options) {
+    unsigned int failed = 0;
+
+    if(options.jobs <= 1) {
+      for(const auto & job : jobs) {
+	if(!compile(job,options)) ++failed;
+      }
+      return failed;
+    }
+
+    unsigned int running = 0;
+    for(auto it = jobs.begin(),it_end = jobs.end();it != it_end || running > 0;) {
+      if(it != it_end && running < options.jobs) {
+	fflush(stderr);
+	const pid_t pid = fork();
+	if(pid == 0) {
+	  _exit(compile(*it,options) ? 0 : 1);
+	}
+	else if(pid < 0) {
+	  fprintf(stderr,"fork: %s\n",strerror(errno));
+	  if(!compile(*it,options)) ++failed;
+	}
+	else {
+	  ++running;
+	}
+	++it;
+      }
+      else {
+	int status = 0;
+	if(wait(&status) < 0) break;
+	--running;
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) ++failed;
+      }
+    }
+
+    return failed;
+  }
+
+  bool parse_location(const char * arg,std::vector< std::pair< std::string,unsigned int > > & locations) {
+    const char * eq = strchr(arg,'=');
+    if(eq == 0 || eq == arg || eq[1] == 0) return false;
+
+    char * end = 0;
+    const unsigned long index = strtoul(eq + 1,&end,0);
+    if(*end != 0) return false;
+
+    locations.push_back(std::make_pair(std::string(arg,eq),(unsigned int)index));
+    return true;
+  }
+
+}
+
+int
+main(int argc,char ** argv)
+{
+  options_t options;
+  int c;
+
+  while((c = getopt(argc,argv,"o:I:a:c:x:sj:fSvh")) != -1) {
+    switch(c) {
+    case 'o':
+      options.output = optarg;
+      break;
+    case 'I':
+      options.include_dirs.push_back(optarg);
+      break;
+    case 'a':
+      if(!parse_location(optarg,options.attrib_locations)) {
+	fprintf(stderr,"%s: bad attribute location \"%s\"\n",argv[0],optarg);
+	return 1;
+      }
+      break;
+    case 'c':
+      if(!parse_location(optarg,options.frag_data_locations)) {
+	fprintf(stderr,"%s: bad fragment output location \"%s\"\n",argv[0],optarg);
+	return 1;
+      }
+      break;
+    case 'x':
+      options.varyings.push_back(optarg);
+      break;
+    case 's':
+      options.varyings_mode = GL_SEPARATE_ATTRIBS;
+      break;
+    case 'j':
+      options.jobs = atoi(optarg);
+      if(options.jobs == 0) options.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+      break;
+    case 'f':
+      options.force = true;
+      break;
+    case 'S':
+      options.disassemble = true;
+      break;
+    case 'v':
+      options.verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+      return (c == 'h') ? 0 : 1;
+    }
+  }
+
+  if(options.output.empty() || optind >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector< job_t > jobs;
+
+  if(is_directory(options.output)) {
+    for(int i = optind;i < argc;++i) {
+      if(!find_jobs(argv[i],options.output,jobs)) return 1;
+    }
+  }
+  else if((argc - optind) == 2) {
+    job_t job;
+    job.vert = argv[optind];
+    job.frag = argv[optind + 1];
+    job.output = options.output;
+    jobs.push_back(job);
+  }
+  else {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(options.verbose) {
+    glInitDebug(1024,debug_callback);
+  }
+
+  host_pipe = rsxglslc_create_pipe();
+  if(host_pipe == 0) {
+    fprintf(stderr,"%s: out of memory\n",argv[0]);
+    return 1;
+  }
+
+  const unsigned int failed = run(jobs,options);
+  if(failed > 0) {
+    fprintf(stderr,"%s: %u of %u programs failed\n",argv[0],failed,(unsigned int)jobs.size());
+    return 1;
+  }
+
+  return 0;
+}
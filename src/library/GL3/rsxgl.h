@@ -24,6 +24,12 @@ struct rsxgl_init_parameters_t {
   uint32_t max_swap_wait_iterations;
   useconds_t swap_wait_interval;
   uint32_t rsx_mspace_offset, rsx_mspace_size;
+
+  /* Directory in which linked programs are cached between runs; NULL disables the cache. The
+     directory must already exist, and the string must remain valid. shader_cache_size limits
+     the size of the cache in bytes (0 selects a default). */
+  const char * shader_cache_path;
+  uint32_t shader_cache_size;
 };
 
 /*! \brief Customize the resources that RSXGL allocates upon initialization. Call this, optionally, before
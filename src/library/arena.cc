@@ -91,7 +91,7 @@ glCreateMemoryArenaRSX(GLenum location,GLsizei align,GLsizei size)
   arena.memory.location = rsx_location;
   arena.memory.offset = offset;
   arena.size = size;
-  arena.space = create_mspace_with_base(arena.address,arena.size,0);
+  arena.space = create_mspace_with_base(arena.address,arena.size,1);
 
   RSXGL_NOERROR(name);
 }
@@ -280,7 +280,7 @@ glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
 
 #if 0
   // If a pending GPU operation uses this buffer, then orphan it:
-  if((buffer -> timestamp != 0) && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,buffer -> timestamp))) {
+  if((buffer -> timestamp != 0) && (!rsxgl_timestamp_check(ctx,buffer -> timestamp))) {
     buffer_t::storage().orphan(ctx -> buffer_binding.names[rsx_target]);
 
     buffer -> timestamp = 0;
@@ -714,8 +714,8 @@ glCopyBufferSubData (GLenum readTarget, GLenum writeTarget, GLintptr readOffset,
 
   rsxgl_timestamp_post(ctx,timestamp);
 
-  rsxgl_assert(timestamp >= ctx -> buffer_binding[iread].timestamp);
-  rsxgl_assert(timestamp >= ctx -> buffer_binding[iwrite].timestamp);
+  rsxgl_assert(rsxgl_timestamp_ordered(ctx -> buffer_binding[iread].timestamp,timestamp));
+  rsxgl_assert(rsxgl_timestamp_ordered(ctx -> buffer_binding[iwrite].timestamp,timestamp));
 
   ctx -> buffer_binding[iread].timestamp = timestamp;
   ctx -> buffer_binding[iwrite].timestamp = timestamp;
@@ -726,7 +726,7 @@ glCopyBufferSubData (GLenum readTarget, GLenum writeTarget, GLintptr readOffset,
 void
 rsxgl_buffer_validate(rsxgl_context_t *,buffer_t & buffer,const uint32_t start,const uint32_t length,const uint32_t timestamp)
 {
-  rsxgl_assert(timestamp >= buffer.timestamp);
+  rsxgl_assert(rsxgl_timestamp_ordered(buffer.timestamp,timestamp));
   buffer.timestamp = timestamp;
 
   if(buffer.invalid) {
@@ -0,0 +1,210 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// compiler_thread.cc - Run the GLSL compiler on a thread of its own.
+
+#include "compiler_thread.h"
+#include "compiler_context.h"
+#include "rsxgl_config.h"
+#include "rsxgl_assert.h"
+#include "debug.h"
+
+#include <sys/thread.h>
+#include <sys/mutex.h>
+#include <sys/cond.h>
+
+#include <string.h>
+#include <deque>
+
+extern "C" {
+
+  struct pipe_context *
+  nvfx_create(struct pipe_screen *pscreen, void *priv);
+
+}
+
+rsxgl_spinlock_t rsxgl_compiler_lock = RSXGL_SPINLOCK_INITIALIZER;
+
+namespace {
+
+  // The application can ask for more, but there's only one; the PPU's other hardware thread
+  // is busy running the application:
+  uint32_t max_threads = ~0U;
+
+  // Serializes creating the mutex, and starting the thread:
+  rsxgl_spinlock_t start_lock = RSXGL_SPINLOCK_INITIALIZER;
+  volatile uint32_t initialized = 0, started = 0, failed = 0;
+
+  struct pipe_screen * screen = 0;
+  sys_ppu_thread_t thread;
+
+  // mutex protects queue, running, and each job's done flag; queue_cond is signalled when a
+  // job is queued or when a job run by another thread is done, and done_cond when any job is
+  // done. running is set while a job is being run, by any thread, so that only one runs at a
+  // time; nothing else is held while it runs:
+  sys_mutex_t mutex;
+  sys_cond_t queue_cond, done_cond;
+  std::deque< std::shared_ptr< rsxgl_compiler_job_t > > queue;
+  uint32_t running = 0;
+
+  void finish(rsxgl_compiler_job_t & job) {
+    sysMutexLock(mutex,0);
+    running = 0;
+    job.done = 1;
+    sysCondBroadcast(done_cond);
+    if(started) sysCondSignal(queue_cond);
+    sysMutexUnlock(mutex);
+  }
+
+  void thread_main(void *) {
+    // The nvfx context is only consulted by the microcode translators; it's never used to
+    // draw anything:
+    compiler_context_t cctx(nvfx_create(screen,0));
+
+    for(;;) {
+      sysMutexLock(mutex,0);
+      while(queue.empty() || running) {
+	sysCondWait(queue_cond,0);
+      }
+      std::shared_ptr< rsxgl_compiler_job_t > job = queue.front();
+      queue.pop_front();
+      running = 1;
+      sysMutexUnlock(mutex);
+
+      job -> run(&cctx);
+
+      finish(*job);
+    }
+  }
+
+  bool initialize() {
+    if(initialized) return true;
+    if(failed) return false;
+
+    rsxgl_spinlock_guard guard(start_lock);
+    if(initialized) return true;
+    if(failed) return false;
+
+    sys_mutex_attr_t mutex_attr;
+    memset(&mutex_attr,0,sizeof(mutex_attr));
+    mutex_attr.attr_protocol = SYS_MUTEX_PROTOCOL_PRIO;
+    mutex_attr.attr_recursive = SYS_MUTEX_ATTR_NOT_RECURSIVE;
+    mutex_attr.attr_pshared = SYS_MUTEX_ATTR_PSHARED;
+    mutex_attr.attr_adaptive = SYS_MUTEX_ATTR_NOT_ADAPTIVE;
+    strncpy(mutex_attr.name,"rsxglcmp",sizeof(mutex_attr.name));
+
+    sys_cond_attr_t cond_attr;
+    memset(&cond_attr,0,sizeof(cond_attr));
+    cond_attr.attr_pshared = SYS_COND_ATTR_PSHARED;
+    strncpy(cond_attr.name,"rsxglcmp",sizeof(cond_attr.name));
+
+    if(sysMutexCreate(&mutex,&mutex_attr) != 0) {
+      failed = 1;
+      return false;
+    }
+    if(sysCondCreate(&queue_cond,mutex,&cond_attr) != 0 || sysCondCreate(&done_cond,mutex,&cond_attr) != 0) {
+      failed = 1;
+      return false;
+    }
+
+    __sync_synchronize();
+    initialized = 1;
+    return true;
+  }
+
+  bool start(struct pipe_screen * _screen) {
+    if(started) return true;
+    if(!initialize()) return false;
+
+    rsxgl_spinlock_guard guard(start_lock);
+    if(started) return true;
+    if(failed) return false;
+
+    screen = _screen;
+
+    if(sysThreadCreate(&thread,thread_main,0,RSXGL_CONFIG_compiler_thread_priority,RSXGL_CONFIG_compiler_thread_stack_size,0,(char *)"rsxgl compiler") != 0) {
+      rsxgl_debug_printf("%s: failed to start the compiler thread\n",__PRETTY_FUNCTION__);
+      failed = 1;
+      return false;
+    }
+
+    __sync_synchronize();
+    started = 1;
+    return true;
+  }
+
+}
+
+void
+rsxgl_compiler_thread_run(const std::shared_ptr< rsxgl_compiler_job_t > & job,compiler_context_t * cctx,struct pipe_screen * screen)
+{
+  if(max_threads > 0 && start(screen)) {
+    sysMutexLock(mutex,0);
+    queue.push_back(job);
+    sysCondSignal(queue_cond);
+    sysMutexUnlock(mutex);
+    return;
+  }
+
+  rsxgl_compiler_job_run(*job,cctx);
+}
+
+void
+rsxgl_compiler_job_run(rsxgl_compiler_job_t & job,compiler_context_t * cctx)
+{
+  // Without the mutex, there can't be a compiler thread either, but jobs still have to be run
+  // one at a time:
+  if(!initialize()) {
+    rsxgl_spinlock_guard guard(start_lock);
+    job.run(cctx);
+    job.done = 1;
+    return;
+  }
+
+  // Jobs that were queued before this one have to finish first, since it may depend upon them:
+  sysMutexLock(mutex,0);
+  while(!queue.empty() || running) {
+    sysCondWait(done_cond,0);
+  }
+  running = 1;
+  sysMutexUnlock(mutex);
+
+  job.run(cctx);
+
+  finish(job);
+}
+
+bool
+rsxgl_compiler_job_done(const rsxgl_compiler_job_t & job)
+{
+  if(!job.done) return false;
+
+  // Don't read the job's results before its done flag:
+  __sync_synchronize();
+  return true;
+}
+
+void
+rsxgl_compiler_job_wait(rsxgl_compiler_job_t & job)
+{
+  if(rsxgl_compiler_job_done(job)) return;
+
+  sysMutexLock(mutex,0);
+  while(!job.done) {
+    sysCondWait(done_cond,0);
+  }
+  sysMutexUnlock(mutex);
+}
+
+void
+rsxgl_compiler_thread_set_max(const uint32_t count)
+{
+  max_threads = count;
+}
+
+uint32_t
+rsxgl_compiler_thread_max()
+{
+  return max_threads;
+}
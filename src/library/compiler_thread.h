@@ -0,0 +1,61 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// compiler_thread.h - Run the GLSL compiler on a thread of its own, so that glCompileShader()
+// and glLinkProgram() can return before their work is done (GL_KHR_parallel_shader_compile).
+//
+// Jobs are run one at a time, in the order that they were queued, by a thread that has its own
+// compiler_context_t. A job only works on mesa's objects and on its own members; the thread that
+// queued it copies its results into the GL objects once it's done (see program.cc). The GLSL
+// compiler keeps global state (e.g., its table of types), so a job that's run by any other
+// thread waits for the compiler thread to be idle first.
+
+#ifndef rsxgl_compiler_thread_H
+#define rsxgl_compiler_thread_H
+
+#include "spinlock.h"
+
+#include <stdint.h>
+#include <memory>
+
+struct compiler_context_t;
+struct pipe_screen;
+
+// Protects the jobs pending for shader & program objects, the state that their results are
+// copied into, and the microcode memory spaces (which are created on demand). It's only held
+// while those are touched, never while a job is run:
+extern rsxgl_spinlock_t rsxgl_compiler_lock;
+
+struct rsxgl_compiler_job_t {
+  volatile uint32_t done;
+
+  rsxgl_compiler_job_t() : done(0) {
+  }
+
+  virtual ~rsxgl_compiler_job_t() {
+  }
+
+  virtual void run(compiler_context_t *) = 0;
+};
+
+// Queue a job for the compiler thread, starting it if need be. If the application has asked
+// for no compiler threads, or the thread can't be started, the job is run before this returns,
+// using the calling context's compiler_context_t:
+void rsxgl_compiler_thread_run(const std::shared_ptr< rsxgl_compiler_job_t > &,compiler_context_t *,struct pipe_screen *);
+
+// Run a job on the calling thread, once the compiler thread has run every job queued before it:
+void rsxgl_compiler_job_run(rsxgl_compiler_job_t &,compiler_context_t *);
+
+// Returns true if the job has been run; its results can then be read:
+bool rsxgl_compiler_job_done(const rsxgl_compiler_job_t &);
+
+// Block until the job has been run:
+void rsxgl_compiler_job_wait(rsxgl_compiler_job_t &);
+
+// glMaxShaderCompilerThreadsKHR(); 0 means that jobs are run by the thread that queues them:
+void rsxgl_compiler_thread_set_max(const uint32_t);
+uint32_t rsxgl_compiler_thread_max();
+
+#endif
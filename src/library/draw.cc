@@ -124,6 +124,11 @@ rsxgl_check_draw_arrays(rsxgl_context_t * ctx,GLenum mode)
 
   // OpenGL 3.1 manpages don't say if a GL error should be given without an active program.
   // Can't see much use in proceeding without one though.
+  if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] != 0) {
+    // It may have been linked again since it was made current:
+    rsxgl_program_complete(ctx -> program_binding[RSXGL_ACTIVE_PROGRAM]);
+  }
+
   if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] == 0 || !ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].linked) {
     return ~0U;
   }
@@ -152,6 +157,11 @@ rsxgl_check_draw_elements(rsxgl_context_t * ctx,GLenum mode,GLenum type)
 
   // OpenGL 3.1 manpages don't say if a GL error should be given without an active program.
   // Can't see much use in proceeding without one though.
+  if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] != 0) {
+    // It may have been linked again since it was made current:
+    rsxgl_program_complete(ctx -> program_binding[RSXGL_ACTIVE_PROGRAM]);
+  }
+
   if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] == 0 || !ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].linked) {
     return std::make_pair(~0U, RSXGL_MAX_ELEMENT_TYPES);
   }
@@ -570,13 +580,18 @@ namespace {
     if(ctx -> state.enable.transform_feedback_mode != 0) {
       rsxgl_assert(ctx -> state.enable.transform_feedback_program);
 
-      const uint32_t count = 16;
-      if(rsxgl_feedback_framebuffer_check(ctx,0,count)) {
+      // Capture the vertices in the draw call's range, as many as the bound buffers have room for:
+      const uint32_t first = index_range.first;
+      const uint32_t count = std::min(index_range.second,rsxgl_feedback_framebuffer_capacity(ctx));
+
+      if(count > 0) {
 	const uint16_t w = RSXGL_MAX_RENDERBUFFER_SIZE, h = RSXGL_MAX_RENDERBUFFER_SIZE;
 
-	const uint32_t vertexid_index = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].streamvp_vertexid_index;
+	// Vertex i of a pass is drawn at (i % w,(i / w) + 1), so a pass fills the first h - 1 rows
+	// of the render target; larger captures take more than one pass:
+	const uint32_t pass_size = (uint32_t)w * (h - 1);
 
-	rsxgl_feedback_framebuffer_validate(ctx,0,count,lastTimestamp);
+	const uint32_t vertexid_index = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].streamvp_vertexid_index;
 
 	// set feedback "viewport":
 	{
@@ -662,24 +677,34 @@ namespace {
 	  gcm_finish_n_commands(gcm_context,4);
 	}
 
-	// Draw this stuff:
-	{
-	  const uint32_t ncommands = (2 + 2) + (2 * count * 2);
+	// Draw this stuff, one pass per rectangle of the transform feedback buffers, emitting a row of
+	// vertices at a time:
+	const uint32_t cmd = NV30_3D_VTX_ATTR_2I(vertexid_index);
 
-	  uint32_t * buffer = gcm_reserve(gcm_context,ncommands);
-	  uint32_t * buffer_start = buffer;
+	for(uint32_t pass_offset = 0;pass_offset < count;pass_offset += pass_size) {
+	  const uint32_t pass_count = std::min(count - pass_offset,pass_size);
 
-	  gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
-	  gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_POINTS);
-	  buffer += 2;
+	  rsxgl_feedback_framebuffer_validate(ctx,pass_offset,pass_count,lastTimestamp);
 
-	  const uint32_t cmd = NV30_3D_VTX_ATTR_2I(vertexid_index);
+	  {
+	    uint32_t * buffer = gcm_reserve(gcm_context,2);
 
-	  uint16_t y = 1, x = 0;
-	  uint32_t idx = 0;
+	    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+	    gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_POINTS);
 
-	  for(uint16_t div = count / RSXGL_MAX_RENDERBUFFER_SIZE;div > 0;--div,++y) {
-	    for(x = 0;x < RSXGL_MAX_RENDERBUFFER_SIZE;++x,++idx) {
+	    gcm_finish_n_commands(gcm_context,2);
+	  }
+
+	  uint32_t idx = first + pass_offset;
+	  uint32_t y = 1;
+
+	  for(uint32_t row_offset = 0;row_offset < pass_count;row_offset += w,++y) {
+	    const uint32_t row_count = std::min(pass_count - row_offset,(uint32_t)w);
+	    const uint32_t ncommands = 4 * row_count;
+
+	    uint32_t * buffer = gcm_reserve(gcm_context,ncommands);
+
+	    for(uint32_t x = 0;x < row_count;++x,++idx) {
 	      gcm_emit_method_at(buffer,0,cmd,1);
 	      gcm_emit_at(buffer,1,((y) << NV30_3D_VTX_ATTR_2I_Y__SHIFT) | ((x) << NV30_3D_VTX_ATTR_2I_X__SHIFT));
 
@@ -688,24 +713,18 @@ namespace {
 
 	      buffer += 4;
 	    }
+
+	    gcm_finish_n_commands(gcm_context,ncommands);
 	  }
 
-	  x = 0;
-	  for(uint16_t mod = count % RSXGL_MAX_RENDERBUFFER_SIZE;mod > 0;--mod,++x,++idx) {
-	    gcm_emit_method_at(buffer,0,cmd,1);
-	    gcm_emit_at(buffer,1,((y) << NV30_3D_VTX_ATTR_2I_Y__SHIFT) | ((x) << NV30_3D_VTX_ATTR_2I_X__SHIFT));
+	  {
+	    uint32_t * buffer = gcm_reserve(gcm_context,2);
 
-	    gcm_emit_method_at(buffer,2,NV30_3D_VB_ELEMENT_U32,1);
-	    gcm_emit_at(buffer,3,idx);
+	    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+	    gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
 
-	    buffer += 4;
+	    gcm_finish_n_commands(gcm_context,2);
 	  }
-
-	  gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
-	  gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
-	  buffer += 2;
-
-	  gcm_finish_n_commands(gcm_context,ncommands);
 	}
 	
 	// For the next draw invocation:
@@ -38,7 +38,7 @@
 
 #endif
 
-static EGLint rsxegl_error = EGL_SUCCESS;
+static __thread EGLint rsxegl_error = EGL_SUCCESS;
 static int rsxegl_initialized = 0;
 
 EGLAPI EGLint EGLAPIENTRY
@@ -118,7 +118,9 @@ struct rsxgl_init_parameters_t rsxgl_init_parameters = {
   .max_swap_wait_iterations = 100000,
   .swap_wait_interval = RSXGL_SYNC_SLEEP_INTERVAL,
   .rsx_mspace_offset = 0,
-  .rsx_mspace_size = 0
+  .rsx_mspace_size = 0,
+  .shader_cache_path = 0,
+  .shader_cache_size = 0
 };
 
 static void * rsx_shared_memory = 0;
@@ -729,8 +731,9 @@ struct rsxgl_object_context_t;
 
 extern struct rsxegl_context_t * rsxgl_context_create(const struct rsxegl_config_t *,gcmContextData *,struct pipe_screen *,struct rsxgl_object_context_t *);
 extern struct rsxgl_object_context_t * rsxgl_object_context_create();
+extern struct rsxgl_object_context_t * rsxgl_context_object_context(struct rsxegl_context_t *);
 
-static struct rsxegl_context_t * current_rsxgl_ctx = 0;
+static __thread struct rsxegl_context_t * current_rsxgl_ctx = 0;
 
 EGLAPI EGLContext EGLAPIENTRY
 eglCreateContext(EGLDisplay dpy,EGLConfig config,EGLContext share_context,const EGLint * attrib_list)
@@ -739,10 +742,20 @@ eglCreateContext(EGLDisplay dpy,EGLConfig config,EGLContext share_context,const
   RSXEGL_CHECK_INITIALIZED(EGL_NO_CONTEXT);
 
   struct rsxegl_context_t * ctx = 0;
+  struct rsxegl_context_t * shared_ctx = (struct rsxegl_context_t *)share_context;
+
+  if(shared_ctx != EGL_NO_CONTEXT && (shared_ctx -> valid == 0 || shared_ctx -> api != rsxegl_api)) {
+    RSXEGL_ERROR(EGL_BAD_CONTEXT,EGL_NO_CONTEXT);
+  }
 
   switch(rsxegl_api) {
   case EGL_OPENGL_API:
-    ctx = rsxgl_context_create(config,rsx_gcm_context,rsx_screen,rsxgl_object_context_create());
+    ctx = rsxgl_context_create(config,rsx_gcm_context,rsx_screen,
+			       (shared_ctx != EGL_NO_CONTEXT) ? rsxgl_context_object_context(shared_ctx) : rsxgl_object_context_create());
+    // Too many contexts share the same objects:
+    if(ctx == 0) {
+      RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_CONTEXT);
+    }
     assert(ctx -> callback != 0);
     RSXEGL_NOERROR(ctx);
   default:
@@ -792,7 +805,8 @@ eglMakeCurrent(EGLDisplay dpy,EGLSurface draw,EGLSurface read,EGLContext _ctx)
     if(ctx == 0) {
       RSXEGL_ERROR(EGL_BAD_CONTEXT,EGL_FALSE);
     }
-    else {
+    // A context can be made current without any surfaces, to load resources on another thread:
+    else if(draw != EGL_NO_SURFACE || read != EGL_NO_SURFACE) {
       RSXEGL_CHECK_SURFACE(draw,EGL_FALSE);
       RSXEGL_CHECK_SURFACE(read,EGL_FALSE);
     }
@@ -1083,6 +1097,9 @@ static const egl_function egl_function_map[] = {
   PROC(glGetProgramiv),
   PROC(glGetProgramInfoLog),
   PROC(glLinkProgram),
+  PROC(glGetProgramBinary),
+  PROC(glProgramBinary),
+  PROC(glMaxShaderCompilerThreadsKHR),
   PROC(glValidateProgram),
   PROC(glUseProgram),
   PROC(glBindAttribLocation),
@@ -1227,6 +1244,9 @@ static const egl_function egl_function_map[] = {
   PROC(glUseMemoryArenaRSX),
   PROC(glGetMemoryArenaParameterivRSX),
   PROC(glGetMemoryArenaPointervRSX),
+  PROC(glGetNameHashRSX),
+  PROC(glGetUniformLocationHashRSX),
+  PROC(glGetAttribLocationHashRSX),
   PROC(glUniform1f),
   PROC(glUniform1fv),
   PROC(glUniform1i),
@@ -13,8 +13,8 @@
 #endif
 #define GLAPI extern "C"
 
-// Error stuff:
-GLenum rsxgl_error = GL_NO_ERROR;
+// Error stuff - each thread with a current context has its own error:
+__thread GLenum rsxgl_error = GL_NO_ERROR;
 
 GLAPI GLenum APIENTRY
 glGetError (void)
@@ -16,7 +16,7 @@ extern "C" {
 // this might be nice to support as well.
 
 // Macros for reporting errors & returning from a function:
-extern GLenum rsxgl_error;
+extern __thread GLenum rsxgl_error;
 
 static inline void
 rsxeglSetError(GLenum e)
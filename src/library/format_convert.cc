@@ -0,0 +1,428 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// format_convert.cc - Specialized kernels for common texel format conversions.
+
+#include "format_convert.h"
+
+#include "util/u_format.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ALTIVEC__)
+#include <altivec.h>
+#define RSXGL_FORMAT_CONVERT_ALTIVEC
+#elif defined(__i386__) || defined(__x86_64__)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define RSXGL_FORMAT_CONVERT_X86
+#endif
+
+// Formats whose texels are a few bytes, each holding one 8-bit unsigned normalized channel,
+// listed in memory order (x is a byte that isn't used). gallium unpacks these byte by byte,
+// whatever the host's endianness, so converting between any two of them is a shuffle:
+static const struct {
+  enum pipe_format format;
+  const char * bytes;
+} byte_formats[] = {
+  { PIPE_FORMAT_R8G8B8A8_UNORM, "rgba" },
+  { PIPE_FORMAT_B8G8R8A8_UNORM, "bgra" },
+  { PIPE_FORMAT_A8R8G8B8_UNORM, "argb" },
+  { PIPE_FORMAT_A8B8G8R8_UNORM, "abgr" },
+  { PIPE_FORMAT_R8G8B8X8_UNORM, "rgbx" },
+  { PIPE_FORMAT_B8G8R8X8_UNORM, "bgrx" },
+  { PIPE_FORMAT_X8R8G8B8_UNORM, "xrgb" },
+  { PIPE_FORMAT_X8B8G8R8_UNORM, "xbgr" },
+  { PIPE_FORMAT_R8G8B8_UNORM, "rgb" },
+  { PIPE_FORMAT_R8G8_UNORM, "rg" },
+  { PIPE_FORMAT_R8A8_UNORM, "ra" },
+  { PIPE_FORMAT_A8R8_UNORM, "ar" },
+  { PIPE_FORMAT_L8A8_UNORM, "la" },
+  { PIPE_FORMAT_R8_UNORM, "r" },
+  { PIPE_FORMAT_L8_UNORM, "l" },
+  { PIPE_FORMAT_A8_UNORM, "a" },
+  { PIPE_FORMAT_I8_UNORM, "i" }
+};
+
+// 32-bit to 16-bit float formats with the same channels:
+static const struct {
+  enum pipe_format dst, src;
+  unsigned channels;
+} half_formats[] = {
+  { PIPE_FORMAT_R16_FLOAT, PIPE_FORMAT_R32_FLOAT, 1 },
+  { PIPE_FORMAT_R16G16_FLOAT, PIPE_FORMAT_R32G32_FLOAT, 2 },
+  { PIPE_FORMAT_R16G16B16_FLOAT, PIPE_FORMAT_R32G32B32_FLOAT, 3 },
+  { PIPE_FORMAT_R16G16B16A16_FLOAT, PIPE_FORMAT_R32G32B32A32_FLOAT, 4 }
+};
+
+// Values of rsxgl_format_conversion_t::pattern for bytes that don't come from the source:
+enum rsxgl_format_conversion_fill {
+  RSXGL_FORMAT_FILL_ZERO = -1,
+  RSXGL_FORMAT_FILL_ONE = -2
+};
+
+struct rsxgl_format_conversion_t;
+typedef void (*rsxgl_format_convert_row_fn)(const rsxgl_format_conversion_t &,uint8_t *,const uint8_t *,unsigned);
+
+struct rsxgl_format_conversion_t {
+  unsigned src_bytes, dst_bytes;
+
+  // Shuffles: each byte of a destination texel is the source texel's byte pattern[i], or a
+  // rsxgl_format_conversion_fill:
+  int pattern[4];
+
+  // The same, for 16 bytes of destination texels at a time; pshufb zeroes bytes whose control
+  // has its top bit set, vec_perm takes bytes 16-31 from its second (zero) argument:
+  uint8_t control[16] __attribute__((aligned(16)));
+  uint8_t perm[16] __attribute__((aligned(16)));
+  uint8_t fill[16] __attribute__((aligned(16)));
+
+  // Half floats: floats per texel:
+  unsigned channels;
+
+  rsxgl_format_convert_row_fn convert_row;
+};
+
+// Which byte of a src texel gives channel c ('r', 'g', 'b' or 'a') once it's been unpacked to
+// RGBA, as util_format_translate() would unpack it:
+static int
+rsxgl_format_source_byte(const char * src,const char c)
+{
+  const char * p = strchr(src,c);
+  if(p == 0 && c != 'a') p = strchr(src,'l');
+  if(p == 0) p = strchr(src,'i');
+
+  if(p != 0) return p - src;
+  return (c == 'a') ? RSXGL_FORMAT_FILL_ONE : RSXGL_FORMAT_FILL_ZERO;
+}
+
+// Scalar kernels:
+static inline void
+rsxgl_shuffle_texels(const rsxgl_format_conversion_t & conversion,uint8_t * dst,const uint8_t * src,unsigned width)
+{
+  const unsigned src_bytes = conversion.src_bytes, dst_bytes = conversion.dst_bytes;
+
+  for(;width > 0;--width,src += src_bytes) {
+    for(unsigned i = 0;i < dst_bytes;++i,++dst) {
+      const int p = conversion.pattern[i];
+      *dst = (p >= 0) ? src[p] : (p == RSXGL_FORMAT_FILL_ONE) ? 0xff : 0;
+    }
+  }
+}
+
+template< unsigned SrcBytes, unsigned DstBytes >
+static void
+rsxgl_shuffle_row(const rsxgl_format_conversion_t & conversion,uint8_t * dst,const uint8_t * src,unsigned width)
+{
+  int pattern[DstBytes];
+  for(unsigned i = 0;i < DstBytes;++i) pattern[i] = conversion.pattern[i];
+
+  for(;width > 0;--width,src += SrcBytes,dst += DstBytes) {
+    for(unsigned i = 0;i < DstBytes;++i) {
+      const int p = pattern[i];
+      dst[i] = (p >= 0) ? src[p] : (p == RSXGL_FORMAT_FILL_ONE) ? 0xff : 0;
+    }
+  }
+}
+
+// gallium's util_float_to_half() (by table, which truncates), without the tables:
+static inline uint16_t
+rsxgl_float_to_half(const uint32_t v)
+{
+  const uint16_t sign = (v >> 16) & 0x8000;
+  const uint32_t e = (v >> 23) & 0xff, m = v & 0x7fffff;
+
+  if(e < 103) return sign;
+  if(e < 113) return sign | ((m | 0x800000) >> (126 - e));
+  if(e < 143) return sign | (((v & 0x7fffffff) >> 13) - (112 << 10));
+  if(e < 255) return sign | 0x7c00;
+  return sign | 0x7c00 | (m >> 13);
+}
+
+static inline void
+rsxgl_half_row(const rsxgl_format_conversion_t & conversion,uint8_t * _dst,const uint8_t * _src,unsigned width)
+{
+  uint16_t * dst = (uint16_t *)_dst;
+  const uint32_t * src = (const uint32_t *)_src;
+
+  for(unsigned n = width * conversion.channels;n > 0;--n,++src,++dst) {
+    *dst = rsxgl_float_to_half(*src);
+  }
+}
+
+// Vector kernels. They handle 16 bytes of destination texels at a time, while there are at least
+// 16 bytes of source texels left to load, and leave the rest to the scalar kernels:
+#if defined(RSXGL_FORMAT_CONVERT_ALTIVEC)
+static inline vector unsigned char
+rsxgl_load_unaligned(const uint8_t * p)
+{
+  return vec_perm(vec_ld(0,p),vec_ld(15,p),vec_lvsl(0,p));
+}
+
+static inline void
+rsxgl_store_unaligned(uint8_t * p,const vector unsigned char v)
+{
+  if(((uintptr_t)p & 15) == 0) {
+    vec_st(v,0,p);
+  }
+  else {
+    union {
+      vector unsigned char v;
+      uint8_t bytes[16];
+    } tmp;
+    tmp.v = v;
+    memcpy(p,tmp.bytes,16);
+  }
+}
+
+static void
+rsxgl_shuffle_row_vector(const rsxgl_format_conversion_t & conversion,uint8_t * dst,const uint8_t * src,unsigned width)
+{
+  const vector unsigned char perm = vec_ld(0,conversion.perm), fill = vec_ld(0,conversion.fill), zero = vec_splat_u8(0);
+  const unsigned src_bytes = conversion.src_bytes, texels = 16 / conversion.dst_bytes, src_step = texels * src_bytes;
+
+  for(;width * src_bytes >= 16;width -= texels,src += src_step,dst += 16) {
+    rsxgl_store_unaligned(dst,vec_or(vec_perm(rsxgl_load_unaligned(src),zero,perm),fill));
+  }
+
+  rsxgl_shuffle_texels(conversion,dst,src,width);
+}
+
+static inline vector unsigned int
+rsxgl_float_to_half_vector(const vector unsigned int v,bool & denormal)
+{
+  const vector unsigned int abs = vec_and(v,(vector unsigned int){ 0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff });
+  const vector unsigned int sign = vec_and(vec_sr(v,vec_splat_u32(-16)),(vector unsigned int){ 0x8000, 0x8000, 0x8000, 0x8000 });
+  const vector unsigned int mantissa = vec_sr(abs,vec_splat_u32(13));
+
+  const vector bool int underflow = vec_cmplt(abs,(vector unsigned int){ 103 << 23, 103 << 23, 103 << 23, 103 << 23 });
+  const vector bool int overflow = vec_cmpgt(abs,(vector unsigned int){ (143 << 23) - 1, (143 << 23) - 1, (143 << 23) - 1, (143 << 23) - 1 });
+  const vector bool int nan = vec_cmpgt(abs,(vector unsigned int){ (255 << 23) - 1, (255 << 23) - 1, (255 << 23) - 1, (255 << 23) - 1 });
+  const vector bool int small = vec_cmplt(abs,(vector unsigned int){ 113 << 23, 113 << 23, 113 << 23, 113 << 23 });
+
+  const vector unsigned int big = vec_or((vector unsigned int){ 0x7c00, 0x7c00, 0x7c00, 0x7c00 },
+					 vec_and(vec_and(mantissa,(vector unsigned int){ 0x3ff, 0x3ff, 0x3ff, 0x3ff }),nan));
+
+  vector unsigned int h = vec_sub(mantissa,(vector unsigned int){ 112 << 10, 112 << 10, 112 << 10, 112 << 10 });
+  h = vec_andc(h,underflow);
+  h = vec_sel(h,big,overflow);
+
+  denormal = vec_any_ne(vec_andc((vector unsigned int)small,(vector unsigned int)underflow),vec_splat_u32(0));
+
+  return vec_or(h,sign);
+}
+
+static void
+rsxgl_half_row_vector(const rsxgl_format_conversion_t & conversion,uint8_t * dst,const uint8_t * src,unsigned width)
+{
+  unsigned n = width * conversion.channels;
+
+  for(;n >= 8;n -= 8,src += 32,dst += 16) {
+    bool denormal0 = false, denormal1 = false;
+    const vector unsigned int h0 = rsxgl_float_to_half_vector((vector unsigned int)rsxgl_load_unaligned(src),denormal0);
+    const vector unsigned int h1 = rsxgl_float_to_half_vector((vector unsigned int)rsxgl_load_unaligned(src + 16),denormal1);
+    rsxgl_store_unaligned(dst,(vector unsigned char)vec_pack(h0,h1));
+
+    if(denormal0 || denormal1) {
+      for(unsigned i = 0;i < 8;++i) {
+	((uint16_t *)dst)[i] = rsxgl_float_to_half(((const uint32_t *)src)[i]);
+      }
+    }
+  }
+
+  for(;n > 0;--n,src += 4,dst += 2) {
+    *(uint16_t *)dst = rsxgl_float_to_half(*(const uint32_t *)src);
+  }
+}
+#endif
+
+#if defined(RSXGL_FORMAT_CONVERT_X86)
+__attribute__((target("ssse3")))
+static void
+rsxgl_shuffle_row_vector(const rsxgl_format_conversion_t & conversion,uint8_t * dst,const uint8_t * src,unsigned width)
+{
+  const __m128i control = _mm_load_si128((const __m128i *)conversion.control), fill = _mm_load_si128((const __m128i *)conversion.fill);
+  const unsigned src_bytes = conversion.src_bytes, texels = 16 / conversion.dst_bytes, src_step = texels * src_bytes;
+
+  for(;width * src_bytes >= 16;width -= texels,src += src_step,dst += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)src);
+    _mm_storeu_si128((__m128i *)dst,_mm_or_si128(_mm_shuffle_epi8(v,control),fill));
+  }
+
+  rsxgl_shuffle_texels(conversion,dst,src,width);
+}
+
+__attribute__((target("sse2")))
+static void
+rsxgl_half_row_vector(const rsxgl_format_conversion_t & conversion,uint8_t * dst,const uint8_t * src,unsigned width)
+{
+  unsigned n = width * conversion.channels;
+
+  for(;n >= 4;n -= 4,src += 16,dst += 8) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)src);
+    const __m128i abs = _mm_and_si128(v,_mm_set1_epi32(0x7fffffff));
+    const __m128i sign = _mm_and_si128(_mm_srli_epi32(v,16),_mm_set1_epi32(0x8000));
+    const __m128i mantissa = _mm_srli_epi32(abs,13);
+
+    // abs is positive, so signed comparisons work:
+    const __m128i underflow = _mm_cmplt_epi32(abs,_mm_set1_epi32(103 << 23));
+    const __m128i overflow = _mm_cmpgt_epi32(abs,_mm_set1_epi32((143 << 23) - 1));
+    const __m128i nan = _mm_cmpgt_epi32(abs,_mm_set1_epi32((255 << 23) - 1));
+    const __m128i small = _mm_cmplt_epi32(abs,_mm_set1_epi32(113 << 23));
+
+    const __m128i big = _mm_or_si128(_mm_set1_epi32(0x7c00),_mm_and_si128(_mm_and_si128(mantissa,_mm_set1_epi32(0x3ff)),nan));
+
+    __m128i h = _mm_sub_epi32(mantissa,_mm_set1_epi32(112 << 10));
+    h = _mm_andnot_si128(underflow,h);
+    h = _mm_or_si128(_mm_andnot_si128(overflow,h),_mm_and_si128(overflow,big));
+    h = _mm_or_si128(h,sign);
+
+    // Sign-extend from 16 bits so that the saturating pack keeps every value:
+    h = _mm_srai_epi32(_mm_slli_epi32(h,16),16);
+    _mm_storel_epi64((__m128i *)dst,_mm_packs_epi32(h,h));
+
+    if(_mm_movemask_epi8(_mm_andnot_si128(underflow,small))) {
+      for(unsigned i = 0;i < 4;++i) {
+	((uint16_t *)dst)[i] = rsxgl_float_to_half(((const uint32_t *)src)[i]);
+      }
+    }
+  }
+
+  for(;n > 0;--n,src += 4,dst += 2) {
+    *(uint16_t *)dst = rsxgl_float_to_half(*(const uint32_t *)src);
+  }
+}
+#endif
+
+static bool
+rsxgl_format_conversion(rsxgl_format_conversion_t & conversion,enum pipe_format dst_format,enum pipe_format src_format)
+{
+  // util_format_translate() just copies these:
+  if(dst_format == src_format ||
+     util_is_format_compatible(util_format_description(src_format),util_format_description(dst_format))) {
+    return false;
+  }
+
+  const char * dst = 0, * src = 0;
+  for(size_t i = 0,n = sizeof(byte_formats) / sizeof(byte_formats[0]);i < n;++i) {
+    if(byte_formats[i].format == dst_format) dst = byte_formats[i].bytes;
+    if(byte_formats[i].format == src_format) src = byte_formats[i].bytes;
+  }
+
+  // Shuffles that don't shrink texels, into texels of 2 or 4 bytes:
+  if(dst != 0 && src != 0) {
+    conversion.src_bytes = strlen(src);
+    conversion.dst_bytes = strlen(dst);
+
+    if(!(conversion.src_bytes <= conversion.dst_bytes && (conversion.dst_bytes == 2 || conversion.dst_bytes == 4))) {
+      return false;
+    }
+
+    for(unsigned i = 0;i < conversion.dst_bytes;++i) {
+      const char c = dst[i];
+      conversion.pattern[i] =
+	(c == 'r' || c == 'g' || c == 'b' || c == 'a') ? rsxgl_format_source_byte(src,c) :
+	(c == 'l' || c == 'i') ? rsxgl_format_source_byte(src,'r') :
+	RSXGL_FORMAT_FILL_ZERO;
+    }
+
+    for(unsigned j = 0;j < 16;++j) {
+      const unsigned texel = j / conversion.dst_bytes;
+      const int p = conversion.pattern[j % conversion.dst_bytes];
+      conversion.control[j] = (p >= 0) ? (texel * conversion.src_bytes + p) : 0x80;
+      conversion.perm[j] = (p >= 0) ? (texel * conversion.src_bytes + p) : 16;
+      conversion.fill[j] = (p == RSXGL_FORMAT_FILL_ONE) ? 0xff : 0;
+    }
+
+#if defined(RSXGL_FORMAT_CONVERT_ALTIVEC)
+    conversion.convert_row = rsxgl_shuffle_row_vector;
+#else
+#if defined(RSXGL_FORMAT_CONVERT_X86)
+    if(__builtin_cpu_supports("ssse3")) {
+      conversion.convert_row = rsxgl_shuffle_row_vector;
+      return true;
+    }
+#endif
+    switch(conversion.src_bytes * 8 + conversion.dst_bytes) {
+    case 1 * 8 + 2: conversion.convert_row = rsxgl_shuffle_row< 1, 2 >; break;
+    case 2 * 8 + 2: conversion.convert_row = rsxgl_shuffle_row< 2, 2 >; break;
+    case 1 * 8 + 4: conversion.convert_row = rsxgl_shuffle_row< 1, 4 >; break;
+    case 2 * 8 + 4: conversion.convert_row = rsxgl_shuffle_row< 2, 4 >; break;
+    case 3 * 8 + 4: conversion.convert_row = rsxgl_shuffle_row< 3, 4 >; break;
+    default: conversion.convert_row = rsxgl_shuffle_row< 4, 4 >; break;
+    }
+#endif
+
+    return true;
+  }
+
+  for(size_t i = 0,n = sizeof(half_formats) / sizeof(half_formats[0]);i < n;++i) {
+    if(half_formats[i].dst == dst_format && half_formats[i].src == src_format) {
+      conversion.channels = half_formats[i].channels;
+      conversion.src_bytes = conversion.channels * 4;
+      conversion.dst_bytes = conversion.channels * 2;
+
+#if defined(RSXGL_FORMAT_CONVERT_ALTIVEC)
+      conversion.convert_row = rsxgl_half_row_vector;
+#else
+      conversion.convert_row = rsxgl_half_row;
+#if defined(RSXGL_FORMAT_CONVERT_X86)
+      if(__builtin_cpu_supports("sse2")) {
+	conversion.convert_row = rsxgl_half_row_vector;
+      }
+#endif
+#endif
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool
+rsxgl_format_convert_supported(enum pipe_format dst_format,enum pipe_format src_format)
+{
+  rsxgl_format_conversion_t conversion;
+  return rsxgl_format_conversion(conversion,dst_format,src_format);
+}
+
+bool
+rsxgl_format_convert(enum pipe_format dst_format,
+		     void * dst,unsigned dst_stride,unsigned dst_x,unsigned dst_y,
+		     enum pipe_format src_format,
+		     const void * src,unsigned src_stride,unsigned src_x,unsigned src_y,
+		     unsigned width,unsigned height)
+{
+  rsxgl_format_conversion_t conversion;
+  if(!rsxgl_format_conversion(conversion,dst_format,src_format)) {
+    return false;
+  }
+
+  uint8_t * dst_row = (uint8_t *)dst + dst_y * dst_stride + dst_x * conversion.dst_bytes;
+  const uint8_t * src_row = (const uint8_t *)src + src_y * src_stride + src_x * conversion.src_bytes;
+
+  for(;height > 0;--height,dst_row += dst_stride,src_row += src_stride) {
+    conversion.convert_row(conversion,dst_row,src_row,width);
+  }
+
+  return true;
+}
+
+void
+rsxgl_format_translate(enum pipe_format dst_format,
+		       void * dst,unsigned dst_stride,unsigned dst_x,unsigned dst_y,
+		       enum pipe_format src_format,
+		       const void * src,unsigned src_stride,unsigned src_x,unsigned src_y,
+		       unsigned width,unsigned height)
+{
+  if(!rsxgl_format_convert(dst_format,dst,dst_stride,dst_x,dst_y,
+			   src_format,src,src_stride,src_x,src_y,
+			   width,height)) {
+    util_format_translate(dst_format,dst,dst_stride,dst_x,dst_y,
+			  src_format,src,src_stride,src_x,src_y,
+			  width,height);
+  }
+}
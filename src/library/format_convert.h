@@ -0,0 +1,39 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// format_convert.h - Specialized kernels for common texel format conversions.
+//
+// util_format_translate() converts between any pair of formats by unpacking each row to an
+// RGBA intermediate and packing it again. Most texture uploads are between 8-bit-per-channel
+// formats that only differ in the order of their bytes (RGBA8 to BGRA8 or ARGB8, RGB8 to
+// XRGB8, L8, A8 & LA8 expanded to four channels, byte swaps of whole texels), or from 32-bit to
+// 16-bit floats; those pairs are done here with one byte shuffle, or one conversion, per
+// texel, using AltiVec on the PPU and SSSE3 or SSE2 on an x86 host.
+
+#ifndef rsxgl_format_convert_H
+#define rsxgl_format_convert_H
+
+#include "pipe/p_format.h"
+
+// Has a specialized kernel for converting from src_format to dst_format:
+bool rsxgl_format_convert_supported(enum pipe_format dst_format,enum pipe_format src_format);
+
+// Converts a width x height block of texels with a specialized kernel, as util_format_translate()
+// would, if there is one for the pair of formats. Returns false, without doing anything, if
+// there isn't:
+bool rsxgl_format_convert(enum pipe_format dst_format,
+			  void * dst,unsigned dst_stride,unsigned dst_x,unsigned dst_y,
+			  enum pipe_format src_format,
+			  const void * src,unsigned src_stride,unsigned src_x,unsigned src_y,
+			  unsigned width,unsigned height);
+
+// rsxgl_format_convert(), falling back to util_format_translate():
+void rsxgl_format_translate(enum pipe_format dst_format,
+			    void * dst,unsigned dst_stride,unsigned dst_x,unsigned dst_y,
+			    enum pipe_format src_format,
+			    const void * src,unsigned src_stride,unsigned src_x,unsigned src_y,
+			    unsigned width,unsigned height);
+
+#endif
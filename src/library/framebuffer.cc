@@ -489,6 +489,9 @@ rsxgl_framebuffer_texture(rsxgl_context_t * ctx,const framebuffer_t::name_type f
   rsxgl_framebuffer_detach(framebuffer,rsx_attachment);
 
   if(texture_name != 0) {
+    // The RSX can't render to swizzled textures of these sizes:
+    rsxgl_texture_require_linear(ctx,texture_t::storage().at(texture_name));
+
     framebuffer.attachment_types.set(rsx_attachment,RSXGL_ATTACHMENT_TYPE_TEXTURE);
     framebuffer.attachments[rsx_attachment] = texture_t::gl_object_type::ref(texture_name);
     framebuffer.attachment_layers[rsx_attachment] = layer;
@@ -775,12 +778,6 @@ glGetFramebufferAttachmentParameteriv (GLenum target, GLenum attachment, GLenum
   rsxgl_get_framebuffer_attachment_parameteriv(ctx,ctx -> framebuffer_binding.names[rsx_framebuffer_target],attachment,pname,params);
 }
 
-GLAPI void APIENTRY
-glGenerateMipmap (GLenum target)
-{
-  RSXGL_NOERROR_();
-}
-
 GLAPI void APIENTRY
 glBlitFramebuffer (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
 {
@@ -1520,6 +1517,16 @@ rsxgl_draw_framebuffer_validate(rsxgl_context_t * ctx,uint32_t timestamp)
 
   rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
 
+  // Attached textures are about to be drawn to; the texture cache is invalidated before they're
+  // next sampled:
+  if(!framebuffer.is_default) {
+    for(framebuffer_t::attachment_types_t::const_iterator it = framebuffer.attachment_types.begin();!it.done();it.next(framebuffer.attachment_types)) {
+      if(it.value() == RSXGL_ATTACHMENT_TYPE_TEXTURE) {
+	texture_t::storage().at(framebuffer.attachments[it.index()]).invalid_contents = 1;
+      }
+    }
+  }
+
   if(ctx -> invalid.parts.draw_framebuffer) {
     if(framebuffer.complete) {
       const uint32_t format = framebuffer.format;
@@ -1582,25 +1589,25 @@ rsxgl_draw_framebuffer_validate(rsxgl_context_t * ctx,uint32_t timestamp)
   }
 }
 
-bool
-rsxgl_feedback_framebuffer_check(rsxgl_context_t * ctx,uint32_t offset,uint32_t count)
+uint32_t
+rsxgl_feedback_framebuffer_capacity(rsxgl_context_t * ctx)
 {
   const program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
   rsxgl_assert(program.streamfp_num_outputs <= RSXGL_MAX_COLOR_ATTACHMENTS);
 
   const uint32_t attrib_stride = sizeof(float) * 4;
-  const uint32_t length = attrib_stride * count;
+  uint32_t capacity = ~0U;
 
   size_t binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER0, range_binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER_RANGE0;
   for(unsigned int i = 0;i < program.streamfp_num_outputs;++i,++binding,++range_binding) {
     if(ctx -> buffer_binding.names[binding] == 0 ||
-       (offset + length) > ctx -> buffer_binding_offset_size[range_binding].second ||
        ctx -> buffer_binding[binding].mapped) {
-      return false;
+      return 0;
     }
+    capacity = std::min(capacity,(uint32_t)(ctx -> buffer_binding_offset_size[range_binding].second / attrib_stride));
   }
 
-  return true;
+  return (program.streamfp_num_outputs > 0) ? capacity : 0;
 }
 
 void
@@ -1623,10 +1630,10 @@ rsxgl_feedback_framebuffer_validate(rsxgl_context_t * ctx,uint32_t offset,uint32
 
   size_t binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER0, range_binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER_RANGE0, surface = RSXGL_FRAMEBUFFER_SURFACE_COLOR0;
   for(unsigned int i = 0;i < program.streamfp_num_outputs;++i,++binding,++range_binding,++surface) {
-    rsxgl_assert(ctx -> buffer_binding.names[binding] != 0 && (offset + length) < ctx -> buffer_binding_offset_size[range_binding].second);
+    rsxgl_assert(ctx -> buffer_binding.names[binding] != 0 && (attrib_length * offset + length) <= ctx -> buffer_binding_offset_size[range_binding].second);
 
     buffer_t & buffer = ctx -> buffer_binding[binding];
-    const uint32_t buffer_offset = ctx -> buffer_binding_offset_size[range_binding].first + offset;
+    const uint32_t buffer_offset = ctx -> buffer_binding_offset_size[range_binding].first + attrib_length * offset;
 
     rsxgl_buffer_validate(ctx,buffer,buffer_offset,length,timestamp);
 
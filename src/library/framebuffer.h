@@ -152,7 +152,12 @@ struct rsxgl_context_t;
 void rsxgl_renderbuffer_validate(rsxgl_context_t *,renderbuffer_t &,uint32_t);
 void rsxgl_framebuffer_validate(rsxgl_context_t *,framebuffer_t &,uint32_t);
 void rsxgl_draw_framebuffer_validate(rsxgl_context_t *,uint32_t);
-bool rsxgl_feedback_framebuffer_check(rsxgl_context_t *,uint32_t,uint32_t);
+
+// Transform feedback is captured by drawing each vertex as a point into a RSXGL_MAX_RENDERBUFFER_SIZE-wide
+// render target, made out of the bound transform feedback buffers. The capacity is the number of vertices
+// that all of those buffers have room for, or 0 if one of them isn't usable:
+uint32_t rsxgl_feedback_framebuffer_capacity(rsxgl_context_t *);
+// offset & count are in vertices:
 void rsxgl_feedback_framebuffer_validate(rsxgl_context_t *,uint32_t,uint32_t,uint32_t);
 
 #endif
@@ -5,10 +5,13 @@
 // get.cc - Implement glGet*() functions.
 
 #include <GL3/gl3.h>
+#include "GL3/gl3ext.h"
 
 #include "rsxgl_context.h"
 #include "error.h"
 #include "gl_constants.h"
+#include "program_binary.h"
+#include "compiler_thread.h"
 
 #if defined(GLAPI)
 #undef GLAPI
@@ -25,6 +28,24 @@ rsxgl_get(rsxgl_context_t * ctx,const GLenum pname, T * params)
   else if(pname == GL_MAX_TEXTURE_SIZE) {
     *params = RSXGL_MAX_TEXTURE_SIZE;
   }
+  else if(pname == GL_NUM_COMPRESSED_TEXTURE_FORMATS) {
+    *params = 4;
+  }
+  else if(pname == GL_COMPRESSED_TEXTURE_FORMATS) {
+    params[0] = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    params[1] = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    params[2] = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+    params[3] = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  }
+  else if(pname == GL_NUM_PROGRAM_BINARY_FORMATS) {
+    *params = 1;
+  }
+  else if(pname == GL_PROGRAM_BINARY_FORMATS) {
+    *params = RSXGL_PROGRAM_BINARY_FORMAT;
+  }
+  else if(pname == GL_MAX_SHADER_COMPILER_THREADS_KHR) {
+    *params = rsxgl_compiler_thread_max();
+  }
   else {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -72,7 +93,7 @@ glGetString (GLenum name)
     RSXGL_NOERROR((const GLubyte *)"1.30");
   }
   else if(name == GL_EXTENSIONS) {
-    RSXGL_NOERROR((const GLubyte *)"");
+    RSXGL_NOERROR((const GLubyte *)"GL_EXT_texture_compression_s3tc");
   }
   else {
     RSXGL_ERROR(GL_INVALID_ENUM,0);
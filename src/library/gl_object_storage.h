@@ -30,12 +30,20 @@
 // that stores entire objects in one array, and class
 // cold_hot_gl_object_storage is a specialization that implements the
 // "hot and cold" object composition pattern described above.
+//
+// Storage may be shared by contexts that are current on different threads
+// (see eglCreateContext's share_context). Creating and destroying names and
+// objects is serialized by a lock held by each storage instance. Accessing
+// objects is not - as with OpenGL's own rules for shared objects, an object
+// that one context is modifying must be handed off to another context with a
+// sync object before it is used there.
 
 #ifndef rsxgl_gl_object_storage_H
 #define rsxgl_gl_object_storage_H
 
 #include "array.h"
 #include "striped_object_array.h"
+#include "spinlock.h"
 #pragma GCC push_options
 #pragma GCC optimize("O0")
 #include "name_space.h"
@@ -69,6 +77,9 @@ public:
 
   name_space_type m_name_space;
 
+  // Serializes changes to the name space, the contents array, and the orphans array:
+  rsxgl_spinlock_t m_lock;
+
   typedef ObjectsT objects_type;
 
   typedef striped_object_array< ObjectsT, name_type, ObjectAlign > contents_type;
@@ -116,6 +127,8 @@ public:
   striped_gl_object_storage(const name_type initial_size = 0,void (*init_default_object)(void *) = 0)
     : m_num_orphans(0)
   {
+    rsxgl_spinlock_init(&m_lock);
+
     contents().allocate(std::max((name_type)1,initial_size));
     orphans().allocate(std::max((typename contents_type::size_type)1,initial_size));
 
@@ -148,17 +161,40 @@ public:
     orphans().destruct(p);
   }
 
-  name_type create_name() {
+private:
+
+  name_type _create_name() {
     std::pair< name_type, bool > tmp = m_name_space.create_name();
     rsxgl_assert(tmp.second);
     return tmp.first;
   }
 
+  void _create_object(const name_type name) {
+    rsxgl_assert(is_name(name) && !is_constructed(name));
+
+    // Construct the object:
+    if(name >= contents().size) {
+      contents().resize(name + m_contents_grow);
+    }
+
+    contents().construct_item(name);
+
+    m_name_space.template set_user_bit< 0 >(name);
+  }
+
+public:
+
+  name_type create_name() {
+    rsxgl_spinlock_guard guard(m_lock);
+    return _create_name();
+  }
+
   template< typename OtherNameType >
   size_t create_names(const size_t n,OtherNameType * names) {
+    rsxgl_spinlock_guard guard(m_lock);
     size_t i;
     for(i = 0;i < n;++i,++names) {
-      *names = create_name();
+      *names = _create_name();
     }
     return i;
   }
@@ -167,6 +203,7 @@ public:
   void destroy(const name_type name) {
     rsxgl_assert(name != 0);
 
+    rsxgl_spinlock_guard guard(m_lock);
     if(is_name(name)) {
       if(is_constructed(name)) {
 	contents().destruct_item(name);
@@ -181,6 +218,7 @@ public:
   void detach(const name_type name) {
     rsxgl_assert(name != 0);
 
+    rsxgl_spinlock_guard guard(m_lock);
     if(is_name(name)) {
       m_name_space.detach_name(name);
     }
@@ -191,6 +229,7 @@ public:
   std::pair< orphan_size_type, bool > orphan(const name_type name) {
     rsxgl_assert(name != 0);
 
+    rsxgl_spinlock_guard guard(m_lock);
     if(is_name(name) && is_constructed(name)) {
       // Make room for another orphan:
       if(m_num_orphans >= orphans().size) {
@@ -208,6 +247,7 @@ public:
 
   // Destroy accumulated orphans:
   void destroy_orphans() {
+    rsxgl_spinlock_guard guard(m_lock);
     for(size_t i = 0,n = m_num_orphans;i < n;++i) {
       orphans().destruct_item(i);
     }
@@ -215,27 +255,21 @@ public:
   }
 
   void destroy_orphan(const orphan_size_type i) {
+    rsxgl_spinlock_guard guard(m_lock);
     rsxgl_assert(i < m_num_orphans);
     orphans().destruct_item(i);
     --m_num_orphans;
   }
 
   void create_object(const name_type name) {
-    rsxgl_assert(is_name(name) && !is_constructed(name));
-
-    // Construct the object:
-    if(name >= contents().size) {
-      contents().resize(name + m_contents_grow);
-    }
-
-    contents().construct_item(name);
-
-    m_name_space.template set_user_bit< 0 >(name);
+    rsxgl_spinlock_guard guard(m_lock);
+    _create_object(name);
   }
 
   name_type create_name_and_object() {
-    name_type name = create_name();
-    create_object(name);
+    rsxgl_spinlock_guard guard(m_lock);
+    name_type name = _create_name();
+    _create_object(name);
     return name;
   }
 
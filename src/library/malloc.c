@@ -1339,7 +1339,7 @@ extern void*     sbrk(ptrdiff_t);
 #endif /* LACKS_UNISTD_H */
 
 /* Declarations for locking */
-#if USE_LOCKS
+#if USE_LOCKS == 1
 #ifndef WIN32
 #include <pthread.h>
 #if defined (__SVR4) && defined (__sun)  /* solaris */
@@ -1884,12 +1884,16 @@ static void init_malloc_global_mutex() {
 /* -----------------------  User-defined locks ------------------------ */
 
 #if USE_LOCKS > 1
-/* Define your own lock implementation here */
-/* #define INITIAL_LOCK(sl)  ... */
-/* #define ACQUIRE_LOCK(sl)  ... */
-/* #define RELEASE_LOCK(sl)  ... */
-/* #define TRY_LOCK(sl) ... */
-/* static MLOCK_T malloc_global_mutex = ... */
+/* RSXGL: mspaces may be shared by contexts current on different threads */
+#include "spinlock.h"
+
+#define MLOCK_T               rsxgl_spinlock_t
+#define INITIAL_LOCK(sl)      (rsxgl_spinlock_init(sl), 0)
+#define ACQUIRE_LOCK(sl)      (rsxgl_spinlock_lock(sl), 0)
+#define RELEASE_LOCK(sl)      rsxgl_spinlock_unlock(sl)
+#define TRY_LOCK(sl)          rsxgl_spinlock_trylock(sl)
+
+static MLOCK_T malloc_global_mutex = RSXGL_SPINLOCK_INITIALIZER;
 #endif /* USE_LOCKS > 1 */
 
 /* -----------------------  Lock-based state ------------------------ */
@@ -38,7 +38,7 @@ rsxgl_rsx_mspace()
 		       __PRETTY_FUNCTION__,
 		       size,available,offset,(uint64_t)config.localAddress + offset);
 
-    _rsx_mspace = create_mspace_with_base((uint8_t *)config.localAddress + offset,size,0);
+    _rsx_mspace = create_mspace_with_base((uint8_t *)config.localAddress + offset,size,1);
   }
 
   assert(_rsx_mspace != 0);
@@ -12,7 +12,10 @@
 
 #include "mem.h"
 
+#include <deque>
+
 typedef struct _gcmCtxData gcmContextData;
+struct rsxgl_context_t;
 
 void * rsxgl_ringbuffer_migrate_memalign(gcmContextData *,const rsx_size_t,const rsx_size_t);
 void rsxgl_ringbuffer_migrate_free(gcmContextData *,const void *,const rsx_size_t);
@@ -30,4 +33,36 @@ void rsxgl_dumb_migrate_reset(gcmContextData *);
 #define rsxgl_vertex_migrate_free rsxgl_ringbuffer_migrate_free
 #define rsxgl_vertex_migrate_reset rsxgl_ringbuffer_migrate_reset
 
+// Each context's own ring of RSX memory, for data that the RSX copies elsewhere once it's done
+// with the destination (glTexSubImage). Unlike the vertex migration buffer, nothing in it is
+// shared with other contexts, so contexts current on different threads can use their own rings
+// without a lock. Each allocation is fenced by a timestamp from the context's own timeline, and
+// only reused once that timestamp has passed:
+struct rsxgl_staging_migrate_t {
+  struct region_t {
+    uint32_t offset, end, timestamp;
+  };
+
+  void * buffer;
+
+  // Allocated regions, oldest first:
+  std::deque< region_t > regions;
+
+  rsxgl_staging_migrate_t() : buffer(0) {
+  }
+};
+
+// Returns 0 if size is larger than the ring (RSXGL_CONFIG_staging_migrate_buffer_size), or if
+// the ring can't be allocated. Otherwise it may wait for the RSX to finish with earlier
+// allocations. Allocations do not stack; each must be freed before the next is made:
+void * rsxgl_staging_migrate_memalign(rsxgl_context_t *,const rsx_size_t,const rsx_size_t);
+
+// The RSX is done reading the allocation once timestamp has passed:
+void rsxgl_staging_migrate_free(rsxgl_context_t *,const void *,const uint32_t timestamp);
+
+// Forget every allocation; the context's timestamps must all have passed:
+void rsxgl_staging_migrate_reset(rsxgl_context_t *);
+
+void rsxgl_staging_migrate_destroy(rsxgl_context_t *);
+
 #endif
@@ -0,0 +1,258 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// mipmap.cc - Box filters for generating mipmap levels with the CPU.
+
+#include "mipmap.h"
+
+#include "util/u_format.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__ALTIVEC__)
+#include <altivec.h>
+#define RSXGL_MIPMAP_ALTIVEC
+#elif defined(__i386__) || defined(__x86_64__)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define RSXGL_MIPMAP_X86
+#endif
+
+unsigned
+rsxgl_mipmap_byte_format(enum pipe_format format)
+{
+  const struct util_format_description * desc = util_format_description(format);
+
+  if(desc == 0 || desc -> layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+     desc -> block.width != 1 || desc -> block.height != 1 ||
+     desc -> colorspace != UTIL_FORMAT_COLORSPACE_RGB ||
+     desc -> block.bits < 8 || desc -> block.bits > 32) {
+    return 0;
+  }
+
+  for(unsigned i = 0;i < desc -> nr_channels;++i) {
+    const struct util_format_channel_description & channel = desc -> channel[i];
+
+    if(channel.size != 8 ||
+       !(channel.type == UTIL_FORMAT_TYPE_VOID ||
+	 (channel.type == UTIL_FORMAT_TYPE_UNSIGNED && channel.normalized && !channel.pure_integer))) {
+      return 0;
+    }
+  }
+
+  return desc -> block.bits / 8;
+}
+
+bool
+rsxgl_mipmap_reduce_supported(enum pipe_format format)
+{
+  if(rsxgl_mipmap_byte_format(format) != 0) {
+    return true;
+  }
+
+  const struct util_format_description * desc = util_format_description(format);
+
+  return desc != 0 &&
+    desc -> block.width == 1 && desc -> block.height == 1 &&
+    desc -> colorspace != UTIL_FORMAT_COLORSPACE_ZS &&
+    !util_format_is_pure_integer(format) &&
+    desc -> unpack_rgba_float != 0 && desc -> pack_rgba_float != 0;
+}
+
+// Averages of 2x2x2 blocks of texels, from two rows in each of two slices (which are the same
+// rows when the image is 2D, and the same slices when it's 1D), a byte at a time. Texels past
+// the end of a row are clamped to the last one:
+static inline void
+rsxgl_mipmap_reduce_bytes(uint8_t * dst,const uint8_t * const src[4],unsigned bytes,unsigned x,unsigned dst_width,unsigned width)
+{
+  for(;x < dst_width;++x) {
+    const unsigned x0 = (x * 2) * bytes, x1 = std::min(x * 2 + 1,width - 1) * bytes;
+
+    for(unsigned i = 0;i < bytes;++i) {
+      const unsigned sum =
+	src[0][x0 + i] + src[0][x1 + i] + src[1][x0 + i] + src[1][x1 + i] +
+	src[2][x0 + i] + src[2][x1 + i] + src[3][x0 + i] + src[3][x1 + i];
+      dst[x * bytes + i] = (sum + 4) >> 3;
+    }
+  }
+}
+
+// Vector kernels. They gather the even and odd texels of 16 bytes of each source row into 8 bytes
+// each, sum all of them as 16-bit integers, and produce 8 bytes of destination texels at a time;
+// the scalar kernel does the rest:
+struct rsxgl_mipmap_masks_t {
+  uint8_t even[16] __attribute__((aligned(16)));
+  uint8_t odd[16] __attribute__((aligned(16)));
+
+  rsxgl_mipmap_masks_t(unsigned bytes,uint8_t unused) {
+    for(unsigned i = 0;i < 16;++i) {
+      const unsigned texel = i / bytes, byte = i % bytes;
+      even[i] = (i < 8) ? (texel * 2) * bytes + byte : unused;
+      odd[i] = (i < 8) ? (texel * 2 + 1) * bytes + byte : unused;
+    }
+  }
+};
+
+#if defined(RSXGL_MIPMAP_ALTIVEC)
+static inline vector unsigned char
+rsxgl_mipmap_load_unaligned(const uint8_t * p)
+{
+  return vec_perm(vec_ld(0,p),vec_ld(15,p),vec_lvsl(0,p));
+}
+
+static void
+rsxgl_mipmap_reduce_bytes_vector(uint8_t * dst,const uint8_t * const src[4],unsigned bytes,unsigned dst_width,unsigned width)
+{
+  // vec_perm takes bytes 16-31 from its second (zero) argument:
+  static const rsxgl_mipmap_masks_t masks1(1,16), masks2(2,16), masks4(4,16);
+  const rsxgl_mipmap_masks_t & masks = (bytes == 1) ? masks1 : (bytes == 2) ? masks2 : masks4;
+
+  const vector unsigned char even = vec_ld(0,masks.even), odd = vec_ld(0,masks.odd), zero = vec_splat_u8(0);
+  const vector unsigned short four = vec_splat_u16(4), three = vec_splat_u16(3);
+  const unsigned dst_texels = 8 / bytes;
+
+  unsigned x = 0;
+  for(;(x + dst_texels) * 2 <= width && (x * 2) * bytes + 16 <= width * bytes;x += dst_texels) {
+    vector unsigned short sum = four;
+
+    for(unsigned i = 0;i < 4;++i) {
+      const vector unsigned char v = rsxgl_mipmap_load_unaligned(src[i] + (x * 2) * bytes);
+      sum = vec_add(sum,(vector unsigned short)vec_mergeh(zero,vec_perm(v,zero,even)));
+      sum = vec_add(sum,(vector unsigned short)vec_mergeh(zero,vec_perm(v,zero,odd)));
+    }
+
+    union {
+      vector unsigned char v;
+      uint8_t bytes[16];
+    } result;
+    result.v = vec_packsu(vec_sr(sum,three),vec_sr(sum,three));
+    memcpy(dst + x * bytes,result.bytes,8);
+  }
+
+  rsxgl_mipmap_reduce_bytes(dst,src,bytes,x,dst_width,width);
+}
+#endif
+
+#if defined(RSXGL_MIPMAP_X86)
+__attribute__((target("ssse3")))
+static void
+rsxgl_mipmap_reduce_bytes_vector(uint8_t * dst,const uint8_t * const src[4],unsigned bytes,unsigned dst_width,unsigned width)
+{
+  // pshufb zeroes bytes whose control has its top bit set:
+  static const rsxgl_mipmap_masks_t masks1(1,0x80), masks2(2,0x80), masks4(4,0x80);
+  const rsxgl_mipmap_masks_t & masks = (bytes == 1) ? masks1 : (bytes == 2) ? masks2 : masks4;
+
+  const __m128i even = _mm_load_si128((const __m128i *)masks.even), odd = _mm_load_si128((const __m128i *)masks.odd), zero = _mm_setzero_si128();
+  const unsigned dst_texels = 8 / bytes;
+
+  unsigned x = 0;
+  for(;(x + dst_texels) * 2 <= width && (x * 2) * bytes + 16 <= width * bytes;x += dst_texels) {
+    __m128i sum = _mm_set1_epi16(4);
+
+    for(unsigned i = 0;i < 4;++i) {
+      const __m128i v = _mm_loadu_si128((const __m128i *)(src[i] + (x * 2) * bytes));
+      sum = _mm_add_epi16(sum,_mm_unpacklo_epi8(_mm_shuffle_epi8(v,even),zero));
+      sum = _mm_add_epi16(sum,_mm_unpacklo_epi8(_mm_shuffle_epi8(v,odd),zero));
+    }
+
+    sum = _mm_srli_epi16(sum,3);
+    _mm_storel_epi64((__m128i *)(dst + x * bytes),_mm_packus_epi16(sum,sum));
+  }
+
+  rsxgl_mipmap_reduce_bytes(dst,src,bytes,x,dst_width,width);
+}
+#endif
+
+// Unpack two rows in each of two slices to floats, and average them:
+static void
+rsxgl_mipmap_reduce_float(const struct util_format_description * desc,uint8_t * dst,const uint8_t * const src[4],float * tmp,unsigned dst_width,unsigned width)
+{
+  const unsigned tmp_stride = width * 4 * sizeof(float);
+
+  for(unsigned i = 0;i < 4;++i) {
+    desc -> unpack_rgba_float(tmp + width * 4 * i,tmp_stride,src[i],0,width,1);
+  }
+
+  float * out = tmp + width * 4 * 4;
+
+  for(unsigned x = 0;x < dst_width;++x) {
+    const unsigned x0 = (x * 2) * 4, x1 = std::min(x * 2 + 1,width - 1) * 4;
+
+    for(unsigned c = 0;c < 4;++c) {
+      float sum = 0;
+      for(unsigned i = 0;i < 4;++i) {
+	sum += tmp[width * 4 * i + x0 + c] + tmp[width * 4 * i + x1 + c];
+      }
+      out[x * 4 + c] = sum * 0.125f;
+    }
+  }
+
+  desc -> pack_rgba_float(dst,0,out,0,dst_width,1);
+}
+
+bool
+rsxgl_mipmap_reduce(enum pipe_format format,
+		    void * _dst,unsigned dst_stride,unsigned dst_image_stride,
+		    const void * _src,unsigned src_stride,unsigned src_image_stride,
+		    unsigned width,unsigned height,unsigned depth)
+{
+  const unsigned
+    dst_width = std::max(width >> 1,1u),
+    dst_height = std::max(height >> 1,1u),
+    dst_depth = std::max(depth >> 1,1u);
+
+  const unsigned bytes = rsxgl_mipmap_byte_format(format);
+  const struct util_format_description * desc = util_format_description(format);
+
+  void (*reduce_bytes)(uint8_t *,const uint8_t * const [4],unsigned,unsigned,unsigned) = 0;
+  float * tmp = 0;
+
+  if(bytes != 0) {
+#if defined(RSXGL_MIPMAP_ALTIVEC)
+    if(bytes != 3) {
+      reduce_bytes = rsxgl_mipmap_reduce_bytes_vector;
+    }
+#elif defined(RSXGL_MIPMAP_X86)
+    if(bytes != 3 && __builtin_cpu_supports("ssse3")) {
+      reduce_bytes = rsxgl_mipmap_reduce_bytes_vector;
+    }
+#endif
+  }
+  else {
+    // Four source rows, and one destination row:
+    tmp = (float *)malloc((width * 4 + dst_width) * 4 * sizeof(float));
+    if(tmp == 0) {
+      return false;
+    }
+  }
+
+  for(unsigned z = 0;z < dst_depth;++z) {
+    const uint8_t
+      * src0 = (const uint8_t *)_src + (z * 2) * src_image_stride,
+      * src1 = (const uint8_t *)_src + std::min(z * 2 + 1,depth - 1) * src_image_stride;
+    uint8_t * dst = (uint8_t *)_dst + z * dst_image_stride;
+
+    for(unsigned y = 0;y < dst_height;++y,dst += dst_stride) {
+      const unsigned y0 = (y * 2) * src_stride, y1 = std::min(y * 2 + 1,height - 1) * src_stride;
+      const uint8_t * const src[4] = { src0 + y0, src0 + y1, src1 + y0, src1 + y1 };
+
+      if(reduce_bytes != 0) {
+	reduce_bytes(dst,src,bytes,dst_width,width);
+      }
+      else if(bytes != 0) {
+	rsxgl_mipmap_reduce_bytes(dst,src,bytes,0,dst_width,width);
+      }
+      else {
+	rsxgl_mipmap_reduce_float(desc,dst,src,tmp,dst_width,width);
+      }
+    }
+  }
+
+  free(tmp);
+  return true;
+}
@@ -0,0 +1,34 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// mipmap.h - Generate mipmap levels by box filtering with the CPU.
+
+#ifndef rsxgl_mipmap_H
+#define rsxgl_mipmap_H
+
+#include "pipe/p_format.h"
+
+#include <stdint.h>
+
+// Texels of these formats are 1 to 4 bytes, each of which is an 8-bit unsigned normalized
+// channel (or unused), so averaging texels is averaging each of their bytes. Returns the number
+// of bytes, or 0 for other formats:
+unsigned rsxgl_mipmap_byte_format(enum pipe_format format);
+
+// Can be filtered by rsxgl_mipmap_reduce:
+bool rsxgl_mipmap_reduce_supported(enum pipe_format format);
+
+// Box filters the width x height x depth image at src into the next level's image, which is
+// max(width >> 1,1) x max(height >> 1,1) x max(depth >> 1,1), at dst. Strides are in bytes; image
+// strides are the distance between slices of 3D images. Formats whose channels are all 8-bit
+// unsigned normalized values are averaged a byte at a time, with AltiVec or SSSE3 if they're
+// available; the rest are unpacked to floats, averaged, and packed again. Returns false, having
+// written nothing, if there isn't the memory to unpack them into:
+bool rsxgl_mipmap_reduce(enum pipe_format format,
+			 void * dst,unsigned dst_stride,unsigned dst_image_stride,
+			 const void * src,unsigned src_stride,unsigned src_image_stride,
+			 unsigned width,unsigned height,unsigned depth);
+
+#endif
@@ -12,7 +12,12 @@
 #include "error.h"
 #include "gl_fifo.h"
 #include "program.h"
+#include "shader_cache.h"
+#include "program_translate.h"
+#include "compiler_thread.h"
+#include "uniforms.h"
 #include "compiler_context.h"
+#include "spinlock.h"
 
 #include <rsx/gcm_sys.h>
 #include "nv40.h"
@@ -25,27 +30,17 @@
 
 // mesa:
 #include <main/mtypes.h>
-#include <state_tracker/st_program.h>
-#include <program/prog_parameter.h>
-#include <glsl/ir.h>
-#include <glsl/ir_uniform.h>
 
 extern "C" {
 #include <nvfx/nvfx_state.h>
+#include <nvfx/nv40_vertprog.h>
+#include <nvfx/nvfx_disasm.h>
 }
 
 #include <malloc.h>
 #include <algorithm>
-#include <deque>
-#include <map>
 #include "set_algorithm2.h"
 
-static u32 endian_fp(u32 v)
-{
-  return ( ( ( v >> 16 ) & 0xffff ) << 0 ) |
-         ( ( ( v >> 0 ) & 0xffff ) << 16 );
-}
-
 #if defined(GLAPI)
 #undef GLAPI
 #endif
@@ -64,7 +59,7 @@ program_t::storage_type & program_t::storage()
 
 // Shader functions:
 shader_t::shader_t()
-  : type(RSXGL_MAX_SHADER_TYPES), compiled(GL_FALSE), deleted(GL_FALSE), ref_count(0), mesa_shader(0)
+  : type(RSXGL_MAX_SHADER_TYPES), compiled(GL_FALSE), deleted(GL_FALSE), compile_deferred(0), ref_count(0), source_hash(0), mesa_shader(0)
 {
 }
 
@@ -130,7 +125,15 @@ glGetShaderiv (GLuint shader_name, GLenum pname, GLint *params)
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  const shader_t & shader = shader_t::storage().at(shader_name);
+  shader_t & shader = shader_t::storage().at(shader_name);
+
+  // Polling for completion mustn't block:
+  if(pname == GL_COMPLETION_STATUS_KHR) {
+    *params = (!shader.pending || rsxgl_compiler_job_done(*shader.pending)) ? GL_TRUE : GL_FALSE;
+    RSXGL_NOERROR_();
+  }
+
+  rsxgl_shader_complete(shader);
 
   if(pname == GL_SHADER_TYPE) {
     if(shader.type == RSXGL_VERTEX_SHADER) {
@@ -166,7 +169,8 @@ glGetShaderInfoLog (GLuint shader_name, GLsizei bufSize, GLsizei *length, GLchar
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  const shader_t & shader = shader_t::storage().at(shader_name);
+  shader_t & shader = shader_t::storage().at(shader_name);
+  rsxgl_shader_complete(shader);
 
   shader.info.copy(infoLog,bufSize);
   if(length != 0) *length = shader.info.length();
@@ -252,28 +256,102 @@ glShaderSource (GLuint shader_name, GLsizei count, const GLchar** string, const
   RSXGL_NOERROR_();
 }
 
+// glCompileShader()'s work. It only touches the mesa shader and its own members, since the
+// shader_t may be moved, or deleted, while it runs:
+struct rsxgl_compile_job_t : public rsxgl_compiler_job_t {
+  gl_shader * mesa_shader;
+  std::string source;
+  uint64_t source_hash;
+
+  // Results:
+  bool compiled;
+  std::string info;
+
+  rsxgl_compile_job_t(gl_shader * _mesa_shader,const std::string & _source,const uint64_t _source_hash)
+    : mesa_shader(_mesa_shader), source(_source), source_hash(_source_hash), compiled(false) {
+  }
+
+  void run(compiler_context_t * cctx) {
+    cctx -> compile_shader(mesa_shader,source.c_str());
+
+    compiled = mesa_shader -> CompileStatus;
+    info = mesa_shader -> InfoLog;
+
+    if(compiled) {
+      rsxgl_shader_cache_insert_shader(source_hash);
+    }
+  }
+};
+
+void
+rsxgl_shader_complete_pending(shader_t & shader)
+{
+  std::shared_ptr< rsxgl_compile_job_t > job;
+  {
+    rsxgl_spinlock_guard guard(rsxgl_compiler_lock);
+    job = shader.pending;
+  }
+  if(!job) return;
+
+  rsxgl_compiler_job_wait(*job);
+
+  // Another thread, sharing this shader, may have got here first:
+  rsxgl_spinlock_guard guard(rsxgl_compiler_lock);
+  if(shader.pending != job) return;
+  shader.pending.reset();
+
+  shader.compiled = job -> compiled;
+  shader.info = job -> info;
+}
+
 GLAPI void APIENTRY
 glCompileShader (GLuint shader_name)
 {
+  rsxgl_context_t * ctx = current_ctx();
+
   if(!shader_t::storage().is_object(shader_name)) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
   shader_t & shader = shader_t::storage().at(shader_name);
+
+  // The results of compiling it before mustn't overwrite these:
+  rsxgl_shader_complete(shader);
+
   shader.compiled = GL_FALSE;
+  shader.compile_deferred = 0;
+  shader.deferred_source.clear();
 
   if(shader.source.empty()) {
     RSXGL_NOERROR_();
   }
 
-  compiler_context_t * cctx = current_ctx() -> compiler_context();
+  compiler_context_t * cctx = ctx -> compiler_context();
   rsxgl_assert(cctx != 0);
 
-  cctx -> compile_shader(shader.mesa_shader,
-			 shader.source.c_str());
+  {
+    rsxgl_spinlock_guard guard(rsxgl_compiler_lock);
+
+    shader.source_hash = rsxgl_shader_cache_hash(shader.type,rsxgl_shader_cache_hash(shader.source.c_str(),RSXGL_SHADER_CACHE_HASH_INIT));
 
-  shader.compiled = shader.mesa_shader -> CompileStatus;
-  shader.info = shader.mesa_shader -> InfoLog;
+    if(rsxgl_shader_cache_find_shader(shader.source_hash)) {
+      shader.compiled = GL_TRUE;
+      shader.compile_deferred = 1;
+      shader.deferred_source = shader.source;
+      shader.info.clear();
+
+      RSXGL_NOERROR_();
+    }
+  }
+
+  shader.info.clear();
+  shader.pending = std::make_shared< rsxgl_compile_job_t >(shader.mesa_shader,shader.source,shader.source_hash);
+  rsxgl_compiler_thread_run(shader.pending,cctx,ctx -> screen());
+
+  // It was compiled on this thread:
+  if(rsxgl_compiler_job_done(*shader.pending)) {
+    rsxgl_shader_complete_pending(shader);
+  }
 
   RSXGL_NOERROR_();
 }
@@ -286,20 +364,33 @@ glReleaseShaderCompiler (void)
   RSXGL_ERROR_(GL_INVALID_OPERATION);
 }
 
+GLAPI void APIENTRY
+glMaxShaderCompilerThreadsKHR (GLuint count)
+{
+  rsxgl_compiler_thread_set_max(count);
+
+  RSXGL_NOERROR_();
+}
+
 // Program functions:
 program_t::program_t()
   : deleted(0), timestamp(0),
     linked(0), validated(0), invalid_uniforms(0), ref_count(0),
+    link_inputs_hash(RSXGL_SHADER_CACHE_HASH_INIT),
     attrib_name_max_length(0), uniform_name_max_length(0),
     mesa_program(0), nvfx_vp(0), nvfx_fp(0), nvfx_streamvp(0), nvfx_streamfp(0),
     vp_ucode_offset(~0), fp_ucode_offset(~0), vp_num_insn(0), fp_num_insn(0), 
+    vp_ucode_serial(0), streamvp_ucode_serial(0), vp_num_branch_relocs(0), streamvp_num_branch_relocs(0),
+    fp_ucode_copies_offset(~0), fp_ucode_stride(0), fp_ucode_copy(0), fp_ucode_copies_written(0),
     streamvp_ucode_offset(~0), streamfp_ucode_offset(~0), streamvp_num_insn(0), streamfp_num_insn(0), 
     vp_input_mask(0), vp_output_mask(0), vp_num_internal_const(0),
     fp_control(0),
     streamvp_input_mask(0), streamvp_output_mask(0), streamvp_num_internal_const(0),
     streamfp_control(0), streamfp_num_outputs(0),
-    streamvp_vertexid_index(~0), instanceid_index(~0), point_sprite_control(0)
+    streamvp_vertexid_index(~0), instanceid_index(~0), point_sprite_control(0),
+    num_vp_uniforms(0)
 {
+  std::fill(fp_ucode_timestamps,fp_ucode_timestamps + RSXGL_FP_UCODE_COPIES,0);
 }
 
 program_t::~program_t()
@@ -331,6 +422,7 @@ glDeleteProgram (GLuint program_name)
 
   // TODO: orphan it, instead of doing this:
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
   if(program.timestamp > 0) {
     rsxgl_timestamp_wait(current_ctx(),program.timestamp);
     program.timestamp = 0;
@@ -360,6 +452,7 @@ glAttachShader (GLuint program_name, GLuint shader_name)
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(!program.attached_shaders.insert(shader_name).second) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
@@ -382,6 +475,7 @@ glDetachShader (GLuint program_name, GLuint shader_name)
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   boost::container::flat_set< shader_t::name_type >::iterator it = program.attached_shaders.find(shader_name);
 
@@ -406,7 +500,8 @@ glGetAttachedShaders (GLuint program_name, GLsizei maxCount, GLsizei *count, GLu
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  const program_t & program = program_t::storage().at(program_name);
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   size_t n = 0;
   for(boost::container::flat_set< shader_t::name_type >::const_iterator it = program.attached_shaders.begin(), it_end = program.attached_shaders.end();
@@ -422,6 +517,37 @@ glGetAttachedShaders (GLuint program_name, GLsizei maxCount, GLsizei *count, GLu
   RSXGL_NOERROR_();
 }
 
+// GL_RSX_program_cost; the pnames come in groups of four, for the vertex & fragment programs:
+static GLint
+rsxgl_program_cost(const rsxgl_program_binary_t & binary,const GLenum pname)
+{
+  struct nvfx_program_cost cost;
+
+  if(pname < GL_FRAGMENT_PROGRAM_INSTRUCTIONS_RSX) {
+    nvfx_vertprog_disasm(binary.vp.ucode.data(),binary.vp.ucode.size() / 4,0,&cost);
+  }
+  else {
+    // The binary holds the fragment program in the RSX's half-word order:
+    std::vector< uint32_t > ucode(binary.fp.ucode.size());
+    for(size_t i = 0,n = ucode.size();i < n;++i) {
+      const uint32_t v = binary.fp.ucode[i];
+      ucode[i] = (v >> 16) | (v << 16);
+    }
+    nvfx_fragprog_disasm(ucode.data(),ucode.size(),0,&cost);
+  }
+
+  switch((pname - GL_VERTEX_PROGRAM_INSTRUCTIONS_RSX) % 4) {
+  case 0:
+    return cost.instructions;
+  case 1:
+    return cost.texture_fetches;
+  case 2:
+    return cost.registers;
+  default:
+    return cost.branches;
+  }
+}
+
 GLAPI void APIENTRY
 glGetProgramiv (GLuint program_name, GLenum pname, GLint *params)
 {
@@ -429,7 +555,15 @@ glGetProgramiv (GLuint program_name, GLenum pname, GLint *params)
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  const program_t & program = program_t::storage().at(program_name);
+  program_t & program = program_t::storage().at(program_name);
+
+  // Polling for completion mustn't block:
+  if(pname == GL_COMPLETION_STATUS_KHR) {
+    *params = (!program.pending || rsxgl_compiler_job_done(*program.pending)) ? GL_TRUE : GL_FALSE;
+    RSXGL_NOERROR_();
+  }
+
+  rsxgl_program_complete(program);
 
   if(pname == GL_DELETE_STATUS) {
     *params = program.deleted;
@@ -446,6 +580,22 @@ glGetProgramiv (GLuint program_name, GLenum pname, GLint *params)
   else if(pname == GL_ATTACHED_SHADERS) {
     // TODO: implement this
   }
+  else if(pname == GL_PROGRAM_BINARY_LENGTH) {
+    if(program.linked && program.binary) {
+      *params = rsxgl_program_binary_size(*program.binary);
+    }
+    else {
+      *params = 0;
+    }
+  }
+  else if(pname >= GL_VERTEX_PROGRAM_INSTRUCTIONS_RSX && pname <= GL_FRAGMENT_PROGRAM_BRANCHES_RSX) {
+    if(program.linked && program.binary) {
+      *params = rsxgl_program_cost(*program.binary,pname);
+    }
+    else {
+      *params = 0;
+    }
+  }
   else if(pname == GL_ACTIVE_ATTRIBUTES) {
     if(program.linked) {
       *params = program.attribs.size();
@@ -502,7 +652,8 @@ glGetProgramInfoLog (GLuint program_name, GLsizei bufSize, GLsizei *length, GLch
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  const program_t & program = program_t::storage().at(program_name);
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
   program.info.copy(infoLog,bufSize);
   if(length != 0) *length = program.info.length();
 
@@ -525,6 +676,19 @@ rsxgl_vp_ucode_offset(const struct nvfx_vertex_program_exec * address)
   return ((uint8_t *)address - (uint8_t *)main_ucode_address) / (sizeof(struct nvfx_vertex_program_exec));
 }
 
+// Serial numbers for linked vertex programs, for rsxgl_vp_cache_t:
+static volatile uint32_t rsxgl_vp_ucode_serial = 0;
+
+static inline uint32_t
+rsxgl_next_vp_ucode_serial()
+{
+  uint32_t serial = __sync_add_and_fetch(&rsxgl_vp_ucode_serial,1);
+  if(serial == 0) {
+    serial = __sync_add_and_fetch(&rsxgl_vp_ucode_serial,1);
+  }
+  return serial;
+}
+
 static mspace
 rsxgl_main_ucode_mspace()
 {
@@ -535,7 +699,7 @@ rsxgl_main_ucode_mspace()
     main_ucode_address = memalign(RSXGL_CACHE_LINE_SIZE,size);
     rsxgl_assert(main_ucode_address != 0);
 
-    space = create_mspace_with_base(main_ucode_address,size,0);
+    space = create_mspace_with_base(main_ucode_address,size,1);
     rsxgl_assert(space != 0);
   }
 
@@ -578,76 +742,17 @@ rsxgl_rsx_ucode_mspace()
 
     gcmAddressToOffset(rsx_ucode_address,&rsx_ucode_offset);
 
-    space = create_mspace_with_base(rsx_ucode_address,size,0);
+    space = create_mspace_with_base(rsx_ucode_address,size,1);
     rsxgl_assert(space != 0);
   }
 
   return space;
 }
 
-static inline uint8_t
-rsxgl_glsl_type_to_rsxgl_type(const glsl_type * type)
-{
-  if(type -> base_type == GLSL_TYPE_FLOAT) {
-    if(type -> vector_elements == 1) {
-      return RSXGL_DATA_TYPE_FLOAT;
-    }
-    else if(type -> vector_elements == 2) {
-      return RSXGL_DATA_TYPE_FLOAT2;
-    }
-    else if(type -> vector_elements == 3) {
-      return RSXGL_DATA_TYPE_FLOAT3;
-    }
-    else if(type -> vector_elements == 4) {
-      if(type -> matrix_columns == 4) {
-	return RSXGL_DATA_TYPE_FLOAT4x4;
-      }
-      else {
-	return RSXGL_DATA_TYPE_FLOAT4;
-      }
-    }
-  }
-  else if(type -> base_type == GLSL_TYPE_SAMPLER) {
-    if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_1D) {
-      return RSXGL_DATA_TYPE_SAMPLER1D;
-    }
-    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_2D) {
-      return RSXGL_DATA_TYPE_SAMPLER2D;
-    }
-    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_3D) {
-      return RSXGL_DATA_TYPE_SAMPLER3D;
-    }
-    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_CUBE) {
-      return RSXGL_DATA_TYPE_SAMPLERCUBE;
-    }
-    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_RECT) {
-      return RSXGL_DATA_TYPE_SAMPLERRECT;
-    }
-  }
-  return RSXGL_DATA_TYPE_UNKNOWN;
-}
-
-GLAPI void APIENTRY
-glLinkProgram (GLuint program_name)
+// Release everything that linking a program creates:
+static void
+rsxgl_program_reset(program_t & program)
 {
-  rsxgl_context_t * ctx = current_ctx();
-
-  if(!program_t::storage().is_object(program_name)) {
-    RSXGL_ERROR_(GL_INVALID_VALUE);
-  }
-
-  if((ctx -> state.enable.transform_feedback_mode != 0) && (ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] == program_name)) {
-    RSXGL_ERROR_(GL_INVALID_OPERATION);
-  }
-
-  program_t & program = program_t::storage().at(program_name);
-
-  // TODO: orphan it, instead of doing this:
-  if(program.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,program.timestamp);
-    program.timestamp = 0;
-  }
-
   // Get rid of any linked shaders:
   std::for_each(program.linked_shaders.begin(),program.linked_shaders.end(),shader_t::gl_object_type::unref_and_maybe_delete);
   program.linked_shaders.clear();
@@ -657,10 +762,12 @@ glLinkProgram (GLuint program_name)
     mspace_free(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_address(program.vp_ucode_offset));
     program.vp_ucode_offset = ~0U;
   }
-  if(program.fp_ucode_offset != ~0U) {
-    mspace_free(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_address(program.fp_ucode_offset));
+  if(program.fp_ucode_copies_offset != ~0U) {
+    mspace_free(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_address(program.fp_ucode_copies_offset));
+    program.fp_ucode_copies_offset = ~0U;
     program.fp_ucode_offset = ~0U;
   }
+  program.fp_ucode.reset();
   if(program.streamvp_ucode_offset != ~0U) {
     mspace_free(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_address(program.streamvp_ucode_offset));
     program.streamvp_ucode_offset = ~0U;
@@ -671,565 +778,625 @@ glLinkProgram (GLuint program_name)
   }
   program.uniform_values.release();
   program.program_offsets.release();
+  program.vp_uniforms.reset();
+  program.num_vp_uniforms = 0;
+  program.vp_ucode_serial = 0;
+  program.streamvp_ucode_serial = 0;
+  program.vp_branch_relocs.reset();
+  program.streamvp_branch_relocs.reset();
+  program.vp_num_branch_relocs = 0;
+  program.streamvp_num_branch_relocs = 0;
+  program.binary.reset();
 
   program.linked = GL_FALSE;
   program.validated = GL_FALSE;
+}
+
+// Copy vertex program microcode to cache-aligned memory:
+static bool
+rsxgl_program_load_vp(const rsxgl_program_binary_t::vp_t & vp,
+		      program_t::ucode_offset_type & ucode_offset,program_t::instruction_size_type & num_insn,uint32_t & serial,
+		      std::unique_ptr< program_t::instruction_size_type[] > & relocs,program_t::instruction_size_type & num_relocs)
+{
+  const uint32_t n = vp.ucode.size() / 4;
+  if(n == 0 || n > RSXGL__VERTEX__MAX_PROGRAM_INSTRUCTIONS) return false;
+
+  for(const uint32_t insn : vp.branch_relocs) {
+    if(insn >= n) return false;
+  }
+
+  struct nvfx_vertex_program_exec * address = (struct nvfx_vertex_program_exec *)mspace_memalign(rsxgl_main_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,n * sizeof(struct nvfx_vertex_program_exec));
+  if(address == 0) return false;
+
+  memcpy(address,&vp.ucode[0],n * sizeof(struct nvfx_vertex_program_exec));
+
+  ucode_offset = rsxgl_vp_ucode_offset(address);
+  num_insn = n;
+  serial = rsxgl_next_vp_ucode_serial();
+
+  num_relocs = vp.branch_relocs.size() / 2;
+  relocs.reset(num_relocs > 0 ? new program_t::instruction_size_type[num_relocs * 2] : 0);
+  std::copy(vp.branch_relocs.begin(),vp.branch_relocs.end(),relocs.get());
+
+  return true;
+}
+
+// Make a program object use the microcode and tables in binary:
+static bool
+rsxgl_program_load(program_t & program,const rsxgl_program_binary_t & binary,std::string & info)
+{
+  static const std::string
+    kVPUcodeAllocFail("Failed to allocate space for vertex program microcode"),
+    kFPUcodeAllocFail("Failed to allocate space for fragment program microcode"),
+    kStreamVPUcodeAllocFail("Failed to allocate space for stream vertex program microcode"),
+    kStreamFPUcodeAllocFail("Failed to allocate space for stream fragment program microcode");
 
   //
-  std::string info;
+  if(!rsxgl_program_load_vp(binary.vp,program.vp_ucode_offset,program.vp_num_insn,program.vp_ucode_serial,program.vp_branch_relocs,program.vp_num_branch_relocs)) {
+    info += kVPUcodeAllocFail;
+    return false;
+  }
+  program.vp_input_mask = binary.vp.input_mask;
+  program.vp_output_mask = binary.vp.output_mask;
+  program.vp_num_internal_const = binary.vp_num_internal_const;
+
+  // Fragment program microcode goes to RSX memory:
+  {
+    const uint32_t n = binary.fp.ucode.size();
+    if(n == 0 || (n / 4) > RSXGL__FRAGMENT__MAX_PROGRAM_INSTRUCTIONS) {
+      info += kFPUcodeAllocFail;
+      return false;
+    }
 
-  compiler_context_t * cctx = ctx -> compiler_context();
+    // Copies are kept a cache line apart:
+    const uint32_t size = n * sizeof(uint32_t);
+    const uint32_t stride = (size + RSXGL_CACHE_LINE_SIZE - 1) & ~(RSXGL_CACHE_LINE_SIZE - 1);
 
-  for(shader_t::name_type name : program.attached_shaders) {
-#if 0
-    const shader_t & shader = shader_t::storage().at(program.attached_shaders()[i]);
-    char * tmp = (char *)malloc(shader.source_size);
-    shader.source().get(tmp,shader.source_size);
-    rsxgl_debug_printf("%u source:\n%s\n",i,tmp);
-    free(tmp);
-#endif
+    uint32_t * address = (uint32_t *)mspace_memalign(rsxgl_rsx_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,stride * RSXGL_FP_UCODE_COPIES);
+    if(address == 0) {
+      info += kFPUcodeAllocFail;
+      return false;
+    }
 
-    cctx -> attach_shader(program.mesa_program,shader_t::storage().at(name).mesa_shader);
+    program.fp_ucode_copies_offset = rsxgl_rsx_ucode_offset(address);
+    program.fp_ucode_stride = stride / (sizeof(uint32_t) * 4);
+    program.fp_ucode_copy = 0;
+    program.fp_ucode_copies_written = 1;
+    program.fp_ucode_offset = program.fp_ucode_copies_offset;
+    std::fill(program.fp_ucode_timestamps,program.fp_ucode_timestamps + RSXGL_FP_UCODE_COPIES,0);
+
+    program.fp_ucode.reset(new uint32_t[n]);
+    std::copy(binary.fp.ucode.begin(),binary.fp.ucode.end(),program.fp_ucode.get());
+    memcpy(address,program.fp_ucode.get(),size);
+
+    program.fp_num_insn = n / 4;
+    program.fp_control = binary.fp.control;
   }
-  
-  cctx -> link_program(program.mesa_program);
 
-#if 0
-  rsxgl_debug_printf("%s result: %i info: %s programs: %lx %x\n",
-		     __PRETTY_FUNCTION__,
-		     program.mesa_program -> LinkStatus,
-		     program.mesa_program -> InfoLog);
-#endif
+  // Stream programs:
+  if(binary.stream_num_outputs > 0) {
+    if(!rsxgl_program_load_vp(binary.streamvp,program.streamvp_ucode_offset,program.streamvp_num_insn,program.streamvp_ucode_serial,program.streamvp_branch_relocs,program.streamvp_num_branch_relocs)) {
+      info += kStreamVPUcodeAllocFail;
+      return false;
+    }
+    program.streamvp_input_mask = binary.streamvp.input_mask;
+    program.streamvp_output_mask = binary.streamvp.output_mask;
+    program.streamvp_num_internal_const = 0;
+    program.streamvp_vertexid_index = binary.streamvp_vertexid_index;
+
+    const uint32_t n = binary.streamfp.ucode.size();
+    uint32_t * address = ((n / 4) > RSXGL__FRAGMENT__MAX_PROGRAM_INSTRUCTIONS) ? 0 : (uint32_t *)mspace_memalign(rsxgl_rsx_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,n * sizeof(uint32_t));
+    if(n == 0 || address == 0) {
+      info += kStreamFPUcodeAllocFail;
+      return false;
+    }
+
+    program.streamfp_ucode_offset = rsxgl_rsx_ucode_offset(address);
+    std::copy(binary.streamfp.ucode.begin(),binary.streamfp.ucode.end(),address);
+
+    program.streamfp_num_insn = n / 4;
+    program.streamfp_control = binary.streamfp.control;
+    program.streamfp_num_outputs = binary.stream_num_outputs;
+  }
+  else {
+    program.streamvp_ucode_offset = ~0;
+    program.streamfp_ucode_offset = ~0;
+    program.streamvp_num_insn = 0;
+    program.streamfp_num_insn = 0;
+    program.streamvp_input_mask = 0;
+    program.streamvp_output_mask = 0;
+    program.streamvp_num_internal_const = 0;
+    program.streamfp_control = 0;
+    program.streamfp_num_outputs = 0;
+    program.streamvp_vertexid_index = ~0;
+  }
+
+  // Migrate uniform values array:
+  program.uniform_values.reset(new ieee32_t[binary.uniform_values.size()]);
+  for(size_t i = 0,n = binary.uniform_values.size();i < n;++i) {
+    program.uniform_values[i].u = binary.uniform_values[i];
+  }
+
+  // Migrate program offsets array:
+  program.program_offsets.reset(new program_t::instruction_size_type[binary.program_offsets.size()]);
+  std::copy(binary.program_offsets.begin(),binary.program_offsets.end(),program.program_offsets.get());
+
+  // Attribute and uniform names:
+  program.names.reset(new char[binary.names.size()]);
+  std::copy(binary.names.begin(),binary.names.end(),program.names.get());
+
+  program.attrib_name_max_length = binary.attrib_name_max_length;
+  program.uniform_name_max_length = binary.uniform_name_max_length;
+
+  // Migrate attributes table:
+  {
+    program.attribs.resize(binary.attribs.size());
+    program.attribs_enabled.reset();
+
+    auto it = program.attribs.begin();
+    for(const auto & attrib : binary.attribs) {
+      it -> first = attrib.name;
+      it -> second.type = attrib.type;
+      it -> second.index = attrib.index;
+      it -> second.location = attrib.location;
+      ++it;
+
+      program.attribs_enabled.set(attrib.index);
+      program.attrib_assignments.set(attrib.index,attrib.location);
+    }
+  }
 
-  info += std::string(program.mesa_program -> InfoLog);
+  // Migrate uniforms table:
+  {
+    program.uniforms.resize(binary.uniforms.size());
 
-  if(program.mesa_program -> LinkStatus) {
-    pipe_stream_output_info stream_info;
-    tgsi_token * vp_tokens = 0;
+    auto it = program.uniforms.begin();
+    for(const auto & uniform : binary.uniforms) {
+      it -> first = uniform.name;
+      it -> second.type = uniform.type;
+      it -> second.invalid.reset();
+      it -> second.enabled.reset();
+      for(unsigned int i = 0;i < RSXGL_MAX_SHADER_TYPES;++i) {
+	if(uniform.enabled & (1 << i)) it -> second.enabled.set(i);
+      }
+      it -> second.values_index = uniform.values_index;
+      it -> second.count = uniform.count;
+      it -> second.vp_index = uniform.vp_index;
+      it -> second.program_offsets_index = uniform.program_offsets_index;
+      ++it;
+    }
+  }
 
-    program.nvfx_vp = cctx -> translate_vp(program.mesa_program,&stream_info,&vp_tokens);
-    program.nvfx_fp = cctx -> translate_fp(program.mesa_program);
-    rsxgl_assert(program.nvfx_vp != 0);
-    rsxgl_assert(program.nvfx_fp != 0);
+  // Migrate texture table:
+  program.fp_texcoords.reset();
+  program.fp_texcoord2D.reset();
+  program.fp_texcoord3D.reset();
+  program.textures_enabled.reset();
 
-    cctx -> link_vp_fp(program.nvfx_vp,program.nvfx_fp);
+  for(unsigned int i = 0;i < RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;++i) {
+    program.texture_assignments.set(i,0);
+  }
 
-    // Move attached shaders to linked shaders:
-    program.linked_shaders = program.attached_shaders;
+  {
+    program.sampler_uniforms.resize(binary.sampler_uniforms.size());
 
-    // Start a new attached shaders array:
-    program.attached_shaders.clear();
+    auto it = program.sampler_uniforms.begin();
+    for(const auto & uniform : binary.sampler_uniforms) {
+      it -> first = uniform.name;
+      it -> second.type = uniform.type;
+      it -> second.vp_index = uniform.vp_index;
+      it -> second.fp_index = uniform.fp_index;
+      ++it;
 
-    {
-      //
-      // Migrate vertex program microcode to cache-aligned memory:
-      {
-	static const std::string kVPUcodeAllocFail("Failed to allocate space for vertex program microcode");
-	
-	struct nvfx_vertex_program_exec * address = (struct nvfx_vertex_program_exec *)mspace_memalign(rsxgl_main_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_vp -> nr_insns * sizeof(struct nvfx_vertex_program_exec));
-	if(address == 0) {
-	  info += kVPUcodeAllocFail;
-	  //goto fail;
-	}
-	else {
-	  program.vp_ucode_offset = rsxgl_vp_ucode_offset(address);
-	  
-	  memcpy(address,program.nvfx_vp -> insns,program.nvfx_vp -> nr_insns * sizeof(struct nvfx_vertex_program_exec));
-	  
-	  program.vp_num_insn = program.nvfx_vp -> nr_insns;
-	  program.vp_input_mask = program.nvfx_vp -> ir;
-	}
+      if(uniform.vp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
+	program.textures_enabled.set(uniform.vp_index);
       }
-      
-      // Migrate fragment program microcode to RSX memory, performing endian swap along the way:
-      {
-	static const std::string kFPUcodeAllocFail("Failed to allocate space for fragment program microcode");
-	
-	uint32_t * address = (uint32_t *)mspace_memalign(rsxgl_rsx_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_fp -> insn_len * sizeof(uint32_t));
-	if(address == 0) {
-	  info += kFPUcodeAllocFail;
-	  //goto fail;
+      if(uniform.fp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
+	program.fp_texcoords.set(uniform.fp_index);
+	if(uniform.type == RSXGL_DATA_TYPE_SAMPLER2D) {
+	  program.fp_texcoord2D.set(uniform.fp_index);
 	}
-	else {
-	  program.fp_ucode_offset = rsxgl_rsx_ucode_offset(address);
-	  
-	  //memcpy(address,program.nvfx_fp -> insn,program.nvfx_fp -> insn_len * sizeof(uint32_t));
-	  for(unsigned int i = 0,n = program.nvfx_fp -> insn_len;i < n;++i) {
-	    address[i] = endian_fp(program.nvfx_fp -> insn[i]);
-	  }
-	  
-	  program.fp_num_insn = program.nvfx_fp -> insn_len / 4;
-	  program.fp_control = program.nvfx_fp -> fp_control;
+	else if(uniform.type == RSXGL_DATA_TYPE_SAMPLER3D) {
+	  program.fp_texcoord3D.set(uniform.fp_index);
 	}
+	program.textures_enabled.set(RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS + uniform.fp_index);
       }
+    }
+  }
+
+  // Hash tables for location queries:
+  {
+    const char * names = program.names.get();
 
-      program.vp_output_mask = program.nvfx_vp -> outregs | program.nvfx_fp -> outregs;
+    program.attrib_hash.reset(program.attribs.size());
+    for(const auto & attrib : program.attribs) {
+      program.attrib_hash.insert(names,attrib.first,attrib.second.location);
     }
 
-    // Things that get accumulated:
-    // program_offsets - uint32_t's
-    // uniform_values - ieee32_t's
-    // names_size - accumulate amount of space required for attribute & uniform names
-    // attribs - map from string's to attrib_t's
-    // uniforms - map from string's to uniform_t's
-    // sampler_uniforms - map from string's to sampler_uniform_t's
-    // then iterate over attribs, uniforms, sampler uniforms, create names area
-
-    std::deque< ieee32_t > uniform_values;
-    std::deque< uint32_t > program_offsets;
-
-    struct cstr_less {
-      bool operator()(const char * lhs,const char * rhs) const {
-	return strcmp(lhs,rhs) < 0;
-      }
-    };
+    program.uniform_hash.reset(program.uniforms.size() + program.sampler_uniforms.size());
+    int32_t location = 0;
+    for(const auto & uniform : program.uniforms) {
+      program.uniform_hash.insert(names,uniform.first,location++);
+    }
+    for(const auto & uniform : program.sampler_uniforms) {
+      program.uniform_hash.insert(names,uniform.first,location++);
+    }
+  }
 
-    std::map< const char *, program_t::attrib_t, cstr_less > attribs;
-    std::map< const char *, program_t::uniform_t, cstr_less > uniforms;
-    std::map< const char *, program_t::sampler_uniform_t, cstr_less > sampler_uniforms;
-    program_t::name_size_type names_size = 0;
+  // Vertex program uniforms, in constant register order:
+  {
+    program_t::uniform_size_type num_vp_uniforms = 0;
+    for(const auto & uniform : program.uniforms) {
+      if(uniform.second.enabled.test(RSXGL_VERTEX_SHADER)) ++num_vp_uniforms;
+    }
 
-    //
-    struct gl_shader * gl_vsh = program.mesa_program->_LinkedShaders[MESA_SHADER_VERTEX];
-    struct gl_program * gl_vp = gl_vsh->Program;
-    
-    struct gl_shader * gl_fsh = program.mesa_program->_LinkedShaders[MESA_SHADER_FRAGMENT];
-    struct gl_program * gl_fp = gl_fsh->Program;
-    
-    // Process vertex program attributes:
-    {
-      program.attrib_name_max_length = 0;
-      
-      struct st_vertex_program * st_vp = st_vertex_program((struct gl_vertex_program *)gl_vp);
-      
-      exec_list *ir = gl_vsh->ir;
-      foreach_list(node, ir) {
-	const ir_variable *const var = ((ir_instruction *) node)->as_variable();
-	
-	if (var == NULL
-	    || var->mode != ir_var_in
-	    || var->location == -1
-	    || var->location < VERT_ATTRIB_GENERIC0)
-	  continue;
-
-	program_t::attrib_t attrib;
-	attrib.type = rsxgl_glsl_type_to_rsxgl_type(var->type);
-	attrib.index = st_vp -> input_to_index[var -> location];
-	attrib.location = var -> location - VERT_ATTRIB_GENERIC0;
-
-	attribs.insert(std::make_pair(var -> name,attrib));
-
-	const program_t::name_size_type name_length = strlen(var -> name);
-	program.attrib_name_max_length = std::max(program.attrib_name_max_length,(program_t::name_size_type)name_length);
-	names_size += name_length + 1;
-      }
+    program.vp_uniforms.reset(new program_t::uniform_size_type[num_vp_uniforms]);
+    program.num_vp_uniforms = num_vp_uniforms;
+
+    program_t::uniform_size_type * vp_uniforms = program.vp_uniforms.get();
+    for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i) {
+      if(program.uniforms[i].second.enabled.test(RSXGL_VERTEX_SHADER)) *vp_uniforms++ = i;
     }
-    
-    // Process program uniforms:
-    {
-      // Build vp constant map - from index into gl_vp -> Parameters to hardware index:
-      // Also deal with vertex program immediates:
-      typedef std::map< unsigned int, uint32_t > nvfx_vp_constant_map_t;
-      nvfx_vp_constant_map_t nvfx_vp_constant_map;
-      uint32_t vp_num_internal_const = 0;
-      
-      if(program.nvfx_vp != 0) {
-	const struct nvfx_vertex_program_data * vp_const = program.nvfx_vp -> consts;
-	for(unsigned int i = 0,n = program.nvfx_vp -> nr_consts;i < n;++i,++vp_const) {
-	  if(vp_const -> index == -1) {
-	    program_offsets.push_back(1);
-	    program_offsets.push_back(i);
-
-	    for(unsigned int j = 0;j < 4;++j) {
-	      ieee32_t tmp;
-	      tmp.f = vp_const -> value[j];
-	      uniform_values.push_back(tmp);
-	    }
 
-	    ++vp_num_internal_const;
-	  }
-	  else {
-	    nvfx_vp_constant_map[vp_const -> index] = i;
-	  }
-	}
-      }
+    std::sort(program.vp_uniforms.get(),program.vp_uniforms.get() + num_vp_uniforms,
+	      [&program](const program_t::uniform_size_type lhs,const program_t::uniform_size_type rhs) {
+		return program.uniforms[lhs].second.vp_index < program.uniforms[rhs].second.vp_index;
+	      });
+  }
 
-      program.vp_num_internal_const = vp_num_internal_const;
-      
-      // Build fp constant map - from index into gl_fp -> Parameters to a std::deque of offsets:
-      typedef std::map< unsigned int, std::deque< uint32_t > > nvfx_fp_constant_map_t;
-      nvfx_fp_constant_map_t nvfx_fp_constant_map;
-      
-      if(program.nvfx_fp != 0) {
-	const struct nvfx_fragment_program_data * fp_const = program.nvfx_fp -> consts;
-	for(unsigned int i = 0,n = program.nvfx_fp -> nr_consts;i < n;++i,++fp_const) {
-	  nvfx_fp_constant_map[fp_const -> index].push_back(fp_const -> offset);
-	}
-      }
-      
-#if 0
-      rsxgl_debug_printf("%i uniforms:\n",program.mesa_program -> NumUserUniformStorage);
-#endif
+  {
+    auto tmp = program_t::table_t< program_t::uniform_t >::find(program.names.get(),program.uniforms,"rsxgl_InstanceID");
+    if(tmp.second) {
+      program.instanceid_index = tmp.first -> second.vp_index;
+    }
+    else {
+      program.instanceid_index = ~0;
+    }
+  }
 
-      for(unsigned int i = 0,n = program.mesa_program -> NumUserUniformStorage;i < n;++i) {
-	const gl_uniform_storage * uniform_storage = program.mesa_program -> UniformStorage + i;
-	const glsl_type * type = uniform_storage -> type;
-	bool add_name = false;
+  program.point_sprite_control = binary.point_sprite_control;
 
-#if 0
-	rsxgl_debug_printf("\t%s type:%s num_driver_storage:%u\n",
-			   uniform_storage -> name,
-			   uniform_storage -> type -> name,
-			   uniform_storage -> num_driver_storage);
-#endif
+  program.linked = GL_TRUE;
 
-	// Non-samplers:
-	if(uniform_storage -> type -> base_type != GLSL_TYPE_SAMPLER) {
-	  program_t::uniform_t uniform;
-	  uniform.type = rsxgl_glsl_type_to_rsxgl_type(type);
-	  uniform.count = type -> matrix_columns;
+  return true;
+}
 
-#if 0
-	  rsxgl_debug_printf("\t\ttype:%u count:%u\n",(unsigned int)uniform.type,(unsigned int)uniform.count);
-#endif
+// glLinkProgram()'s work. Like rsxgl_compile_job_t, it only touches mesa's objects and its own
+// members; shaders are described by what they were when glLinkProgram() was called:
+struct rsxgl_link_job_t : public rsxgl_compiler_job_t {
+  struct shader_input_t {
+    shader_t::name_type name;
+    gl_shader * mesa_shader;
+    uint64_t source_hash;
+    bool compiled;
+
+    // If the shader's compilation hasn't been completed, this has its results; it's run before
+    // this job, since jobs are run in order:
+    std::shared_ptr< rsxgl_compile_job_t > compile;
+
+    // If compiling it was deferred (see shader_cache.h), the source to compile, and the results:
+    std::string deferred_source, info;
+  };
 
-	  uniform.values_index = uniform_values.size();
-	  std::fill_n(std::back_inserter(uniform_values),type -> vector_elements * type -> matrix_columns,ieee32_t());
-	  
-	  // Search for it in vp:
-	  // store vp index
-	  uniform.vp_index = 0;
-
-	  for(unsigned int i = 0,n = gl_vp -> Parameters -> NumParameters;i < n;++i) {
-	    gl_program_parameter * parameter = gl_vp -> Parameters -> Parameters + i;
-	    if(parameter -> Type == PROGRAM_UNIFORM && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
-	      nvfx_vp_constant_map_t::const_iterator it = nvfx_vp_constant_map.find(i);
-	      if(it != nvfx_vp_constant_map.end()) {
-		uniform.enabled.set(RSXGL_VERTEX_SHADER);
-		uniform.vp_index = it -> second;
-	      }
-	      break;
-	    }
-	  }
-	  
-	  // Search for it in fp:
-	  // for each in count:
-	  // - store an offset count n
-	  // - store n (offsets / 4)
-	  uniform.program_offsets_index = 0;
-
-	  for(unsigned int i = 0,n = gl_fp -> Parameters -> NumParameters;i < n;++i) {
-	    gl_program_parameter * parameter = gl_fp -> Parameters -> Parameters + i;
-	    if(parameter -> Type == PROGRAM_UNIFORM && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
-	      nvfx_fp_constant_map_t::const_iterator it = nvfx_fp_constant_map.find(i);
-	      if(it != nvfx_fp_constant_map.end()) {
-		uniform.enabled.set(RSXGL_FRAGMENT_SHADER);
-		uniform.program_offsets_index = program_offsets.size();
-		
-		const std::deque< uint32_t > & offsets = it -> second;
-		program_offsets.push_back(offsets.size());
-
-		for(std::deque< uint32_t >::const_iterator jt = offsets.begin(),jt_end = offsets.end();jt != jt_end;++jt) {
-		  program_offsets.push_back(*jt / 4);
-		}
-	      }
-	      break;
-	    }
-	  }
+  gl_shader_program * mesa_program;
+  std::vector< shader_input_t > shaders;
+  uint64_t link_inputs_hash;
+  bool use_cache;
+
+  // Results. binary is set if the program was found in the shader cache, or was linked:
+  uint64_t cache_key;
+  bool cache_hit;
+  std::unique_ptr< rsxgl_program_binary_t > binary;
+  nvfx_vertex_program * nvfx_vp, * nvfx_streamvp;
+  nvfx_fragment_program * nvfx_fp, * nvfx_streamfp;
+  std::string info;
 
-	  uniforms.insert(std::make_pair(uniform_storage -> name,uniform));
-	  add_name = true;
-	}
-	// Sampler:
-	else {
-	  program_t::sampler_uniform_t sampler_uniform;
-	  sampler_uniform.type = rsxgl_glsl_type_to_rsxgl_type(uniform_storage -> type);
-	  sampler_uniform.vp_index = RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;
-	  sampler_uniform.fp_index = RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;
-
-	  // Search for it in vp:
-	  for(unsigned int i = 0,n = gl_vp -> Parameters -> NumParameters;i < n;++i) {
-	    gl_program_parameter * parameter = gl_vp -> Parameters -> Parameters + i;
-	    if(parameter -> Type == PROGRAM_SAMPLER && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
-	      sampler_uniform.vp_index = (unsigned int)uniform_storage -> sampler;
-	      break;
-	    }
-	  }
-	  
-	  // Search for it in fp:
-	  for(unsigned int i = 0,n = gl_fp -> Parameters -> NumParameters;i < n;++i) {
-	    gl_program_parameter * parameter = gl_fp -> Parameters -> Parameters + i;
-	    if(parameter -> Type == PROGRAM_SAMPLER && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
-	      sampler_uniform.fp_index = (unsigned int)uniform_storage -> sampler;
-	      break;
-	    }
-	  }
+  rsxgl_link_job_t(gl_shader_program * _mesa_program,const uint64_t _link_inputs_hash)
+    : mesa_program(_mesa_program), link_inputs_hash(_link_inputs_hash), use_cache(true),
+      cache_key(0), cache_hit(false), nvfx_vp(0), nvfx_streamvp(0), nvfx_fp(0), nvfx_streamfp(0) {
+  }
 
-	  sampler_uniforms.insert(std::make_pair(uniform_storage -> name,sampler_uniform));
-	  add_name = true;
-	}
+  // Key for the shader cache, from the program's shaders and the state that affects linking;
+  // 0 if the program can't be cached:
+  uint64_t key() const {
+    std::vector< uint64_t > source_hashes;
+    for(const auto & shader : shaders) {
+      if(!(shader.compile ? shader.compile -> compiled : shader.compiled)) return 0;
+      source_hashes.push_back(shader.source_hash);
+    }
 
-	if(add_name) {
-	  const program_t::name_size_type name_length = strlen(uniform_storage -> name);
-	  program.uniform_name_max_length = std::max(program.uniform_name_max_length,(program_t::name_size_type)name_length);
-	  names_size += name_length + 1;
-	}
-      }
+    if(source_hashes.empty()) return 0;
+
+    // Shader names depend upon the order in which the application creates them:
+    std::sort(source_hashes.begin(),source_hashes.end());
+
+    uint64_t result = rsxgl_shader_cache_hash(RSXGL_SHADER_CACHE_VERSION,link_inputs_hash);
+    for(const uint64_t source_hash : source_hashes) {
+      result = rsxgl_shader_cache_hash((uint32_t)(source_hash >> 32),result);
+      result = rsxgl_shader_cache_hash((uint32_t)source_hash,result);
     }
 
-    // Migrate uniform values array:
-    program.uniform_values.reset(new ieee32_t[uniform_values.size()]);
-    std::copy(uniform_values.begin(),uniform_values.end(),program.uniform_values.get());
+    return (result != 0) ? result : 1;
+  }
 
-    // Migrate program offsets array:
-    program.program_offsets.reset(new program_t::instruction_size_type[program_offsets.size()]);
-    std::copy(program_offsets.begin(),program_offsets.end(),program.program_offsets.get());
+  void run(compiler_context_t * cctx) {
+    cache_key = (use_cache && rsxgl_shader_cache_enabled()) ? key() : 0;
+    cache_hit = false;
+    binary.reset();
+    info.clear();
 
-    // Make space for attribute and uniform names:
-#if 0
-    rsxgl_debug_printf("names require %u bytes\n",(unsigned int)names_size);
-#endif
-    program.names.reset(new char[names_size]);
-    char * pnames = program.names.get();
+    if(cache_key != 0) {
+      binary.reset(new rsxgl_program_binary_t());
+      if(rsxgl_shader_cache_find_program(cache_key,*binary)) {
+	cache_hit = true;
+	return;
+      }
+      binary.reset();
+    }
 
-    auto push_name = [&program,&pnames](const char * name) -> program_t::name_size_type {
-      program_t::name_size_type result = pnames - program.names.get();
-      while(*name != 0) {
-	*pnames++ = *name++;
+    // Compile shaders whose compilation had been deferred in hope of a cache hit:
+    for(auto & shader : shaders) {
+      if(!shader.deferred_source.empty()) {
+	cctx -> compile_shader(shader.mesa_shader,shader.deferred_source.c_str());
+	shader.compiled = shader.mesa_shader -> CompileStatus;
+	shader.info = shader.mesa_shader -> InfoLog;
       }
-      *pnames++ = 0;
-      return result;
-    };
+    }
 
-    // Migrate attributes table:
-    {
-#if 0
-      rsxgl_debug_printf("%u attribs\n",attribs.size());
-#endif
+    for(const auto & shader : shaders) {
+      cctx -> attach_shader(mesa_program,shader.mesa_shader);
+    }
 
-      program.attribs.resize(attribs.size());
-      program.attribs_enabled.reset();
+    cctx -> link_program(mesa_program);
 
-      auto it = program.attribs.begin();
-      for(const auto & name_attrib : attribs) {
 #if 0
-	rsxgl_debug_printf(" %s: type:%u index:%u\n",
-			   jt -> first,
-			   (unsigned int)jt -> second.type,
-			   (unsigned int)jt -> second.index);
+    rsxgl_debug_printf("%s result: %i info: %s\n",
+		       __PRETTY_FUNCTION__,
+		       mesa_program -> LinkStatus,
+		       mesa_program -> InfoLog);
 #endif
 
-	*it++ = std::make_pair(push_name(name_attrib.first),name_attrib.second);
+    info = mesa_program -> InfoLog;
 
-	program.attribs_enabled.set(name_attrib.second.index);
-	program.attrib_assignments.set(name_attrib.second.index,name_attrib.second.location);
-      }
+    if(mesa_program -> LinkStatus) {
+      binary.reset(new rsxgl_program_binary_t());
+      rsxgl_program_translate(cctx,mesa_program,*binary,nvfx_vp,nvfx_fp,nvfx_streamvp,nvfx_streamfp);
     }
+  }
+};
 
-    // Migrate uniforms table:
-    {
-#if 0
-      rsxgl_debug_printf("%u uniforms\n",uniforms.size());
-#endif
+// Copy the results of linking a program into it; called with rsxgl_compiler_lock held:
+static void
+rsxgl_program_finish_link(program_t & program,rsxgl_link_job_t & job)
+{
+  std::string info = job.info;
+
+  // Shaders that were compiled because the program wasn't in the cache, unless the application
+  // has given them new source since:
+  for(const auto & input : job.shaders) {
+    if(input.deferred_source.empty() || !shader_t::storage().is_object(input.name)) continue;
+
+    shader_t & shader = shader_t::storage().at(input.name);
+    if(shader.compile_deferred && !shader.pending && shader.source_hash == input.source_hash) {
+      shader.compile_deferred = 0;
+      shader.deferred_source.clear();
+      shader.compiled = input.compiled;
+      shader.info = input.info;
+    }
+  }
 
-      program.uniforms.resize(uniforms.size());
+  if(job.binary) {
+    program.nvfx_vp = job.nvfx_vp;
+    program.nvfx_fp = job.nvfx_fp;
+    program.nvfx_streamvp = job.nvfx_streamvp;
+    program.nvfx_streamfp = job.nvfx_streamfp;
 
-      unsigned int i = 0;
-      auto it = program.uniforms.begin();
-      for(const auto & name_uniform : uniforms) {
-#if 0
-	rsxgl_debug_printf(" %s: type:%u count:%u values_index:%u vp_index:%u program_offsets_index:%u\n",
-			   value.first,
-			   (unsigned int)value.second.type,
-			   (unsigned int)value.second.count,
-			   (unsigned int)value.second.values_index,
-			   (unsigned int)value.second.vp_index,
-			   (unsigned int)value.second.program_offsets_index);
-#endif
+    // Move attached shaders to linked shaders:
+    program.linked_shaders = program.attached_shaders;
 
-	*it++ = std::make_pair(push_name(name_uniform.first),name_uniform.second);
+    // Start a new attached shaders array:
+    program.attached_shaders.clear();
+
+    if(rsxgl_program_load(program,*job.binary,info)) {
+      if(job.cache_key != 0) {
+	rsxgl_shader_cache_insert_program(job.cache_key,*job.binary);
       }
+      program.binary = std::move(job.binary);
     }
+  }
 
-    // Migrate texture table:
-    program.fp_texcoords.reset();
-    program.fp_texcoord2D.reset();
-    program.fp_texcoord3D.reset();
-    program.textures_enabled.reset();
+  std::swap(program.info,info);
+}
 
-    for(unsigned int i = 0;i < RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;++i) {
-      program.texture_assignments.set(i,0);
-    }
+void
+rsxgl_program_complete_pending(program_t & program)
+{
+  std::shared_ptr< rsxgl_link_job_t > job;
+  {
+    rsxgl_spinlock_guard guard(rsxgl_compiler_lock);
+    job = program.pending;
+  }
+  if(!job) return;
 
-    {
-#if 0
-      rsxgl_debug_printf("%u sampler uniforms\n",sampler_uniforms.size());
-#endif
+  rsxgl_compiler_job_wait(*job);
 
-      program.sampler_uniforms.resize(sampler_uniforms.size());
+  {
+    // Another thread, sharing this program, may have got here first:
+    rsxgl_spinlock_guard compiler_guard(rsxgl_compiler_lock);
+    if(program.pending != job) return;
+    program.pending.reset();
 
-      auto it = program.sampler_uniforms.begin();
-      for(const auto & name_uniform : sampler_uniforms) {
-#if 0
-	rsxgl_debug_printf(" %s: type:%u vp_index:%u fp_index:%u\n",
-			   value.first,
-			   (unsigned int)value.second.type,
-			   (unsigned int)value.second.vp_index,
-			   (unsigned int)value.second.fp_index);
-#endif
+    if(!job -> cache_hit) {
+      rsxgl_program_finish_link(program,*job);
+      return;
+    }
 
-	*it++ = std::make_pair(push_name(name_uniform.first),name_uniform.second);
+    std::string info = job -> info;
+    if(rsxgl_program_load(program,*job -> binary,info)) {
+      program.linked_shaders = program.attached_shaders;
+      program.attached_shaders.clear();
+      program.binary = std::move(job -> binary);
 
-	if(name_uniform.second.vp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
-	  program.textures_enabled.set(name_uniform.second.vp_index);
-	}
-	if(name_uniform.second.fp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
-	  program.fp_texcoords.set(name_uniform.second.fp_index);
-	  if(name_uniform.second.type == RSXGL_DATA_TYPE_SAMPLER2D) {
-	    program.fp_texcoord2D.set(name_uniform.second.fp_index);
-	  }
-	  else if(name_uniform.second.type == RSXGL_DATA_TYPE_SAMPLER3D) {
-	    program.fp_texcoord3D.set(name_uniform.second.fp_index);
-	  }
-	  program.textures_enabled.set(RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS + name_uniform.second.fp_index);
-	}
-      }
+      std::swap(program.info,info);
+      return;
     }
 
-    {
-      //program_t::uniform_table_type::type table = program.uniform_table();
-      //const std::pair< bool, program_t::uniform_size_type > tmp = const_cast< const program_t & > (program).uniform_table().find(const_cast< const program_t & > (program).names(),"rsxgl_InstanceID");
-      auto tmp = program_t::table_t< program_t::uniform_t >::find(program.names.get(),program.uniforms,"rsxgl_InstanceID");
-      if(tmp.second) {
-	program.instanceid_index = tmp.first -> second.vp_index;
-      }
-      else {
-	program.instanceid_index = ~0;
-      }
-    }
+    rsxgl_program_reset(program);
+  }
 
-    // TODO: deal with this:
-    program.point_sprite_control = 0;
+  // Fall back to compiling the program, here. The job is no longer pending, so no other thread
+  // will complete it:
+  job -> use_cache = false;
+  rsxgl_compiler_job_run(*job,current_ctx() -> compiler_context());
 
-    // Create stream programs if any varyings are captured.
-    // This seems to clobber the original vertex program's data such that the main rendering program's
-    // attribute assignments get messed up. This isn't good, but, for now, creating the stream programs
-    // takes place after RSXGL is otherwise finished creating the rendering programs.
-    if(stream_info.num_outputs > 0) {
-#if 0
-      rsxgl_debug_printf("VP stream outputs: %u\n",stream_info.num_outputs);
-#endif
+  rsxgl_spinlock_guard compiler_guard(rsxgl_compiler_lock);
 
-      unsigned int vertexid_index = 0;
-      std::tie(program.nvfx_streamvp,program.nvfx_streamfp) = cctx -> translate_stream_vp_fp(program.mesa_program,&stream_info,vp_tokens,&vertexid_index);
-      rsxgl_assert(program.nvfx_streamvp != 0);
-      rsxgl_assert(program.nvfx_streamfp != 0);
-      
-      cctx -> link_vp_fp(program.nvfx_streamvp,program.nvfx_streamfp);
+  // The program was linked again, by another thread sharing it, in the meantime:
+  if(program.pending) return;
 
-#if 0
-      // Dump VP: microcode:
-      {
-	rsxgl_debug_printf("VP microcode: %u instructions\n",program.nvfx_streamvp -> nr_insns);
-	for(unsigned int i = 0,n = program.nvfx_streamvp -> nr_insns;i < n;++i) {
-	  rsxgl_debug_printf("%04u: %x %x %x %x\n",i,
-			     program.nvfx_streamvp -> insns[i].data[0],
-			     program.nvfx_streamvp -> insns[i].data[1],
-			     program.nvfx_streamvp -> insns[i].data[2],
-			     program.nvfx_streamvp -> insns[i].data[3]);
-	}
+  rsxgl_program_finish_link(program,*job);
+}
 
-	
-      }
-      
-      // Dump FP microcode:
-      {
-	rsxgl_debug_printf("FP microcode: %u instructions\n",program.nvfx_streamfp -> insn_len / 4);
-	for(unsigned int i = 0,n = program.nvfx_streamfp -> insn_len / 4;i < n;++i) {
-	  rsxgl_debug_printf("%04u: %08x %08x %08x %08x\n",i,
-			     program.nvfx_streamfp -> insn[i*4],
-			     program.nvfx_streamfp -> insn[i*4+1],
-			     program.nvfx_streamfp -> insn[i*4+2],
-			     program.nvfx_streamfp -> insn[i*4+3]);
-	}
+GLAPI void APIENTRY
+glLinkProgram (GLuint program_name)
+{
+  rsxgl_context_t * ctx = current_ctx();
 
-	rsxgl_debug_printf("streamfp slots:\n");
-	for(unsigned int i = 0;i < program.nvfx_streamfp -> num_slots;++i) {
-	  rsxgl_debug_printf("\t%u: %u %u\n",i,
-			     program.nvfx_streamfp -> slot_to_generic[i],
-			     program.nvfx_streamvp -> generic_to_fp_input[program.nvfx_streamfp -> slot_to_generic[i]]);
-	}
-      }
-#endif
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
 
-      //
-      // Migrate vertex program microcode to cache-aligned memory:
-      {
-	static const std::string kVPUcodeAllocFail("Failed to allocate space for stream vertex program microcode");
-	
-	struct nvfx_vertex_program_exec * address = (struct nvfx_vertex_program_exec *)mspace_memalign(rsxgl_main_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_streamvp -> nr_insns * sizeof(struct nvfx_vertex_program_exec));
-	if(address == 0) {
-	  info += kVPUcodeAllocFail;
-	  //goto fail;
-	}
-	else {
-	  program.streamvp_ucode_offset = rsxgl_vp_ucode_offset(address);
-	  
-	  memcpy(address,program.nvfx_streamvp -> insns,program.nvfx_streamvp -> nr_insns * sizeof(struct nvfx_vertex_program_exec));
-	  
-	  program.streamvp_num_insn = program.nvfx_streamvp -> nr_insns;
-	  program.streamvp_input_mask = program.nvfx_streamvp -> ir;
-	}
-      }
-      
-      // Migrate fragment program microcode to RSX memory, performing endian swap along the way:
-      {
-	static const std::string kFPUcodeAllocFail("Failed to allocate space for stream fragment program microcode");
-	
-	uint32_t * address = (uint32_t *)mspace_memalign(rsxgl_rsx_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_streamfp -> insn_len * sizeof(uint32_t));
-	if(address == 0) {
-	  info += kFPUcodeAllocFail;
-	  //goto fail;
-	}
-	else {
-	  program.streamfp_ucode_offset = rsxgl_rsx_ucode_offset(address);
-	  
-	  //memcpy(address,program.nvfx_streamfp -> insn,program.nvfx_streamfp -> insn_len * sizeof(uint32_t));
-	  for(unsigned int i = 0,n = program.nvfx_streamfp -> insn_len;i < n;++i) {
-	    address[i] = endian_fp(program.nvfx_streamfp -> insn[i]);
-	  }
-	  
-	  program.streamfp_num_insn = program.nvfx_streamfp -> insn_len / 4;
-	  program.streamfp_control = program.nvfx_streamfp -> fp_control;
-	  program.streamfp_num_outputs = stream_info.num_outputs;
-	}
-      }
+  if((ctx -> state.enable.transform_feedback_mode != 0) && (ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] == program_name)) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
 
-      program.streamvp_output_mask = program.nvfx_streamvp -> outregs | program.nvfx_streamfp -> outregs;
-      program.streamvp_vertexid_index = vertexid_index;
-    }
-    else {
-      program.nvfx_streamvp = 0;
-      program.nvfx_streamfp = 0;
-      program.streamvp_ucode_offset = ~0;
-      program.streamfp_ucode_offset = ~0;
-      program.streamvp_num_insn = 0;
-      program.streamfp_num_insn = 0;
-      program.streamvp_input_mask = 0;
-      program.streamvp_output_mask = 0;
-      program.streamvp_num_internal_const = 0;
-      program.streamfp_control = 0;
-      program.streamfp_num_outputs = 0;
-      program.streamvp_vertexid_index = ~0;
+  program_t & program = program_t::storage().at(program_name);
+
+  // The results of linking it before mustn't overwrite these:
+  rsxgl_program_complete(program);
+
+  // TODO: orphan it, instead of doing this:
+  if(program.timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,program.timestamp);
+    program.timestamp = 0;
+  }
+
+  std::shared_ptr< rsxgl_link_job_t > job = std::make_shared< rsxgl_link_job_t >(program.mesa_program,program.link_inputs_hash);
+
+  for(shader_t::name_type name : program.attached_shaders) {
+    const shader_t & shader = shader_t::storage().at(name);
+
+    rsxgl_link_job_t::shader_input_t input;
+    input.name = name;
+    input.mesa_shader = shader.mesa_shader;
+    input.source_hash = shader.source_hash;
+    input.compiled = shader.compiled;
+    input.compile = shader.pending;
+    if(shader.compile_deferred) {
+      input.deferred_source = shader.deferred_source;
     }
 
-    program.linked = GL_TRUE;
+    job -> shaders.push_back(input);
+  }
 
-#if 0
-    rsxgl_debug_printf("wrote %u names bytes\n",(unsigned int)(pnames - program.names.get()));
-#endif
+  {
+    rsxgl_spinlock_guard compiler_guard(rsxgl_compiler_lock);
+    rsxgl_program_reset(program);
   }
-  
+
+  program.info.clear();
+  program.pending = job;
+  rsxgl_compiler_thread_run(job,ctx -> compiler_context(),ctx -> screen());
+
+  // It was linked on this thread:
+  if(rsxgl_compiler_job_done(*job)) {
+    rsxgl_program_complete_pending(program);
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glGetProgramBinary (GLuint program_name, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, GLvoid *binary)
+{
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
+
+  if(!program.linked || !program.binary) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  const size_t size = rsxgl_program_binary_size(*program.binary);
+  if(bufSize < 0 || (size_t)bufSize < size) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  rsxgl_program_binary_write(*program.binary,binary);
+
+  if(length != 0) *length = size;
+  if(binaryFormat != 0) *binaryFormat = RSXGL_PROGRAM_BINARY_FORMAT;
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glProgramBinary (GLuint program_name, GLenum binaryFormat, const GLvoid *binary, GLsizei length)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  if(binaryFormat != RSXGL_PROGRAM_BINARY_FORMAT) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  if((ctx -> state.enable.transform_feedback_mode != 0) && (ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] == program_name)) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  if(length < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  // A binary from another version only causes the link to fail; the application is expected to
+  // compile the program from source instead. One that passes its checksum but refers to things
+  // it doesn't contain is an error, and leaves the program alone:
+  std::unique_ptr< rsxgl_program_binary_t > image(new rsxgl_program_binary_t());
+  const rsxgl_program_binary_status status = rsxgl_program_binary_read(*image,binary,length);
+
+  if(status == RSXGL_PROGRAM_BINARY_MALFORMED) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
+
+  if(program.timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,program.timestamp);
+    program.timestamp = 0;
+  }
+
+  rsxgl_spinlock_guard compiler_guard(rsxgl_compiler_lock);
+
+  rsxgl_program_reset(program);
+
+  static const std::string kInvalidBinary("Invalid program binary");
+
+  std::string info;
+
+  if(status != RSXGL_PROGRAM_BINARY_OK) {
+    info += kInvalidBinary;
+  }
+  else if(rsxgl_program_load(program,*image,info)) {
+    program.binary = std::move(image);
+  }
+
   std::swap(program.info,info);
 
   RSXGL_NOERROR_();
@@ -1243,6 +1410,7 @@ glValidateProgram (GLuint program_name)
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(program.linked) {
     program.validated = GL_TRUE;
@@ -1273,12 +1441,14 @@ glUseProgram (GLuint program_name)
     ctx -> invalid.parts.program = 1;
 
     if(program_name != 0) {
-      const program_t & program = program_t::storage().at(program_name);
+      program_t & program = program_t::storage().at(program_name);
+      rsxgl_program_complete(program);
 
       ctx -> state.enable.transform_feedback_program = (program.streamvp_num_insn > 0 && program.streamfp_num_insn > 0);
       
       if(prev_program_name != 0) {
-	const program_t & prev_program = program_t::storage().at(prev_program_name);
+	program_t & prev_program = program_t::storage().at(prev_program_name);
+	rsxgl_program_complete(prev_program);
 
 	{
 	  const program_t::attribs_bitfield_type
@@ -1338,10 +1508,13 @@ glBindAttribLocation (GLuint program_name, GLuint index, const GLchar* name)
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   compiler_context_t * cctx = current_ctx() -> compiler_context();
   cctx -> bind_attrib_location(program.mesa_program,index,name);
 
+  program.link_inputs_hash = rsxgl_shader_cache_hash(name,rsxgl_shader_cache_hash(index,rsxgl_shader_cache_hash((uint32_t)GL_VERTEX_SHADER,program.link_inputs_hash)));
+
   RSXGL_NOERROR_();
 }
 
@@ -1356,7 +1529,8 @@ glGetActiveAttrib (GLuint program_name, GLuint index, GLsizei bufsize, GLsizei*
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  const program_t & program = program_t::storage().at(program_name);
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(!program.linked) {
     if(length != 0) *length = 0;
@@ -1412,20 +1586,31 @@ glGetAttribLocation (GLuint program_name, const GLchar* name)
     RSXGL_ERROR(GL_INVALID_VALUE,-1);
   }
 
-  const program_t & program = program_t::storage().at(program_name);
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(!program.linked) {
     RSXGL_NOERROR(-1);
   }
 
-  auto tmp = program_t::table_t< program_t::attrib_t >::find(program.names.get(),program.attribs,name);
+  RSXGL_NOERROR(program.attrib_hash.find(program.names.get(),rsxgl_name_hash(name),name));
+}
 
-  if(tmp.second) {
-    RSXGL_NOERROR(tmp.first -> second.location);
+GLAPI GLint APIENTRY
+glGetAttribLocationHashRSX (GLuint program_name, GLuint hash, const GLchar* name)
+{
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR(GL_INVALID_VALUE,-1);
   }
-  else {
+
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
+
+  if(!program.linked) {
     RSXGL_NOERROR(-1);
   }
+
+  RSXGL_NOERROR(program.attrib_hash.find(program.names.get(),hash,name));
 }
 
 GLAPI void APIENTRY
@@ -1439,7 +1624,8 @@ glGetActiveUniform (GLuint program_name, GLuint index, GLsizei bufSize, GLsizei
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  const program_t & program = program_t::storage().at(program_name);
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(!program.linked) {
     if(length != 0) *length = 0;
@@ -1527,27 +1713,41 @@ glGetUniformLocation (GLuint program_name, const GLchar* name)
     RSXGL_ERROR(GL_INVALID_VALUE,-1);
   }
 
-  const program_t & program = program_t::storage().at(program_name);
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(!program.linked) {
     RSXGL_NOERROR(-1);
   }
 
-  auto tmp = program_t::table_t< program_t::uniform_t >::find(program.names.get(),program.uniforms,name);
+  RSXGL_NOERROR(program.uniform_hash.find(program.names.get(),rsxgl_name_hash(name),name));
+}
+
+GLAPI GLint APIENTRY
+glGetUniformLocationHashRSX (GLuint program_name, GLuint hash, const GLchar* name)
+{
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR(GL_INVALID_VALUE,-1);
+  }
+
+  program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
-  if(tmp.second) {
-    RSXGL_NOERROR(std::distance(program.uniforms.begin(),tmp.first));
+  if(!program.linked) {
+    RSXGL_NOERROR(-1);
   }
-  else {
-    auto tmp2 = program_t::table_t< program_t::sampler_uniform_t >::find(program.names.get(),program.sampler_uniforms,name);
 
-    if(tmp2.second) {
-      RSXGL_NOERROR(program.uniforms.size() + std::distance(program.sampler_uniforms.begin(),tmp2.first));
-    }
-    else {
-      RSXGL_NOERROR(-1);
-    }
+  RSXGL_NOERROR(program.uniform_hash.find(program.names.get(),hash,name));
+}
+
+GLAPI GLuint APIENTRY
+glGetNameHashRSX (const GLchar* name)
+{
+  if(name == 0) {
+    RSXGL_ERROR(GL_INVALID_VALUE,0);
   }
+
+  RSXGL_NOERROR(rsxgl_name_hash(name));
 }
 
 GLAPI void APIENTRY
@@ -1562,9 +1762,12 @@ glBindFragDataLocation (GLuint program_name, GLuint color, const GLchar *name)
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   compiler_context_t * cctx = current_ctx() -> compiler_context();
   cctx -> bind_frag_data_location(program.mesa_program,color,name);
+
+  program.link_inputs_hash = rsxgl_shader_cache_hash(name,rsxgl_shader_cache_hash(color,rsxgl_shader_cache_hash((uint32_t)GL_FRAGMENT_SHADER,program.link_inputs_hash)));
   
   RSXGL_NOERROR_();
 }
@@ -1577,6 +1780,7 @@ glGetFragDataLocation (GLuint program_name, const GLchar *name)
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   // TODO: implement this
 
@@ -1595,9 +1799,15 @@ glTransformFeedbackVaryings (GLuint program_name, GLsizei count, const GLchar* *
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   compiler_context_t * cctx = current_ctx() -> compiler_context();
   cctx -> transform_feedback_varyings(program.mesa_program,count,varyings,bufferMode);
+
+  program.link_inputs_hash = rsxgl_shader_cache_hash((uint32_t)count,rsxgl_shader_cache_hash((uint32_t)bufferMode,program.link_inputs_hash));
+  for(GLsizei i = 0;i < count;++i) {
+    program.link_inputs_hash = rsxgl_shader_cache_hash(varyings[i],program.link_inputs_hash);
+  }
   
   RSXGL_NOERROR_();
 }
@@ -1613,6 +1823,61 @@ glGetTransformFeedbackVarying (GLuint program_name, GLuint index, GLsizei bufSiz
   RSXGL_NOERROR_();
 }
 
+// Make a vertex program active, uploading it first if it isn't already resident in the RSX's
+// vertex program memory:
+static void
+rsxgl_vp_load(rsxgl_context_t * ctx,const uint32_t serial,
+	      const struct nvfx_vertex_program_exec * ucode,const uint32_t num_insn,
+	      const program_t::instruction_size_type * relocs,const uint32_t num_relocs,
+	      const uint32_t input_mask,const uint32_t output_mask)
+{
+  gcmContextData * context = ctx -> base.gcm_context;
+
+  uint32_t start = 0;
+  if(!ctx -> vp_cache.lookup(serial,num_insn,start)) {
+    const uint32_t n = 2 + (num_insn * 5);
+    uint32_t * buffer = gcm_reserve(context,n);
+
+    gcm_emit_method_at(buffer,0,NV30_3D_VP_UPLOAD_FROM_ID,1);
+    gcm_emit_at(buffer,1,start);
+
+    uint32_t * insn = buffer + 2;
+    for(uint32_t i = 0;i < num_insn;++i,++ucode,insn += 5) {
+      gcm_emit_method_at(insn,0,NV30_3D_VP_UPLOAD_INST(0),4);
+      gcm_emit_at(insn,1,ucode -> data[0]);
+      gcm_emit_at(insn,2,ucode -> data[1]);
+      gcm_emit_at(insn,3,ucode -> data[2]);
+      gcm_emit_at(insn,4,ucode -> data[3]);
+    }
+
+    // Branch targets are relative to the start of the program; patch the copy in the
+    // command buffer:
+    for(uint32_t i = 0;i < num_relocs;++i,relocs += 2) {
+      uint32_t * hw = buffer + 2 + (relocs[0] * 5) + 1;
+      const uint32_t target = start + relocs[1];
+
+      hw[3] &= ~NV40_VP_INST_IADDRL_MASK;
+      hw[3] |= (target & 7) << NV40_VP_INST_IADDRL_SHIFT;
+
+      hw[2] &= ~NV40_VP_INST_IADDRH_MASK;
+      hw[2] |= ((target >> 3) & 0x3f) << NV40_VP_INST_IADDRH_SHIFT;
+    }
+
+    gcm_finish_n_commands(context,n);
+  }
+
+  uint32_t * buffer = gcm_reserve(context,5);
+
+  gcm_emit_method_at(buffer,0,NV30_3D_VP_START_FROM_ID,1);
+  gcm_emit_at(buffer,1,start);
+
+  gcm_emit_method_at(buffer,2,NV40_3D_VP_ATTRIB_EN,2);
+  gcm_emit_at(buffer,3,input_mask);
+  gcm_emit_at(buffer,4,output_mask);
+
+  gcm_finish_n_commands(context,5);
+}
+
 void
 rsxgl_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
 {
@@ -1621,7 +1886,7 @@ rsxgl_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
   if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] != 0) {
     program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
 
-    rsxgl_assert(timestamp >= program.timestamp);
+    rsxgl_assert(rsxgl_timestamp_ordered(program.timestamp,timestamp));
     program.timestamp = timestamp;    
   }
 
@@ -1631,54 +1896,26 @@ rsxgl_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
       
       if(program.linked) {
 	// load the vertex program:
-	{
-	  uint32_t * buffer = gcm_reserve(context,program.vp_num_insn * 5 + 7);
-	  
-	  gcm_emit_method(&buffer,NV30_3D_VP_UPLOAD_FROM_ID,1);
-	  gcm_emit(&buffer,0);
-	  
-	  const struct nvfx_vertex_program_exec * ucode = rsxgl_main_ucode_address(program.vp_ucode_offset);
-	  for(size_t i = 0,n = program.vp_num_insn;i < n;++i,++ucode) {
-	    gcm_emit_method(&buffer,NV30_3D_VP_UPLOAD_INST(0),4);
-	    gcm_emit(&buffer,ucode -> data[0]);
-	    gcm_emit(&buffer,ucode -> data[1]);
-	    gcm_emit(&buffer,ucode -> data[2]);
-	    gcm_emit(&buffer,ucode -> data[3]);
-	  }
-	  
-	  gcm_emit_method(&buffer,NV30_3D_VP_START_FROM_ID,1);
-	  gcm_emit(&buffer,0);
-	  
-	  gcm_emit_method(&buffer,NV40_3D_VP_ATTRIB_EN,2);
-	  gcm_emit(&buffer,program.vp_input_mask);
-	  gcm_emit(&buffer,program.vp_output_mask);
-	  
-	  gcm_finish_commands(context,&buffer);
-	}
+	rsxgl_vp_load(ctx,program.vp_ucode_serial,rsxgl_main_ucode_address(program.vp_ucode_offset),program.vp_num_insn,
+		      program.vp_branch_relocs.get(),program.vp_num_branch_relocs,
+		      program.vp_input_mask,program.vp_output_mask);
 	
 	// load vertex program internal constants:
 	if(program.vp_num_internal_const > 0) {
 	  const program_t::instruction_size_type * program_offsets = program.program_offsets.get();
 	  const ieee32_t * uniform_values = program.uniform_values.get();
+	  rsxgl_vp_constant_batch_t batch(context);
 	  
 	  for(program_t::uniform_size_type i = 0,n = program.vp_num_internal_const;i < n;++i) {
 	    program_t::instruction_size_type count = *program_offsets++;
 	    program_t::instruction_size_type index = *program_offsets++;
 	    
-	    uint32_t * buffer = gcm_reserve(context,6 * count);
-	    
 	    for(;count > 0;--count,++index,uniform_values += 4) {
-	      gcm_emit_method(&buffer,NV30_3D_VP_UPLOAD_CONST_ID,5);
-	      gcm_emit(&buffer,index);
-	      
-	      gcm_emit(&buffer,uniform_values[0].u);
-	      gcm_emit(&buffer,uniform_values[1].u);
-	      gcm_emit(&buffer,uniform_values[2].u);
-	      gcm_emit(&buffer,uniform_values[3].u);
+	      batch.push(index,uniform_values,4);
 	    }
-	    
-	    gcm_finish_commands(context,&buffer);
 	  }
+
+	  batch.flush();
 	}
 	
 	// load the fragment program:
@@ -1823,7 +2060,7 @@ rsxgl_feedback_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
   if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] != 0) {
     program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
 
-    rsxgl_assert(timestamp >= program.timestamp);
+    rsxgl_assert(rsxgl_timestamp_ordered(program.timestamp,timestamp));
     program.timestamp = timestamp;    
   }
 
@@ -1832,31 +2069,9 @@ rsxgl_feedback_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
     
     if(program.linked) {
       // load the vertex program:
-      {
-	uint32_t * buffer = gcm_reserve(context,program.streamvp_num_insn * 5 + 7);
-	
-	gcm_emit_method(&buffer,NV30_3D_VP_UPLOAD_FROM_ID,1);
-	gcm_emit(&buffer,0);
-
-	const struct nvfx_vertex_program_exec * ucode = rsxgl_main_ucode_address(program.streamvp_ucode_offset);
-	for(size_t i = 0,n = program.streamvp_num_insn;i < n;++i,++ucode) {
-	  gcm_emit_method(&buffer,NV30_3D_VP_UPLOAD_INST(0),4);
-
-	  gcm_emit(&buffer,ucode -> data[0]);
-	  gcm_emit(&buffer,ucode -> data[1]);
-	  gcm_emit(&buffer,ucode -> data[2]);
-	  gcm_emit(&buffer,ucode -> data[3]);
-	}
-	
-	gcm_emit_method(&buffer,NV30_3D_VP_START_FROM_ID,1);
-	gcm_emit(&buffer,0);
-	
-	gcm_emit_method(&buffer,NV40_3D_VP_ATTRIB_EN,2);
-	gcm_emit(&buffer,program.streamvp_input_mask);
-	gcm_emit(&buffer,program.streamvp_output_mask);
-	
-	gcm_finish_commands(context,&buffer);
-      }
+      rsxgl_vp_load(ctx,program.streamvp_ucode_serial,rsxgl_main_ucode_address(program.streamvp_ucode_offset),program.streamvp_num_insn,
+		    program.streamvp_branch_relocs.get(),program.streamvp_num_branch_relocs,
+		    program.streamvp_input_mask,program.streamvp_output_mask);
 
 #if 0      
       // load vertex program internal constants:
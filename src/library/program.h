@@ -12,10 +12,12 @@
 #include "gl_object_storage.h"
 #include "ieee32_t.h"
 #include "compiler_context.h"
+#include "program_binary.h"
 
 #include <memory>
 #include <string>
 #include <cstddef>
+#include <cstring>
 #include <cassert>
 #include <vector>
 #include <utility>
@@ -28,26 +30,21 @@ enum rsxgl_program_target {
   RSXGL_MAX_PROGRAM_TARGETS = 1
 };
 
-enum rsxgl_shader_types {
-  RSXGL_VERTEX_SHADER = 0,
-  RSXGL_FRAGMENT_SHADER = 1,
-  RSXGL_MAX_SHADER_TYPES = 2
-};
-
-enum rsxgl_data_types {
-  RSXGL_DATA_TYPE_FLOAT = 0,
-  RSXGL_DATA_TYPE_FLOAT2 = 1,
-  RSXGL_DATA_TYPE_FLOAT3 = 2,
-  RSXGL_DATA_TYPE_FLOAT4 = 3,
-  RSXGL_DATA_TYPE_FLOAT4x4 = 4,
-  RSXGL_DATA_TYPE_SAMPLER1D = 5,
-  RSXGL_DATA_TYPE_SAMPLER2D = 6,
-  RSXGL_DATA_TYPE_SAMPLER3D = 7,
-  RSXGL_DATA_TYPE_SAMPLERCUBE = 8,
-  RSXGL_DATA_TYPE_SAMPLERRECT = 9,
-  RSXGL_MAX_DATA_TYPES = 10,
-  RSXGL_DATA_TYPE_UNKNOWN = 10
-};
+// 32-bit FNV-1a hash of a uniform or attribute name, as used by glGetUniformLocationHashRSX()
+// and glGetAttribLocationHashRSX():
+static inline uint32_t
+rsxgl_name_hash(const char * name)
+{
+  uint32_t hash = 2166136261U;
+  for(;*name != 0;++name) {
+    hash = (hash ^ (uint8_t)*name) * 16777619U;
+  }
+  return hash;
+}
+
+// Work that glCompileShader() & glLinkProgram() leave to the compiler thread:
+struct rsxgl_compile_job_t;
+struct rsxgl_link_job_t;
 
 struct shader_t {
   typedef gl_object< shader_t, RSXGL_MAX_SHADERS > gl_object_type;
@@ -60,13 +57,22 @@ struct shader_t {
   ~shader_t();
 
   // --- cold:
-  uint32_t type:2,compiled:1,deleted:1,ref_count:28;
+  uint32_t type:2,compiled:1,deleted:1,compile_deferred:1,ref_count:27;
 
   std::string source;
+
+  // Hash of the type and source, for the shader cache. If the cache had already seen the
+  // source compile successfully, compiling it is deferred until a program that uses it is
+  // linked and isn't found in the cache; deferred_source is what was compiled:
+  uint64_t source_hash;
+  std::string deferred_source;
   std::unique_ptr< uint8_t[] > binary;
   std::string info;
 
   gl_shader * mesa_shader;
+
+  // Set while glCompileShader()'s results haven't been copied into this object:
+  std::shared_ptr< rsxgl_compile_job_t > pending;
 };
 
 struct program_t {
@@ -93,6 +99,10 @@ struct program_t {
   // Information returned from glLinkProgram():
   std::string info;
 
+  // Hash of the attribute & fragment data bindings, and of the transform feedback varyings,
+  // in the order in which they were specified; part of the shader cache's key:
+  uint64_t link_inputs_hash;
+
   // Accumulate all of the names used by this program:
   typedef uint32_t name_size_type;
   std::unique_ptr< char[] > names;
@@ -133,6 +143,65 @@ struct program_t {
     }
   };
 
+  // Open-addressed hash table, built by glLinkProgram(), that maps names to the locations
+  // that glGetUniformLocation() and glGetAttribLocation() return. Names are hashed with
+  // rsxgl_name_hash(); applications may precompute those hashes.
+  struct hash_table_t {
+    struct slot_t {
+      uint32_t hash;
+      name_size_type name;
+      int32_t value;
+    };
+
+    std::unique_ptr< slot_t[] > slots;
+    uint32_t mask;
+
+    hash_table_t() : mask(0) {
+    }
+
+    // Make room for n names, and empty the table:
+    void reset(const uint32_t n) {
+      if(n == 0) {
+	slots.reset();
+	mask = 0;
+	return;
+      }
+
+      // Keep the load factor at or below 1/2:
+      uint32_t size = 2;
+      while(size < (n * 2)) size <<= 1;
+
+      slots.reset(new slot_t[size]);
+      mask = size - 1;
+      for(uint32_t i = 0;i < size;++i) {
+	slots[i].value = -1;
+      }
+    }
+
+    void insert(const char * names,const name_size_type name,const int32_t value) {
+      rsxgl_assert(slots);
+      const uint32_t hash = rsxgl_name_hash(names + name);
+      uint32_t i = hash & mask;
+      while(slots[i].value != -1) {
+	i = (i + 1) & mask;
+      }
+      slots[i].hash = hash;
+      slots[i].name = name;
+      slots[i].value = value;
+    }
+
+    // key may be null, in which case the first name with a matching hash is found:
+    int32_t find(const char * names,const uint32_t hash,const char * key) const {
+      if(!slots) return -1;
+      for(uint32_t i = hash & mask;slots[i].value != -1;i = (i + 1) & mask) {
+	if(slots[i].hash == hash && (key == 0 || strcmp(names + slots[i].name,key) == 0)) {
+	  return slots[i].value;
+	}
+      }
+      return -1;
+    }
+  };
+
   // Tables of attributes, uniform variables, and texture maps:
   struct attrib_t {
     uint8_t type;
@@ -155,9 +224,19 @@ struct program_t {
   table_t< uniform_t >::type uniforms;
   table_t< sampler_uniform_t >::type sampler_uniforms;
 
+  // attrib_hash maps to attribute locations; uniform_hash maps to indices into uniforms, or,
+  // for sampler uniforms, uniforms.size() plus their index into sampler_uniforms:
+  hash_table_t attrib_hash, uniform_hash;
+
   name_size_type attrib_name_max_length, uniform_name_max_length;
 
   gl_shader_program * mesa_program;
+
+  // Set while glLinkProgram()'s results haven't been copied into this object:
+  std::shared_ptr< rsxgl_link_job_t > pending;
+
+  // What glLinkProgram() or glProgramBinary() loaded into this program, for glGetProgramBinary():
+  std::unique_ptr< rsxgl_program_binary_t > binary;
   nvfx_vertex_program * nvfx_vp, * nvfx_streamvp;
   nvfx_fragment_program * nvfx_fp, * nvfx_streamfp;
 
@@ -173,6 +252,28 @@ struct program_t {
   ucode_offset_type vp_ucode_offset, fp_ucode_offset, streamvp_ucode_offset, streamfp_ucode_offset;
   instruction_size_type vp_num_insn, fp_num_insn, streamvp_num_insn, streamfp_num_insn;
 
+  // Identifies the vertex programs in each context's rsxgl_vp_cache_t; assigned when the
+  // program is linked:
+  uint32_t vp_ucode_serial, streamvp_ucode_serial;
+
+  // Vertex program branch instructions, and the instructions they branch to, as pairs. These
+  // are patched according to where the program is loaded in the RSX's program memory:
+  std::unique_ptr< instruction_size_type[] > vp_branch_relocs, streamvp_branch_relocs;
+  instruction_size_type vp_num_branch_relocs, streamvp_num_branch_relocs;
+
+  // Fragment program microcode is allocated RSXGL_FP_UCODE_COPIES times, fp_ucode_stride
+  // instructions apart, starting at fp_ucode_copies_offset; fp_ucode_offset is the copy
+  // that's in use. fp_ucode_timestamps records the last draw to use each copy. Copies whose
+  // bits are set in fp_ucode_copies_written have been written in full, and only need their
+  // immediates updated:
+  ucode_offset_type fp_ucode_copies_offset, fp_ucode_stride;
+  uint32_t fp_ucode_copy, fp_ucode_copies_written;
+  uint32_t fp_ucode_timestamps[RSXGL_FP_UCODE_COPIES];
+
+  // Fragment program microcode in main memory, with current uniform values. Copies in RSX
+  // memory are written from this:
+  std::unique_ptr< uint32_t[] > fp_ucode;
+
   uint32_t vp_input_mask, vp_output_mask, vp_num_internal_const;
   uint32_t fp_control;
   uint32_t streamvp_input_mask, streamvp_output_mask, streamvp_num_internal_const;
@@ -199,8 +300,31 @@ struct program_t {
 
   // Storage for uniform and texture program offsets:
   std::unique_ptr< instruction_size_type[] > program_offsets;
+
+  // Indices into uniforms of the uniforms that the vertex program uses, ordered by vp_index,
+  // so that uniforms stored in adjacent constant registers can be uploaded together:
+  std::unique_ptr< uniform_size_type[] > vp_uniforms;
+  uniform_size_type num_vp_uniforms;
 };
 
+// glCompileShader() and glLinkProgram() may return before the compiler thread has done their
+// work. Anything that depends upon a shader's or a program's compiled or linked state first
+// calls these, which wait for that work if need be, and copy its results into the object:
+void rsxgl_shader_complete_pending(shader_t &);
+void rsxgl_program_complete_pending(program_t &);
+
+static inline void
+rsxgl_shader_complete(shader_t & shader)
+{
+  if(shader.pending) rsxgl_shader_complete_pending(shader);
+}
+
+static inline void
+rsxgl_program_complete(program_t & program)
+{
+  if(program.pending) rsxgl_program_complete_pending(program);
+}
+
 struct rsxgl_context_t;
 
 void rsxgl_program_validate(rsxgl_context_t *,const uint32_t);
@@ -0,0 +1,308 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// program_binary.cc - Linked programs, in a form that can be stored and loaded again without
+// running the GLSL compiler.
+
+#include "program_binary.h"
+#include "gl_constants.h"
+
+#include <string.h>
+
+namespace {
+
+  // The three passes over a binary - measuring, writing, and reading - share the description
+  // of its layout in serialize(), below.
+  struct sizer_t {
+    size_t size;
+
+    sizer_t() : size(0) {
+    }
+
+    bool word(uint32_t &) {
+      size += sizeof(uint32_t);
+      return true;
+    }
+
+    template< typename Value >
+    bool count(std::vector< Value > & v) {
+      size += sizeof(uint32_t);
+      return true;
+    }
+
+    bool bytes(std::vector< char > & v) {
+      size += (v.size() + 3) & ~3;
+      return true;
+    }
+  };
+
+  struct writer_t {
+    uint8_t * p;
+
+    writer_t(void * _p) : p((uint8_t *)_p) {
+    }
+
+    bool word(uint32_t & w) {
+      p[0] = (uint8_t)(w >> 24);
+      p[1] = (uint8_t)(w >> 16);
+      p[2] = (uint8_t)(w >> 8);
+      p[3] = (uint8_t)w;
+      p += sizeof(uint32_t);
+      return true;
+    }
+
+    template< typename Value >
+    bool count(std::vector< Value > & v) {
+      uint32_t n = v.size();
+      return word(n);
+    }
+
+    bool bytes(std::vector< char > & v) {
+      const size_t n = v.size(), n_padded = (n + 3) & ~3;
+      if(n > 0) memcpy(p,&v[0],n);
+      memset(p + n,0,n_padded - n);
+      p += n_padded;
+      return true;
+    }
+  };
+
+  struct reader_t {
+    const uint8_t * p, * end;
+
+    reader_t(const void * _p,const size_t n) : p((const uint8_t *)_p), end((const uint8_t *)_p + n) {
+    }
+
+    bool word(uint32_t & w) {
+      if((end - p) < (ptrdiff_t)sizeof(uint32_t)) return false;
+      w = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+      p += sizeof(uint32_t);
+      return true;
+    }
+
+    // Every element takes at least one byte, which bounds the count of a valid table:
+    template< typename Value >
+    bool count(std::vector< Value > & v) {
+      uint32_t n = 0;
+      if(!word(n) || n > (uint32_t)(end - p)) return false;
+      v.resize(n);
+      return true;
+    }
+
+    bool bytes(std::vector< char > & v) {
+      const size_t n = v.size(), n_padded = (n + 3) & ~3;
+      if((size_t)(end - p) < n_padded) return false;
+      if(n > 0) memcpy(&v[0],p,n);
+      p += n_padded;
+      return true;
+    }
+  };
+
+  template< typename Archive >
+  bool words(Archive & ar,std::vector< uint32_t > & v) {
+    if(!ar.count(v)) return false;
+    for(size_t i = 0,n = v.size();i < n;++i) {
+      if(!ar.word(v[i])) return false;
+    }
+    return true;
+  }
+
+  template< typename Archive >
+  bool serialize(Archive & ar,rsxgl_program_binary_t::vp_t & vp) {
+    return words(ar,vp.ucode) && words(ar,vp.branch_relocs) && ar.word(vp.input_mask) && ar.word(vp.output_mask);
+  }
+
+  template< typename Archive >
+  bool serialize(Archive & ar,rsxgl_program_binary_t::fp_t & fp) {
+    return words(ar,fp.ucode) && ar.word(fp.control);
+  }
+
+  template< typename Archive >
+  bool serialize(Archive & ar,rsxgl_program_binary_t & binary) {
+    if(!(serialize(ar,binary.vp) && serialize(ar,binary.fp) &&
+	 ar.word(binary.vp_num_internal_const) &&
+	 ar.word(binary.stream_num_outputs) && ar.word(binary.streamvp_vertexid_index) &&
+	 ar.word(binary.point_sprite_control))) {
+      return false;
+    }
+
+    if(binary.stream_num_outputs > 0) {
+      if(!(serialize(ar,binary.streamvp) && serialize(ar,binary.streamfp))) return false;
+    }
+
+    if(!(ar.count(binary.names) && ar.bytes(binary.names) &&
+	 ar.word(binary.attrib_name_max_length) && ar.word(binary.uniform_name_max_length))) {
+      return false;
+    }
+
+    if(!ar.count(binary.attribs)) return false;
+    for(auto & attrib : binary.attribs) {
+      if(!(ar.word(attrib.name) && ar.word(attrib.type) && ar.word(attrib.index) && ar.word(attrib.location))) return false;
+    }
+
+    if(!ar.count(binary.uniforms)) return false;
+    for(auto & uniform : binary.uniforms) {
+      if(!(ar.word(uniform.name) && ar.word(uniform.type) && ar.word(uniform.enabled) &&
+	   ar.word(uniform.values_index) && ar.word(uniform.count) && ar.word(uniform.vp_index) &&
+	   ar.word(uniform.program_offsets_index))) return false;
+    }
+
+    if(!ar.count(binary.sampler_uniforms)) return false;
+    for(auto & uniform : binary.sampler_uniforms) {
+      if(!(ar.word(uniform.name) && ar.word(uniform.type) && ar.word(uniform.vp_index) && ar.word(uniform.fp_index))) return false;
+    }
+
+    return words(ar,binary.uniform_values) && words(ar,binary.program_offsets);
+  }
+
+  // Number of components in each column of a uniform:
+  uint32_t width(const uint32_t type) {
+    switch(type) {
+    case RSXGL_DATA_TYPE_FLOAT:
+      return 1;
+    case RSXGL_DATA_TYPE_FLOAT2:
+      return 2;
+    case RSXGL_DATA_TYPE_FLOAT3:
+      return 3;
+    case RSXGL_DATA_TYPE_FLOAT4:
+    case RSXGL_DATA_TYPE_FLOAT4x4:
+      return 4;
+    default:
+      return 0;
+    }
+  }
+
+  // Check that the tables only refer to things that are present, and that everything loading
+  // the binary will index with stays within the limits of the implementation. Sizes are compared
+  // as 64-bit quantities, so that no sum of words read from the binary can overflow:
+  bool validate(const rsxgl_program_binary_t & binary) {
+    const size_t names_size = binary.names.size();
+    if(names_size > 0 && binary.names[names_size - 1] != 0) return false;
+
+    if((binary.vp.ucode.size() % 4) != 0 || (binary.fp.ucode.size() % 4) != 0 ||
+       (binary.streamvp.ucode.size() % 4) != 0 || (binary.streamfp.ucode.size() % 4) != 0) return false;
+
+    if((binary.vp.branch_relocs.size() % 2) != 0 || (binary.streamvp.branch_relocs.size() % 2) != 0) return false;
+
+    const uint64_t num_values = binary.uniform_values.size(), num_offsets = binary.program_offsets.size();
+    const uint64_t num_vp_constants = RSXGL__VERTEX__MAX_PROGRAM_UNIFORM_COMPONENTS / 4;
+    const uint32_t fp_num_insn = binary.fp.ucode.size() / 4;
+
+    // Vertex program internal constants come first in both program_offsets and uniform_values,
+    // as (count, index) pairs, each followed by count vec4's of values:
+    if(((uint64_t)binary.vp_num_internal_const * 2) > num_offsets) return false;
+    uint64_t internal_values = 0;
+    for(uint32_t i = 0;i < binary.vp_num_internal_const;++i) {
+      const uint64_t count = binary.program_offsets[i * 2], index = binary.program_offsets[i * 2 + 1];
+      if((index + count) > num_vp_constants) return false;
+      internal_values += count * 4;
+      if(internal_values > num_values) return false;
+    }
+
+    for(const auto & attrib : binary.attribs) {
+      if(attrib.name >= names_size) return false;
+      if(attrib.index >= RSXGL_MAX_VERTEX_ATTRIBS || attrib.location >= RSXGL_MAX_VERTEX_ATTRIBS) return false;
+    }
+
+    for(const auto & uniform : binary.uniforms) {
+      if(uniform.name >= names_size) return false;
+
+      const uint64_t n = width(uniform.type);
+      if(n == 0 || ((uint64_t)uniform.values_index + (uint64_t)uniform.count * n) > num_values) return false;
+
+      if((uniform.enabled & (1 << RSXGL_VERTEX_SHADER)) &&
+	 ((uint64_t)uniform.vp_index + (uint64_t)uniform.count) > num_vp_constants) return false;
+
+      // For each column, a count of fragment program instructions holding its immediate,
+      // followed by those instructions' indices:
+      if(uniform.enabled & (1 << RSXGL_FRAGMENT_SHADER)) {
+	uint64_t offset = uniform.program_offsets_index;
+	for(uint32_t j = 0;j < uniform.count;++j) {
+	  if(offset >= num_offsets) return false;
+	  uint64_t count = binary.program_offsets[offset++];
+	  if((offset + count) > num_offsets) return false;
+	  for(;count > 0;--count,++offset) {
+	    if(binary.program_offsets[offset] >= fp_num_insn) return false;
+	  }
+	}
+      }
+      else if(uniform.program_offsets_index > num_offsets) {
+	return false;
+      }
+    }
+
+    // Samplers that a shader doesn't use have an index of RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
+    for(const auto & uniform : binary.sampler_uniforms) {
+      if(uniform.name >= names_size) return false;
+      if(uniform.vp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS && uniform.vp_index >= RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS) return false;
+      if(uniform.fp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS && uniform.fp_index >= RSXGL_MAX_TEXTURE_COORDS) return false;
+    }
+
+    return true;
+  }
+
+}
+
+uint32_t
+rsxgl_program_binary_checksum(const void * data,const size_t n,uint32_t hash)
+{
+  const uint8_t * p = (const uint8_t *)data, * end = p + n;
+  for(;p != end;++p) {
+    hash = (hash ^ *p) * 16777619U;
+  }
+  return hash;
+}
+
+size_t
+rsxgl_program_binary_size(const rsxgl_program_binary_t & binary)
+{
+  sizer_t sizer;
+  serialize(sizer,const_cast< rsxgl_program_binary_t & >(binary));
+  return RSXGL_PROGRAM_BINARY_HEADER_SIZE + sizer.size;
+}
+
+void
+rsxgl_program_binary_write(const rsxgl_program_binary_t & binary,void * data)
+{
+  const uint32_t size = rsxgl_program_binary_size(binary);
+
+  writer_t writer((uint8_t *)data + RSXGL_PROGRAM_BINARY_HEADER_SIZE);
+  serialize(writer,const_cast< rsxgl_program_binary_t & >(binary));
+
+  uint32_t header[4] = {
+    RSXGL_PROGRAM_BINARY_MAGIC,
+    RSXGL_PROGRAM_BINARY_VERSION,
+    size,
+    rsxgl_program_binary_checksum((const uint8_t *)data + RSXGL_PROGRAM_BINARY_HEADER_SIZE,size - RSXGL_PROGRAM_BINARY_HEADER_SIZE)
+  };
+
+  writer_t header_writer(data);
+  for(unsigned int i = 0;i < 4;++i) {
+    header_writer.word(header[i]);
+  }
+}
+
+rsxgl_program_binary_status
+rsxgl_program_binary_read(rsxgl_program_binary_t & binary,const void * data,const size_t n)
+{
+  if(data == 0 || n < RSXGL_PROGRAM_BINARY_HEADER_SIZE) return RSXGL_PROGRAM_BINARY_INCOMPATIBLE;
+
+  reader_t header_reader(data,RSXGL_PROGRAM_BINARY_HEADER_SIZE);
+  uint32_t header[4];
+  for(unsigned int i = 0;i < 4;++i) {
+    header_reader.word(header[i]);
+  }
+
+  if(header[0] != RSXGL_PROGRAM_BINARY_MAGIC || header[1] != RSXGL_PROGRAM_BINARY_VERSION || header[2] != n) return RSXGL_PROGRAM_BINARY_INCOMPATIBLE;
+
+  const uint8_t * payload = (const uint8_t *)data + RSXGL_PROGRAM_BINARY_HEADER_SIZE;
+  const size_t payload_size = n - RSXGL_PROGRAM_BINARY_HEADER_SIZE;
+  if(header[3] != rsxgl_program_binary_checksum(payload,payload_size)) return RSXGL_PROGRAM_BINARY_INCOMPATIBLE;
+
+  rsxgl_program_binary_t tmp;
+  reader_t reader(payload,payload_size);
+  if(!serialize(reader,tmp) || reader.p != reader.end || !validate(tmp)) return RSXGL_PROGRAM_BINARY_MALFORMED;
+
+  std::swap(binary,tmp);
+  return RSXGL_PROGRAM_BINARY_OK;
+}
@@ -0,0 +1,141 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// program_binary.h - Linked programs, in a form that can be stored and loaded again without
+// running the GLSL compiler.
+//
+// glLinkProgram() translates a program into an rsxgl_program_binary_t, then loads that into
+// the program object; glProgramBinary() gets one from the serialized format instead. This
+// file doesn't depend upon the RSX or upon the rest of the library, so that tools that run
+// on the host can produce binaries.
+//
+// The serialized format is a sequence of big-endian 32-bit words (strings are padded to a
+// multiple of 4 bytes), beginning with a header:
+//   magic, version, length of the whole binary in bytes, checksum of everything after the header
+
+#ifndef rsxgl_program_binary_H
+#define rsxgl_program_binary_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Value of binaryFormat for glProgramBinary() & glGetProgramBinary(); see GL3/rsxgl3ext.h:
+#define RSXGL_PROGRAM_BINARY_FORMAT 0x5258
+
+#define RSXGL_PROGRAM_BINARY_MAGIC 0x52535850 // "RSXP"
+
+// Increment whenever the layout of the binary, or the meaning of anything stored in it, changes:
+#define RSXGL_PROGRAM_BINARY_VERSION 1
+
+#define RSXGL_PROGRAM_BINARY_HEADER_SIZE (4 * sizeof(uint32_t))
+
+// These values are stored in binaries, so mustn't change without incrementing the version:
+enum rsxgl_shader_types {
+  RSXGL_VERTEX_SHADER = 0,
+  RSXGL_FRAGMENT_SHADER = 1,
+  RSXGL_MAX_SHADER_TYPES = 2
+};
+
+enum rsxgl_data_types {
+  RSXGL_DATA_TYPE_FLOAT = 0,
+  RSXGL_DATA_TYPE_FLOAT2 = 1,
+  RSXGL_DATA_TYPE_FLOAT3 = 2,
+  RSXGL_DATA_TYPE_FLOAT4 = 3,
+  RSXGL_DATA_TYPE_FLOAT4x4 = 4,
+  RSXGL_DATA_TYPE_SAMPLER1D = 5,
+  RSXGL_DATA_TYPE_SAMPLER2D = 6,
+  RSXGL_DATA_TYPE_SAMPLER3D = 7,
+  RSXGL_DATA_TYPE_SAMPLERCUBE = 8,
+  RSXGL_DATA_TYPE_SAMPLERRECT = 9,
+  RSXGL_MAX_DATA_TYPES = 10,
+  RSXGL_DATA_TYPE_UNKNOWN = 10
+};
+
+struct rsxgl_program_binary_t {
+  // Vertex program microcode (4 words per instruction), and the branch instructions that need
+  // to be relocated, as (instruction, target) pairs:
+  struct vp_t {
+    std::vector< uint32_t > ucode, branch_relocs;
+    uint32_t input_mask, output_mask;
+
+    vp_t() : input_mask(0), output_mask(0) {
+    }
+  };
+
+  // Fragment program microcode, already in the RSX's half-word order:
+  struct fp_t {
+    std::vector< uint32_t > ucode;
+    uint32_t control;
+
+    fp_t() : control(0) {
+    }
+  };
+
+  vp_t vp, streamvp;
+  fp_t fp, streamfp;
+
+  uint32_t vp_num_internal_const;
+
+  // Transform feedback programs are only present if stream_num_outputs > 0:
+  uint32_t stream_num_outputs, streamvp_vertexid_index;
+
+  uint32_t point_sprite_control;
+
+  // Names of attributes and uniforms; tables refer to them by offset. Each table is sorted
+  // by name:
+  std::vector< char > names;
+  uint32_t attrib_name_max_length, uniform_name_max_length;
+
+  struct attrib_t {
+    uint32_t name, type, index, location;
+  };
+
+  struct uniform_t {
+    // enabled is a bit mask of shader types (RSXGL_VERTEX_SHADER, RSXGL_FRAGMENT_SHADER):
+    uint32_t name, type, enabled, values_index, count, vp_index, program_offsets_index;
+  };
+
+  struct sampler_uniform_t {
+    uint32_t name, type, vp_index, fp_index;
+  };
+
+  std::vector< attrib_t > attribs;
+  std::vector< uniform_t > uniforms;
+  std::vector< sampler_uniform_t > sampler_uniforms;
+
+  // Initial values of uniforms and of vertex program internal constants, as IEEE words:
+  std::vector< uint32_t > uniform_values;
+
+  // Vertex program internal constant indices, and fragment program uniform offsets:
+  std::vector< uint32_t > program_offsets;
+
+  rsxgl_program_binary_t()
+    : vp_num_internal_const(0), stream_num_outputs(0), streamvp_vertexid_index(~0U), point_sprite_control(0),
+      attrib_name_max_length(0), uniform_name_max_length(0) {
+  }
+};
+
+// Number of bytes needed to serialize a program:
+size_t rsxgl_program_binary_size(const rsxgl_program_binary_t &);
+
+// Serialize a program into a buffer of rsxgl_program_binary_size() bytes:
+void rsxgl_program_binary_write(const rsxgl_program_binary_t &,void *);
+
+enum rsxgl_program_binary_status {
+  RSXGL_PROGRAM_BINARY_OK = 0,
+  // Not a binary of this version, or damaged (the header or checksum doesn't match):
+  RSXGL_PROGRAM_BINARY_INCOMPATIBLE = 1,
+  // Intact, but its tables refer to things outside of the binary or beyond the implementation's limits:
+  RSXGL_PROGRAM_BINARY_MALFORMED = 2
+};
+
+// Deserialize a program. binary is left alone unless RSXGL_PROGRAM_BINARY_OK is returned:
+rsxgl_program_binary_status rsxgl_program_binary_read(rsxgl_program_binary_t &,const void *,const size_t);
+
+// Checksum used by the header (32-bit FNV-1a):
+uint32_t rsxgl_program_binary_checksum(const void *,const size_t,uint32_t = 2166136261U);
+
+#endif
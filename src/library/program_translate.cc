@@ -0,0 +1,421 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// program_translate.cc - Translate programs that mesa has linked into RSX microcode.
+
+#include "program_translate.h"
+#include "compiler_context.h"
+#include "gl_constants.h"
+#include "rsxgl_assert.h"
+#include "debug.h"
+#include "ieee32_t.h"
+
+// mesa:
+#include <main/mtypes.h>
+#include <state_tracker/st_program.h>
+#include <program/prog_parameter.h>
+#include <glsl/ir.h>
+#include <glsl/ir_uniform.h>
+
+extern "C" {
+#include <nvfx/nvfx_state.h>
+#include <nvfx/nvfx_shader.h>
+}
+
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <tuple>
+
+static inline uint32_t
+endian_fp(uint32_t v)
+{
+  return ( ( ( v >> 16 ) & 0xffff ) << 0 ) |
+         ( ( ( v >> 0 ) & 0xffff ) << 16 );
+}
+
+static inline uint8_t
+rsxgl_glsl_type_to_rsxgl_type(const glsl_type * type)
+{
+  if(type -> base_type == GLSL_TYPE_FLOAT) {
+    if(type -> vector_elements == 1) {
+      return RSXGL_DATA_TYPE_FLOAT;
+    }
+    else if(type -> vector_elements == 2) {
+      return RSXGL_DATA_TYPE_FLOAT2;
+    }
+    else if(type -> vector_elements == 3) {
+      return RSXGL_DATA_TYPE_FLOAT3;
+    }
+    else if(type -> vector_elements == 4) {
+      if(type -> matrix_columns == 4) {
+	return RSXGL_DATA_TYPE_FLOAT4x4;
+      }
+      else {
+	return RSXGL_DATA_TYPE_FLOAT4;
+      }
+    }
+  }
+  else if(type -> base_type == GLSL_TYPE_SAMPLER) {
+    if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_1D) {
+      return RSXGL_DATA_TYPE_SAMPLER1D;
+    }
+    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_2D) {
+      return RSXGL_DATA_TYPE_SAMPLER2D;
+    }
+    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_3D) {
+      return RSXGL_DATA_TYPE_SAMPLER3D;
+    }
+    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_CUBE) {
+      return RSXGL_DATA_TYPE_SAMPLERCUBE;
+    }
+    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_RECT) {
+      return RSXGL_DATA_TYPE_SAMPLERRECT;
+    }
+  }
+  return RSXGL_DATA_TYPE_UNKNOWN;
+}
+
+static void
+rsxgl_program_binary_vp(const struct nvfx_vertex_program * nvfx_vp,const struct nvfx_fragment_program * nvfx_fp,rsxgl_program_binary_t::vp_t & vp)
+{
+  vp.ucode.resize(nvfx_vp -> nr_insns * 4);
+  for(unsigned int i = 0,n = nvfx_vp -> nr_insns;i < n;++i) {
+    std::copy(nvfx_vp -> insns[i].data,nvfx_vp -> insns[i].data + 4,vp.ucode.begin() + (i * 4));
+  }
+
+  const struct nvfx_relocation * reloc = (const struct nvfx_relocation *)nvfx_vp -> branch_relocs.data;
+  for(unsigned int i = 0,n = nvfx_vp -> branch_relocs.size / sizeof(struct nvfx_relocation);i < n;++i,++reloc) {
+    vp.branch_relocs.push_back(reloc -> location);
+    vp.branch_relocs.push_back(reloc -> target);
+  }
+
+  vp.input_mask = nvfx_vp -> ir;
+  vp.output_mask = nvfx_vp -> outregs | nvfx_fp -> outregs;
+}
+
+// Fragment program microcode is stored with the endian swap already performed:
+static void
+rsxgl_program_binary_fp(const struct nvfx_fragment_program * nvfx_fp,rsxgl_program_binary_t::fp_t & fp)
+{
+  fp.ucode.resize(nvfx_fp -> insn_len);
+  for(unsigned int i = 0,n = nvfx_fp -> insn_len;i < n;++i) {
+    fp.ucode[i] = endian_fp(nvfx_fp -> insn[i]);
+  }
+  fp.control = nvfx_fp -> fp_control;
+}
+
+void
+rsxgl_program_translate(compiler_context_t * cctx,struct gl_shader_program * mesa_program,rsxgl_program_binary_t & binary,
+			struct nvfx_vertex_program *& nvfx_vp,struct nvfx_fragment_program *& nvfx_fp,
+			struct nvfx_vertex_program *& nvfx_streamvp,struct nvfx_fragment_program *& nvfx_streamfp)
+{
+  pipe_stream_output_info stream_info;
+  tgsi_token * vp_tokens = 0;
+
+  nvfx_vp = cctx -> translate_vp(mesa_program,&stream_info,&vp_tokens);
+  nvfx_fp = cctx -> translate_fp(mesa_program);
+  rsxgl_assert(nvfx_vp != 0);
+  rsxgl_assert(nvfx_fp != 0);
+
+  cctx -> link_vp_fp(nvfx_vp,nvfx_fp);
+
+  rsxgl_program_binary_vp(nvfx_vp,nvfx_fp,binary.vp);
+  rsxgl_program_binary_fp(nvfx_fp,binary.fp);
+
+  // Things that get accumulated:
+  // program_offsets - uint32_t's
+  // uniform_values - ieee32_t's
+  // attribs - map from string's to attrib_t's
+  // uniforms - map from string's to uniform_t's
+  // sampler_uniforms - map from string's to sampler_uniform_t's
+  // then iterate over attribs, uniforms, sampler uniforms, create names area
+
+  struct cstr_less {
+    bool operator()(const char * lhs,const char * rhs) const {
+      return strcmp(lhs,rhs) < 0;
+    }
+  };
+
+  std::map< const char *, rsxgl_program_binary_t::attrib_t, cstr_less > attribs;
+  std::map< const char *, rsxgl_program_binary_t::uniform_t, cstr_less > uniforms;
+  std::map< const char *, rsxgl_program_binary_t::sampler_uniform_t, cstr_less > sampler_uniforms;
+
+  //
+  struct gl_shader * gl_vsh = mesa_program->_LinkedShaders[MESA_SHADER_VERTEX];
+  struct gl_program * gl_vp = gl_vsh->Program;
+
+  struct gl_shader * gl_fsh = mesa_program->_LinkedShaders[MESA_SHADER_FRAGMENT];
+  struct gl_program * gl_fp = gl_fsh->Program;
+
+  // Process vertex program attributes:
+  {
+    struct st_vertex_program * st_vp = st_vertex_program((struct gl_vertex_program *)gl_vp);
+
+    exec_list *ir = gl_vsh->ir;
+    foreach_list(node, ir) {
+      const ir_variable *const var = ((ir_instruction *) node)->as_variable();
+
+      if (var == NULL
+	  || var->mode != ir_var_in
+	  || var->location == -1
+	  || var->location < VERT_ATTRIB_GENERIC0)
+	continue;
+
+      rsxgl_program_binary_t::attrib_t attrib;
+      attrib.type = rsxgl_glsl_type_to_rsxgl_type(var->type);
+      attrib.index = st_vp -> input_to_index[var -> location];
+      attrib.location = var -> location - VERT_ATTRIB_GENERIC0;
+
+      attribs.insert(std::make_pair(var -> name,attrib));
+
+      binary.attrib_name_max_length = std::max(binary.attrib_name_max_length,(uint32_t)strlen(var -> name));
+    }
+  }
+
+  // Process program uniforms:
+  {
+    // Build vp constant map - from index into gl_vp -> Parameters to hardware index:
+    // Also deal with vertex program immediates:
+    typedef std::map< unsigned int, uint32_t > nvfx_vp_constant_map_t;
+    nvfx_vp_constant_map_t nvfx_vp_constant_map;
+
+    {
+      const struct nvfx_vertex_program_data * vp_const = nvfx_vp -> consts;
+      for(unsigned int i = 0,n = nvfx_vp -> nr_consts;i < n;++i,++vp_const) {
+	if(vp_const -> index == -1) {
+	  binary.program_offsets.push_back(1);
+	  binary.program_offsets.push_back(i);
+
+	  for(unsigned int j = 0;j < 4;++j) {
+	    ieee32_t tmp;
+	    tmp.f = vp_const -> value[j];
+	    binary.uniform_values.push_back(tmp.u);
+	  }
+
+	  ++binary.vp_num_internal_const;
+	}
+	else {
+	  nvfx_vp_constant_map[vp_const -> index] = i;
+	}
+      }
+    }
+
+    // Build fp constant map - from index into gl_fp -> Parameters to a std::deque of offsets:
+    typedef std::map< unsigned int, std::deque< uint32_t > > nvfx_fp_constant_map_t;
+    nvfx_fp_constant_map_t nvfx_fp_constant_map;
+
+    {
+      const struct nvfx_fragment_program_data * fp_const = nvfx_fp -> consts;
+      for(unsigned int i = 0,n = nvfx_fp -> nr_consts;i < n;++i,++fp_const) {
+	nvfx_fp_constant_map[fp_const -> index].push_back(fp_const -> offset);
+      }
+    }
+
+#if 0
+    rsxgl_debug_printf("%i uniforms:\n",mesa_program -> NumUserUniformStorage);
+#endif
+
+    for(unsigned int i = 0,n = mesa_program -> NumUserUniformStorage;i < n;++i) {
+      const gl_uniform_storage * uniform_storage = mesa_program -> UniformStorage + i;
+      const glsl_type * type = uniform_storage -> type;
+
+#if 0
+      rsxgl_debug_printf("\t%s type:%s num_driver_storage:%u\n",
+			 uniform_storage -> name,
+			 uniform_storage -> type -> name,
+			 uniform_storage -> num_driver_storage);
+#endif
+
+      // Non-samplers:
+      if(uniform_storage -> type -> base_type != GLSL_TYPE_SAMPLER) {
+	rsxgl_program_binary_t::uniform_t uniform;
+	uniform.type = rsxgl_glsl_type_to_rsxgl_type(type);
+	uniform.enabled = 0;
+	uniform.count = type -> matrix_columns;
+
+#if 0
+	rsxgl_debug_printf("\t\ttype:%u count:%u\n",(unsigned int)uniform.type,(unsigned int)uniform.count);
+#endif
+
+	uniform.values_index = binary.uniform_values.size();
+	binary.uniform_values.resize(binary.uniform_values.size() + (type -> vector_elements * type -> matrix_columns),0);
+
+	// Search for it in vp:
+	// store vp index
+	uniform.vp_index = 0;
+
+	for(unsigned int i = 0,n = gl_vp -> Parameters -> NumParameters;i < n;++i) {
+	  gl_program_parameter * parameter = gl_vp -> Parameters -> Parameters + i;
+	  if(parameter -> Type == PROGRAM_UNIFORM && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
+	    nvfx_vp_constant_map_t::const_iterator it = nvfx_vp_constant_map.find(i);
+	    if(it != nvfx_vp_constant_map.end()) {
+	      uniform.enabled |= (1 << RSXGL_VERTEX_SHADER);
+	      uniform.vp_index = it -> second;
+	    }
+	    break;
+	  }
+	}
+
+	// Search for it in fp:
+	// for each in count:
+	// - store an offset count n
+	// - store n (offsets / 4)
+	// Each column of a matrix is a separate parameter, following the first one:
+	uniform.program_offsets_index = 0;
+
+	for(unsigned int i = 0,n = gl_fp -> Parameters -> NumParameters;i < n;++i) {
+	  gl_program_parameter * parameter = gl_fp -> Parameters -> Parameters + i;
+	  if(parameter -> Type == PROGRAM_UNIFORM && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
+	    const size_t program_offsets_index = binary.program_offsets.size();
+	    bool used = false;
+
+	    for(unsigned int j = 0;j < uniform.count;++j) {
+	      nvfx_fp_constant_map_t::const_iterator it = ((i + j) < n) ? nvfx_fp_constant_map.find(i + j) : nvfx_fp_constant_map.end();
+	      if(it != nvfx_fp_constant_map.end()) {
+		used = true;
+
+		const std::deque< uint32_t > & offsets = it -> second;
+		binary.program_offsets.push_back(offsets.size());
+
+		for(std::deque< uint32_t >::const_iterator jt = offsets.begin(),jt_end = offsets.end();jt != jt_end;++jt) {
+		  binary.program_offsets.push_back(*jt / 4);
+		}
+	      }
+	      else {
+		binary.program_offsets.push_back(0);
+	      }
+	    }
+
+	    if(used) {
+	      uniform.enabled |= (1 << RSXGL_FRAGMENT_SHADER);
+	      uniform.program_offsets_index = program_offsets_index;
+	    }
+	    else {
+	      binary.program_offsets.resize(program_offsets_index);
+	    }
+	    break;
+	  }
+	}
+
+	uniforms.insert(std::make_pair(uniform_storage -> name,uniform));
+      }
+      // Sampler:
+      else {
+	rsxgl_program_binary_t::sampler_uniform_t sampler_uniform;
+	sampler_uniform.type = rsxgl_glsl_type_to_rsxgl_type(uniform_storage -> type);
+	sampler_uniform.vp_index = RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;
+	sampler_uniform.fp_index = RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;
+
+	// Search for it in vp:
+	for(unsigned int i = 0,n = gl_vp -> Parameters -> NumParameters;i < n;++i) {
+	  gl_program_parameter * parameter = gl_vp -> Parameters -> Parameters + i;
+	  if(parameter -> Type == PROGRAM_SAMPLER && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
+	    sampler_uniform.vp_index = (unsigned int)uniform_storage -> sampler;
+	    break;
+	  }
+	}
+
+	// Search for it in fp:
+	for(unsigned int i = 0,n = gl_fp -> Parameters -> NumParameters;i < n;++i) {
+	  gl_program_parameter * parameter = gl_fp -> Parameters -> Parameters + i;
+	  if(parameter -> Type == PROGRAM_SAMPLER && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
+	    sampler_uniform.fp_index = (unsigned int)uniform_storage -> sampler;
+	    break;
+	  }
+	}
+
+	sampler_uniforms.insert(std::make_pair(uniform_storage -> name,sampler_uniform));
+      }
+
+      binary.uniform_name_max_length = std::max(binary.uniform_name_max_length,(uint32_t)strlen(uniform_storage -> name));
+    }
+  }
+
+  // Attribute and uniform names, and the tables that refer to them:
+  auto push_name = [&binary](const char * name) -> uint32_t {
+    const uint32_t result = binary.names.size();
+    binary.names.insert(binary.names.end(),name,name + strlen(name) + 1);
+    return result;
+  };
+
+  for(const auto & name_attrib : attribs) {
+    binary.attribs.push_back(name_attrib.second);
+    binary.attribs.back().name = push_name(name_attrib.first);
+  }
+
+  for(const auto & name_uniform : uniforms) {
+    binary.uniforms.push_back(name_uniform.second);
+    binary.uniforms.back().name = push_name(name_uniform.first);
+  }
+
+  for(const auto & name_uniform : sampler_uniforms) {
+    binary.sampler_uniforms.push_back(name_uniform.second);
+    binary.sampler_uniforms.back().name = push_name(name_uniform.first);
+  }
+
+  // TODO: deal with this:
+  binary.point_sprite_control = 0;
+
+  // Create stream programs if any varyings are captured.
+  // This seems to clobber the original vertex program's data such that the main rendering program's
+  // attribute assignments get messed up. This isn't good, but, for now, creating the stream programs
+  // takes place after RSXGL is otherwise finished creating the rendering programs.
+  if(stream_info.num_outputs > 0) {
+#if 0
+    rsxgl_debug_printf("VP stream outputs: %u\n",stream_info.num_outputs);
+#endif
+
+    unsigned int vertexid_index = 0;
+    std::tie(nvfx_streamvp,nvfx_streamfp) = cctx -> translate_stream_vp_fp(mesa_program,&stream_info,vp_tokens,&vertexid_index);
+    rsxgl_assert(nvfx_streamvp != 0);
+    rsxgl_assert(nvfx_streamfp != 0);
+
+    cctx -> link_vp_fp(nvfx_streamvp,nvfx_streamfp);
+
+#if 0
+    // Dump VP: microcode:
+    {
+      rsxgl_debug_printf("VP microcode: %u instructions\n",nvfx_streamvp -> nr_insns);
+      for(unsigned int i = 0,n = nvfx_streamvp -> nr_insns;i < n;++i) {
+	rsxgl_debug_printf("%04u: %x %x %x %x\n",i,
+			   nvfx_streamvp -> insns[i].data[0],
+			   nvfx_streamvp -> insns[i].data[1],
+			   nvfx_streamvp -> insns[i].data[2],
+			   nvfx_streamvp -> insns[i].data[3]);
+      }
+    }
+
+    // Dump FP microcode:
+    {
+      rsxgl_debug_printf("FP microcode: %u instructions\n",nvfx_streamfp -> insn_len / 4);
+      for(unsigned int i = 0,n = nvfx_streamfp -> insn_len / 4;i < n;++i) {
+	rsxgl_debug_printf("%04u: %08x %08x %08x %08x\n",i,
+			   nvfx_streamfp -> insn[i*4],
+			   nvfx_streamfp -> insn[i*4+1],
+			   nvfx_streamfp -> insn[i*4+2],
+			   nvfx_streamfp -> insn[i*4+3]);
+      }
+
+      rsxgl_debug_printf("streamfp slots:\n");
+      for(unsigned int i = 0;i < nvfx_streamfp -> num_slots;++i) {
+	rsxgl_debug_printf("\t%u: %u %u\n",i,
+			   nvfx_streamfp -> slot_to_generic[i],
+			   nvfx_streamvp -> generic_to_fp_input[nvfx_streamfp -> slot_to_generic[i]]);
+      }
+    }
+#endif
+
+    rsxgl_program_binary_vp(nvfx_streamvp,nvfx_streamfp,binary.streamvp);
+    rsxgl_program_binary_fp(nvfx_streamfp,binary.streamfp);
+
+    binary.stream_num_outputs = stream_info.num_outputs;
+    binary.streamvp_vertexid_index = vertexid_index;
+  }
+  else {
+    nvfx_streamvp = 0;
+    nvfx_streamfp = 0;
+  }
+}
@@ -0,0 +1,28 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// program_translate.h - Translate programs that mesa has linked into RSX microcode.
+//
+// This is shared by glLinkProgram() and by the offline compiler (src/glslcomp), so it doesn't
+// depend upon the RSX, or upon the rest of the library.
+
+#ifndef rsxgl_program_translate_H
+#define rsxgl_program_translate_H
+
+#include "program_binary.h"
+
+struct compiler_context_t;
+struct gl_shader_program;
+struct nvfx_vertex_program;
+struct nvfx_fragment_program;
+
+// Translate a program that mesa has linked into the RSX's microcode, and gather the attribute &
+// uniform tables. The nvfx programs that are created are returned too; the stream programs
+// are only created if the program captures transform feedback varyings (otherwise they're 0):
+void rsxgl_program_translate(compiler_context_t *,struct gl_shader_program *,rsxgl_program_binary_t &,
+			     struct nvfx_vertex_program *&,struct nvfx_fragment_program *&,
+			     struct nvfx_vertex_program *&,struct nvfx_fragment_program *&);
+
+#endif
@@ -7,6 +7,7 @@
 #include "timestamp.h"
 #include "rsxgl_limits.h"
 #include "cxxutil.h"
+#include "shader_cache.h"
 
 #include <GL3/gl3.h>
 #include "GL3/rsxgl.h"
@@ -23,15 +24,25 @@ extern "C" {
 #include <malloc.h>
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
 
-rsxgl_context_t * rsxgl_ctx = 0;
+__thread rsxgl_context_t * rsxgl_ctx = 0;
 
 extern "C"
 void *
 rsxgl_context_create(const struct rsxegl_config_t * config,gcmContextData * gcm_context,struct pipe_screen * screen,rsxgl_object_context_t * object_context)
 {
   rsxgl_debug_printf("%s\n",__PRETTY_FUNCTION__);
-  return new rsxgl_context_t(config,gcm_context,screen,object_context);
+
+  rsxgl_sync_object_index_type timestamp_sync = 0;
+  uint32_t last_timestamp = 0;
+  const uint32_t timeline = object_context -> acquire_timeline(timestamp_sync,last_timestamp);
+
+  if(timeline == RSXGL_MAX_TIMESTAMP_TIMELINES) {
+    return 0;
+  }
+
+  return new rsxgl_context_t(config,gcm_context,screen,object_context,timeline,timestamp_sync,last_timestamp);
 }
 
 extern "C"
@@ -41,8 +52,17 @@ rsxgl_object_context_create()
   return new rsxgl_object_context_t();
 }
 
-rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContextData * gcm_context,struct pipe_screen * screen,struct rsxgl_object_context_t * _object_context)
-  : m_object_context(_object_context), active_texture(0), any_samples_passed_query(RSXGL_MAX_QUERY_OBJECTS), ref(0), timestamp_sync(0), next_timestamp(1), last_timestamp(0), cached_timestamp(0), m_compiler_context(0)
+extern "C"
+void *
+rsxgl_context_object_context(struct rsxegl_context_t * ctx)
+{
+  return ((rsxgl_context_t *)ctx) -> object_context();
+}
+
+rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContextData * gcm_context,struct pipe_screen * screen,struct rsxgl_object_context_t * _object_context,
+				 const uint32_t _timeline,const rsxgl_sync_object_index_type _timestamp_sync,const uint32_t _last_timestamp)
+  : m_object_context(_object_context), m_shared_fifo(0), active_texture(0), any_samples_passed_query(RSXGL_MAX_QUERY_OBJECTS), ref(0),
+    timeline(_timeline), timestamp_sync(_timestamp_sync), next_timestamp(_last_timestamp + 1), last_timestamp(_last_timestamp), cached_timestamp(_last_timestamp), m_compiler_context(0)
 {
   base.api = EGL_OPENGL_API;
   base.config = config;
@@ -57,11 +77,13 @@ rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContex
   m_pctx = nvfx_create(screen,0);
   rsxgl_debug_printf("m_pctx: %lx\n",(unsigned long)m_pctx);
 
-  ++m_object_context -> m_refCount;
+  // Contexts after the first to use this object context record commands into their own buffer:
+  if(__sync_fetch_and_add(&m_object_context -> m_refCount,1) > 0) {
+    m_shared_fifo = rsxgl_shared_fifo_create(m_object_context);
+    base.gcm_context = &m_shared_fifo -> gcm_context;
+  }
 
-  timestamp_sync = rsxgl_sync_object_allocate();
   rsxgl_assert(timestamp_sync != 0);
-  rsxgl_sync_cpu_signal(timestamp_sync,0);
 
   for(size_t i = 0,n = (RSXGL_MAX_TRANSFORM_FEEDBACK_BUFFER_BINDINGS + RSXGL_MAX_UNIFORM_BUFFER_BINDINGS);i < n;++i) {
     buffer_binding_offset_size[i] = std::make_pair(0,0);
@@ -70,8 +92,24 @@ rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContex
 
 rsxgl_context_t::~rsxgl_context_t()
 {
-  --m_object_context -> m_refCount;
-  if(m_object_context -> m_refCount == 0) {
+  // Objects may still hold timestamps from this context's timeline, which the next context to
+  // take it assumes have passed. A shared context's commands are finished when its command
+  // buffer is destroyed:
+  if(m_shared_fifo != 0) {
+    rsxgl_shared_fifo_destroy(m_shared_fifo);
+  }
+  else {
+    rsxgl_timestamp_wait(this,last_timestamp);
+  }
+
+  rsxgl_staging_migrate_destroy(this);
+
+  m_object_context -> release_timeline(timeline,last_timestamp);
+
+  // Applications usually exit soon after destroying their contexts:
+  rsxgl_shader_cache_flush();
+
+  if(__sync_sub_and_fetch(&m_object_context -> m_refCount,1) == 0) {
     delete m_object_context;
   }
 
@@ -80,15 +118,34 @@ rsxgl_context_t::~rsxgl_context_t()
   }
 }
 
+static void
+rsxgl_context_invalidate(rsxgl_context_t * ctx)
+{
+  if(ctx -> base.draw != 0) {
+    framebuffer_t & framebuffer = ctx -> object_context() -> framebuffer_storage().at(0);
+    framebuffer.invalid = 1;
+    framebuffer.invalid_complete = 1;
+  }
+
+  ctx -> state.invalid.all = ~0;
+  ctx -> invalid.all = ~0;
+    
+  ctx -> invalid_attribs.set();
+  ctx -> invalid_textures.set();
+  ctx -> invalid_samplers.set();
+}
+
 void
 rsxgl_context_t::egl_callback(struct rsxegl_context_t * egl_ctx,const uint8_t op)
 {
   rsxgl_context_t * ctx = (rsxgl_context_t *)egl_ctx;
 
   if(op == RSXEGL_MAKE_CONTEXT_CURRENT || op == RSXEGL_POST_GPU_SWAP) {
-    framebuffer_t & framebuffer = ctx -> object_context() -> framebuffer_storage().at(0);
+    // The default framebuffer belongs to the context with a drawable; a context made current
+    // without one (e.g., to load resources on another thread) leaves it alone:
+    if(op == RSXEGL_MAKE_CONTEXT_CURRENT && ctx -> base.draw != 0) {
+      framebuffer_t & framebuffer = ctx -> object_context() -> framebuffer_storage().at(0);
 
-    if(op == RSXEGL_MAKE_CONTEXT_CURRENT) {
       framebuffer.attachment_types.set(RSXGL_COLOR_ATTACHMENT0,ctx -> base.draw -> color_pformat != PIPE_FORMAT_NONE ? RSXGL_ATTACHMENT_TYPE_RENDERBUFFER : RSXGL_ATTACHMENT_TYPE_NONE);
       framebuffer.attachment_types.set(RSXGL_DEPTH_STENCIL_ATTACHMENT,ctx -> base.draw -> depth_pformat != PIPE_FORMAT_NONE ? RSXGL_ATTACHMENT_TYPE_RENDERBUFFER : RSXGL_ATTACHMENT_TYPE_NONE);
 
@@ -100,20 +157,23 @@ rsxgl_context_t::egl_callback(struct rsxegl_context_t * egl_ctx,const uint8_t op
 	ctx -> state.viewport.depthRange[0] = 0.0f;
 	ctx -> state.viewport.depthRange[1] = 1.0f;
       }
+    }
 
+    if(op == RSXEGL_MAKE_CONTEXT_CURRENT) {
       rsxgl_ctx = ctx;
+
+      // Another context may have loaded its own vertex programs:
+      ctx -> vp_cache.clear();
     }
 
-    //
-    framebuffer.invalid = 1;
-    framebuffer.invalid_complete = 1;
+    // Segments that the GPU calls from here on are separated from this context's commands by the swap:
+    if(op == RSXEGL_POST_GPU_SWAP && ctx -> m_shared_fifo == 0) {
+      if(rsxgl_shared_fifo_call_pending(ctx -> object_context(),ctx -> gcm_context()) > 0) {
+	ctx -> vp_cache.clear();
+      }
+    }
 
-    ctx -> state.invalid.all = ~0;
-    ctx -> invalid.all = ~0;
-    
-    ctx -> invalid_attribs.set();
-    ctx -> invalid_textures.set();
-    ctx -> invalid_samplers.set();
+    rsxgl_context_invalidate(ctx);
   }
   else if(op == RSXEGL_DESTROY_CONTEXT) {
     ctx -> base.valid = 0;
@@ -123,7 +183,8 @@ rsxgl_context_t::egl_callback(struct rsxegl_context_t * egl_ctx,const uint8_t op
 uint32_t
 rsxgl_timestamp_create(rsxgl_context_t * ctx,const uint32_t count)
 {
-  const uint32_t max_timestamp = RSXGL_MAX_TIMESTAMP;
+  const uint32_t first_timestamp = ctx -> timeline << RSXGL_TIMESTAMP_TIMELINE_SHIFT;
+  const uint32_t max_timestamp = first_timestamp | RSXGL_MAX_TIMESTAMP;
 
   const uint32_t current_timestamp = ctx -> next_timestamp;
   rsxgl_assert(current_timestamp == (ctx -> last_timestamp + 1));
@@ -140,7 +201,8 @@ rsxgl_timestamp_create(rsxgl_context_t * ctx,const uint32_t count)
       const buffer_t::name_type n = ctx -> object_context() -> buffer_storage().contents().size;
       for(buffer_t::name_type i = 0;i < n;++i) {
 	if(!ctx -> object_context() -> buffer_storage().is_object(i)) continue;
-	ctx -> object_context() -> buffer_storage().at(i).timestamp = 0;
+	buffer_t & buffer = ctx -> object_context() -> buffer_storage().at(i);
+	if(rsxgl_timestamp_timeline(buffer.timestamp) == ctx -> timeline) buffer.timestamp = 0;
       }
     }
     
@@ -149,14 +211,30 @@ rsxgl_timestamp_create(rsxgl_context_t * ctx,const uint32_t count)
       const texture_t::name_type n = ctx -> object_context() -> texture_storage().contents().size;
       for(texture_t::name_type i = 0;i < n;++i) {
 	if(!ctx -> object_context() -> texture_storage().is_object(i)) continue;
-	ctx -> object_context() -> texture_storage().at(i).timestamp = 0;
+	texture_t & texture = ctx -> object_context() -> texture_storage().at(i);
+	if(rsxgl_timestamp_timeline(texture.timestamp) == ctx -> timeline) texture.timestamp = 0;
       }
     }
 
-    //
-    ctx -> cached_timestamp = 0;
-    ctx -> next_timestamp = 1 + count;
-    return 1;
+    // Programs:
+    {
+      const program_t::name_type n = ctx -> object_context() -> program_storage().contents().size;
+      for(program_t::name_type i = 0;i < n;++i) {
+	if(!ctx -> object_context() -> program_storage().is_object(i)) continue;
+	program_t & program = ctx -> object_context() -> program_storage().at(i);
+	if(rsxgl_timestamp_timeline(program.timestamp) == ctx -> timeline) program.timestamp = 0;
+	for(size_t j = 0;j < RSXGL_FP_UCODE_COPIES;++j) {
+	  if(rsxgl_timestamp_timeline(program.fp_ucode_timestamps[j]) == ctx -> timeline) program.fp_ucode_timestamps[j] = 0;
+	}
+      }
+    }
+
+    rsxgl_staging_migrate_reset(ctx);
+
+    // Other contexts' timestamps are left alone:
+    ctx -> cached_timestamp = first_timestamp;
+    ctx -> next_timestamp = first_timestamp + 1 + count;
+    return first_timestamp + 1;
   }
   //
   else {
@@ -179,8 +257,18 @@ rsxgl_timestamp_wait(rsxgl_context_t * ctx,const uint32_t timestamp)
 {
   rsxgl_assert(ctx -> timestamp_sync != 0);
 
-  rsxgl_gcm_flush(ctx -> gcm_context());
-  rsxgl_timestamp_wait(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp,ctx -> base.sync_sleep_interval);
+  rsxgl_context_flush(ctx);
+
+  if(rsxgl_timestamp_timeline(timestamp) == ctx -> timeline) {
+    rsxgl_timestamp_wait(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp,ctx -> base.sync_sleep_interval);
+  }
+  else {
+    const rsxgl_sync_object_index_type sync = ctx -> object_context() -> timeline_sync(rsxgl_timestamp_timeline(timestamp));
+    if(sync != 0) {
+      uint32_t cached_timestamp = 0;
+      rsxgl_timestamp_wait(cached_timestamp,sync,timestamp,ctx -> base.sync_sleep_interval);
+    }
+  }
 }
 
 bool
@@ -188,8 +276,36 @@ rsxgl_timestamp_passed(rsxgl_context_t * ctx,const uint32_t timestamp)
 {
   rsxgl_assert(ctx -> timestamp_sync != 0);
 
-  rsxgl_gcm_flush(ctx -> gcm_context());
-  return rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp);
+  rsxgl_context_flush(ctx);
+  return rsxgl_timestamp_check(ctx,timestamp);
+}
+
+bool
+rsxgl_timestamp_other_passed(rsxgl_context_t * ctx,const uint32_t timestamp)
+{
+  // The timeline's context waited for all of its timestamps before it was destroyed:
+  const rsxgl_sync_object_index_type sync = ctx -> object_context() -> timeline_sync(rsxgl_timestamp_timeline(timestamp));
+  return sync == 0 || rsxgl_sync_value(sync) >= timestamp;
+}
+
+void
+rsxgl_context_flush(rsxgl_context_t * ctx)
+{
+  if(ctx -> shared_fifo() != 0) {
+    rsxgl_shared_fifo_submit(ctx -> shared_fifo());
+  }
+  else {
+    rsxgl_gcm_flush(ctx -> gcm_context());
+  }
+}
+
+void
+rsxgl_context_call_shared(rsxgl_context_t * ctx)
+{
+  if(ctx -> shared_fifo() == 0 && rsxgl_shared_fifo_call_pending(ctx -> object_context(),ctx -> gcm_context()) > 0) {
+    ctx -> vp_cache.clear();
+    rsxgl_context_invalidate(ctx);
+  }
 }
 
 #if 0
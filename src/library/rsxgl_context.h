@@ -15,10 +15,14 @@
 #include "uniforms.h"
 #include "textures.h"
 #include "program.h"
+#include "vp_cache.h"
 #include "compiler_context.h"
 #include "framebuffer.h"
 #include "sync.h"
+#include "timestamp.h"
 #include "query.h"
+#include "shared_fifo.h"
+#include "migrate.h"
 
 #include "bit_set.h"
 
@@ -33,6 +37,10 @@ private:
   pipe_context * m_pctx;
   compiler_context_t * m_compiler_context;
 
+  // Non-zero if this context was created to share another context's objects, in which case
+  // base.gcm_context records commands into this buffer instead of the RSX's command channel:
+  rsxgl_shared_fifo_t * m_shared_fifo;
+
 public:
 
   state_t state;
@@ -69,9 +77,17 @@ public:
   program_t::attribs_bitfield_type invalid_attrib_assignments;
   program_t::textures_bitfield_type invalid_texture_assignments;
 
+  // Vertex programs that are resident in the RSX's vertex program memory:
+  rsxgl_vp_cache_t vp_cache;
+
+  // Staging memory for texture uploads:
+  rsxgl_staging_migrate_t staging_migrate;
+
   // Used by glFinish():
   uint32_t ref;
 
+  // Timestamps are issued on this context's own timeline, and released to timestamp_sync:
+  uint32_t timeline;
   rsxgl_sync_object_index_type timestamp_sync;
 
   // Next timestamp to be given out when draw functions are initiated.
@@ -85,7 +101,7 @@ public:
   // Should be initialized to 0:
   uint32_t cached_timestamp;
 
-  rsxgl_context_t(const struct rsxegl_config_t *,gcmContextData *,struct pipe_screen *,struct rsxgl_object_context_t *);
+  rsxgl_context_t(const struct rsxegl_config_t *,gcmContextData *,struct pipe_screen *,struct rsxgl_object_context_t *,const uint32_t,const rsxgl_sync_object_index_type,const uint32_t);
   ~rsxgl_context_t();
 
   inline
@@ -100,6 +116,11 @@ public:
     return m_object_context;
   }
 
+  inline
+  rsxgl_shared_fifo_t * shared_fifo() {
+    return m_shared_fifo;
+  }
+
   inline
   struct pipe_screen * screen() {
     rsxgl_assert(base.screen != 0);
@@ -125,7 +146,8 @@ public:
   static void timestamp_overflow(void *);
 };
 
-extern rsxgl_context_t * rsxgl_ctx;
+// Contexts may be current on more than one thread at once:
+extern __thread rsxgl_context_t * rsxgl_ctx;
 
 static inline rsxgl_context_t *
 current_ctx()
@@ -146,4 +168,32 @@ void rsxgl_timestamp_wait(rsxgl_context_t *,const uint32_t);
 bool rsxgl_timestamp_passed(rsxgl_context_t *,const uint32_t);
 void rsxgl_timestamp_post(rsxgl_context_t *,const uint32_t);
 
+// Objects are shared between contexts, so the timestamp that an object was last used with may be
+// from another context's timeline. Objects must be handed from one context to another with a
+// fence (glWaitSync() or glClientWaitSync()), which calls the other contexts' commands; a context
+// may then wait for timestamps from their timelines:
+bool rsxgl_timestamp_other_passed(rsxgl_context_t *,const uint32_t);
+
+// Like rsxgl_timestamp_passed(), but doesn't flush the command buffer, so that it can be called
+// for every draw:
+static inline bool
+rsxgl_timestamp_check(rsxgl_context_t * ctx,const uint32_t timestamp)
+{
+  if(rsxgl_timestamp_timeline(timestamp) == ctx -> timeline) {
+    return rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp);
+  }
+  else {
+    return rsxgl_timestamp_other_passed(ctx,timestamp);
+  }
+}
+
+// Send the commands recorded so far to the GPU. For a context that shares another context's
+// objects, this queues them to be called by the owning context:
+void rsxgl_context_flush(rsxgl_context_t *);
+
+// Call the commands queued by contexts that share this context's objects. The GPU state those
+// commands leave behind is unknown, so this invalidates all of this context's state; only call
+// it between GL operations:
+void rsxgl_context_call_shared(rsxgl_context_t *);
+
 #endif
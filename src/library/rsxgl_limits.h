@@ -58,8 +58,29 @@
 #define RSXGL_TEXTURE_MIGRATE_BUFFER_ALIGN 1024 * 1024
 #define RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION RSXGL_MEMORY_LOCATION_LOCAL
 
-// Maximum value for a drawing timestamp. It's set this way so that GL objects
-// can have 1 bit for a deleted flag, and the remaining 31 bits for a timestamp.
-#define RSXGL_MAX_TIMESTAMP (((uint32_t)1 << 31) - 1)
+// Command buffers of contexts that share objects with another context are mapped
+// main memory, which must be aligned to 1MB:
+#define RSXGL_SHARED_FIFO_BUFFER_ALIGN 1024 * 1024
+
+// Number of command buffer segments that contexts sharing objects can submit before
+// the context that owns the RSX's command channel calls them:
+#define RSXGL_MAX_SHARED_FIFO_SEGMENTS 64
+
+// Number of copies of each fragment program's microcode. Uniform values are patched into
+// the next copy, so that the GPU can keep drawing with the previous ones; at most 32:
+#define RSXGL_FP_UCODE_COPIES 8
+
+// Number of vertex programs that can be resident in the RSX's vertex program memory at once:
+#define RSXGL_MAX_RESIDENT_VERTEX_PROGRAMS 16
+
+// Each context that shares a set of objects issues timestamps on a timeline of its own, which
+// is kept in the top bits of the timestamp; GL objects have 1 bit for a deleted flag, and the
+// remaining 31 bits for a timestamp:
+#define RSXGL_TIMESTAMP_TIMELINE_BITS 2
+#define RSXGL_TIMESTAMP_TIMELINE_SHIFT (31 - RSXGL_TIMESTAMP_TIMELINE_BITS)
+#define RSXGL_MAX_TIMESTAMP_TIMELINES (1 << RSXGL_TIMESTAMP_TIMELINE_BITS)
+
+// Maximum value for a drawing timestamp, within its timeline:
+#define RSXGL_MAX_TIMESTAMP (((uint32_t)1 << RSXGL_TIMESTAMP_TIMELINE_SHIFT) - 1)
 
 #endif
@@ -30,6 +30,58 @@ rsxgl_init_default_framebuffer(void * ptr)
 }
 
 rsxgl_object_context_t::rsxgl_object_context_t()
-  : m_refCount(0), m_arena_storage(0,rsxgl_init_default_arena), m_attribs_storage(0,0), m_sampler_storage(0,0), m_texture_storage(0,0), m_framebuffer_storage(0,rsxgl_init_default_framebuffer)
+  : m_refCount(0), m_num_segments(0), m_arena_storage(0,rsxgl_init_default_arena), m_attribs_storage(0,0), m_sampler_storage(0,0), m_texture_storage(0,0), m_framebuffer_storage(0,rsxgl_init_default_framebuffer)
 {
+  rsxgl_spinlock_init(&m_segments_lock);
+  rsxgl_spinlock_init(&m_timelines_lock);
+
+  for(uint32_t i = 0;i < RSXGL_MAX_TIMESTAMP_TIMELINES;++i) {
+    m_timeline_syncs[i] = 0;
+    m_timeline_last[i] = i << RSXGL_TIMESTAMP_TIMELINE_SHIFT;
+  }
+}
+
+uint32_t
+rsxgl_object_context_t::acquire_timeline(rsxgl_sync_object_index_type & sync,uint32_t & last)
+{
+  rsxgl_spinlock_guard guard(m_timelines_lock);
+
+  for(uint32_t i = 0;i < RSXGL_MAX_TIMESTAMP_TIMELINES;++i) {
+    if(m_timeline_syncs[i] != 0) continue;
+
+    sync = rsxgl_sync_object_allocate();
+    if(sync == RSXGL_MAX_SYNC_OBJECTS) {
+      break;
+    }
+
+    // Timestamps that objects still hold from the timeline's previous context have passed:
+    last = m_timeline_last[i];
+    rsxgl_sync_cpu_signal(sync,last);
+
+    m_timeline_syncs[i] = sync;
+    return i;
+  }
+
+  return RSXGL_MAX_TIMESTAMP_TIMELINES;
+}
+
+void
+rsxgl_object_context_t::release_timeline(const uint32_t timeline,const uint32_t last)
+{
+  rsxgl_assert(timeline < RSXGL_MAX_TIMESTAMP_TIMELINES);
+
+  rsxgl_spinlock_guard guard(m_timelines_lock);
+
+  rsxgl_sync_object_free(m_timeline_syncs[timeline]);
+  m_timeline_syncs[timeline] = 0;
+  m_timeline_last[timeline] = last;
+}
+
+rsxgl_sync_object_index_type
+rsxgl_object_context_t::timeline_sync(const uint32_t timeline)
+{
+  rsxgl_assert(timeline < RSXGL_MAX_TIMESTAMP_TIMELINES);
+
+  rsxgl_spinlock_guard guard(m_timelines_lock);
+  return m_timeline_syncs[timeline];
 }
@@ -11,12 +11,36 @@
 #include "program.h"
 #include "framebuffer.h"
 #include "query.h"
+#include "spinlock.h"
+#include "sync.h"
+#include "rsxgl_limits.h"
 
 struct rsxgl_object_context_t {
-  uint32_t m_refCount;
+  // Number of contexts sharing these objects. Modified with atomic operations, as contexts
+  // may be created and destroyed on different threads:
+  volatile uint32_t m_refCount;
+
+  // Command buffer segments submitted by contexts that share these objects, waiting to be
+  // called by a context that owns the RSX's command channel (see shared_fifo.h):
+  rsxgl_spinlock_t m_segments_lock;
+  uint32_t m_num_segments;
+  uint32_t m_segments[RSXGL_MAX_SHARED_FIFO_SEGMENTS];
 
   rsxgl_object_context_t();
 
+  // Each context that uses these objects releases the timestamps that it fences them with to a
+  // sync object of its own, on a timeline of its own, so that the other contexts can tell when
+  // the objects are no longer busy. Returns RSXGL_MAX_TIMESTAMP_TIMELINES if every timeline is
+  // taken; otherwise, last is set to the last timestamp that was issued on the timeline, which
+  // the sync object has already been set to:
+  uint32_t acquire_timeline(rsxgl_sync_object_index_type & sync,uint32_t & last);
+
+  // The context has waited for every timestamp it issued, up to last:
+  void release_timeline(const uint32_t timeline,const uint32_t last);
+
+  // Sync object of a timeline, or 0 if no context has it:
+  rsxgl_sync_object_index_type timeline_sync(const uint32_t timeline);
+
   inline
   memory_arena_t::storage_type & arena_storage() {
     return m_arena_storage;
@@ -69,6 +93,10 @@ struct rsxgl_object_context_t {
 
 private:
 
+  rsxgl_spinlock_t m_timelines_lock;
+  rsxgl_sync_object_index_type m_timeline_syncs[RSXGL_MAX_TIMESTAMP_TIMELINES];
+  uint32_t m_timeline_last[RSXGL_MAX_TIMESTAMP_TIMELINES];
+
   memory_arena_t::storage_type m_arena_storage;
   buffer_t::storage_type m_buffer_storage;
   attribs_t::storage_type m_attribs_storage;
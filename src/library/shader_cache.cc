@@ -0,0 +1,471 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// shader_cache.cc - Keep linked programs on disk, so that they needn't be compiled again the
+// next time the application runs.
+
+#include <EGL/egl.h>
+#include "GL3/rsxgl.h"
+
+#include "shader_cache.h"
+#include "rsxgl_config.h"
+#include "debug.h"
+#include "spinlock.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+extern "C" struct rsxgl_init_parameters_t rsxgl_init_parameters;
+
+#define RSXGL_SHADER_CACHE_INDEX_MAGIC 0x52535843 // "RSXC"
+
+namespace {
+
+  struct entry_t {
+    uint64_t key;
+
+    // Size of the program's file; 0 for shaders:
+    uint32_t size;
+
+    uint32_t last_use;
+  };
+
+  struct cache_t {
+    bool initialized, enabled, dirty, saving, flush;
+    std::string path;
+    uint64_t max_size, total_size;
+    uint32_t clock;
+
+    // Number of changes to entries since the index was last written:
+    uint32_t changes;
+
+    std::vector< entry_t > entries;
+
+    cache_t() : initialized(false), enabled(false), dirty(false), saving(false), flush(false), max_size(0), total_size(0), clock(0), changes(0) {
+    }
+  };
+
+  cache_t cache;
+
+  // Protects cache. It's only held while entries are looked up or changed in memory; files
+  // are read, written and removed without it, so that other threads needn't wait for the
+  // disk. cache.path doesn't change once cache.initialized is set:
+  rsxgl_spinlock_t lock = RSXGL_SPINLOCK_INITIALIZER;
+
+  std::string index_path() {
+    return cache.path + "/index";
+  }
+
+  std::string program_path(const uint64_t key) {
+    char name[32];
+    snprintf(name,sizeof(name),"/%08x%08x.rsxp",(unsigned int)(key >> 32),(unsigned int)key);
+    return cache.path + name;
+  }
+
+  void put_word(std::vector< uint8_t > & data,const uint32_t w) {
+    data.push_back((uint8_t)(w >> 24));
+    data.push_back((uint8_t)(w >> 16));
+    data.push_back((uint8_t)(w >> 8));
+    data.push_back((uint8_t)w);
+  }
+
+  uint32_t get_word(const uint8_t * p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+  }
+
+  bool read_file(const std::string & filename,std::vector< uint8_t > & data) {
+    FILE * f = fopen(filename.c_str(),"rb");
+    if(f == 0) return false;
+
+    bool result = false;
+    if(fseek(f,0,SEEK_END) == 0) {
+      const long size = ftell(f);
+      if(size >= 0 && fseek(f,0,SEEK_SET) == 0) {
+	data.resize(size);
+	result = (size == 0) || (fread(&data[0],size,1,f) == 1);
+      }
+    }
+
+    fclose(f);
+    return result;
+  }
+
+  // Write to a temporary file, then rename it, so that an interrupted write doesn't leave
+  // a truncated file behind:
+  bool write_file(const std::string & filename,const std::vector< uint8_t > & data) {
+    const std::string tmp_filename = filename + ".tmp";
+
+    FILE * f = fopen(tmp_filename.c_str(),"wb");
+    if(f == 0) return false;
+
+    const bool written = data.empty() || (fwrite(&data[0],data.size(),1,f) == 1);
+    if(fclose(f) != 0 || !written) {
+      remove(tmp_filename.c_str());
+      return false;
+    }
+
+    remove(filename.c_str());
+    if(rename(tmp_filename.c_str(),filename.c_str()) != 0) {
+      remove(tmp_filename.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  // Index format, as big-endian words:
+  //   magic, RSXGL_SHADER_CACHE_VERSION, RSXGL_PROGRAM_BINARY_VERSION, clock, number of entries,
+  //   entries (key high, key low, size, last use), checksum of everything before it
+  //
+  // Called with the lock held, with the index file's contents:
+  void load_index(const std::vector< uint8_t > & data) {
+    if(data.size() < (6 * sizeof(uint32_t))) return;
+
+    const uint8_t * p = &data[0];
+    const size_t n = data.size() - sizeof(uint32_t);
+
+    if(get_word(p + n) != rsxgl_program_binary_checksum(p,n) ||
+       get_word(p) != RSXGL_SHADER_CACHE_INDEX_MAGIC ||
+       get_word(p + 4) != RSXGL_SHADER_CACHE_VERSION ||
+       get_word(p + 8) != RSXGL_PROGRAM_BINARY_VERSION) {
+      rsxgl_debug_printf("shader cache: discarding index\n");
+      return;
+    }
+
+    const uint32_t clock = get_word(p + 12), num_entries = get_word(p + 16);
+    if(n != ((5 + (num_entries * 4)) * sizeof(uint32_t))) return;
+
+    cache.clock = clock;
+    cache.entries.resize(num_entries);
+
+    p += 5 * sizeof(uint32_t);
+    for(auto & entry : cache.entries) {
+      entry.key = ((uint64_t)get_word(p) << 32) | (uint64_t)get_word(p + 4);
+      entry.size = get_word(p + 8);
+      entry.last_use = get_word(p + 12);
+      cache.total_size += entry.size;
+      p += 4 * sizeof(uint32_t);
+    }
+  }
+
+  // Called with the lock held:
+  void serialize_index(std::vector< uint8_t > & data) {
+    data.clear();
+    data.reserve((6 + (cache.entries.size() * 4)) * sizeof(uint32_t));
+
+    put_word(data,RSXGL_SHADER_CACHE_INDEX_MAGIC);
+    put_word(data,RSXGL_SHADER_CACHE_VERSION);
+    put_word(data,RSXGL_PROGRAM_BINARY_VERSION);
+    put_word(data,cache.clock);
+    put_word(data,cache.entries.size());
+
+    for(const auto & entry : cache.entries) {
+      put_word(data,(uint32_t)(entry.key >> 32));
+      put_word(data,(uint32_t)entry.key);
+      put_word(data,entry.size);
+      put_word(data,entry.last_use);
+    }
+
+    put_word(data,rsxgl_program_binary_checksum(&data[0],data.size()));
+  }
+
+  // Entries are only changed in memory; the index is written once enough changes have been
+  // made, and by rsxgl_shader_cache_flush(). Program files whose entries haven't been written
+  // yet are replaced the next time that the program is inserted. Called with the lock held:
+  void changed() {
+    cache.dirty = true;
+    ++cache.changes;
+  }
+
+  // Write the index if a batch of changes has been made, or if flush is set and there are any
+  // changes. Called without the lock. Only one thread writes the index at a time; a thread
+  // that finds another writing it leaves the other to write it again, if need be, once it's
+  // done:
+  void save_index(const bool flush) {
+    std::vector< uint8_t > data;
+
+    rsxgl_spinlock_lock(&lock);
+
+    if(flush) cache.flush = true;
+
+    while(!cache.saving && cache.dirty && (cache.flush || cache.changes >= RSXGL_CONFIG_shader_cache_index_batch)) {
+      serialize_index(data);
+      cache.saving = true;
+      cache.flush = false;
+
+      // Don't try again until another batch of changes has been made:
+      cache.changes = 0;
+
+      rsxgl_spinlock_unlock(&lock);
+      const bool written = write_file(index_path(),data);
+      rsxgl_spinlock_lock(&lock);
+
+      cache.saving = false;
+      if(written && cache.changes == 0) {
+	cache.dirty = false;
+      }
+    }
+
+    rsxgl_spinlock_unlock(&lock);
+  }
+
+  bool initialize() {
+    {
+      rsxgl_spinlock_guard guard(lock);
+      if(cache.initialized) return cache.enabled;
+    }
+
+    const char * path = rsxgl_init_parameters.shader_cache_path;
+    const bool enabled = (path != 0 && path[0] != 0);
+
+    // Another thread may be doing the same; whichever finishes first initializes the cache:
+    std::vector< uint8_t > data;
+    if(enabled) {
+      read_file(std::string(path) + "/index",data);
+    }
+
+    rsxgl_spinlock_guard guard(lock);
+
+    if(!cache.initialized) {
+      cache.initialized = true;
+
+      if(enabled) {
+	cache.enabled = true;
+	cache.path = path;
+	cache.max_size = (rsxgl_init_parameters.shader_cache_size != 0) ? rsxgl_init_parameters.shader_cache_size : RSXGL_CONFIG_default_shader_cache_size;
+
+	load_index(data);
+      }
+    }
+
+    return cache.enabled;
+  }
+
+  // The following are called with the lock held:
+  std::vector< entry_t >::iterator find(const uint64_t key,const bool is_program) {
+    return std::find_if(cache.entries.begin(),cache.entries.end(),
+			[key,is_program](const entry_t & entry) -> bool {
+			  return entry.key == key && (entry.size > 0) == is_program;
+			});
+  }
+
+  // Programs' files are added to removed, for remove_files() to remove once the lock has been
+  // released:
+  void erase(std::vector< entry_t >::iterator it,std::vector< uint64_t > & removed) {
+    if(it -> size > 0) {
+      removed.push_back(it -> key);
+      cache.total_size -= it -> size;
+    }
+    cache.entries.erase(it);
+    changed();
+  }
+
+  // Remove least recently used entries until there's room for an entry of size bytes:
+  void make_room(const uint32_t size,std::vector< uint64_t > & removed) {
+    while(!cache.entries.empty() &&
+	  ((cache.total_size + size) > cache.max_size || cache.entries.size() >= RSXGL_CONFIG_shader_cache_max_entries)) {
+      // Shaders don't take up any space, so are only evicted if there are too many entries:
+      const bool evict_shaders = cache.entries.size() >= RSXGL_CONFIG_shader_cache_max_entries;
+
+      auto lru = cache.entries.end();
+      for(auto it = cache.entries.begin(),it_end = cache.entries.end();it != it_end;++it) {
+	if(((it -> size > 0) || evict_shaders) &&
+	   (lru == it_end || (cache.clock - it -> last_use) > (cache.clock - lru -> last_use))) {
+	  lru = it;
+	}
+      }
+      if(lru == cache.entries.end()) break;
+
+      erase(lru,removed);
+    }
+  }
+
+  void remove_files(const std::vector< uint64_t > & removed) {
+    for(const auto key : removed) {
+      remove(program_path(key).c_str());
+    }
+  }
+
+}
+
+bool
+rsxgl_shader_cache_enabled()
+{
+  return initialize();
+}
+
+bool
+rsxgl_shader_cache_find_shader(const uint64_t key)
+{
+  if(!initialize()) return false;
+
+  {
+    rsxgl_spinlock_guard guard(lock);
+
+    auto it = find(key,false);
+    if(it == cache.entries.end()) return false;
+
+    it -> last_use = ++cache.clock;
+    changed();
+  }
+
+  save_index(false);
+  return true;
+}
+
+void
+rsxgl_shader_cache_insert_shader(const uint64_t key)
+{
+  if(!initialize()) return;
+
+  std::vector< uint64_t > removed;
+
+  {
+    rsxgl_spinlock_guard guard(lock);
+
+    auto it = find(key,false);
+    if(it == cache.entries.end()) {
+      make_room(0,removed);
+
+      entry_t entry;
+      entry.key = key;
+      entry.size = 0;
+      entry.last_use = ++cache.clock;
+      cache.entries.push_back(entry);
+    }
+    else {
+      it -> last_use = ++cache.clock;
+    }
+
+    changed();
+  }
+
+  remove_files(removed);
+  save_index(false);
+}
+
+bool
+rsxgl_shader_cache_find_program(const uint64_t key,rsxgl_program_binary_t & binary)
+{
+  if(!initialize()) return false;
+
+  uint32_t size = 0;
+
+  {
+    rsxgl_spinlock_guard guard(lock);
+
+    auto it = find(key,true);
+    if(it == cache.entries.end()) return false;
+
+    size = it -> size;
+  }
+
+  // Each file begins with its key, followed by the program:
+  std::vector< uint8_t > data;
+  const bool result =
+    read_file(program_path(key),data) &&
+    data.size() == size &&
+    data.size() > (2 * sizeof(uint32_t)) &&
+    get_word(&data[0]) == (uint32_t)(key >> 32) && get_word(&data[4]) == (uint32_t)key &&
+    rsxgl_program_binary_read(binary,&data[8],data.size() - 8) == RSXGL_PROGRAM_BINARY_OK;
+
+  if(!result) {
+    rsxgl_debug_printf("shader cache: discarding %s\n",program_path(key).c_str());
+  }
+
+  std::vector< uint64_t > removed;
+
+  // The entry may have been evicted while the file was read:
+  {
+    rsxgl_spinlock_guard guard(lock);
+
+    auto it = find(key,true);
+    if(it != cache.entries.end()) {
+      if(result) {
+	it -> last_use = ++cache.clock;
+	changed();
+      }
+      else {
+	erase(it,removed);
+      }
+    }
+  }
+
+  remove_files(removed);
+  save_index(false);
+  return result;
+}
+
+void
+rsxgl_shader_cache_insert_program(const uint64_t key,const rsxgl_program_binary_t & binary)
+{
+  if(!initialize()) return;
+
+  const size_t binary_size = rsxgl_program_binary_size(binary);
+  const size_t size = (2 * sizeof(uint32_t)) + binary_size;
+
+  std::vector< uint64_t > removed;
+  bool fits = false;
+
+  // Room is made, and the entry added, before the file is written, so that other threads
+  // account for its size:
+  {
+    rsxgl_spinlock_guard guard(lock);
+
+    auto it = find(key,true);
+    if(it != cache.entries.end()) {
+      erase(it,removed);
+    }
+
+    fits = size <= cache.max_size;
+    if(fits) {
+      make_room(size,removed);
+
+      entry_t entry;
+      entry.key = key;
+      entry.size = size;
+      entry.last_use = ++cache.clock;
+      cache.entries.push_back(entry);
+      cache.total_size += size;
+      changed();
+    }
+  }
+
+  remove_files(removed);
+
+  if(fits) {
+    std::vector< uint8_t > data;
+    data.reserve(size);
+    put_word(data,(uint32_t)(key >> 32));
+    put_word(data,(uint32_t)key);
+    data.resize(size);
+    rsxgl_program_binary_write(binary,&data[8]);
+
+    // write_file() doesn't leave a file behind when it fails, so there's none to remove:
+    if(!write_file(program_path(key),data)) {
+      rsxgl_spinlock_guard guard(lock);
+
+      auto it = find(key,true);
+      if(it != cache.entries.end()) {
+	erase(it,removed);
+      }
+    }
+  }
+
+  save_index(false);
+}
+
+void
+rsxgl_shader_cache_flush()
+{
+  {
+    rsxgl_spinlock_guard guard(lock);
+    if(!cache.enabled) return;
+  }
+
+  save_index(true);
+}
@@ -0,0 +1,81 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// shader_cache.h - Keep linked programs on disk, so that they needn't be compiled again the
+// next time the application runs.
+//
+// The cache is enabled by setting rsxgl_init_parameters_t::shader_cache_path to an existing
+// directory. It holds two kinds of entry, both keyed by 64-bit FNV-1a hashes:
+// - shaders whose source is known to compile; glCompileShader() defers compiling these,
+//   in case the program that they're linked into is also in the cache.
+// - linked programs, as rsxgl_program_binary_t's, keyed by the hashes of their shaders and
+//   of the state that affects linking (attribute & fragment data bindings, transform
+//   feedback varyings).
+//
+// The directory contains an index, listing the entries and when they were last used, and one
+// file per program. The index is written after every RSXGL_CONFIG_shader_cache_index_batch
+// changes to the entries (including lookups, which update when they were last used), and when
+// a context is destroyed. Files that fail to load (wrong version, bad checksum, truncated) are
+// removed. Once the program files exceed rsxgl_init_parameters_t::shader_cache_size bytes,
+// the least recently used ones are removed.
+//
+// These functions can be called from any thread, including the compiler thread. The cache has
+// a lock of its own, which is only held while its entries are looked up or changed in memory;
+// none of the library's locks, including that one, are held while its files are read or
+// written.
+
+#ifndef rsxgl_shader_cache_H
+#define rsxgl_shader_cache_H
+
+#include "program_binary.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RSXGL_SHADER_CACHE_HASH_INIT 14695981039346656037ULL
+
+// Increment whenever the compiler's output, for the same input, changes:
+#define RSXGL_SHADER_CACHE_VERSION 5
+
+static inline uint64_t
+rsxgl_shader_cache_hash(const void * data,const size_t n,uint64_t hash = RSXGL_SHADER_CACHE_HASH_INIT)
+{
+  const uint8_t * p = (const uint8_t *)data, * end = p + n;
+  for(;p != end;++p) {
+    hash = (hash ^ *p) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static inline uint64_t
+rsxgl_shader_cache_hash(const uint32_t value,uint64_t hash)
+{
+  const uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+  return rsxgl_shader_cache_hash(bytes,4,hash);
+}
+
+// Strings are hashed with their terminating 0, so that consecutive strings can't run together:
+static inline uint64_t
+rsxgl_shader_cache_hash(const char * s,uint64_t hash)
+{
+  for(;;++s) {
+    hash = (hash ^ (uint8_t)*s) * 1099511628211ULL;
+    if(*s == 0) break;
+  }
+  return hash;
+}
+
+bool rsxgl_shader_cache_enabled();
+
+bool rsxgl_shader_cache_find_shader(const uint64_t key);
+void rsxgl_shader_cache_insert_shader(const uint64_t key);
+
+bool rsxgl_shader_cache_find_program(const uint64_t key,rsxgl_program_binary_t &);
+void rsxgl_shader_cache_insert_program(const uint64_t key,const rsxgl_program_binary_t &);
+
+// Write the index, if it has changed since it was last written:
+void rsxgl_shader_cache_flush();
+
+#endif
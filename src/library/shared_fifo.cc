@@ -0,0 +1,184 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// shared_fifo.cc - Command buffers for contexts that share objects with another context.
+
+#include "shared_fifo.h"
+#include "rsxgl_object_context.h"
+
+#include "rsxgl_config.h"
+#include "rsxgl_limits.h"
+#include "rsxgl_assert.h"
+#include "debug.h"
+#include "gl_fifo.h"
+#include "spinlock.h"
+
+#include <malloc.h>
+#include <stdint.h>
+
+// Words kept free at the end of the buffer, so that a segment can always be terminated
+// without gcm_reserve() calling back into rsxgl_shared_fifo_callback():
+static const uint32_t rsxgl_shared_fifo_slack = 8;
+
+static int32_t
+rsxgl_shared_fifo_callback(gcmContextData * context,uint32_t count)
+{
+  rsxgl_shared_fifo_t * fifo = (rsxgl_shared_fifo_t *)context;
+
+  if(count > (fifo -> buffer_length - rsxgl_shared_fifo_slack)) {
+    __rsxgl_assert_func(__FILE__,__LINE__,__PRETTY_FUNCTION__,"command is larger than a shared context's command buffer");
+    return -1;
+  }
+
+  // Hand everything recorded so far to the owning context, and wait for the GPU to finish
+  // with it before starting over at the beginning of the buffer:
+  const uint32_t serial = rsxgl_shared_fifo_submit(fifo);
+  rsxgl_shared_fifo_wait(fifo,serial,RSXGL_SYNC_SLEEP_INTERVAL);
+
+  fifo -> gcm_context.current = fifo -> buffer;
+  fifo -> segment = fifo -> buffer;
+
+  return 0;
+}
+
+rsxgl_shared_fifo_t *
+rsxgl_shared_fifo_create(rsxgl_object_context_t * object_context)
+{
+  rsxgl_assert(object_context != 0);
+
+  const uint32_t size = RSXGL_CONFIG_shared_command_buffer_size;
+
+  rsxgl_shared_fifo_t * fifo = new rsxgl_shared_fifo_t;
+
+  fifo -> object_context = object_context;
+
+  fifo -> buffer = (uint32_t *)memalign(RSXGL_SHARED_FIFO_BUFFER_ALIGN,size);
+  if(fifo -> buffer == 0) {
+    __rsxgl_assert_func(__FILE__,__LINE__,__PRETTY_FUNCTION__,"failed to allocate shared context's command buffer");
+  }
+
+  int32_t s = gcmMapMainMemory(fifo -> buffer,size,&fifo -> buffer_offset);
+  if(s != 0) {
+    __rsxgl_assert_func(__FILE__,__LINE__,__PRETTY_FUNCTION__,"failed to map shared context's command buffer into RSX memory");
+  }
+
+  fifo -> buffer_length = size / sizeof(uint32_t);
+  fifo -> segment = fifo -> buffer;
+
+  fifo -> sync = rsxgl_sync_object_allocate();
+  rsxgl_assert(fifo -> sync != RSXGL_MAX_SYNC_OBJECTS);
+  fifo -> serial = 0;
+  rsxgl_sync_cpu_signal(fifo -> sync,0);
+
+  // The PPU ABI's function descriptors are 64-bit; the GCM context wants a pointer to one
+  // with 32-bit fields:
+  const uint64_t * opd = (const uint64_t *)(void *)&rsxgl_shared_fifo_callback;
+  fifo -> callback_opd[0] = (uint32_t)opd[0];
+  fifo -> callback_opd[1] = (uint32_t)opd[1];
+
+  fifo -> gcm_context.begin = fifo -> buffer;
+  fifo -> gcm_context.end = fifo -> buffer + fifo -> buffer_length - rsxgl_shared_fifo_slack;
+  fifo -> gcm_context.current = fifo -> buffer;
+  fifo -> gcm_context.callback = (gcmContextCallback)fifo -> callback_opd;
+
+  return fifo;
+}
+
+void
+rsxgl_shared_fifo_destroy(rsxgl_shared_fifo_t * fifo)
+{
+  rsxgl_assert(fifo != 0);
+
+  // The owning context may not have called every segment yet; the RSX is done reading the buffer
+  // once it has released the last one:
+  rsxgl_shared_fifo_wait(fifo,rsxgl_shared_fifo_submit(fifo),RSXGL_SYNC_SLEEP_INTERVAL);
+
+  rsxgl_sync_object_free(fifo -> sync);
+
+  // Leak the buffer rather than let the RSX see it reused:
+  int32_t s = gcmUnmapIoAddress(fifo -> buffer_offset);
+  if(s != 0) {
+    __rsxgl_assert_func(__FILE__,__LINE__,__PRETTY_FUNCTION__,"failed to unmap shared context's command buffer from RSX memory");
+  }
+  else {
+    free(fifo -> buffer);
+  }
+
+  delete fifo;
+}
+
+uint32_t
+rsxgl_shared_fifo_submit(rsxgl_shared_fifo_t * fifo)
+{
+  rsxgl_assert(fifo != 0);
+
+  uint32_t * buffer = fifo -> gcm_context.current;
+  if(buffer == fifo -> segment) {
+    return fifo -> serial;
+  }
+
+  // Terminate the segment. There is always room for this, since gcm_context.end leaves
+  // rsxgl_shared_fifo_slack words free:
+  const uint32_t serial = ++fifo -> serial;
+  _rsxgl_emit_sync_gpu_signal_write(buffer,fifo -> sync,serial);
+  gcm_emit_at(buffer,4,gcm_return_cmd());
+
+  const uint32_t offset = fifo -> buffer_offset + (uint32_t)((uint8_t *)fifo -> segment - (uint8_t *)fifo -> buffer);
+
+  fifo -> gcm_context.current = buffer + 5;
+  fifo -> segment = buffer + 5;
+
+  __sync();
+
+  // Queue it, waiting for the owning context to catch up if the queue is full:
+  rsxgl_object_context_t * object_context = fifo -> object_context;
+  for(;;) {
+    rsxgl_spinlock_lock(&object_context -> m_segments_lock);
+    if(object_context -> m_num_segments < RSXGL_MAX_SHARED_FIFO_SEGMENTS) {
+      object_context -> m_segments[object_context -> m_num_segments++] = offset;
+      rsxgl_spinlock_unlock(&object_context -> m_segments_lock);
+      break;
+    }
+    rsxgl_spinlock_unlock(&object_context -> m_segments_lock);
+    usleep(RSXGL_SYNC_SLEEP_INTERVAL);
+  }
+
+  return serial;
+}
+
+void
+rsxgl_shared_fifo_wait(rsxgl_shared_fifo_t * fifo,const uint32_t serial,const useconds_t timeout_interval)
+{
+  rsxgl_assert(fifo != 0);
+
+  volatile uint32_t * object = gcmGetLabelAddress(fifo -> sync);
+  rsxgl_assert(object != 0);
+
+  while(*object < serial) {
+    if(timeout_interval > 0) {
+      usleep(timeout_interval);
+    }
+  }
+}
+
+uint32_t
+rsxgl_shared_fifo_call_pending(rsxgl_object_context_t * object_context,gcmContextData * context)
+{
+  rsxgl_spinlock_guard guard(object_context -> m_segments_lock);
+
+  const uint32_t n = object_context -> m_num_segments;
+  if(n == 0) {
+    return 0;
+  }
+
+  uint32_t * buffer = gcm_reserve(context,n);
+  for(uint32_t i = 0;i < n;++i) {
+    gcm_emit_at(buffer,i,gcm_call_cmd(object_context -> m_segments[i]));
+  }
+  gcm_finish_n_commands(context,n);
+
+  object_context -> m_num_segments = 0;
+
+  return n;
+}
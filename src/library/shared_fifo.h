@@ -0,0 +1,63 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// shared_fifo.h - Command buffers for contexts that share objects with another context.
+//
+// The RSX has one command channel, which belongs to the contexts that own their objects
+// (normally, the context that renders to the screen). A context that is created to share
+// another context's objects - for instance, to load resources on another thread - records
+// its commands into a private buffer instead. Flushing that context turns the commands
+// recorded since the previous flush into a "segment," which is terminated by a semaphore
+// release and a "return" command, and which is queued on the shared object context. The
+// owning context "calls" the queued segments from its own command stream when it is safe
+// to do so (see rsxgl_context_call_shared()).
+
+#ifndef rsxgl_shared_fifo_H
+#define rsxgl_shared_fifo_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <rsx/gcm_sys.h>
+
+#include "sync.h"
+
+struct rsxgl_object_context_t;
+
+struct rsxgl_shared_fifo_t {
+  // Must be the first member; gcm_reserve_callback() hands the callback a pointer to it.
+  gcmContextData gcm_context;
+
+  rsxgl_object_context_t * object_context;
+
+  uint32_t * buffer;
+  uint32_t buffer_offset, buffer_length;
+
+  // Start of the commands that have not been submitted yet:
+  uint32_t * segment;
+
+  // Released by the GPU as it finishes each segment, with the serial number of the segment:
+  rsxgl_sync_object_index_type sync;
+  uint32_t serial;
+
+  // 32-bit function descriptor for the buffer-full callback, in the form that
+  // gcm_reserve_callback() expects:
+  uint32_t callback_opd[2];
+};
+
+rsxgl_shared_fifo_t * rsxgl_shared_fifo_create(rsxgl_object_context_t *);
+void rsxgl_shared_fifo_destroy(rsxgl_shared_fifo_t *);
+
+// Queue the commands that were recorded since the last submission. Returns the serial number
+// of the queued segment, or of the last segment if there was nothing to queue:
+uint32_t rsxgl_shared_fifo_submit(rsxgl_shared_fifo_t *);
+
+// Block until the GPU has finished a submitted segment:
+void rsxgl_shared_fifo_wait(rsxgl_shared_fifo_t *,const uint32_t,const useconds_t);
+
+// Call every queued segment from another command stream. Returns the number of segments called:
+uint32_t rsxgl_shared_fifo_call_pending(rsxgl_object_context_t *,gcmContextData *);
+
+#endif
@@ -0,0 +1,87 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// spinlock.h - Lightweight lock for state that is shared by contexts current on different
+// threads (object storage, memory spaces, the queue of command buffer segments, etc.).
+//
+// Critical sections protected by these locks are expected to be short. A thread that
+// fails to take the lock after a number of tries yields the PPU to the other hardware
+// thread rather than starving it.
+
+#ifndef rsxgl_spinlock_H
+#define rsxgl_spinlock_H
+
+#include <stdint.h>
+#include <sys/thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RSXGL_SPINLOCK_SPIN_COUNT 64
+
+typedef struct rsxgl_spinlock_t {
+  volatile uint32_t value;
+} rsxgl_spinlock_t;
+
+#define RSXGL_SPINLOCK_INITIALIZER { 0 }
+
+static inline void
+rsxgl_spinlock_init(rsxgl_spinlock_t * lock)
+{
+  lock -> value = 0;
+}
+
+static inline int
+rsxgl_spinlock_trylock(rsxgl_spinlock_t * lock)
+{
+  return __sync_lock_test_and_set(&lock -> value,1) == 0;
+}
+
+static inline void
+rsxgl_spinlock_lock(rsxgl_spinlock_t * lock)
+{
+  uint32_t spins = 0;
+  while(!rsxgl_spinlock_trylock(lock)) {
+    // Wait for the lock to look free before attempting the atomic operation again:
+    while(lock -> value != 0) {
+      if(++spins == RSXGL_SPINLOCK_SPIN_COUNT) {
+	sysThreadYield();
+	spins = 0;
+      }
+    }
+  }
+}
+
+static inline void
+rsxgl_spinlock_unlock(rsxgl_spinlock_t * lock)
+{
+  __sync_lock_release(&lock -> value);
+}
+
+#ifdef __cplusplus
+}
+
+// Hold a lock for the duration of a scope:
+struct rsxgl_spinlock_guard {
+  rsxgl_spinlock_t & m_lock;
+
+  rsxgl_spinlock_guard(rsxgl_spinlock_t & lock)
+    : m_lock(lock) {
+    rsxgl_spinlock_lock(&m_lock);
+  }
+
+  ~rsxgl_spinlock_guard() {
+    rsxgl_spinlock_unlock(&m_lock);
+  }
+
+private:
+
+  rsxgl_spinlock_guard(const rsxgl_spinlock_guard &);
+  rsxgl_spinlock_guard & operator =(const rsxgl_spinlock_guard &);
+};
+#endif
+
+#endif
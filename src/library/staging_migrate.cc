@@ -0,0 +1,96 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// staging_migrate.cc
+
+#include "migrate.h"
+
+#include "rsxgl_config.h"
+#include "rsxgl_context.h"
+#include "rsxgl_assert.h"
+#include "timestamp.h"
+#include "mem.h"
+
+void *
+rsxgl_staging_migrate_memalign(rsxgl_context_t * ctx,const rsx_size_t align,const rsx_size_t size)
+{
+  rsxgl_staging_migrate_t & staging = ctx -> staging_migrate;
+  const uint32_t capacity = RSXGL_CONFIG_staging_migrate_buffer_size;
+
+  if(size > capacity) return 0;
+
+  if(staging.buffer == 0) {
+    staging.buffer = rsxgl_rsx_memalign(RSXGL_CACHE_LINE_SIZE,capacity);
+    if(staging.buffer == 0) return 0;
+  }
+
+  rsxgl_assert(staging.regions.empty() || staging.regions.back().timestamp != 0);
+
+  // Regions whose copies are done:
+  while(!staging.regions.empty() && rsxgl_timestamp_check(ctx,staging.regions.front().timestamp)) {
+    staging.regions.pop_front();
+  }
+
+  // Find room after the newest region, or at the start of the ring, waiting for the oldest
+  // regions until there is some:
+  uint32_t offset = 0;
+  while(!staging.regions.empty()) {
+    const rsxgl_staging_migrate_t::region_t & head = staging.regions.front(), & tail = staging.regions.back();
+    const uint32_t tail_offset = (tail.end + align - 1) & ~(align - 1);
+
+    if(tail.offset >= head.offset) {
+      if((tail_offset + size) <= capacity) {
+	offset = tail_offset;
+	break;
+      }
+      else if(size <= head.offset) {
+	offset = 0;
+	break;
+      }
+    }
+    else if((tail_offset + size) <= head.offset) {
+      offset = tail_offset;
+      break;
+    }
+
+    rsxgl_timestamp_wait(ctx,head.timestamp);
+    staging.regions.pop_front();
+  }
+
+  rsxgl_staging_migrate_t::region_t region = { offset, offset + (uint32_t)size, 0 };
+  staging.regions.push_back(region);
+
+  return (uint8_t *)staging.buffer + offset;
+}
+
+void
+rsxgl_staging_migrate_free(rsxgl_context_t * ctx,const void * ptr,const uint32_t timestamp)
+{
+  rsxgl_staging_migrate_t & staging = ctx -> staging_migrate;
+
+  rsxgl_assert(!staging.regions.empty());
+  rsxgl_assert(staging.regions.back().timestamp == 0);
+  rsxgl_assert((const uint8_t *)ptr == (const uint8_t *)staging.buffer + staging.regions.back().offset);
+  rsxgl_assert(timestamp != 0);
+
+  staging.regions.back().timestamp = timestamp;
+}
+
+void
+rsxgl_staging_migrate_reset(rsxgl_context_t * ctx)
+{
+  ctx -> staging_migrate.regions.clear();
+}
+
+void
+rsxgl_staging_migrate_destroy(rsxgl_context_t * ctx)
+{
+  rsxgl_staging_migrate_t & staging = ctx -> staging_migrate;
+
+  staging.regions.clear();
+  if(staging.buffer != 0) {
+    rsxgl_rsx_free(staging.buffer);
+    staging.buffer = 0;
+  }
+}
@@ -0,0 +1,253 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// swizzle.h - Swizzled (Morton order) texture layout, and copying linear images into it with
+// the CPU or with the RSX's scaled image engine.
+
+#ifndef rsxgl_swizzle_H
+#define rsxgl_swizzle_H
+
+#include "arena.h"
+#include "gl_fifo.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+// A texel's offset in a swizzled image interleaves the bits of its x, y and z coordinates,
+// lowest first, leaving out each coordinate once it has run out of bits (so a rectangular 2D
+// image is a row of square swizzled tiles). These masks select which bits of the offset come
+// from each coordinate:
+struct rsxgl_swizzle_t {
+  uint32_t mask[3];
+
+  // width, height & depth are powers of two:
+  rsxgl_swizzle_t(uint32_t width,uint32_t height,uint32_t depth) {
+    uint32_t size[3] = { width >> 1, height >> 1, depth >> 1 };
+
+    mask[0] = 0;
+    mask[1] = 0;
+    mask[2] = 0;
+
+    for(uint32_t bit = 1;size[0] || size[1] || size[2];) {
+      for(int j = 0;j < 3;++j) {
+	if(size[j]) {
+	  mask[j] |= bit;
+	  size[j] >>= 1;
+	  bit <<= 1;
+	}
+      }
+    }
+  }
+
+  // Spread the bits of coordinate j into the positions that it occupies in an offset:
+  uint32_t spread(int j,uint32_t value) const {
+    uint32_t result = 0;
+    for(uint32_t m = mask[j];m != 0 && value != 0;m &= m - 1,value >>= 1) {
+      if(value & 1) result |= m & -m;
+    }
+    return result;
+  }
+
+  uint32_t offset(uint32_t x,uint32_t y,uint32_t z) const {
+    return spread(0,x) | spread(1,y) | spread(2,z);
+  }
+
+  // Given the spread bits of a coordinate, returns the spread bits of the next one:
+  uint32_t next(int j,uint32_t spread_value) const {
+    return ((spread_value | ~mask[j]) + 1) & mask[j];
+  }
+};
+
+static inline bool
+rsxgl_is_pot(uint32_t value)
+{
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+template< size_t Bytes >
+static inline void
+rsxgl_swizzle_copy_row(uint8_t * dst,const rsxgl_swizzle_t & swizzle,uint32_t x_bits,const uint32_t yz_bits,const uint8_t * src,uint32_t width)
+{
+  for(;width > 0;--width,src += Bytes) {
+    memcpy(dst + (size_t)(x_bits | yz_bits) * Bytes,src,Bytes);
+    x_bits = swizzle.next(0,x_bits);
+  }
+}
+
+// Copy a width x height x depth block of bytes-sized texels from a linear image (rows
+// src_pitch bytes apart, images src_image_pitch bytes apart) to (x,y,z) in a swizzled image
+// of dst_size. Rather than compute each texel's offset from scratch, the spread bits of each
+// coordinate are incremented:
+static inline void
+rsxgl_swizzle_copy(void * dst,const uint32_t dst_size[3],uint32_t x,uint32_t y,uint32_t z,
+		   const void * src,uint32_t src_pitch,uint32_t src_image_pitch,
+		   uint32_t bytes,uint32_t width,uint32_t height,uint32_t depth)
+{
+  const rsxgl_swizzle_t swizzle(dst_size[0],dst_size[1],dst_size[2]);
+  const uint32_t x_bits = swizzle.spread(0,x);
+  uint32_t z_bits = swizzle.spread(2,z);
+
+  for(uint32_t k = 0;k < depth;++k,z_bits = swizzle.next(2,z_bits)) {
+    const uint8_t * src_row = (const uint8_t *)src + (size_t)k * src_image_pitch;
+    uint32_t y_bits = swizzle.spread(1,y);
+
+    for(uint32_t j = 0;j < height;++j,y_bits = swizzle.next(1,y_bits),src_row += src_pitch) {
+      switch(bytes) {
+      case 1:
+	rsxgl_swizzle_copy_row< 1 >((uint8_t *)dst,swizzle,x_bits,y_bits | z_bits,src_row,width);
+	break;
+      case 2:
+	rsxgl_swizzle_copy_row< 2 >((uint8_t *)dst,swizzle,x_bits,y_bits | z_bits,src_row,width);
+	break;
+      case 4:
+	rsxgl_swizzle_copy_row< 4 >((uint8_t *)dst,swizzle,x_bits,y_bits | z_bits,src_row,width);
+	break;
+      case 8:
+	rsxgl_swizzle_copy_row< 8 >((uint8_t *)dst,swizzle,x_bits,y_bits | z_bits,src_row,width);
+	break;
+      case 16:
+	rsxgl_swizzle_copy_row< 16 >((uint8_t *)dst,swizzle,x_bits,y_bits | z_bits,src_row,width);
+	break;
+      default:
+	for(uint32_t i = 0,x_bits_i = x_bits;i < width;++i,x_bits_i = swizzle.next(0,x_bits_i)) {
+	  memcpy((uint8_t *)dst + (size_t)(x_bits_i | y_bits | z_bits) * bytes,src_row + (size_t)i * bytes,bytes);
+	}
+	break;
+      }
+    }
+  }
+}
+
+// The reverse of rsxgl_swizzle_copy(), a texel at a time; only used when a swizzled texture needs
+// to be made linear:
+static inline void
+rsxgl_unswizzle_copy(void * dst,uint32_t dst_pitch,uint32_t dst_image_pitch,
+		     const void * src,const uint32_t src_size[3],
+		     uint32_t bytes,uint32_t width,uint32_t height,uint32_t depth)
+{
+  const rsxgl_swizzle_t swizzle(src_size[0],src_size[1],src_size[2]);
+
+  for(uint32_t k = 0,z_bits = 0;k < depth;++k,z_bits = swizzle.next(2,z_bits)) {
+    for(uint32_t j = 0,y_bits = 0;j < height;++j,y_bits = swizzle.next(1,y_bits)) {
+      uint8_t * dst_row = (uint8_t *)dst + (size_t)k * dst_image_pitch + (size_t)j * dst_pitch;
+      for(uint32_t i = 0,x_bits = 0;i < width;++i,x_bits = swizzle.next(0,x_bits),dst_row += bytes) {
+	memcpy(dst_row,(const uint8_t *)src + (size_t)(x_bits | y_bits | z_bits) * bytes,bytes);
+      }
+    }
+  }
+}
+
+// The scaled image from memory (SIFM) engine can write into a swizzled surface, so the RSX can
+// swizzle 2D images of 1, 2 or 4 byte texels by itself. The subchannels and object handle are the
+// ones that libgcm's default command buffer setup binds:
+enum rsxgl_swizzle_transfer_objects {
+  RSXGL_SWIZZLE_SURFACE_SUBCHANNEL = 5,
+  RSXGL_SCALED_IMAGE_SUBCHANNEL = 6,
+  RSXGL_SWIZZLE_SURFACE_HANDLE = 0x31337A73
+};
+
+// Swizzled surfaces can be at most 1024 texels on a side; larger images are transferred in
+// square blocks, which are themselves swizzled images:
+#define RSXGL_MAX_SWIZZLE_TRANSFER_LOG2 10
+
+static inline bool
+rsxgl_swizzle_transfer_supported(const memory_t & dst,uint32_t bytes,uint32_t width,uint32_t height)
+{
+  return (bytes == 1 || bytes == 2 || bytes == 4) &&
+    (dst.offset & 63) == 0 &&
+    (width * height * bytes) >= 64 &&
+    width >= 8;
+}
+
+// Copy a width x height block from a linear image at src to (x,y) in the swizzled 2D image of
+// dst_width x dst_height at dst. If they're given, the texels are converted from sifm_format (an
+// NV03_SCALED_IMAGE_FROM_MEMORY_COLOR_FORMAT) to surface_format (an
+// NV04_SWIZZLED_SURFACE_FORMAT_COLOR); bytes and src_bytes are the sizes of the destination's and
+// the source's texels:
+static inline void
+rsxgl_swizzle_transfer(gcmContextData * context,
+		       const memory_t & dst,const uint32_t dst_width,const uint32_t dst_height,const uint32_t x,const uint32_t y,
+		       const memory_t & src,const uint32_t srcpitch,const uint8_t bytes,
+		       const uint32_t width,const uint32_t height,
+		       uint32_t surface_format = 0,uint32_t sifm_format = 0,uint8_t src_bytes = 0)
+{
+  // Otherwise NV04_SWIZZLED_SURFACE_FORMAT_COLOR_Y8, _R5G6B5, _A8R8G8B8; and the same for NV03_SCALED_IMAGE_FROM_MEMORY_COLOR_FORMAT.
+  // Texels are copied without being converted, so these formats stand for any format of the same size:
+  if(surface_format == 0) {
+    surface_format = (bytes == 1) ? 0x1 : (bytes == 2) ? 0x4 : 0xa;
+    sifm_format = (bytes == 1) ? 0x8 : (bytes == 2) ? 0x7 : 0x3;
+    src_bytes = bytes;
+  }
+
+  const uint32_t block_width = std::min(dst_width,(uint32_t)1 << RSXGL_MAX_SWIZZLE_TRANSFER_LOG2);
+  const uint32_t block_height = std::min(dst_height,(uint32_t)1 << RSXGL_MAX_SWIZZLE_TRANSFER_LOG2);
+  const rsxgl_swizzle_t swizzle(dst_width,dst_height,1);
+
+  {
+    uint32_t * buffer = gcm_reserve(context,8);
+
+    // NV04_SWIZZLED_SURFACE_DMA_IMAGE = 0x184
+    gcm_emit_channel_method_at(buffer,0,RSXGL_SWIZZLE_SURFACE_SUBCHANNEL,0x184,1);
+    gcm_emit_at(buffer,1,RSXGL_TRANSFER_LOCATION(dst.location));
+
+    // NV04_SWIZZLED_SURFACE_FORMAT = 0x300
+    gcm_emit_channel_method_at(buffer,2,RSXGL_SWIZZLE_SURFACE_SUBCHANNEL,0x300,1);
+    gcm_emit_at(buffer,3,surface_format | ((31 - __builtin_clz(block_width)) << 16) | ((31 - __builtin_clz(block_height)) << 24));
+
+    // NV03_SCALED_IMAGE_FROM_MEMORY_DMA_IMAGE = 0x184
+    gcm_emit_channel_method_at(buffer,4,RSXGL_SCALED_IMAGE_SUBCHANNEL,0x184,1);
+    gcm_emit_at(buffer,5,RSXGL_TRANSFER_LOCATION(src.location));
+
+    // NV04_SCALED_IMAGE_FROM_MEMORY_SURFACE = 0x198
+    gcm_emit_channel_method_at(buffer,6,RSXGL_SCALED_IMAGE_SUBCHANNEL,0x198,1);
+    gcm_emit_at(buffer,7,RSXGL_SWIZZLE_SURFACE_HANDLE);
+
+    gcm_finish_n_commands(context,8);
+  }
+
+  for(uint32_t by = y / block_height,ey = (y + height - 1) / block_height;by <= ey;++by) {
+    const int32_t ry = std::max((int32_t)y - (int32_t)(block_height * by),0);
+    const int32_t rh = std::min((int32_t)block_height,(int32_t)(y + height) - (int32_t)(block_height * by)) - ry;
+
+    for(uint32_t bx = x / block_width,ex = (x + width - 1) / block_width;bx <= ex;++bx) {
+      const int32_t rx = std::max((int32_t)x - (int32_t)(block_width * bx),0);
+      const int32_t rw = std::min((int32_t)block_width,(int32_t)(x + width) - (int32_t)(block_width * bx)) - rx;
+
+      const uint32_t dst_offset = dst.offset + swizzle.offset(bx * block_width,by * block_height,0) * bytes;
+      const uint32_t src_offset = src.offset + (block_height * by + ry - y) * srcpitch + (block_width * bx + rx - x) * src_bytes;
+
+      uint32_t * buffer = gcm_reserve(context,17);
+
+      // NV04_SWIZZLED_SURFACE_OFFSET = 0x304
+      gcm_emit_channel_method_at(buffer,0,RSXGL_SWIZZLE_SURFACE_SUBCHANNEL,0x304,1);
+      gcm_emit_at(buffer,1,dst_offset);
+
+      // NV03_SCALED_IMAGE_FROM_MEMORY_COLOR_CONVERSION = 0x2fc
+      gcm_emit_channel_method_at(buffer,2,RSXGL_SCALED_IMAGE_SUBCHANNEL,0x2fc,9);
+      gcm_emit_at(buffer,3,1); // truncate
+      gcm_emit_at(buffer,4,sifm_format);
+      gcm_emit_at(buffer,5,3); // source copy
+      gcm_emit_at(buffer,6,rx | (ry << 16)); // clip point
+      gcm_emit_at(buffer,7,rw | (rh << 16)); // clip size
+      gcm_emit_at(buffer,8,rx | (ry << 16)); // out point
+      gcm_emit_at(buffer,9,rw | (rh << 16)); // out size
+      gcm_emit_at(buffer,10,1 << 20); // ds/dx
+      gcm_emit_at(buffer,11,1 << 20); // dt/dy
+
+      // NV03_SCALED_IMAGE_FROM_MEMORY_SIZE = 0x400
+      gcm_emit_channel_method_at(buffer,12,RSXGL_SCALED_IMAGE_SUBCHANNEL,0x400,4);
+      gcm_emit_at(buffer,13,((rw + 7) & ~7) | (rh << 16));
+      gcm_emit_at(buffer,14,srcpitch | 0x00010000); // origin center, point sampled
+      gcm_emit_at(buffer,15,src_offset);
+      gcm_emit_at(buffer,16,0);
+
+      gcm_finish_n_commands(context,17);
+    }
+  }
+}
+
+#endif
@@ -14,6 +14,8 @@
 #include "attribs.h"
 #include "uniforms.h"
 #include "gl_object.h"
+#include "shared_fifo.h"
+#include "spinlock.h"
 
 #include <GL3/gl3.h>
 #include "error.h"
@@ -23,10 +25,12 @@
 #endif
 #define GLAPI extern "C"
 
+// Also a point at which commands submitted by contexts that share ctx's objects can be called:
 static inline void
 rsxgl_flush(rsxgl_context_t * ctx)
 {
-  rsxgl_gcm_flush(ctx -> gcm_context());
+  rsxgl_context_call_shared(ctx);
+  rsxgl_context_flush(ctx);
 }
 
 GLAPI void APIENTRY
@@ -43,6 +47,13 @@ glFinish (void)
 {
   rsxgl_context_t * ctx = current_ctx();
 
+  // A context that shares another context's objects doesn't own the ref register; wait for
+  // the GPU to finish its last segment instead:
+  if(ctx -> shared_fifo() != 0) {
+    rsxgl_shared_fifo_wait(ctx -> shared_fifo(),rsxgl_shared_fifo_submit(ctx -> shared_fifo()),ctx -> base.sync_sleep_interval);
+    RSXGL_NOERROR_();
+  }
+
   // TODO - Rumor has it that waiting on ctx -> ref is "slow". See if this is unacceptable, and see if a sync object is any better.
   const uint32_t ref = ctx -> ref++;
   rsxgl_emit_set_ref(ctx -> gcm_context(),ref);
@@ -87,9 +98,13 @@ rsxgl_sync_object_name_space()
   return name_space;
 }
 
+// Contexts on different threads allocate semaphores:
+static rsxgl_spinlock_t rsxgl_sync_object_lock = RSXGL_SPINLOCK_INITIALIZER;
+
 rsxgl_sync_object_index_type
 rsxgl_sync_object_allocate()
 {
+  rsxgl_spinlock_guard guard(rsxgl_sync_object_lock);
   std::pair< rsxgl_sync_object_name_space_type::name_type, bool > tmp = rsxgl_sync_object_name_space().create_name();
   if(tmp.second) {
     return tmp.first + 64;
@@ -104,6 +119,7 @@ rsxgl_sync_object_free(const rsxgl_sync_object_index_type index)
 {
   const rsxgl_sync_object_index_type tmp = index - 64;
   if(tmp < RSXGL_MAX_SYNC_OBJECTS) {
+    rsxgl_spinlock_guard guard(rsxgl_sync_object_lock);
     rsxgl_sync_object_name_space().destroy_name(tmp);
   }
 }
@@ -141,7 +157,7 @@ static uint32_t _rsxgl_sync_token = 0;
 static uint32_t
 rsxgl_sync_token()
 {
-  return (_rsxgl_sync_token = (_rsxgl_sync_token + 1) & rsxgl_sync_token_max);
+  return __sync_add_and_fetch(&_rsxgl_sync_token,1) & rsxgl_sync_token_max;
 }
 
 GLAPI GLsync APIENTRY
@@ -250,7 +266,19 @@ glWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  // TODO - Do something here. Not sure what.
+  rsxgl_context_t * ctx = current_ctx();
+
+  rsxgl_sync_object_t * sync_object = reinterpret_cast< rsxgl_sync_object_t * >(sync);
+
+  if(sync_object -> status) {
+    RSXGL_NOERROR_();
+  }
+
+  // The fence may have been placed by a context that shares ctx's objects - its commands
+  // need to be called first:
+  rsxgl_context_call_shared(ctx);
+
+  rsxgl_sync_gpu_wait(ctx -> gcm_context(),sync_object -> index,sync_object -> value);
 
   RSXGL_NOERROR_();
 }
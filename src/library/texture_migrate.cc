@@ -10,6 +10,7 @@
 #include "debug.h"
 #include "rsxgl_assert.h"
 #include "rsxgl_limits.h"
+#include "spinlock.h"
 
 #include <rsx/gcm_sys.h>
 
@@ -67,16 +68,21 @@ rsxgl_texture_migrate_buffer_free(void * ptr)
 #endif
 }
 
+// Textures may be specified by contexts current on different threads:
+static rsxgl_spinlock_t rsxgl_texture_migrate_buffer_lock = RSXGL_SPINLOCK_INITIALIZER;
+
 static inline
 void * rsxgl_texture_migrate_buffer()
 {
+  rsxgl_spinlock_guard guard(rsxgl_texture_migrate_buffer_lock);
+
   if(_rsxgl_texture_migrate_buffer == 0) {
     _rsxgl_texture_migrate_buffer = rsxgl_texture_migrate_buffer_new (rsxgl_texture_migrate_align, rsxgl_texture_migrate_size,
                                                                       &rsxgl_texture_migrate_buffer_offset);
 
     rsxgl_assert(_rsxgl_texture_migrate_buffer != 0);
 
-    rsxgl_texture_migrate_buffer_space = create_mspace_with_base(_rsxgl_texture_migrate_buffer,rsxgl_texture_migrate_size,0);
+    rsxgl_texture_migrate_buffer_space = create_mspace_with_base(_rsxgl_texture_migrate_buffer,rsxgl_texture_migrate_size,1);
   }
 
   return _rsxgl_texture_migrate_buffer;
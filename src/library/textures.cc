@@ -4,15 +4,21 @@
 //
 // textures.cc - Handle texture maps.
 
+#include "rsxgl_config.h"
 #include "debug.h"
 #include "rsxgl_assert.h"
 #include "rsxgl_context.h"
 #include "gl_constants.h"
 #include "textures.h"
 #include "texture_migrate.h"
+#include "migrate.h"
+#include "swizzle.h"
+#include "format_convert.h"
+#include "mipmap.h"
 
 #include <GL3/gl3.h>
 #include "GL3/gl3ext.h"
+#include "GL3/rsxgl3ext.h"
 #include "error.h"
 
 #include <rsx/gcm_sys.h>
@@ -70,6 +76,20 @@ sampler_t::storage_type & sampler_t::storage()
   return current_object_ctx() -> sampler_storage();
 }
 
+// Serials are never 0. Samplers are shared between contexts, which may be current on different
+// threads:
+static volatile uint32_t rsxgl_sampler_serial = 0;
+
+static inline uint32_t
+rsxgl_sampler_next_serial()
+{
+  uint32_t serial = __sync_add_and_fetch(&rsxgl_sampler_serial,1);
+  if(serial == 0) {
+    serial = __sync_add_and_fetch(&rsxgl_sampler_serial,1);
+  }
+  return serial;
+}
+
 sampler_t::sampler_t()
 {
   wrap_s = RSXGL_REPEAT;
@@ -85,6 +105,8 @@ sampler_t::sampler_t()
   lodBias = 0.0f;
   minLod = 0.0f;
   maxLod = 12.0f;
+
+  serial = rsxgl_sampler_next_serial();
 }
 
 GLAPI void APIENTRY
@@ -168,6 +190,8 @@ glBindSampler (GLuint unit, GLuint sampler_name)
 static inline void
 _rsxgl_set_sampler_parameteri(rsxgl_context_t * ctx,sampler_t & sampler,GLenum pname, uint32_t param)
 {
+  sampler.serial = rsxgl_sampler_next_serial();
+
   if(pname == GL_TEXTURE_MIN_FILTER) {
     switch(param) {
     case GL_NEAREST:
@@ -390,6 +414,8 @@ _rsxgl_get_sampler_parameteri(rsxgl_context_t * ctx,sampler_t & sampler,GLenum p
 static inline void
 _rsxgl_set_sampler_parameterf(rsxgl_context_t * ctx,sampler_t & sampler,GLenum pname,float param)
 {
+  sampler.serial = rsxgl_sampler_next_serial();
+
   if(pname == GL_TEXTURE_MIN_LOD) {
     sampler.minLod = param;
   }
@@ -611,9 +637,10 @@ texture_t::storage_type & texture_t::storage()
 
 texture_t::texture_t()
   : deleted(0), timestamp(0), ref_count(0),
-    invalid(0), invalid_complete(0),
+    invalid(0), invalid_complete(0), invalid_contents(0),
     complete(0), immutable(0),
-    cube(0), rect(0), num_levels(0), dims(0), pformat(PIPE_FORMAT_NONE), format(0), pitch(0), remap(0)
+    cube(0), rect(0), num_levels(0), storage_levels(0), swizzled(0), linear(0), dims(0), pformat(PIPE_FORMAT_NONE), packet_serial(0), format(0), pitch(0), remap(0),
+    resident_level(0), requested_resident_level(0), resident_timestamp(0), release_timestamp(0), replaced_timestamp(0)
 {
   swizzle.r = RSXGL_TEXTURE_SWIZZLE_FROM_R;
   swizzle.g = RSXGL_TEXTURE_SWIZZLE_FROM_G;
@@ -630,10 +657,22 @@ texture_t::~texture_t()
   if(memory.owner && memory) {
     rsxgl_arena_free(memory_arena_t::storage().at(arena),memory);
   }
+  if(replaced_memory.owner && replaced_memory) {
+    rsxgl_arena_free(memory_arena_t::storage().at(arena),replaced_memory);
+  }
+}
+
+// The texture's state has changed; its register packet is built again when it's next sampled,
+// and every unit that it's bound to is validated again:
+static inline void
+rsxgl_texture_invalidate(rsxgl_context_t * ctx,texture_t & texture)
+{
+  texture.packet_serial = 0;
+  ctx -> invalid_textures |= texture.binding_bitfield;
 }
 
 texture_t::level_t::level_t()
-  : dims(0), cube(0), rect(0), pformat(PIPE_FORMAT_NONE), pitch(0), memory(RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION,0,1)
+  : dims(0), cube(0), rect(0), stored(0), pformat(PIPE_FORMAT_NONE), pitch(0), memory(RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION,0,1), memory_ptr(0)
 {
   size[0] = 0;
   size[1] = 0;
@@ -682,6 +721,10 @@ glDeleteTextures (GLsizei n, const GLuint *textures)
 	rsxgl_timestamp_wait(ctx,texture.timestamp);
 	texture.timestamp = 0;
       }
+      if(texture.replaced_timestamp > 0) {
+	rsxgl_timestamp_wait(ctx,texture.replaced_timestamp);
+	texture.replaced_timestamp = 0;
+      }
 
       texture_t::gl_object_type::maybe_delete(texture_name);
     }
@@ -729,17 +772,30 @@ rsxgl_texture_target_dims(GLenum target)
   }
 }
 
+// Swizzled textures have no pitch; each of their levels is packed:
 static inline uint32_t
-rsxgl_get_tex_level_offset_size(const texture_t::dimension_size_type _size[3],
-				const uint32_t pitch,
+rsxgl_get_tex_level_pitch(const texture_t & texture,const texture_t::dimension_size_type width)
+{
+  return texture.swizzled ? util_format_get_stride(texture.pformat,width) : texture.pitch;
+}
+
+// Bytes taken by a level of size; rows of compressed formats are rows of blocks:
+static inline uint32_t
+rsxgl_get_tex_level_size(const texture_t & texture,const texture_t::dimension_size_type size[3])
+{
+  return util_format_get_2d_size(texture.pformat,rsxgl_get_tex_level_pitch(texture,size[0]),size[1]) * size[2];
+}
+
+static inline uint32_t
+rsxgl_get_tex_level_offset_size(const texture_t & texture,
 				const texture_t::level_size_type level,
 				texture_t::dimension_size_type * outsize)
 {
-  texture_t::dimension_size_type size[3] = { _size[0], _size[1], _size[2] };
+  texture_t::dimension_size_type size[3] = { texture.size[0], texture.size[1], texture.size[2] };
   uint32_t offset = 0;
 
   for(texture_t::level_size_type i = 1;i <= level;++i) {
-    offset += pitch * size[1] * size[2];
+    offset += rsxgl_get_tex_level_size(texture,size);
 
     for(int j = 0;j < 3;++j) {
       size[j] = std::max(size[j] >> 1,1);
@@ -755,8 +811,52 @@ rsxgl_get_tex_level_offset_size(const texture_t::dimension_size_type _size[3],
   return offset;
 }
 
-// Meant to look like gallium's util_format_translate, but tries to use DMA:
+// NV_MEMORY_TO_MEMORY_FORMAT's pitches are 16 bits, and it copies at most 2047 lines at once:
+static const unsigned rsxgl_memory_transfer_max_pitch = 32767, rsxgl_memory_transfer_max_lines = 2047;
+
+// Ask the RSX to copy nbytes from src to dst, as lines as long as the pitch allows:
 static inline void
+rsxgl_memory_copy_dma(rsxgl_context_t * ctx,memory_t dst,memory_t src,uint32_t nbytes)
+{
+  static const uint32_t linelength = 16384;
+
+  uint32_t lines = nbytes / linelength;
+  while(lines > 0) {
+    const uint32_t n = std::min(lines,(uint32_t)rsxgl_memory_transfer_max_lines);
+
+    rsxgl_memory_transfer(ctx -> gcm_context(),
+			  dst,linelength,1,
+			  src,linelength,1,
+			  linelength,n);
+
+    dst += n * linelength;
+    src += n * linelength;
+    lines -= n;
+  }
+
+  nbytes %= linelength;
+  if(nbytes > 0) {
+    rsxgl_memory_transfer(ctx -> gcm_context(),
+			  dst,nbytes,1,
+			  src,nbytes,1,
+			  nbytes,1);
+  }
+}
+
+// rsxgl_util_format_translate_dma would ask the RSX to do the copy:
+static inline bool
+rsxgl_util_format_translate_dma_supported(enum pipe_format dst_format,const memory_t & dstmem,unsigned dst_stride,
+					  enum pipe_format src_format,bool src_visible,unsigned src_stride)
+{
+  return dstmem && src_visible &&
+    dst_stride <= rsxgl_memory_transfer_max_pitch && src_stride <= rsxgl_memory_transfer_max_pitch &&
+    util_is_format_compatible(util_format_description(src_format),util_format_description(dst_format));
+}
+
+// Meant to look like gallium's util_format_translate, but tries to use DMA. If both images are
+// visible to the RSX, and util_format_translate would only copy them, the RSX is asked to copy
+// them instead; returns true if it was:
+static inline bool
 rsxgl_util_format_translate_dma(rsxgl_context_t * ctx,
 				enum pipe_format dst_format,
 				void * dstaddress, const memory_t & dstmem, unsigned dst_stride,
@@ -766,62 +866,290 @@ rsxgl_util_format_translate_dma(rsxgl_context_t * ctx,
 				unsigned src_x, unsigned src_y,
 				unsigned width, unsigned height)
 {
-  const struct util_format_description *dst_format_desc = util_format_description(dst_format);
-  const struct util_format_description *src_format_desc = util_format_description(src_format);
+  if(rsxgl_util_format_translate_dma_supported(dst_format,dstmem,dst_stride,src_format,srcmem,src_stride)) {
+    const struct util_format_description *dst_format_desc = util_format_description(dst_format);
+    const unsigned blocksize = dst_format_desc -> block.bits / 8;
+    const unsigned blockwidth = dst_format_desc -> block.width;
+    const unsigned blockheight = dst_format_desc -> block.height;
 
-  util_format_translate(dst_format,dstaddress,dst_stride,dst_x,dst_y,
-			src_format,srcaddress,src_stride,src_x,src_y,
-			width,height);
-
-#if 0
-  const uint8_t * pdstaddress = (const uint8_t *)dstaddress;
-  for(unsigned int j = 0;j < 120;++j) {
-    const uint8_t * ppdstaddress = pdstaddress;
-    for(unsigned int i = 0;i < 160;++i) {
-      rsxgl_debug_printf("(%i,%i,%i,%i)",
-			 (unsigned int)ppdstaddress[0],
-			 (unsigned int)ppdstaddress[1],
-			 (unsigned int)ppdstaddress[2],
-			 (unsigned int)ppdstaddress[3]);
-      ppdstaddress += 4;
-    }
-    rsxgl_debug_printf("\n");
-    pdstaddress += dst_stride;
-  }
-#endif
-  
-#if 0
-  if(util_is_format_compatible(src_format_desc, dst_format_desc)) {
-    const int blocksize = dst_format_desc->block.bits / 8;
-    const int blockwidth = dst_format_desc->block.width;
-    const int blockheight = dst_format_desc->block.height;
-    
     dst_x /= blockwidth;
     dst_y /= blockheight;
-    width = (width + blockwidth - 1)/blockwidth;
-    height = (height + blockheight - 1)/blockheight;
+    width = (width + blockwidth - 1) / blockwidth;
+    height = (height + blockheight - 1) / blockheight;
     src_x /= blockwidth;
     src_y /= blockheight;
-    
+
     const uint32_t linelength = width * blocksize;
-    
-    rsxgl_memory_transfer(ctx -> gcm_context(),
-			  dstmem + (dst_x * blocksize) + (dst_y * dst_stride),dst_stride,1,
-			  srcmem + (src_x * blocksize) + (src_y * src_stride),src_stride,1,
-			  linelength,height);
+    memory_t dst = dstmem + (dst_x * blocksize) + (dst_y * dst_stride);
+    memory_t src = srcmem + (src_x * blocksize) + (src_y * src_stride);
+
+    while(height > 0) {
+      const unsigned lines = std::min(height,rsxgl_memory_transfer_max_lines);
+
+      rsxgl_memory_transfer(ctx -> gcm_context(),
+			    dst,dst_stride,1,
+			    src,src_stride,1,
+			    linelength,lines);
+
+      dst += lines * dst_stride;
+      src += lines * src_stride;
+      height -= lines;
+    }
+
+    return true;
   }
-  else {
-    rsxgl_debug_printf("%s: non-trivial transfer didn't happen src:%x dst:%x\n",__PRETTY_FUNCTION__,
-		       (unsigned int)src_format,(unsigned int)dst_format);
 
-    rsxgl_assert(dstaddress != 0);
-    rsxgl_assert(srcaddress != 0);
+  rsxgl_assert(dstaddress != 0);
+  rsxgl_assert(srcaddress != 0);
+
+  rsxgl_format_translate(dst_format,dstaddress,dst_stride,dst_x,dst_y,
+			 src_format,srcaddress,src_stride,src_x,src_y,
+			 width,height);
+  return false;
+}
+
+// rsxgl_texture_translate would ask the RSX to do the copy, given a source that is visible to it
+// (src_visible):
+static inline bool
+rsxgl_texture_translate_supported(enum pipe_format dst_format,const memory_t & dstmem,unsigned dst_stride,
+				  const texture_t::dimension_size_type dst_size[3],
+				  enum pipe_format src_format,bool src_visible,unsigned src_stride)
+{
+  if(dst_stride != 0) {
+    return rsxgl_util_format_translate_dma_supported(dst_format,dstmem,dst_stride,src_format,src_visible,src_stride);
+  }
+
+  return dst_format == src_format && src_visible && dst_size[2] == 1 &&
+    rsxgl_swizzle_transfer_supported(dstmem,util_format_get_blocksize(dst_format),dst_size[0],dst_size[1]);
+}
+
+// Like rsxgl_util_format_translate_dma, except that a dst_stride of 0 means that the destination
+// is a swizzled image of dst_size, and dst_z selects the slice of it to write. Images with the same
+// format are swizzled by the RSX when the source is visible to it; returns true if it was asked to:
+static inline bool
+rsxgl_texture_translate(rsxgl_context_t * ctx,
+			enum pipe_format dst_format,
+			void * dstaddress, const memory_t & dstmem, unsigned dst_stride,
+			const texture_t::dimension_size_type dst_size[3],
+			unsigned dst_x, unsigned dst_y, unsigned dst_z,
+			enum pipe_format src_format,
+			const void * srcaddress, const memory_t & srcmem, unsigned src_stride,
+			unsigned src_x, unsigned src_y,
+			unsigned width, unsigned height)
+{
+  if(dst_stride != 0) {
+    return rsxgl_util_format_translate_dma(ctx,
+					   dst_format,dstaddress,dstmem,dst_stride,dst_x,dst_y,
+					   src_format,srcaddress,srcmem,src_stride,src_x,src_y,
+					   width,height);
+  }
+
+  const uint32_t bytes = util_format_get_blocksize(dst_format);
+  const uint32_t size[3] = { dst_size[0], dst_size[1], dst_size[2] };
+
+  if(dst_format == src_format) {
+    if(rsxgl_texture_translate_supported(dst_format,dstmem,dst_stride,dst_size,src_format,srcmem,src_stride)) {
+      rsxgl_swizzle_transfer(ctx -> gcm_context(),
+			     dstmem,size[0],size[1],dst_x,dst_y,
+			     srcmem + (src_y * src_stride) + (src_x * bytes),src_stride,bytes,
+			     width,height);
+      return true;
+    }
+
+    rsxgl_swizzle_copy(dstaddress,size,dst_x,dst_y,dst_z,
+		       (const uint8_t *)srcaddress + (src_y * src_stride) + (src_x * bytes),src_stride,0,
+		       bytes,width,height,1);
+    return false;
+  }
+
+  // Convert to the destination format first, then swizzle that:
+  const uint32_t tmp_stride = width * bytes;
+  void * tmp = malloc(tmp_stride * height);
+  if(tmp == 0) {
+    return false;
+  }
+
+  rsxgl_format_translate(dst_format,tmp,tmp_stride,0,0,
+			 src_format,srcaddress,src_stride,src_x,src_y,
+			 width,height);
+  rsxgl_swizzle_copy(dstaddress,size,dst_x,dst_y,dst_z,
+		     tmp,tmp_stride,0,
+		     bytes,width,height,1);
+
+  free(tmp);
+  return false;
+}
+
+// The scaled image from memory (SIFM) engine reads a linear 2D image, and can scale, filter and
+// convert it into a surface set up by NV04_CONTEXT_SURFACES_2D (or NV04_SWIZZLED_SURFACE, as
+// rsxgl_swizzle_transfer does). The subchannel and object handle are the ones that libgcm's
+// default command buffer setup binds:
+enum rsxgl_scaled_image_transfer_objects {
+  RSXGL_SURFACE_2D_SUBCHANNEL = 3,
+  RSXGL_SURFACE_2D_HANDLE = 0x313371C3
+};
+
+// The RSX's 2D surfaces need 64-byte aligned offsets & pitches, and images less than 2048 texels
+// on a side; x is where the image starts in each row of the surface:
+static inline bool
+rsxgl_scaled_image_transfer_supported(const memory_t & dst,uint32_t dst_pitch,uint32_t x,uint32_t width,uint32_t height)
+{
+  return dst && (dst.offset & 63) == 0 &&
+    dst_pitch != 0 && (dst_pitch & 63) == 0 && dst_pitch <= rsxgl_memory_transfer_max_pitch &&
+    (x + width) < 2048 && height < 2048;
+}
 
-    util_format_translate(dst_format,dstaddress,dst_stride,dst_x,dst_y,
-			  src_format,srcaddress,src_stride,src_x,src_y,
-			  width,height);
+// Scale the src_width x src_height image at src, converting it from sifm_format (an
+// NV03_SCALED_IMAGE_FROM_MEMORY_COLOR_FORMAT) to surface_format (an NV04_CONTEXT_SURFACES_2D_FORMAT),
+// into the dst_width x dst_height rectangle at (x,0) of the surface at dst. The source is filtered
+// bilinearly from its corner if filter is set, and point sampled from its texels' centers if it
+// isn't:
+static inline void
+rsxgl_scaled_image_transfer(gcmContextData * context,
+			    const memory_t & dst,const uint32_t dst_pitch,const uint32_t surface_format,
+			    const uint32_t x,const uint32_t dst_width,const uint32_t dst_height,
+			    const memory_t & src,const uint32_t src_pitch,const uint32_t sifm_format,
+			    const uint32_t src_width,const uint32_t src_height,const bool filter)
+{
+  uint32_t * buffer = gcm_reserve(context,27);
+
+  // NV04_CONTEXT_SURFACES_2D_DMA_IMAGE_SOURCE = 0x184, _DMA_IMAGE_DESTIN = 0x188
+  gcm_emit_channel_method_at(buffer,0,RSXGL_SURFACE_2D_SUBCHANNEL,0x184,2);
+  gcm_emit_at(buffer,1,RSXGL_TRANSFER_LOCATION(dst.location));
+  gcm_emit_at(buffer,2,RSXGL_TRANSFER_LOCATION(dst.location));
+
+  // NV04_CONTEXT_SURFACES_2D_FORMAT = 0x300, _PITCH, _OFFSET_SOURCE, _OFFSET_DESTIN
+  gcm_emit_channel_method_at(buffer,3,RSXGL_SURFACE_2D_SUBCHANNEL,0x300,4);
+  gcm_emit_at(buffer,4,surface_format);
+  gcm_emit_at(buffer,5,dst_pitch | (dst_pitch << 16));
+  gcm_emit_at(buffer,6,dst.offset);
+  gcm_emit_at(buffer,7,dst.offset);
+
+  // NV03_SCALED_IMAGE_FROM_MEMORY_DMA_IMAGE = 0x184
+  gcm_emit_channel_method_at(buffer,8,RSXGL_SCALED_IMAGE_SUBCHANNEL,0x184,1);
+  gcm_emit_at(buffer,9,RSXGL_TRANSFER_LOCATION(src.location));
+
+  // NV04_SCALED_IMAGE_FROM_MEMORY_SURFACE = 0x198
+  gcm_emit_channel_method_at(buffer,10,RSXGL_SCALED_IMAGE_SUBCHANNEL,0x198,1);
+  gcm_emit_at(buffer,11,RSXGL_SURFACE_2D_HANDLE);
+
+  // NV03_SCALED_IMAGE_FROM_MEMORY_COLOR_CONVERSION = 0x2fc
+  gcm_emit_channel_method_at(buffer,12,RSXGL_SCALED_IMAGE_SUBCHANNEL,0x2fc,9);
+  gcm_emit_at(buffer,13,1); // truncate
+  gcm_emit_at(buffer,14,sifm_format);
+  gcm_emit_at(buffer,15,3); // source copy
+  gcm_emit_at(buffer,16,x); // clip point
+  gcm_emit_at(buffer,17,dst_width | (dst_height << 16)); // clip size
+  gcm_emit_at(buffer,18,x); // out point
+  gcm_emit_at(buffer,19,dst_width | (dst_height << 16)); // out size
+  gcm_emit_at(buffer,20,(src_width << 20) / dst_width); // ds/dx
+  gcm_emit_at(buffer,21,(src_height << 20) / dst_height); // dt/dy
+
+  // NV03_SCALED_IMAGE_FROM_MEMORY_SIZE = 0x400
+  gcm_emit_channel_method_at(buffer,22,RSXGL_SCALED_IMAGE_SUBCHANNEL,0x400,4);
+  gcm_emit_at(buffer,23,((src_width + 7) & ~7) | (src_height << 16));
+  gcm_emit_at(buffer,24,src_pitch | (filter ? (0x00020000 | 0x01000000) : 0x00010000)); // origin corner, bilinear; or origin center, point sampled
+  gcm_emit_at(buffer,25,src.offset);
+  gcm_emit_at(buffer,26,0);
+
+  gcm_finish_n_commands(context,27);
+}
+
+// The formats of color buffers that the SIFM engine can convert between. Returns the
+// NV04_CONTEXT_SURFACES_2D_FORMAT (which NV04_SWIZZLED_SURFACE_FORMAT_COLOR shares) and the
+// NV03_SCALED_IMAGE_FROM_MEMORY_COLOR_FORMAT for the format, or false if there aren't any. These
+// are the formats that nvfx_get_framebuffer_format() renders A8R8G8B8, X8R8G8B8 & R5G6B5 as:
+static inline bool
+rsxgl_scaled_image_format(pipe_format format,uint32_t * surface_format,uint32_t * sifm_format)
+{
+  switch(format) {
+  case PIPE_FORMAT_R8G8B8A8_UNORM:
+    *surface_format = 0xa; // A8R8G8B8
+    *sifm_format = 0x3; // A8R8G8B8
+    return true;
+  case PIPE_FORMAT_R8G8B8X8_UNORM:
+    *surface_format = 0x7; // X8R8G8B8_X8R8G8B8
+    *sifm_format = 0x4; // X8R8G8B8
+    return true;
+  case PIPE_FORMAT_B5G6R5_UNORM:
+    *surface_format = 0x4; // R5G6B5
+    *sifm_format = 0x7; // R5G6B5
+    return true;
+  default:
+    return false;
   }
-#endif
+}
+
+// rsxgl_framebuffer_translate would ask the RSX to do the copy:
+static inline bool
+rsxgl_framebuffer_translate_supported(enum pipe_format dst_format,const memory_t & dstmem,unsigned dst_stride,
+				      const texture_t::dimension_size_type dst_size[3],unsigned dst_x,unsigned dst_y,
+				      enum pipe_format src_format,const memory_t & srcmem,unsigned src_stride,
+				      unsigned width,unsigned height)
+{
+  if(rsxgl_texture_translate_supported(dst_format,dstmem,dst_stride,dst_size,src_format,srcmem,src_stride)) {
+    return true;
+  }
+
+  uint32_t surface_format = 0, sifm_format = 0;
+  if(!(srcmem && src_stride <= rsxgl_memory_transfer_max_pitch &&
+       rsxgl_scaled_image_format(dst_format,&surface_format,&sifm_format) &&
+       rsxgl_scaled_image_format(src_format,&surface_format,&sifm_format))) {
+    return false;
+  }
+
+  if(dst_stride != 0) {
+    return rsxgl_scaled_image_transfer_supported(dstmem + dst_y * dst_stride,dst_stride,dst_x,width,height);
+  }
+  else {
+    return dst_size[2] == 1 &&
+      rsxgl_swizzle_transfer_supported(dstmem,util_format_get_blocksize(dst_format),dst_size[0],dst_size[1]);
+  }
+}
+
+// rsxgl_texture_translate, for copies from a framebuffer's color buffer (srcmem, which is always
+// visible to the RSX) to a texture. Copies between different formats are converted by the SIFM
+// engine if they're both color buffer formats. Returns true if the RSX was asked to do the copy;
+// if it wasn't, the CPU read the color buffer, and the caller must have waited for it:
+static inline bool
+rsxgl_framebuffer_translate(rsxgl_context_t * ctx,
+			    enum pipe_format dst_format,
+			    void * dstaddress, const memory_t & dstmem, unsigned dst_stride,
+			    const texture_t::dimension_size_type dst_size[3],
+			    unsigned dst_x, unsigned dst_y, unsigned dst_z,
+			    enum pipe_format src_format,
+			    const void * srcaddress, const memory_t & srcmem, unsigned src_stride,
+			    unsigned src_x, unsigned src_y,
+			    unsigned width, unsigned height)
+{
+  if(!rsxgl_texture_translate_supported(dst_format,dstmem,dst_stride,dst_size,src_format,srcmem,src_stride) &&
+     rsxgl_framebuffer_translate_supported(dst_format,dstmem,dst_stride,dst_size,dst_x,dst_y,src_format,srcmem,src_stride,width,height)) {
+    uint32_t surface_format = 0, sifm_format = 0, src_surface_format = 0, src_sifm_format = 0;
+    rsxgl_scaled_image_format(dst_format,&surface_format,&sifm_format);
+    rsxgl_scaled_image_format(src_format,&src_surface_format,&src_sifm_format);
+
+    const uint32_t src_bytes = util_format_get_blocksize(src_format);
+    const memory_t src = srcmem + (src_y * src_stride) + (src_x * src_bytes);
+
+    if(dst_stride != 0) {
+      rsxgl_scaled_image_transfer(ctx -> gcm_context(),
+				  dstmem + dst_y * dst_stride,dst_stride,surface_format,dst_x,width,height,
+				  src,src_stride,src_sifm_format,width,height,false);
+    }
+    else {
+      rsxgl_swizzle_transfer(ctx -> gcm_context(),
+			     dstmem,dst_size[0],dst_size[1],dst_x,dst_y,
+			     src,src_stride,util_format_get_blocksize(dst_format),
+			     width,height,
+			     surface_format,src_sifm_format,src_bytes);
+    }
+    return true;
+  }
+
+  return rsxgl_texture_translate(ctx,
+				 dst_format,dstaddress,dstmem,dst_stride,dst_size,dst_x,dst_y,dst_z,
+				 src_format,srcaddress,srcmem,src_stride,src_x,src_y,
+				 width,height);
 }
 
 bool
@@ -920,6 +1248,40 @@ glBindTexture (GLenum target, GLuint texture_name)
   RSXGL_NOERROR_();
 }
 
+// GL_TEXTURE_MIN_RESIDENT_LEVEL_RSX. Coarser levels, and finer ones whose uploads are already
+// done, take effect straight away; other finer ones wait for whatever the texture was last used
+// for, which includes their uploads:
+static inline void
+rsxgl_texture_request_resident_level(rsxgl_context_t * ctx,texture_t & texture,const texture_t::level_size_type level)
+{
+  texture.requested_resident_level = level;
+
+  if(level >= texture.resident_level || texture.timestamp == 0 || rsxgl_timestamp_check(ctx,texture.timestamp)) {
+    texture.resident_level = level;
+    texture.resident_timestamp = 0;
+    rsxgl_texture_invalidate(ctx,texture);
+  }
+  else {
+    texture.resident_timestamp = texture.timestamp;
+  }
+}
+
+// Make the requested level resident if its fence has passed. Doesn't flush or wait, so that it
+// can be called for every draw. Returns true if the resident level changed:
+static inline bool
+rsxgl_texture_update_resident_level(rsxgl_context_t * ctx,texture_t & texture)
+{
+  if(texture.resident_timestamp != 0 && rsxgl_timestamp_check(ctx,texture.resident_timestamp)) {
+    texture.resident_level = texture.requested_resident_level;
+    texture.resident_timestamp = 0;
+    rsxgl_texture_invalidate(ctx,texture);
+    return true;
+  }
+  else {
+    return false;
+  }
+}
+
 static inline void
 rsxgl_tex_parameteri(rsxgl_context_t * ctx,texture_t::name_type texture_name,GLenum pname,uint32_t param)
 {
@@ -953,6 +1315,16 @@ rsxgl_tex_parameteri(rsxgl_context_t * ctx,texture_t::name_type texture_name,GLe
       RSXGL_ERROR_(GL_INVALID_ENUM);
     }
   }
+  else if(pname == GL_TEXTURE_LINEAR_RSX) {
+    if(!(param == GL_TRUE || param == GL_FALSE)) {
+      RSXGL_ERROR_(GL_INVALID_ENUM);
+    }
+  }
+  else if(pname == GL_TEXTURE_MIN_RESIDENT_LEVEL_RSX) {
+    if(param >= texture_t::max_levels) {
+      RSXGL_ERROR_(GL_INVALID_VALUE);
+    }
+  }
   else {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -964,7 +1336,19 @@ rsxgl_tex_parameteri(rsxgl_context_t * ctx,texture_t::name_type texture_name,GLe
   texture_t & texture = texture_t::storage().at(texture_name);
 
   if(pname == GL_TEXTURE_SWIZZLE_R || pname == GL_TEXTURE_SWIZZLE_G || pname == GL_TEXTURE_SWIZZLE_B || pname == GL_TEXTURE_SWIZZLE_A) {
-    ctx -> invalid_textures |= texture.binding_bitfield;
+    rsxgl_texture_invalidate(ctx,texture);
+  }
+  else if(pname == GL_TEXTURE_LINEAR_RSX) {
+    // Storage that's already linear stays that way until it's respecified:
+    if(param == GL_TRUE) {
+      rsxgl_texture_require_linear(ctx,texture);
+    }
+    else {
+      texture.linear = 0;
+    }
+  }
+  else if(pname == GL_TEXTURE_MIN_RESIDENT_LEVEL_RSX) {
+    rsxgl_texture_request_resident_level(ctx,texture,param);
   }
   else {
     _rsxgl_set_sampler_parameteri(ctx,texture.sampler,pname,param);
@@ -981,7 +1365,9 @@ rsxgl_get_texture_parameteri(rsxgl_context_t * ctx,texture_t::name_type texture_
        pname == GL_TEXTURE_MAG_FILTER ||
        pname == GL_TEXTURE_WRAP_S || pname == GL_TEXTURE_WRAP_T || pname == GL_TEXTURE_WRAP_T ||
        pname == GL_TEXTURE_COMPARE_MODE ||
-       pname == GL_TEXTURE_COMPARE_FUNC)) {
+       pname == GL_TEXTURE_COMPARE_FUNC ||
+       pname == GL_TEXTURE_LINEAR_RSX ||
+       pname == GL_TEXTURE_MIN_RESIDENT_LEVEL_RSX)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
@@ -992,6 +1378,13 @@ rsxgl_get_texture_parameteri(rsxgl_context_t * ctx,texture_t::name_type texture_
   texture_t & texture = texture_t::storage().at(texture_name);
   if(pname == GL_TEXTURE_SWIZZLE_R || pname == GL_TEXTURE_SWIZZLE_G || pname == GL_TEXTURE_SWIZZLE_B || pname == GL_TEXTURE_SWIZZLE_A) {
   }
+  else if(pname == GL_TEXTURE_LINEAR_RSX) {
+    *param = texture.linear ? GL_TRUE : GL_FALSE;
+  }
+  else if(pname == GL_TEXTURE_MIN_RESIDENT_LEVEL_RSX) {
+    rsxgl_texture_update_resident_level(ctx,texture);
+    *param = texture.resident_level;
+  }
   else {  
     _rsxgl_get_sampler_parameteri(ctx,texture.sampler,pname,param);
   }
@@ -1082,7 +1475,7 @@ rsxgl_tex_parameterf(rsxgl_context_t * ctx,texture_t::name_type texture_name,GLe
     texture.remap = nvfx_get_texture_remap(nvfx_get_texture_format(texture.pformat),
 					   texture.swizzle.r,texture.swizzle.g,texture.swizzle.b,texture.swizzle.a);
 
-    ctx -> invalid_textures |= texture.binding_bitfield;
+    rsxgl_texture_invalidate(ctx,texture);
   }
   else {
     _rsxgl_set_sampler_parameterf(ctx,texture.sampler,pname,param);
@@ -1203,7 +1596,7 @@ void rsxgl_get_tex_level_parameter(GLenum target,GLint level,GLenum pname,T * pa
        pname == GL_TEXTURE_HEIGHT ||
        pname == GL_TEXTURE_DEPTH) {
       texture_t::dimension_size_type size[3] = { 1, 1, 1 };
-      rsxgl_get_tex_level_offset_size(texture.size,texture.pitch,level,size);
+      rsxgl_get_tex_level_offset_size(texture,level,size);
       
       if(pname == GL_TEXTURE_WIDTH) {
 	*params = size[0];
@@ -1241,10 +1634,17 @@ void rsxgl_get_tex_level_parameter(GLenum target,GLint level,GLenum pname,T * pa
       *params = rsxgl_get_format_depth_bit_depth(texture.pformat,0);
     }
     else if(pname == GL_TEXTURE_COMPRESSED) {
-      *params = 0;
+      *params = util_format_is_compressed(texture.pformat);
     }
     else if(pname == GL_TEXTURE_COMPRESSED_IMAGE_SIZE) {
-      *params = 0;
+      if(util_format_is_compressed(texture.pformat)) {
+	texture_t::dimension_size_type size[3] = { 1, 1, 1 };
+	rsxgl_get_tex_level_offset_size(texture,level,size);
+	*params = util_format_get_2d_size(texture.pformat,util_format_get_stride(texture.pformat,size[0]),size[1]) * size[2];
+      }
+      else {
+	*params = 0;
+      }
     }
   }
   else {
@@ -1314,6 +1714,27 @@ glTexParameteriv (GLenum target, GLenum pname, const GLint *params)
   rsxgl_tex_parameteri(ctx,ctx -> texture_binding.names[ctx -> active_texture],pname,*params);
 }
 
+// The RSX samples swizzled textures faster than linear ones, but can only swizzle power-of-two
+// sizes, and can't render to them (so framebuffer attachments set the linear bit):
+static inline bool
+rsxgl_texture_can_swizzle(const texture_t & texture)
+{
+  if(texture.linear || texture.rect || texture.dims < 2) {
+    return false;
+  }
+
+  // Compressed textures are already tiled; float formats are left linear so that they can be
+  // fetched by vertex programs:
+  const struct util_format_description * desc = util_format_description(texture.pformat);
+  if(desc == 0 || desc -> block.width != 1 || desc -> block.height != 1 ||
+     util_format_is_float(texture.pformat) || util_format_is_depth_or_stencil(texture.pformat)) {
+    return false;
+  }
+
+  return rsxgl_is_pot(texture.size[0]) && rsxgl_is_pot(texture.size[1]) && rsxgl_is_pot(texture.size[2]);
+}
+
+// Allocates room for storage_levels levels, of which the first num_levels are sampled:
 static inline void
 rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
 {
@@ -1321,15 +1742,18 @@ rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
   rsxgl_assert(texture.complete);
   rsxgl_assert(texture.dims != 0);
   rsxgl_assert(texture.pformat != PIPE_FORMAT_NONE);
+  rsxgl_assert(texture.storage_levels >= texture.num_levels);
+
+  texture.swizzled = rsxgl_texture_can_swizzle(texture);
 
   // pitch is aligned to 64 bytes so it can be attached to a framebuffer:
   const uint32_t pitch_tmp = util_format_get_stride(texture.pformat,texture.size[0]);
-  const uint32_t pitch = texture.dims > 1 ? align_pot< uint32_t, 64 >(pitch_tmp) : pitch_tmp;
+  texture.pitch = texture.swizzled ? 0 : texture.dims > 1 ? align_pot< uint32_t, 64 >(pitch_tmp) : pitch_tmp;
 
   uint32_t nbytes = 0;
   texture_t::dimension_size_type size[3] = { texture.size[0], texture.size[1], texture.size[2] };
-  for(texture_t::level_size_type i = 0,n = texture.num_levels;i < n;++i) {
-    nbytes += pitch * size[1] * size[2];
+  for(texture_t::level_size_type i = 0,n = texture.storage_levels;i < n;++i) {
+    nbytes += rsxgl_get_tex_level_size(texture,size);
 
     for(int j = 0;j < 3;++j) {
       size[j] = std::max(size[j] >> 1,1);
@@ -1338,19 +1762,21 @@ rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
 
   texture.memory = rsxgl_arena_allocate(memory_arena_t::storage().at(texture.arena),128,nbytes,0);
   texture.memory.owner = true;
+  texture.packet_serial = 0;
+  texture.invalid_contents = 1;
 
   if(texture.memory) {
     const nvfx_texture_format * pfmt = nvfx_get_texture_format(texture.pformat);
     rsxgl_assert(pfmt != 0);
     
-    const uint32_t fmt = pfmt -> fmt[4] | NV40_3D_TEX_FORMAT_LINEAR | (texture.rect ? NV40_3D_TEX_FORMAT_RECT : 0) | 0x8000;
+    const uint32_t fmt = pfmt -> fmt[4] | (texture.swizzled ? 0 : NV40_3D_TEX_FORMAT_LINEAR) | (texture.rect ? NV40_3D_TEX_FORMAT_RECT : 0) | 0x8000;
 
 #if 0
     rsxgl_debug_printf("%s: dims:%u pformat:%u size:%ux%ux%u pitch:%u levels:%u bytes:%u fmt:%x\n",__PRETTY_FUNCTION__,
 		       (unsigned int)texture.dims,
 		       (unsigned int)texture.pformat,
 		       (unsigned int)texture.size[0],(unsigned int)texture.size[1],(unsigned int)texture.size[2],
-		       (unsigned int)pitch,
+		       (unsigned int)texture.pitch,
 		       (unsigned int)texture.num_levels,
 		       (unsigned int)nbytes,(unsigned int)fmt);
     rsxgl_debug_printf("\toffset:%u\n",texture.memory.offset);
@@ -1365,8 +1791,6 @@ rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
       ((uint32_t)texture.num_levels << NV40_3D_TEX_FORMAT_MIPMAP_COUNT__SHIFT)
       ;
 
-    texture.pitch = pitch;
-    
     texture.remap = nvfx_get_texture_remap(pfmt,
 					   texture.swizzle.r,texture.swizzle.g,texture.swizzle.b,texture.swizzle.a);
   }
@@ -1382,7 +1806,14 @@ rsxgl_texture_reset_storage(texture_t & texture)
   texture.format = 0;
   texture.pitch = 0;
   texture.remap = 0;
+  texture.swizzled = 0;
+  texture.storage_levels = 0;
+  texture.packet_serial = 0;
   texture.memory = memory_t();
+
+  for(texture_t::level_size_type i = 0;i < texture_t::max_levels;++i) {
+    texture.levels[i].stored = 0;
+  }
 }
 
 static inline void
@@ -1424,7 +1855,7 @@ rsxgl_texture_level_validate_storage(texture_t::level_t & level)
 }
 
 static inline void
-rsxgl_texture_level_reset_storage(texture_t::level_t & level)
+rsxgl_texture_level_release_memory(texture_t::level_t & level)
 {
   if(level.memory.owner && level.memory) {
     if (level.memory_ptr)
@@ -1432,14 +1863,242 @@ rsxgl_texture_level_reset_storage(texture_t::level_t & level)
     else
       rsxgl_texture_migrate_free(rsxgl_texture_migrate_address(level.memory.offset));
   }
+
+  level.memory = memory_t();
+  level.memory_ptr = NULL;
+}
+
+static inline void
+rsxgl_texture_level_reset_storage(texture_t::level_t & level)
+{
+  rsxgl_texture_level_release_memory(level);
   
+  level.stored = 0;
   level.pformat = PIPE_FORMAT_NONE;
   level.size[0] = 0;
   level.size[1] = 0;
   level.size[2] = 0;
   level.pitch = 0;
-  level.memory = memory_t();
-  level.memory_ptr = NULL;
+}
+
+static inline uint8_t *
+rsxgl_texture_level_address(texture_t::level_t & level)
+{
+  return (uint8_t *)((level.memory_ptr != 0) ? level.memory_ptr : rsxgl_texture_migrate_address(level.memory.offset));
+}
+
+// Levels whose images are only kept in their own memory make every texture load move its texels
+// twice, the second time when the texture is first drawn with, so levels are stored in the
+// texture's storage whenever it's been allocated and they fit in it. Storage is allocated as soon
+// as level 0 is specified, or when the texture is first drawn with, with room for every level if
+// the texture's minification filter uses them (so it's best set before the levels are specified):
+static inline texture_t::level_size_type
+rsxgl_texture_max_levels(const texture_t & texture)
+{
+  return log2_uint32(std::max(texture.size[0],std::max(texture.size[1],texture.size[2]))) + 1;
+}
+
+static inline texture_t::level_size_type
+rsxgl_texture_storage_levels(const texture_t & texture)
+{
+  if(texture.cube || texture.rect || texture.sampler.filter_min < RSXGL_NEAREST_MIPMAP_NEAREST) {
+    return std::max((texture_t::level_size_type)texture.num_levels,(texture_t::level_size_type)1);
+  }
+
+  return std::max((texture_t::level_size_type)texture.num_levels,rsxgl_texture_max_levels(texture));
+}
+
+// The level's image would be at _level of the texture's storage (if it has room for it):
+static inline bool
+rsxgl_texture_level_fits_storage(const texture_t & texture,const texture_t::level_size_type _level,
+				 uint8_t dims,pipe_format pformat,const texture_t::dimension_size_type size[3])
+{
+  if(dims != texture.dims || pformat != texture.pformat || _level >= rsxgl_texture_max_levels(texture)) {
+    return false;
+  }
+
+  texture_t::dimension_size_type level_size[3];
+  rsxgl_get_tex_level_offset_size(texture,_level,level_size);
+
+  return size[0] == level_size[0] && size[1] == level_size[1] && size[2] == level_size[2];
+}
+
+// Free stored levels' own memory once the RSX passes timestamp (it may still be copying them into
+// the texture's storage, or writing them from pixel buffers), and replaced storage once it passes
+// replaced_timestamp. Doesn't flush or wait, so that it can be called for every draw:
+static inline void
+rsxgl_texture_release_levels(rsxgl_context_t * ctx,texture_t & texture,const uint32_t timestamp)
+{
+  if(texture.replaced_timestamp != 0 && rsxgl_timestamp_check(ctx,texture.replaced_timestamp)) {
+    if(texture.replaced_memory.owner && texture.replaced_memory) {
+      rsxgl_arena_free(memory_arena_t::storage().at(texture.arena),texture.replaced_memory);
+    }
+    texture.replaced_memory = memory_t();
+    texture.replaced_timestamp = 0;
+  }
+
+  if(timestamp == 0 || rsxgl_timestamp_check(ctx,timestamp)) {
+    for(texture_t::level_size_type i = 0;i < texture_t::max_levels;++i) {
+      if(texture.levels[i].stored) {
+	rsxgl_texture_level_release_memory(texture.levels[i]);
+      }
+    }
+
+    // Keep coming back until the replaced storage is freed too:
+    texture.release_timestamp = texture.replaced_timestamp;
+  }
+  else {
+    texture.release_timestamp = timestamp;
+  }
+}
+
+// Levels 0 through num_levels - 1 are sampled; they're the stored levels up to the first one
+// that isn't:
+static inline void
+rsxgl_texture_count_levels(rsxgl_context_t * ctx,texture_t & texture)
+{
+  texture_t::level_size_type num_levels = 0;
+  while(num_levels < texture.storage_levels && texture.levels[num_levels].stored) {
+    ++num_levels;
+  }
+
+  if(num_levels != texture.num_levels) {
+    texture.num_levels = num_levels;
+    texture.format = (texture.format & ~NV40_3D_TEX_FORMAT_MIPMAP_COUNT__MASK) | ((uint32_t)num_levels << NV40_3D_TEX_FORMAT_MIPMAP_COUNT__SHIFT);
+    rsxgl_texture_invalidate(ctx,texture);
+  }
+}
+
+// _level's image is, or is about to be, in the texture's storage:
+static inline void
+rsxgl_texture_store_level(texture_t & texture,const texture_t::level_size_type _level)
+{
+  texture_t::level_t & level = texture.levels[_level];
+
+  texture_t::dimension_size_type size[3];
+  rsxgl_get_tex_level_offset_size(texture,_level,size);
+
+  rsxgl_texture_level_format(level,texture.dims,texture.pformat,size[0],size[1],size[2]);
+  level.stored = 1;
+}
+
+// Reallocate a texture's storage with room for num_levels levels. Levels are laid out from the
+// finest to the coarsest whatever the number of them, so the RSX copies the stored ones as they
+// are, behind the commands that may still be using them; the old storage is freed once it's done:
+static inline bool
+rsxgl_texture_grow_storage(rsxgl_context_t * ctx,texture_t & texture,const texture_t::level_size_type num_levels)
+{
+  rsxgl_assert(texture.memory);
+  rsxgl_assert(num_levels > texture.storage_levels);
+
+  // Only commands from this context are known to be done before the copy:
+  if(texture.timestamp > 0 && rsxgl_timestamp_timeline(texture.timestamp) != ctx -> timeline) {
+    rsxgl_timestamp_wait(ctx,texture.timestamp);
+    texture.timestamp = 0;
+  }
+
+  // Storage replaced earlier has to be freed first:
+  if(texture.replaced_timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,texture.replaced_timestamp);
+    rsxgl_texture_release_levels(ctx,texture,texture.release_timestamp);
+  }
+
+  const memory_t srcmem = texture.memory;
+  const texture_t::level_size_type storage_levels = texture.storage_levels;
+  const uint32_t nbytes = rsxgl_get_tex_level_offset_size(texture,storage_levels,0);
+
+  texture.memory = memory_t();
+  texture.storage_levels = num_levels;
+  rsxgl_texture_validate_storage(ctx,texture);
+
+  // The failed allocation left the rest of the texture as it was:
+  if(!texture.memory) {
+    texture.memory = srcmem;
+    texture.storage_levels = storage_levels;
+    return false;
+  }
+
+  const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+
+  rsxgl_memory_copy_dma(ctx,texture.memory,srcmem,nbytes);
+
+  texture.timestamp = timestamp;
+  texture.invalid_contents = 1;
+  texture.replaced_memory = srcmem;
+  texture.replaced_timestamp = timestamp;
+  rsxgl_timestamp_post(ctx,timestamp);
+
+  rsxgl_texture_release_levels(ctx,texture,texture.release_timestamp);
+  rsxgl_texture_invalidate(ctx,texture);
+
+  return true;
+}
+
+// A level that doesn't fit in the texture's storage is being specified; move the stored levels
+// (except for that one) back into memory of their own, and free the storage. The texture must
+// not be in use by the RSX:
+static inline void
+rsxgl_texture_evict_storage(texture_t & texture,const texture_t::level_size_type except)
+{
+  rsxgl_assert(texture.memory);
+  rsxgl_assert(texture.timestamp == 0);
+
+  const uint8_t * address = (const uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(texture.arena),texture.memory);
+
+  for(texture_t::level_size_type i = 0,n = texture.storage_levels;i < n;++i) {
+    texture_t::level_t & level = texture.levels[i];
+    if(!level.stored || i == except) continue;
+
+    texture_t::dimension_size_type size[3];
+    const uint32_t offset = rsxgl_get_tex_level_offset_size(texture,i,size);
+
+    rsxgl_texture_level_release_memory(level);
+    rsxgl_texture_level_validate_storage(level);
+
+    const uint8_t * src = address + offset;
+    uint8_t * dst = rsxgl_texture_level_address(level);
+
+    if(texture.swizzled) {
+      const uint32_t swizzled_size[3] = { size[0], size[1], size[2] };
+      rsxgl_unswizzle_copy(dst,level.pitch,level.pitch * size[1],src,swizzled_size,util_format_get_blocksize(level.pformat),size[0],size[1],size[2]);
+    }
+    else {
+      for(uint32_t j = 0,m = util_format_get_nblocksy(level.pformat,size[1]) * size[2];j < m;++j,src += texture.pitch,dst += level.pitch) {
+	memcpy(dst,src,level.pitch);
+      }
+    }
+  }
+
+  texture.release_timestamp = 0;
+  rsxgl_texture_reset_storage(texture);
+}
+
+// The RSX samples S3TC textures natively, but gallium only reports them as supported when it can
+// compress & decompress them in software, which the PPU can't. rsxgl_choose_format falls back to
+// these, whose data is only ever copied:
+static inline pipe_format
+rsxgl_choose_compressed_format(GLenum glinternalformat)
+{
+  switch(glinternalformat) {
+  case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    return PIPE_FORMAT_DXT1_RGB;
+  case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    return PIPE_FORMAT_DXT1_RGBA;
+  case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    return PIPE_FORMAT_DXT3_RGBA;
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    return PIPE_FORMAT_DXT5_RGBA;
+  case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    return PIPE_FORMAT_DXT1_SRGB;
+  case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    return PIPE_FORMAT_DXT1_SRGBA;
+  case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+    return PIPE_FORMAT_DXT3_SRGBA;
+  case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+    return PIPE_FORMAT_DXT5_SRGBA;
+  default:
+    return PIPE_FORMAT_NONE;
+  }
 }
 
 static inline void
@@ -1469,7 +2128,7 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
 
 #if 0
   // TODO: Orphan the texture
-  if(texture.timestamp != 0 && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,texture.timestamp))) {
+  if(texture.timestamp != 0 && (!rsxgl_timestamp_check(ctx,texture.timestamp))) {
   }
 #else
   if(texture.timestamp > 0) {
@@ -1487,16 +2146,19 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
   texture.invalid_complete = 0;
   texture.immutable = 1;
 
-  ctx -> invalid_textures |= texture.binding_bitfield;
+  rsxgl_texture_invalidate(ctx,texture);
 
-  const pipe_format pformat = rsxgl_choose_format(ctx -> screen(),
-						  glinternalformat,GL_NONE,GL_NONE,
-						  (dims == 1) ? PIPE_TEXTURE_1D :
-						  (dims == 2) ? (cube ? PIPE_TEXTURE_CUBE : (rect ? PIPE_TEXTURE_RECT : PIPE_TEXTURE_2D)) :
-						  (dims == 3) ? PIPE_TEXTURE_2D :
-						  PIPE_MAX_TEXTURE_TYPES,
-						  1,
-						  PIPE_BIND_SAMPLER_VIEW);
+  pipe_format pformat = rsxgl_choose_format(ctx -> screen(),
+					    glinternalformat,GL_NONE,GL_NONE,
+					    (dims == 1) ? PIPE_TEXTURE_1D :
+					    (dims == 2) ? (cube ? PIPE_TEXTURE_CUBE : (rect ? PIPE_TEXTURE_RECT : PIPE_TEXTURE_2D)) :
+					    (dims == 3) ? PIPE_TEXTURE_2D :
+					    PIPE_MAX_TEXTURE_TYPES,
+					    1,
+					    PIPE_BIND_SAMPLER_VIEW);
+  if(pformat == PIPE_FORMAT_NONE && dims == 2 && !rect) {
+    pformat = rsxgl_choose_compressed_format(glinternalformat);
+  }
 
   if(pformat == PIPE_FORMAT_NONE) {
     texture.complete = 0;
@@ -1522,6 +2184,7 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
     texture.size[1] = height;
     texture.size[2] = depth;
 
+    texture.storage_levels = levels;
     texture.arena = ctx -> arena_binding.names[RSXGL_TEXTURE_ARENA];
     
     rsxgl_texture_validate_storage(ctx,texture);
@@ -1547,7 +2210,7 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
     RSXGL_ERROR(GL_INVALID_VALUE,false);
   }
 
-  const pipe_format pdstformat = (texture.levels[0].pformat != PIPE_FORMAT_NONE) ?
+  pipe_format pdstformat = (texture.levels[0].pformat != PIPE_FORMAT_NONE) ?
     texture.levels[0].pformat :
     rsxgl_choose_format(ctx -> screen(),
 			glinternalformat,GL_NONE,GL_NONE,
@@ -1557,6 +2220,9 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
 			PIPE_MAX_TEXTURE_TYPES,
 			1,
 			PIPE_BIND_SAMPLER_VIEW);
+  if(pdstformat == PIPE_FORMAT_NONE && dims == 2 && !rect) {
+    pdstformat = rsxgl_choose_compressed_format(glinternalformat);
+  }
 
   if(pdstformat == PIPE_FORMAT_NONE) {
     RSXGL_ERROR(GL_INVALID_VALUE,false);
@@ -1567,9 +2233,25 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
     RSXGL_ERROR(GL_INVALID_VALUE,false);
   }
 
+  texture_t::level_t & level = texture.levels[_level];
+  const texture_t::dimension_size_type size[3] = { (texture_t::dimension_size_type)width, (texture_t::dimension_size_type)height, (texture_t::dimension_size_type)depth };
+
+  // The level fits in the texture's storage (it's being respecified as it was, or it's the next
+  // level of the texture), so the texture stays valid, and the caller writes the image there:
+  if(texture.memory && rsxgl_texture_level_fits_storage(texture,_level,dims,pdstformat,size) &&
+     (_level < texture.storage_levels || rsxgl_texture_grow_storage(ctx,texture,rsxgl_texture_max_levels(texture)))) {
+    if(!level.stored) {
+      rsxgl_texture_store_level(texture,_level);
+      rsxgl_texture_release_levels(ctx,texture,texture.timestamp);
+      rsxgl_texture_count_levels(ctx,texture);
+    }
+
+    RSXGL_NOERROR(true);
+  }
+
 #if 0
   // TODO: Orphan the texture
-  if(texture.timestamp != 0 && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,texture.timestamp))) {
+  if(texture.timestamp != 0 && (!rsxgl_timestamp_check(ctx,texture.timestamp))) {
     texture.timestamp = 0;
   }
 #else
@@ -1579,6 +2261,10 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
   }
 #endif
 
+  if(texture.memory) {
+    rsxgl_texture_evict_storage(texture,_level);
+  }
+
   // set the texture's invalid & allocated bits:
   texture.invalid = 1;
   texture.invalid_complete = 1;
@@ -1586,21 +2272,58 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
   texture.arena = ctx -> arena_binding.names[RSXGL_TEXTURE_ARENA];
 
   // set the mipmap level data:
-  texture_t::level_t & level = texture.levels[_level];
-
   if(level.pformat != pdstformat || level.size[0] != width || level.size[1] != height || level.size[2] != depth) {
     rsxgl_texture_level_reset_storage(level);
     rsxgl_texture_level_format(level,dims,pdstformat,width,height,depth);
   }
 
-  ctx -> invalid_textures |= texture.binding_bitfield;
+  // Checked against the other levels when the texture is validated:
+  level.rect = rect;
 
-  RSXGL_NOERROR(true);
-}
+  rsxgl_texture_invalidate(ctx,texture);
 
-static inline bool
+  // Level 0, with no other levels, is a complete texture; allocate its storage now, and store
+  // the level there, rather than when the texture is first drawn with:
+  if(_level == 0 && !cube) {
+    bool others = false;
+    for(texture_t::level_size_type i = 1;!others && i < texture_t::max_levels;++i) {
+      others = texture.levels[i].pformat != PIPE_FORMAT_NONE;
+    }
+
+    if(!others) {
+      texture.complete = 1;
+      texture.pformat = pdstformat;
+      texture.cube = false;
+      texture.rect = rect;
+      texture.num_levels = 1;
+      texture.size[0] = width;
+      texture.size[1] = height;
+      texture.size[2] = depth;
+
+      texture.storage_levels = rsxgl_texture_storage_levels(texture);
+      rsxgl_texture_validate_storage(ctx,texture);
+
+      // Otherwise the texture stays invalid, and the level is kept in its own memory:
+      if(texture.memory) {
+	texture.invalid = 0;
+	texture.invalid_complete = 0;
+
+	rsxgl_texture_level_release_memory(level);
+	level.stored = 1;
+      }
+      else {
+	texture.storage_levels = 0;
+      }
+    }
+  }
+
+  RSXGL_NOERROR(true);
+}
+
+// Doesn't wait for the RSX to finish with the texture; callers that write it with the CPU must:
+static inline bool
 rsxgl_tex_subimage_init(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint x,GLint y,GLint z,GLsizei width,GLsizei height,GLsizei depth,
-			pipe_format * pdstformat,uint32_t * dstpitch,void ** dstaddress,memory_t * dstmem)
+			pipe_format * pdstformat,uint32_t * dstpitch,void ** dstaddress,memory_t * dstmem,texture_t::dimension_size_type * dstsize)
 {
   rsxgl_assert(width > 0);
   rsxgl_assert(height > 0);
@@ -1615,19 +2338,13 @@ rsxgl_tex_subimage_init(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
     RSXGL_ERROR(GL_INVALID_VALUE,false);
   }
 
-  // TODO: Asynchronous updating:
-  if(texture.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,texture.timestamp);
-    texture.timestamp = 0;
-  }
-
   texture_t::dimension_size_type size[3] = { 0,0,0 };
   *pdstformat = PIPE_FORMAT_NONE;
   *dstpitch = 0;
 
-  // the texture's storage is allocated (either by rsxgl_tex_storage, or by having previously validated a texture specified with rsxgl_tex_image)
-  if(texture.memory) {
-    const uint32_t offset = rsxgl_get_tex_level_offset_size(texture.size,texture.pitch,_level,size);
+  // the level is in the texture's storage (allocated either by rsxgl_tex_storage, or for a texture specified with rsxgl_tex_image)
+  if(texture.memory && (texture.immutable ? (_level < (GLint)texture.num_levels) : (bool)texture.levels[_level].stored)) {
+    const uint32_t offset = rsxgl_get_tex_level_offset_size(texture,_level,size);
 
     *pdstformat = texture.pformat;
     *dstpitch = texture.pitch;
@@ -1668,6 +2385,10 @@ rsxgl_tex_subimage_init(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
     RSXGL_ERROR(GL_INVALID_VALUE,false);
   }
 
+  dstsize[0] = size[0];
+  dstsize[1] = size[1];
+  dstsize[2] = size[2];
+
   RSXGL_NOERROR(true);
 }
 
@@ -1688,6 +2409,166 @@ rsxgl_pixel_store_aligned(const pixel_store_t & store,uint32_t value)
   }
 }
 
+// Copy an image into a level, from a pixel buffer (data is an offset into it) or from client
+// memory (srcoffset is added to data):
+static inline void
+rsxgl_tex_image_copy(rsxgl_context_t * ctx,texture_t & texture,texture_t::level_t & level,
+		     pipe_format psrcformat,uint32_t srcpitch,uint32_t srcoffset,const GLvoid * data,
+		     GLsizei width,GLsizei height)
+{
+  if(!level.memory) {
+    rsxgl_texture_level_validate_storage(level);
+  }
+  void *memory_ptr = level.memory_ptr;
+  if (memory_ptr == NULL)
+    memory_ptr = rsxgl_texture_migrate_address(level.memory.offset);
+
+  if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0 ||
+     data != 0) {
+    rsxgl_assert(level.memory);
+
+    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0) {
+      buffer_t & srcbuffer = ctx -> buffer_binding[RSXGL_PIXEL_UNPACK_BUFFER];
+      const memory_t & srcmem = srcbuffer.memory + rsxgl_pointer_to_offset(data);
+      const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+
+      if(rsxgl_util_format_translate_dma(ctx,
+					 level.pformat,
+					 memory_ptr,level.memory,level.pitch,0,0,
+					 psrcformat,
+					 rsxgl_arena_address(memory_arena_t::storage().at(srcbuffer.arena),srcmem),srcmem,srcpitch,0,0,
+					 width,height)) {
+	// The RSX reads the buffer and writes the texture:
+	srcbuffer.timestamp = timestamp;
+	texture.timestamp = timestamp;
+      }
+
+      rsxgl_timestamp_post(ctx,timestamp);
+    }
+    else if(data != 0) {
+      data = (const uint8_t *)data + srcoffset;
+      rsxgl_format_translate(level.pformat,memory_ptr,level.pitch,0,0,
+			     psrcformat,data,srcpitch,0,0,width,height);
+    }
+  }
+}
+
+// Copy an image into (x,y,z) of an allocated level, from a pixel buffer (data is an offset into
+// it) or from client memory (srcoffset is added to data):
+static inline void
+rsxgl_tex_subimage_copy(rsxgl_context_t * ctx,texture_t & texture,
+			pipe_format pdstformat,uint32_t dstpitch,void * dstaddress,const memory_t & dstmem,const texture_t::dimension_size_type dstsize[3],
+			GLint x,GLint y,GLint z,GLsizei width,GLsizei height,GLsizei depth,
+			pipe_format psrcformat,uint32_t srcpitch,uint32_t srcoffset,const GLvoid * data)
+{
+  rsxgl_assert(dstaddress != 0);
+  rsxgl_assert(dstmem);
+
+  texture.invalid_contents = 1;
+
+  if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0) {
+    buffer_t & srcbuffer = ctx -> buffer_binding[RSXGL_PIXEL_UNPACK_BUFFER];
+    const memory_t & srcmem = srcbuffer.memory + rsxgl_pointer_to_offset(data);
+
+    // Copies done by the RSX are queued behind the commands that may still be using the texture:
+    if(texture.timestamp > 0 &&
+       !rsxgl_texture_translate_supported(pdstformat,dstmem,dstpitch,dstsize,psrcformat,srcmem,srcpitch)) {
+      rsxgl_timestamp_wait(ctx,texture.timestamp);
+      texture.timestamp = 0;
+    }
+
+    const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+
+    if(rsxgl_texture_translate(ctx,
+			       pdstformat,
+			       dstaddress,dstmem,dstpitch,dstsize,x,y,z,
+			       psrcformat,
+			       rsxgl_arena_address(memory_arena_t::storage().at(srcbuffer.arena),srcmem),srcmem,srcpitch,0,0,
+			       width,height)) {
+      // The RSX reads the buffer and writes the texture:
+      srcbuffer.timestamp = timestamp;
+      texture.timestamp = timestamp;
+    }
+
+    rsxgl_timestamp_post(ctx,timestamp);
+  }
+  else if(data) {
+    rsxgl_assert(dstaddress != 0);
+    data = (const uint8_t *)data + srcoffset;
+
+    const uint32_t staging_pitch = util_format_get_stride(pdstformat,width);
+    const uint32_t staging_size = util_format_get_2d_size(pdstformat,staging_pitch,height);
+
+    // The RSX may still be reading the texture. Rather than wait for it, convert the texels into
+    // this context's staging memory, and have the RSX copy them once it's done. Only commands
+    // from this context are known to be done before the copy. The timestamp is created first,
+    // since running out of them resets the staging memory:
+    void * staging = 0;
+    uint32_t timestamp = 0;
+    if(texture.timestamp > 0 && rsxgl_timestamp_timeline(texture.timestamp) == ctx -> timeline &&
+       !rsxgl_timestamp_passed(ctx,texture.timestamp) && depth == 1 &&
+       rsxgl_texture_translate_supported(pdstformat,dstmem,dstpitch,dstsize,pdstformat,true,staging_pitch)) {
+      timestamp = rsxgl_timestamp_create(ctx,1);
+      staging = rsxgl_staging_migrate_memalign(ctx,RSXGL_VERTEX_MIGRATE_BUFFER_ALIGN,staging_size);
+    }
+
+    if(staging != 0) {
+      uint32_t staging_offset = 0;
+      int32_t s = gcmAddressToOffset(staging,&staging_offset);
+      rsxgl_assert(s == 0);
+
+      rsxgl_format_translate(pdstformat,staging,staging_pitch,0,0,
+			     psrcformat,data,srcpitch,0,0,width,height);
+
+      rsxgl_texture_translate(ctx,
+			      pdstformat,
+			      dstaddress,dstmem,dstpitch,dstsize,x,y,z,
+			      pdstformat,
+			      staging,memory_t(RSXGL_MEMORY_LOCATION_LOCAL,staging_offset,0),staging_pitch,0,0,
+			      width,height);
+      rsxgl_staging_migrate_free(ctx,staging,timestamp);
+
+      texture.timestamp = timestamp;
+      rsxgl_timestamp_post(ctx,timestamp);
+    }
+    else {
+      // A timestamp that was created for staging still has to be posted, in order:
+      if(timestamp != 0) {
+	rsxgl_timestamp_post(ctx,timestamp);
+      }
+
+      if(texture.timestamp > 0) {
+	rsxgl_timestamp_wait(ctx,texture.timestamp);
+	texture.timestamp = 0;
+      }
+
+      rsxgl_texture_translate(ctx,
+			      pdstformat,
+			      dstaddress,dstmem,dstpitch,dstsize,x,y,z,
+			      psrcformat,
+			      data,memory_t(),srcpitch,0,0,
+			      width,height);
+    }
+  }
+}
+
+// Copy an image into the whole of a level that's in the texture's storage:
+static inline void
+rsxgl_tex_image_store(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLsizei width,GLsizei height,GLsizei depth,
+		      pipe_format psrcformat,uint32_t srcpitch,uint32_t srcoffset,const GLvoid * data)
+{
+  pipe_format pdstformat = PIPE_FORMAT_NONE;
+  uint32_t dstpitch = 0;
+  void * dstaddress = 0;
+  memory_t dstmem;
+  texture_t::dimension_size_type dstsize[3] = { 0,0,0 };
+
+  if(rsxgl_tex_subimage_init(ctx,texture,_level,0,0,0,width,height,depth,&pdstformat,&dstpitch,&dstaddress,&dstmem,dstsize)) {
+    rsxgl_tex_subimage_copy(ctx,texture,pdstformat,dstpitch,dstaddress,dstmem,dstsize,0,0,0,width,height,depth,
+			    psrcformat,srcpitch,srcoffset,data);
+  }
+}
+
 static inline void
 rsxgl_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLsizei width,GLsizei height,GLsizei depth,
 		GLenum format,GLenum type,const GLvoid * data)
@@ -1701,41 +2582,61 @@ rsxgl_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube
       RSXGL_ERROR_(GL_INVALID_VALUE);
     }
 
+    texture_t::level_t & level = texture.levels[_level];
+
+    // There's no S3TC compressor; compressed levels can be allocated, but only filled in by
+    // glCompressedTexSubImage:
+    if(util_format_is_compressed(level.pformat) &&
+       (ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0 || data != 0)) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
     const pixel_store_t unpack = ctx -> state.pixelstore_unpack;
     const uint32_t srcpitch = rsxgl_pixel_store_aligned(unpack,util_format_get_stride(psrcformat,unpack.row_length ? unpack.row_length : width));
     const uint32_t srcoffset = (srcpitch * unpack.skip_rows) + (util_format_get_stride(psrcformat,1) * unpack.skip_pixels);
 
-    texture_t::level_t & level = texture.levels[_level];
-
-    if(!level.memory) {
-      rsxgl_texture_level_validate_storage(level);
+    if(level.stored) {
+      rsxgl_tex_image_store(ctx,texture,_level,width,height,depth,psrcformat,srcpitch,srcoffset,data);
     }
-    void *memory_ptr = level.memory_ptr;
-    if (memory_ptr == NULL)
-      memory_ptr = rsxgl_texture_migrate_address(level.memory.offset);
+    else {
+      rsxgl_tex_image_copy(ctx,texture,level,psrcformat,srcpitch,srcoffset,data,width,height);
+    }
+  }
+}
 
-    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0 ||
-       data != 0) {
-      rsxgl_assert(level.memory);
+// Compressed images are copied into the level as they are; the RSX samples them directly:
+static inline void
+rsxgl_compressed_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,GLint _level,GLenum glinternalformat,GLsizei width,GLsizei height,GLsizei depth,
+			   GLsizei imageSize,const GLvoid * data)
+{
+  const pipe_format pformat = rsxgl_choose_compressed_format(glinternalformat);
 
-      if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0) {
-	const buffer_t & srcbuffer = ctx -> buffer_binding[RSXGL_PIXEL_UNPACK_BUFFER];
-	const memory_t & srcmem = srcbuffer.memory + rsxgl_pointer_to_offset(data);
+  if(pformat == PIPE_FORMAT_NONE) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
 
-	rsxgl_util_format_translate_dma(ctx,
-					level.pformat,
-					memory_ptr,level.memory,level.pitch,0,0,
-					psrcformat,
-					rsxgl_arena_address(memory_arena_t::storage().at(srcbuffer.arena),srcmem),srcmem,srcpitch,0,0,
-					width,height);
-      }
-      else if(data != 0) {
-        data = (const uint8_t *)data + srcoffset;
-	util_format_translate(level.pformat,memory_ptr,level.pitch,0,0,
-			      psrcformat,data,srcpitch,0,0,width,height);
-      }
+  const uint32_t pitch = util_format_get_stride(pformat,width);
+
+  if(imageSize < 0 || (uint32_t)imageSize != util_format_get_2d_size(pformat,pitch,height) * depth) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  const bool result = rsxgl_tex_image_format(ctx,texture,dims,cube,false,_level,glinternalformat,width,height,depth);
+
+  if(result) {
+    texture_t::level_t & level = texture.levels[_level];
+
+    // Every level takes level 0's format:
+    if(level.pformat != pformat) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
     }
 
+    if(level.stored) {
+      rsxgl_tex_image_store(ctx,texture,_level,width,height,depth,pformat,pitch,0,data);
+    }
+    else {
+      rsxgl_tex_image_copy(ctx,texture,level,pformat,pitch,0,data,width,height);
+    }
   }
 }
 
@@ -1747,7 +2648,8 @@ rsxgl_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint
   uint32_t dstpitch = 0;
   void * dstaddress = 0;
   memory_t dstmem;
-  const bool result = rsxgl_tex_subimage_init(ctx,texture,_level,x,y,z,width,height,depth,&pdstformat,&dstpitch,&dstaddress,&dstmem);
+  texture_t::dimension_size_type dstsize[3] = { 0,0,0 };
+  const bool result = rsxgl_tex_subimage_init(ctx,texture,_level,x,y,z,width,height,depth,&pdstformat,&dstpitch,&dstaddress,&dstmem,dstsize);
 
   if(result) {
     // pick a format:
@@ -1757,69 +2659,118 @@ rsxgl_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint
       RSXGL_ERROR_(GL_INVALID_ENUM);
     }
 
-    rsxgl_assert(dstaddress != 0);
-    rsxgl_assert(dstmem);
-    
+    // There's no S3TC compressor:
+    if(util_format_is_compressed(pdstformat)) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
     const pixel_store_t unpack = ctx -> state.pixelstore_unpack;
 
     const uint32_t srcpitch = rsxgl_pixel_store_aligned(unpack,util_format_get_stride(psrcformat,unpack.row_length ? unpack.row_length : width));
     const uint32_t srcoffset = (srcpitch * unpack.skip_rows) + (util_format_get_stride(psrcformat,1) * unpack.skip_pixels);
 
-    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0) {
-      const buffer_t & srcbuffer = ctx -> buffer_binding[RSXGL_PIXEL_UNPACK_BUFFER];
-      const memory_t & srcmem = srcbuffer.memory + rsxgl_pointer_to_offset(data);
+    rsxgl_tex_subimage_copy(ctx,texture,pdstformat,dstpitch,dstaddress,dstmem,dstsize,x,y,z,width,height,depth,
+			    psrcformat,srcpitch,srcoffset,data);
+
+    RSXGL_NOERROR_();
+  }
+}
+
+static inline void
+rsxgl_compressed_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint x,GLint y,GLint z,GLsizei width,GLsizei height,GLsizei depth,
+			      GLenum format,GLsizei imageSize,const GLvoid * data)
+{
+  const pipe_format psrcformat = rsxgl_choose_compressed_format(format);
+
+  if(psrcformat == PIPE_FORMAT_NONE) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  pipe_format pdstformat = PIPE_FORMAT_NONE;
+  uint32_t dstpitch = 0;
+  void * dstaddress = 0;
+  memory_t dstmem;
+  texture_t::dimension_size_type dstsize[3] = { 0,0,0 };
+  const bool result = rsxgl_tex_subimage_init(ctx,texture,_level,x,y,z,width,height,depth,&pdstformat,&dstpitch,&dstaddress,&dstmem,dstsize);
 
-      rsxgl_util_format_translate_dma(ctx,
-				      pdstformat,
-				      dstaddress,dstmem,dstpitch,x,y,
-				      psrcformat,
-				      rsxgl_arena_address(memory_arena_t::storage().at(srcbuffer.arena),srcmem),srcmem,srcpitch,0,0,
-				      width,height);
+  if(result) {
+    if(pdstformat != psrcformat) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
     }
-    else if(data) {
-      rsxgl_assert(dstaddress != 0);
-      data = (const uint8_t *)data + srcoffset;
-      util_format_translate(pdstformat,dstaddress,dstpitch,x,y,
-			    psrcformat,data,srcpitch,0,0,width,height);
+
+    // Only whole blocks can be replaced, except at the right & bottom edges of the level:
+    const unsigned blockwidth = util_format_get_blockwidth(psrcformat), blockheight = util_format_get_blockheight(psrcformat);
+    if((x % blockwidth) != 0 || (y % blockheight) != 0 ||
+       ((width % blockwidth) != 0 && (x + width) != dstsize[0]) ||
+       ((height % blockheight) != 0 && (y + height) != dstsize[1])) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
     }
 
+    const uint32_t srcpitch = util_format_get_stride(psrcformat,width);
+
+    if(imageSize < 0 || (uint32_t)imageSize != util_format_get_2d_size(psrcformat,srcpitch,height) * depth) {
+      RSXGL_ERROR_(GL_INVALID_VALUE);
+    }
+
+    rsxgl_tex_subimage_copy(ctx,texture,pdstformat,dstpitch,dstaddress,dstmem,dstsize,x,y,z,width,height,depth,
+			    psrcformat,srcpitch,0,data);
+
     RSXGL_NOERROR_();
   }
 }
 
+// Copy from the read framebuffer's color buffer into a texture's storage, or into a level. The RSX
+// does the copy, queued behind whatever may still be using the texture, unless the formats are
+// ones that it can't convert between; then the CPU reads the color buffer, after waiting for it to
+// be drawn:
 static inline void
-rsxgl_copy_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLint x,GLint y,GLsizei width,GLsizei height)
+rsxgl_copy_tex_framebuffer(rsxgl_context_t * ctx,texture_t & texture,
+			   pipe_format pdstformat,uint32_t dstpitch,void * dstaddress,const memory_t & dstmem,const texture_t::dimension_size_type dstsize[3],
+			   GLint xoffset,GLint yoffset,GLint zoffset,GLint x,GLint y,GLsizei width,GLsizei height)
 {
-  const bool result = rsxgl_tex_image_format(ctx,texture,dims,cube,rect,_level,glinternalformat,width,height,1);
+  const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
 
-  if(result) {
-    const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
-    
-    framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_READ_FRAMEBUFFER];
-    rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
+  framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_READ_FRAMEBUFFER];
+  rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
 
-    if(framebuffer.color_pformat != PIPE_FORMAT_NONE && framebuffer.read_surface.memory) {
-      texture_t::level_t & level = texture.levels[_level];
-      if(!level.memory) {
-	rsxgl_texture_level_validate_storage(level);
-      }
-      void *memory_ptr = level.memory_ptr;
-      if (memory_ptr == NULL)
-        memory_ptr = rsxgl_texture_migrate_address(level.memory.offset);
+  if(framebuffer.color_pformat != PIPE_FORMAT_NONE && framebuffer.read_surface.memory) {
+    rsxgl_assert(dstaddress != 0);
+    rsxgl_assert(dstmem);
 
-      rsxgl_assert(level.memory);
+    texture.invalid_contents = 1;
 
-      rsxgl_util_format_translate_dma(ctx,
-				      level.pformat,
-				      memory_ptr,level.memory,level.pitch,0,0,
-				      framebuffer.color_pformat,
-				      framebuffer.read_address,framebuffer.read_surface.memory,framebuffer.read_surface.pitch,
-				      std::min((unsigned)x,(unsigned)framebuffer.size[0] - 1),std::min((unsigned)y,(unsigned)framebuffer.size[1] - 1),
-				      std::min((unsigned)width,(unsigned)framebuffer.size[0] - x),std::min((unsigned)height,(unsigned)framebuffer.size[1] - y));
+    const unsigned
+      src_x = std::min((unsigned)x,(unsigned)framebuffer.size[0] - 1),
+      src_y = std::min((unsigned)y,(unsigned)framebuffer.size[1] - 1),
+      src_width = std::min((unsigned)width,(unsigned)framebuffer.size[0] - src_x),
+      src_height = std::min((unsigned)height,(unsigned)framebuffer.size[1] - src_y);
+
+    if(!rsxgl_framebuffer_translate_supported(pdstformat,dstmem,dstpitch,dstsize,xoffset,yoffset,
+					      framebuffer.color_pformat,framebuffer.read_surface.memory,framebuffer.read_surface.pitch,
+					      src_width,src_height)) {
+      rsxgl_timestamp_post(ctx,timestamp);
+      rsxgl_timestamp_wait(ctx,timestamp);
+      texture.timestamp = 0;
+
+      rsxgl_framebuffer_translate(ctx,
+				  pdstformat,
+				  dstaddress,dstmem,dstpitch,dstsize,xoffset,yoffset,zoffset,
+				  framebuffer.color_pformat,
+				  framebuffer.read_address,framebuffer.read_surface.memory,framebuffer.read_surface.pitch,
+				  src_x,src_y,src_width,src_height);
+      return;
     }
 
-    rsxgl_timestamp_post(ctx,timestamp);
+    rsxgl_framebuffer_translate(ctx,
+				pdstformat,
+				dstaddress,dstmem,dstpitch,dstsize,xoffset,yoffset,zoffset,
+				framebuffer.color_pformat,
+				framebuffer.read_address,framebuffer.read_surface.memory,framebuffer.read_surface.pitch,
+				src_x,src_y,src_width,src_height);
+    texture.timestamp = timestamp;
   }
+
+  rsxgl_timestamp_post(ctx,timestamp);
 }
 
 static inline void
@@ -1829,28 +2780,258 @@ rsxgl_copy_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
   uint32_t dstpitch = 0;
   void * dstaddress = 0;
   memory_t dstmem;
-  const bool result = rsxgl_tex_subimage_init(ctx,texture,_level,xoffset,yoffset,zoffset,width,height,1,&pdstformat,&dstpitch,&dstaddress,&dstmem);
+  texture_t::dimension_size_type dstsize[3] = { 0,0,0 };
+  const bool result = rsxgl_tex_subimage_init(ctx,texture,_level,xoffset,yoffset,zoffset,width,height,1,&pdstformat,&dstpitch,&dstaddress,&dstmem,dstsize);
 
   if(result) {
-    const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
-    
-    framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_READ_FRAMEBUFFER];
-    rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
+    if(util_format_is_compressed(pdstformat)) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    rsxgl_copy_tex_framebuffer(ctx,texture,pdstformat,dstpitch,dstaddress,dstmem,dstsize,xoffset,yoffset,zoffset,x,y,width,height);
+  }
+}
+
+static inline void
+rsxgl_copy_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLint x,GLint y,GLsizei width,GLsizei height)
+{
+  const bool result = rsxgl_tex_image_format(ctx,texture,dims,cube,rect,_level,glinternalformat,width,height,1);
 
-    if(framebuffer.color_pformat != PIPE_FORMAT_NONE && framebuffer.read_surface.memory) {
-      rsxgl_assert(dstaddress != 0);
-      rsxgl_assert(dstmem);
+  if(result) {
+    texture_t::level_t & level = texture.levels[_level];
 
-      rsxgl_util_format_translate_dma(ctx,
-				      pdstformat,
-				      dstaddress,dstmem,dstpitch,0,0,
-				      framebuffer.color_pformat,
-				      framebuffer.read_address,framebuffer.read_surface.memory,framebuffer.read_surface.pitch,
-				      std::min((unsigned)x,(unsigned)framebuffer.size[0] - 1),std::min((unsigned)y,(unsigned)framebuffer.size[1] - 1),
-				      std::min((unsigned)width,(unsigned)framebuffer.size[0] - x),std::min((unsigned)height,(unsigned)framebuffer.size[1] - y));
+    // There's no S3TC compressor:
+    if(util_format_is_compressed(level.pformat)) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
     }
-    
-    rsxgl_timestamp_post(ctx,timestamp);
+
+    // Respecifying a level with the format and size that it already has, which is what grabbing
+    // the framebuffer every frame does, leaves it in the texture's storage:
+    if(level.stored) {
+      rsxgl_copy_tex_subimage(ctx,texture,_level,0,0,0,x,y,width,height);
+      return;
+    }
+
+    if(!level.memory) {
+      rsxgl_texture_level_validate_storage(level);
+    }
+    void *memory_ptr = level.memory_ptr;
+    if (memory_ptr == NULL)
+      memory_ptr = rsxgl_texture_migrate_address(level.memory.offset);
+
+    rsxgl_assert(level.memory);
+
+    rsxgl_copy_tex_framebuffer(ctx,texture,level.pformat,level.pitch,memory_ptr,level.memory,level.size,0,0,0,x,y,width,height);
+  }
+}
+
+// The RSX can also generate the levels of linear textures whose texels are 4 bytes (filtered as
+// A8R8G8B8, which averages each byte separately) or 1 byte (Y8), by scaling each level into the
+// next with the SIFM engine.
+static inline bool
+rsxgl_mipmap_transfer_supported(const memory_t & mem,uint32_t pitch,uint32_t bytes,uint32_t width,uint32_t height)
+{
+  return (bytes == 1 || bytes == 4) &&
+    rsxgl_scaled_image_transfer_supported(mem,pitch,0,width,height);
+}
+
+// Filter the width x height image at src into the max(width >> 1,1) x max(height >> 1,1) image
+// at dst; both have the same pitch:
+static inline void
+rsxgl_mipmap_transfer(gcmContextData * context,
+		      const memory_t & dst,const memory_t & src,const uint32_t pitch,const uint8_t bytes,
+		      const uint32_t width,const uint32_t height)
+{
+  // NV04_CONTEXT_SURFACES_2D_FORMAT_Y8, _A8R8G8B8; NV03_SCALED_IMAGE_FROM_MEMORY_COLOR_FORMAT_Y8, _A8R8G8B8:
+  const uint32_t surface_format = (bytes == 1) ? 0x1 : 0xa;
+  const uint32_t sifm_format = (bytes == 1) ? 0x8 : 0x3;
+
+  // Sampling from the corner, with bilinear filtering, at twice the source's spacing puts each
+  // sample in the middle of a 2x2 block of texels, which averages them:
+  rsxgl_scaled_image_transfer(context,
+			      dst,pitch,surface_format,0,std::max(width >> 1,(uint32_t)1),std::max(height >> 1,(uint32_t)1),
+			      src,pitch,sifm_format,width,height,true);
+}
+
+// Generate levels 1 through num_levels - 1 of a texture whose storage is allocated and valid, in
+// place. The RSX does it if it can filter every level; otherwise the CPU does, after waiting for
+// the RSX to finish with the texture:
+static inline bool
+rsxgl_generate_mipmap_storage(rsxgl_context_t * ctx,texture_t & texture,const texture_t::level_size_type num_levels)
+{
+  const uint32_t bytes = util_format_get_blocksize(texture.pformat);
+  uint32_t size[3] = { texture.size[0], texture.size[1], texture.size[2] };
+
+  if(!texture.swizzled && texture.dims == 2 && (bytes == 1 || bytes == 4) && rsxgl_mipmap_byte_format(texture.pformat) == bytes) {
+    bool transfer = true;
+    for(texture_t::level_size_type i = 0;transfer && i < num_levels;++i) {
+      texture_t::dimension_size_type level_size[3];
+      const uint32_t offset = rsxgl_get_tex_level_offset_size(texture,i,level_size);
+      transfer = rsxgl_mipmap_transfer_supported(texture.memory + offset,texture.pitch,bytes,level_size[0],level_size[1]);
+    }
+
+    if(transfer) {
+      const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+
+      memory_t src = texture.memory;
+      for(texture_t::level_size_type i = 1;i < num_levels;++i) {
+	const memory_t dst = src + texture.pitch * size[1];
+	rsxgl_mipmap_transfer(ctx -> gcm_context(),dst,src,texture.pitch,bytes,size[0],size[1]);
+
+	src = dst;
+	for(int j = 0;j < 3;++j) {
+	  size[j] = std::max(size[j] >> 1,(uint32_t)1);
+	}
+      }
+
+      texture.timestamp = timestamp;
+      rsxgl_timestamp_post(ctx,timestamp);
+      return true;
+    }
+  }
+
+  if(texture.timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,texture.timestamp);
+    texture.timestamp = 0;
+  }
+
+  uint8_t * address = (uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(texture.arena),texture.memory);
+
+  if(!texture.swizzled) {
+    for(texture_t::level_size_type i = 1;i < num_levels;++i) {
+      uint8_t * dst = address + texture.pitch * size[1] * size[2];
+      if(!rsxgl_mipmap_reduce(texture.pformat,
+			      dst,texture.pitch,texture.pitch * std::max(size[1] >> 1,(uint32_t)1),
+			      address,texture.pitch,texture.pitch * size[1],
+			      size[0],size[1],size[2])) {
+	RSXGL_ERROR(GL_OUT_OF_MEMORY,false);
+      }
+
+      address = dst;
+      for(int j = 0;j < 3;++j) {
+	size[j] = std::max(size[j] >> 1,(uint32_t)1);
+      }
+    }
+    return true;
+  }
+
+  // Swizzled levels are filtered as linear images, then swizzled again:
+  uint8_t * src = (uint8_t *)malloc(bytes * size[0] * size[1] * size[2]);
+  uint8_t * dst = (uint8_t *)malloc(bytes * std::max(size[0] >> 1,(uint32_t)1) * std::max(size[1] >> 1,(uint32_t)1) * std::max(size[2] >> 1,(uint32_t)1));
+
+  if(src == 0 || dst == 0) {
+    free(src);
+    free(dst);
+    RSXGL_ERROR(GL_OUT_OF_MEMORY,false);
+  }
+
+  rsxgl_unswizzle_copy(src,bytes * size[0],bytes * size[0] * size[1],address,size,bytes,size[0],size[1],size[2]);
+
+  for(texture_t::level_size_type i = 1;i < num_levels;++i) {
+    address += bytes * size[0] * size[1] * size[2];
+
+    const uint32_t dst_size[3] = { std::max(size[0] >> 1,(uint32_t)1), std::max(size[1] >> 1,(uint32_t)1), std::max(size[2] >> 1,(uint32_t)1) };
+    if(!rsxgl_mipmap_reduce(texture.pformat,
+			    dst,bytes * dst_size[0],bytes * dst_size[0] * dst_size[1],
+			    src,bytes * size[0],bytes * size[0] * size[1],
+			    size[0],size[1],size[2])) {
+      free(src);
+      free(dst);
+      RSXGL_ERROR(GL_OUT_OF_MEMORY,false);
+    }
+    rsxgl_swizzle_copy(address,dst_size,0,0,0,
+		       dst,bytes * dst_size[0],bytes * dst_size[0] * dst_size[1],
+		       bytes,dst_size[0],dst_size[1],dst_size[2]);
+
+    std::swap(src,dst);
+    for(int j = 0;j < 3;++j) {
+      size[j] = dst_size[j];
+    }
+  }
+
+  free(src);
+  free(dst);
+  return true;
+}
+
+// Specify levels 1 through num_levels - 1 of a mutable texture whose levels aren't stored,
+// filtered from level 0:
+static inline bool
+rsxgl_generate_mipmap_levels(rsxgl_context_t * ctx,texture_t & texture,const texture_t::level_size_type num_levels)
+{
+  for(texture_t::level_size_type i = 1;i < num_levels;++i) {
+    texture_t::level_t & src = texture.levels[i - 1];
+
+    if(!rsxgl_tex_image_format(ctx,texture,src.dims,false,false,i,GL_NONE,
+			       std::max(src.size[0] >> 1,1),std::max(src.size[1] >> 1,1),std::max(src.size[2] >> 1,1))) {
+      return false;
+    }
+
+    texture_t::level_t & dst = texture.levels[i];
+    if(!dst.memory) {
+      rsxgl_texture_level_validate_storage(dst);
+    }
+
+    if(!rsxgl_mipmap_reduce(src.pformat,
+			    rsxgl_texture_level_address(dst),dst.pitch,dst.pitch * dst.size[1],
+			    rsxgl_texture_level_address(src),src.pitch,src.pitch * src.size[1],
+			    src.size[0],src.size[1],src.size[2])) {
+      RSXGL_ERROR(GL_OUT_OF_MEMORY,false);
+    }
+  }
+
+  return true;
+}
+
+static inline void
+rsxgl_generate_mipmap(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims)
+{
+  if(texture.dims != dims) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  // Immutable textures' storage is always valid; mutable ones' is valid until a level that
+  // doesn't fit in it is specified:
+  const bool stored = texture.memory && !texture.invalid;
+
+  if(texture.immutable && !stored) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  const pipe_format pformat = stored ? texture.pformat : texture.levels[0].pformat;
+  const texture_t::dimension_size_type * size = stored ? texture.size : texture.levels[0].size;
+
+  if(pformat == PIPE_FORMAT_NONE || (!stored && !texture.levels[0].memory) || !rsxgl_mipmap_reduce_supported(pformat)) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  const texture_t::level_size_type num_levels = texture.immutable ?
+    texture.num_levels :
+    log2_uint32(std::max(size[0],std::max(size[1],size[2]))) + 1;
+
+  if(stored && texture.storage_levels < num_levels && !rsxgl_texture_grow_storage(ctx,texture,num_levels)) {
+    RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+
+  texture.invalid_contents = 1;
+
+  const bool result = stored ?
+    rsxgl_generate_mipmap_storage(ctx,texture,num_levels) :
+    rsxgl_generate_mipmap_levels(ctx,texture,num_levels);
+
+  // The generated levels are stored:
+  if(result && stored && !texture.immutable) {
+    for(texture_t::level_size_type i = 1;i < num_levels;++i) {
+      rsxgl_texture_store_level(texture,i);
+    }
+    rsxgl_texture_release_levels(ctx,texture,texture.timestamp);
+    rsxgl_texture_count_levels(ctx,texture);
+  }
+
+  rsxgl_texture_invalidate(ctx,texture);
+
+  if(result) {
+    RSXGL_NOERROR_();
   }
 }
 
@@ -2069,6 +3250,29 @@ glCopyTexSubImage3D (GLenum target, GLint level, GLint xoffset, GLint yoffset, G
   rsxgl_copy_tex_subimage(ctx,texture,level,xoffset,yoffset,zoffset,x,y,width,height);
 }
 
+GLAPI void APIENTRY
+glGenerateMipmap (GLenum target)
+{
+  if(!(target == GL_TEXTURE_1D ||
+       target == GL_TEXTURE_2D ||
+       target == GL_TEXTURE_3D ||
+       target == GL_TEXTURE_1D_ARRAY ||
+       target == GL_TEXTURE_2D_ARRAY ||
+       target == GL_TEXTURE_CUBE_MAP)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  // Array and cube map textures aren't stored with more than one layer or face:
+  if(target == GL_TEXTURE_1D_ARRAY || target == GL_TEXTURE_2D_ARRAY || target == GL_TEXTURE_CUBE_MAP) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  rsxgl_context_t * ctx = current_ctx();
+  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
+
+  rsxgl_generate_mipmap(ctx,texture,rsxgl_texture_target_dims(target));
+}
+
 GLAPI void APIENTRY
 glTexSubImage1D (GLenum target, GLint level, GLint xoffset, GLsizei width, GLenum format, GLenum type, const GLvoid *pixels)
 {
@@ -2113,31 +3317,57 @@ glTexSubImage3D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint
 GLAPI void APIENTRY
 glCompressedTexImage3D (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLsizei imageSize, const GLvoid *data)
 {
+  // S3TC images are only 2D:
+  RSXGL_ERROR_(GL_INVALID_ENUM);
 }
 
 GLAPI void APIENTRY
 glCompressedTexImage2D (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid *data)
 {
+  if(!(target == GL_TEXTURE_2D ||
+       target == GL_TEXTURE_CUBE_MAP)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  rsxgl_context_t * ctx = current_ctx();
+  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
+
+  rsxgl_compressed_tex_image(ctx,texture,2,target == GL_TEXTURE_CUBE_MAP,level,internalformat,std::max(width,1),std::max(height,1),1,imageSize,data);
 }
 
 GLAPI void APIENTRY
 glCompressedTexImage1D (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLint border, GLsizei imageSize, const GLvoid *data)
 {
+  // S3TC images are only 2D:
+  RSXGL_ERROR_(GL_INVALID_ENUM);
 }
 
 GLAPI void APIENTRY
 glCompressedTexSubImage3D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const GLvoid *data)
 {
+  // S3TC images are only 2D:
+  RSXGL_ERROR_(GL_INVALID_ENUM);
 }
 
 GLAPI void APIENTRY
 glCompressedTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const GLvoid *data)
 {
+  if(!(target == GL_TEXTURE_2D ||
+       target == GL_TEXTURE_CUBE_MAP)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  rsxgl_context_t * ctx = current_ctx();
+  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
+
+  rsxgl_compressed_tex_subimage(ctx,texture,level,xoffset,yoffset,0,width,height,1,format,imageSize,data);
 }
 
 GLAPI void APIENTRY
 glCompressedTexSubImage1D (GLenum target, GLint level, GLint xoffset, GLsizei width, GLenum format, GLsizei imageSize, const GLvoid *data)
 {
+  // S3TC images are only 2D:
+  RSXGL_ERROR_(GL_INVALID_ENUM);
 }
 
 GLAPI void APIENTRY
@@ -2150,109 +3380,214 @@ glTexBuffer (GLenum target, GLenum internalformat, GLuint buffer)
 {
 }
 
+// Allocate the storage of a texture that's been specified level by level, and have the RSX copy
+// the levels that fit in it there, behind whatever it's still doing to them (writing them from
+// pixel buffers). The CPU copies the ones that the RSX can't, after waiting for that:
 void
 rsxgl_texture_validate(rsxgl_context_t * ctx,texture_t & texture,uint32_t timestamp)
 {
-  rsxgl_assert(timestamp >= texture.timestamp);
-  texture.timestamp = timestamp;
+  rsxgl_assert(rsxgl_timestamp_ordered(texture.timestamp,timestamp));
 
   if(texture.invalid) {
-    rsxgl_texture_reset_storage(texture);
+    // Specifying a level that doesn't fit in the storage frees it:
+    rsxgl_assert(!texture.memory);
+
     if(rsxgl_texture_validate_complete(ctx,texture)) {
+      texture.storage_levels = rsxgl_texture_storage_levels(texture);
       rsxgl_texture_validate_storage(ctx,texture);
 
       if(texture.memory) {
 	const pipe_format pdstformat = texture.pformat;
 	texture_t::dimension_size_type size[3] = { texture.size[0], texture.size[1], texture.size[2] };
-	const uint32_t dstpitch = texture.pitch;
 	uint32_t dstoffset = 0;
-	unsigned int ndelete = 0;
 
-	// transfer contents of each mipmap level:
-	{
-	  texture_t::level_t * plevel = texture.levels;
-	  for(texture_t::level_size_type i = 0,n = texture.num_levels;i < n;++i,++plevel) {
-	    if(plevel -> memory) {
-#if 0
-	      rsxgl_debug_printf("%lx copying mipmap level:%u pformat:%u pitch:%u size:%ux%ux%u from:%u pdstformat:%u dstpitch:%u to:%u\n",
-				 (uint32_t)((uint64_t)&texture),
-				 (unsigned int)i,(unsigned int)plevel -> pformat,(unsigned int)plevel -> pitch,
-				 (unsigned int)std::min(size[0],plevel -> size[0]),(unsigned int)std::min(size[1],plevel -> size[1]),(unsigned int)std::min(size[2],plevel -> size[2]),
-				 (unsigned long)plevel -> memory.offset,
-				 
-				 (unsigned int)pdstformat,(unsigned int)dstpitch,
-				 (unsigned long)texture.memory.offset);
-#endif
-	      
-#if 0
-	      rsxgl_texture_blit(ctx,
-				 pdstformat,texture.memory + dstoffset,dstpitch,0,0,
-				 plevel -> pformat,plevel -> memory,plevel -> pitch,0,0,
-				 std::min(size[0],plevel -> size[0]),std::min(size[1],plevel -> size[1]));
-#endif
+	// Levels that fit are stored; ones that don't (their sizes are wrong) stay in their own
+	// memory, and aren't sampled:
+	bool copy[texture_t::max_levels], cpu = false;
+
+	for(texture_t::level_size_type i = 0,n = texture.storage_levels;i < n;++i) {
+	  texture_t::level_t & level = texture.levels[i];
+	  const memory_t dstmem = texture.memory + dstoffset;
 
-	      const memory_t dstmem = texture.memory + dstoffset;
-
-              void *memory_ptr = plevel -> memory_ptr;
-              if (memory_ptr == NULL)
-                memory_ptr = rsxgl_texture_migrate_address(plevel -> memory.offset);
-
-	      rsxgl_util_format_translate_dma(ctx,
-					      pdstformat,
-					      rsxgl_arena_address(memory_arena_t::storage().at(texture.arena),dstmem),dstmem,dstpitch,0,0,
-					      plevel -> pformat,
-					      memory_ptr,plevel -> memory,plevel -> pitch,0,0,
-					      std::min(size[0],plevel -> size[0]),std::min(size[1],plevel -> size[1]));
-
-	      if(plevel -> memory.owner) {
-		++ndelete;
-	      }
-	    }
-	    
-	    dstoffset += dstpitch * size[1] * size[2];
-	    for(int j = 0;j < 3;++j) {
-	      size[j] = std::max(size[j] >> 1,1);
-	    }
+	  level.stored = level.pformat != PIPE_FORMAT_NONE && rsxgl_texture_level_fits_storage(texture,i,level.dims,level.pformat,level.size);
+	  copy[i] = level.stored && level.memory;
+
+	  if(copy[i] && !rsxgl_texture_translate_supported(pdstformat,dstmem,texture.pitch,size,level.pformat,true,level.pitch)) {
+	    cpu = true;
 	  }
+
+	  dstoffset += rsxgl_get_tex_level_size(texture,size);
+	  for(int j = 0;j < 3;++j) {
+	    size[j] = std::max(size[j] >> 1,1);
+	  }
+	}
+
+	if(cpu && texture.timestamp > 0) {
+	  rsxgl_timestamp_wait(ctx,texture.timestamp);
+	  texture.timestamp = 0;
 	}
 
-	// TODO: wait for transfers to complete, then delete memory:
-	if(ndelete) {
-	  texture_t::level_t * plevel = texture.levels;
-	  for(texture_t::level_size_type i = 0,n = texture.num_levels;i < n;++i,++plevel) {
-	    if(plevel -> memory.owner) {
-	      // rsxgl_texture_level_reset_storage(*plevel);
-	    }
+	size[0] = texture.size[0];
+	size[1] = texture.size[1];
+	size[2] = texture.size[2];
+	dstoffset = 0;
+
+	for(texture_t::level_size_type i = 0,n = texture.storage_levels;i < n;++i) {
+	  texture_t::level_t & level = texture.levels[i];
+
+	  if(copy[i]) {
+	    const memory_t dstmem = texture.memory + dstoffset;
+
+	    rsxgl_texture_translate(ctx,
+				    pdstformat,
+				    rsxgl_arena_address(memory_arena_t::storage().at(texture.arena),dstmem),dstmem,texture.pitch,size,0,0,0,
+				    level.pformat,
+				    rsxgl_texture_level_address(level),level.memory,level.pitch,0,0,
+				    size[0],size[1]);
+	  }
+
+	  dstoffset += rsxgl_get_tex_level_size(texture,size);
+	  for(int j = 0;j < 3;++j) {
+	    size[j] = std::max(size[j] >> 1,1);
 	  }
 	}
+
+	rsxgl_texture_release_levels(ctx,texture,timestamp);
+	rsxgl_texture_count_levels(ctx,texture);
+      }
+      else {
+	texture.storage_levels = 0;
       }
     }
 
     texture.invalid = 0;
   }
+
+  texture.timestamp = timestamp;
 }
 
+// Move a swizzled texture's contents into linear storage, so that it can be rendered to. The
+// texture stays linear from then on:
 void
-rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t timestamp)
+rsxgl_texture_require_linear(rsxgl_context_t * ctx,texture_t & texture)
 {
-  gcmContextData * context = ctx -> base.gcm_context;
+  texture.linear = 1;
 
-  // Invalidate the texture cache.
-  // TODO: determine when this is necessary to do, and only do it then.
-  {
-    uint32_t * buffer = gcm_reserve(context,4);
+  if(!texture.swizzled || !texture.memory) {
+    return;
+  }
 
-    // Fragment program textures:
-    gcm_emit_method_at(buffer,0,NV40_3D_TEX_CACHE_CTL,1);
-    gcm_emit_at(buffer,1,1);
+  if(texture.timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,texture.timestamp);
+    texture.timestamp = 0;
+  }
 
-    // Vertex program textures:
-    gcm_emit_method_at(buffer,2,NV40_3D_TEX_CACHE_CTL,1);
-    gcm_emit_at(buffer,3,2);
+  memory_arena_t & arena = memory_arena_t::storage().at(texture.arena);
+  const memory_t srcmem = texture.memory;
+  const uint8_t * srcaddress = (const uint8_t *)rsxgl_arena_address(arena,srcmem);
 
-    gcm_finish_n_commands(context,4);
+  texture.memory = memory_t();
+  rsxgl_texture_validate_storage(ctx,texture);
+
+  if(!texture.memory) {
+    // Keep the swizzled storage; rendering to the texture will be wrong, but sampling it won't be:
+    texture.memory = srcmem;
+    texture.swizzled = 1;
+    texture.pitch = 0;
+    RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+
+  uint8_t * dstaddress = (uint8_t *)rsxgl_arena_address(arena,texture.memory);
+  const uint32_t bytes = util_format_get_blocksize(texture.pformat);
+  uint32_t size[3] = { texture.size[0], texture.size[1], texture.size[2] };
+
+  for(texture_t::level_size_type i = 0,n = texture.storage_levels;i < n;++i) {
+    rsxgl_unswizzle_copy(dstaddress,texture.pitch,texture.pitch * size[1],
+			 srcaddress,size,
+			 bytes,size[0],size[1],size[2]);
+
+    srcaddress += bytes * size[0] * size[1] * size[2];
+    dstaddress += texture.pitch * size[1] * size[2];
+    for(int j = 0;j < 3;++j) {
+      size[j] = std::max(size[j] >> 1,(uint32_t)1);
+    }
   }
 
+  rsxgl_arena_free(arena,srcmem);
+
+  rsxgl_texture_invalidate(ctx,texture);
+}
+
+// TEX_ENABLE holds the range of levels that can be sampled, as 4.8 fixed point numbers; it comes
+// from the sampler's LOD range, clamped to the levels that the texture has and to its finest
+// resident level:
+static inline uint32_t
+rsxgl_texture_enable(const texture_t & texture,const sampler_t & sampler)
+{
+  const float
+    finest = std::min((float)texture.resident_level,(float)(texture.num_levels - 1)),
+    coarsest = std::min((float)(texture.num_levels - 1),15.0f + (255.0f / 256.0f)),
+    maxLod = std::min(std::max(sampler.maxLod,finest),coarsest),
+    minLod = std::min(std::max(sampler.minLod,finest),maxLod);
+
+  return NV40_3D_TEX_ENABLE_ENABLE |
+    ((uint32_t)(minLod * 256.0f) << 19) |
+    ((uint32_t)(maxLod * 256.0f) << 7);
+}
+
+// Pack the texture's fragment program registers, as they'd be sampled with the sampler, so that
+// binding the two together again only has to copy them:
+static inline void
+rsxgl_texture_build_packet(texture_t & texture,const sampler_t & sampler)
+{
+  const uint32_t wrap = 
+    ((uint32_t)(sampler.wrap_s + 1) << NV30_3D_TEX_WRAP_S__SHIFT) |
+    ((uint32_t)(sampler.wrap_t + 1) << NV30_3D_TEX_WRAP_T__SHIFT) |
+    ((uint32_t)(sampler.wrap_r + 1) << NV30_3D_TEX_WRAP_R__SHIFT)
+    ;
+  
+  const uint32_t compare =
+    (uint32_t)sampler.compare_func << NV30_3D_TEX_WRAP_RCOMP__SHIFT
+    ;
+  
+  const uint32_t filter =
+    ((uint32_t)(sampler.filter_min + 1) << NV30_3D_TEX_FILTER_MIN__SHIFT) |
+    ((uint32_t)(sampler.filter_mag + 1) << NV30_3D_TEX_FILTER_MAG__SHIFT) |
+    // "convolution":
+    ((uint32_t)1 << 13) |
+    // LOD bias, as 5.8 fixed point:
+    ((uint32_t)(int32_t)(std::min(std::max(sampler.lodBias,-16.0f),15.0f + (255.0f / 256.0f)) * 256.0f) & 0x1fff)
+    ;
+
+  uint32_t * packet = texture.packet;
+
+  // NV30_3D_TEX_OFFSET:
+  packet[0] = texture.memory.offset;
+  // NV30_3D_TEX_FORMAT:
+  packet[1] = texture.format;
+  // NV30_3D_TEX_WRAP:
+  packet[2] = wrap | compare;
+  // NV30_3D_TEX_ENABLE:
+  packet[3] = rsxgl_texture_enable(texture,sampler);
+  // NV30_3D_TEX_SWIZZLE:
+  packet[4] = texture.remap;
+  // NV30_3D_TEX_FILTER:
+  packet[5] = filter;
+  // NV30_3D_TEX_NPOT_SIZE:
+  packet[6] = ((uint32_t)texture.size[0] << NV30_3D_TEX_NPOT_SIZE_W__SHIFT) | (uint32_t)texture.size[1];
+  // NV30_3D_TEX_BORDER_COLOR:
+  packet[7] = 0;
+  // NV40_3D_TEX_SIZE1:
+  packet[8] = ((uint32_t)texture.size[2] << NV40_3D_TEX_SIZE1_DEPTH__SHIFT) | (uint32_t)texture.pitch;
+
+  texture.packet_serial = sampler.serial;
+}
+
+void
+rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t timestamp)
+{
+  gcmContextData * context = ctx -> base.gcm_context;
+
   const program_t::textures_bitfield_type
     textures_enabled = program.textures_enabled,
     invalid_texture_assignments = ctx -> invalid_texture_assignments;
@@ -2272,6 +3607,10 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
   bit_set< RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS >
     validated;
 
+  // Set if a texture that's about to be sampled has been written since the texture cache was last
+  // invalidated:
+  bool flush = false;
+
   // Vertex program textures:
   for(program_t::texture_size_type index = 0;index < RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS;++index,enabled_it.next(textures_enabled),invalid_it.next(invalid_texture_assignments),assignment_it.next(texture_assignments)) {
     if(!enabled_it.test()) continue;
@@ -2280,10 +3619,23 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 
     if(ctx -> texture_binding.names[api_index] != 0) {
       texture_t & texture = ctx -> texture_binding[api_index];
-      rsxgl_assert(timestamp >= texture.timestamp);
+      if(texture.release_timestamp != 0) {
+	rsxgl_texture_release_levels(ctx,texture,texture.release_timestamp);
+      }
+      rsxgl_assert(rsxgl_timestamp_ordered(texture.timestamp,timestamp));
       texture.timestamp = timestamp;
     }
 
+    if(invalid_it.test() || invalid_textures.test(api_index)) {
+      rsxgl_texture_validate(ctx,ctx -> texture_binding[api_index],timestamp);
+    }
+
+    {
+      texture_t & texture = ctx -> texture_binding[api_index];
+      flush = flush || texture.invalid_contents;
+      texture.invalid_contents = 0;
+    }
+
     if(invalid_it.test() || invalid_samplers.test(api_index)) {
       validated.set(api_index);
 
@@ -2292,8 +3644,6 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
     if(invalid_it.test() || invalid_textures.test(api_index)) {
       texture_t & texture = ctx -> texture_binding[api_index];
 
-      rsxgl_texture_validate(ctx,texture,timestamp);
-      
       if(texture.memory) {
 	const uint32_t format = texture.format & (0x3 | NV30_3D_TEX_FORMAT_DIMS__MASK | NV30_3D_TEX_FORMAT_FORMAT__MASK | NV40_3D_TEX_FORMAT_MIPMAP_COUNT__MASK);
 	const uint32_t format_format = (format & NV30_3D_TEX_FORMAT_FORMAT__MASK);
@@ -2344,53 +3694,30 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
     if(!enabled_it.test()) continue;
 
     const texture_t::binding_type::size_type api_index = assignment_it.value();
+    texture_t & texture = ctx -> texture_binding[api_index];
+
+    // Set if the unit's registers need to be sent again:
+    bool invalid = invalid_it.test() || invalid_samplers.test(api_index) || invalid_textures.test(api_index);
 
     if(ctx -> texture_binding.names[api_index] != 0) {
-      texture_t & texture = ctx -> texture_binding[api_index];
-      rsxgl_assert(timestamp >= texture.timestamp);
-      texture.timestamp = timestamp;
+      invalid = rsxgl_texture_update_resident_level(ctx,texture) || invalid;
+      if(texture.release_timestamp != 0) {
+	rsxgl_texture_release_levels(ctx,texture,texture.release_timestamp);
+      }
     }
 
-    if(invalid_it.test() || invalid_samplers.test(api_index)) {
-      const sampler_t & sampler = (ctx -> sampler_binding.names[api_index] != 0) ? ctx -> sampler_binding[api_index] : ctx -> texture_binding[api_index].sampler;
-      
-      const uint32_t wrap = 
-	((uint32_t)(sampler.wrap_s + 1) << NV30_3D_TEX_WRAP_S__SHIFT) |
-	((uint32_t)(sampler.wrap_t + 1) << NV30_3D_TEX_WRAP_T__SHIFT) |
-	((uint32_t)(sampler.wrap_r + 1) << NV30_3D_TEX_WRAP_R__SHIFT)
-	;
-      
-      const uint32_t compare =
-	(uint32_t)sampler.compare_func << NV30_3D_TEX_WRAP_RCOMP__SHIFT
-	;
-      
-      const uint32_t filter =
-	((uint32_t)(sampler.filter_min + 1) << NV30_3D_TEX_FILTER_MIN__SHIFT) |
-	((uint32_t)(sampler.filter_mag + 1) << NV30_3D_TEX_FILTER_MAG__SHIFT) |
-	// "convolution":
-	((uint32_t)1 << 13)
-	;
-      
-      //
-      uint32_t * buffer = gcm_reserve(context,4);
-      
-      gcm_emit_method(&buffer,NV30_3D_TEX_FILTER(index),1);
-      gcm_emit(&buffer,filter);
-      
-      gcm_emit_method(&buffer,NV30_3D_TEX_WRAP(index),1);
-      gcm_emit(&buffer,wrap | compare);
-
-      // TODO: Set LOD min, max, bias:
-      
-      gcm_finish_commands(context,&buffer);
-
-      validated.set(api_index);
+    if(invalid) {
+      rsxgl_texture_validate(ctx,texture,timestamp);
+    }
+    else {
+      rsxgl_assert(rsxgl_timestamp_ordered(texture.timestamp,timestamp));
+      texture.timestamp = timestamp;
     }
-    if(invalid_it.test() || invalid_textures.test(api_index)) {
-      texture_t & texture = ctx -> texture_binding[api_index];
 
-      rsxgl_texture_validate(ctx,texture,timestamp);
-      
+    flush = flush || texture.invalid_contents;
+    texture.invalid_contents = 0;
+
+    if(invalid) {
       if(texture.memory) {
 #if 0
 	rsxgl_debug_printf("texture: %u (%u) %lx memory: %u %u pformat: %u format:%x size:%ux%u pitch:%u remap:%x\n",
@@ -2403,25 +3730,31 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 			   (uint32_t)texture.pitch,(uint32_t)texture.remap);
 #endif
 
+	const sampler_t & sampler = (ctx -> sampler_binding.names[api_index] != 0) ? ctx -> sampler_binding[api_index] : texture.sampler;
+
+	if(texture.packet_serial != sampler.serial) {
+	  rsxgl_texture_build_packet(texture,sampler);
+	}
+
 	// activate the texture:
 	uint32_t * buffer = gcm_reserve(context,11);
-	
-	gcm_emit_method(&buffer,NV30_3D_TEX_OFFSET(index),2);
-	gcm_emit(&buffer,texture.memory.offset);
-	gcm_emit(&buffer,texture.format);
-	
+
+	gcm_emit_method_at(buffer,0,NV30_3D_TEX_OFFSET(index),8);
+	for(unsigned i = 0;i < 8;++i) {
+	  gcm_emit_at(buffer,1 + i,texture.packet[i]);
+	}
+
+	gcm_emit_method_at(buffer,9,NV40_3D_TEX_SIZE1(index),1);
+	gcm_emit_at(buffer,10,texture.packet[8]);
+
+	gcm_finish_n_commands(context,11);
+      }
+      else {
+	uint32_t * buffer = gcm_reserve(context,2);
+
 	gcm_emit_method(&buffer,NV30_3D_TEX_ENABLE(index),1);
-	gcm_emit(&buffer,NV40_3D_TEX_ENABLE_ENABLE);
-	
-	gcm_emit_method(&buffer,NV30_3D_TEX_NPOT_SIZE(index),1);
-	gcm_emit(&buffer,((uint32_t)texture.size[0] << NV30_3D_TEX_NPOT_SIZE_W__SHIFT) | (uint32_t)texture.size[1]);
-	
-	gcm_emit_method(&buffer,NV40_3D_TEX_SIZE1(index),1);
-	gcm_emit(&buffer,((uint32_t)texture.size[2] << NV40_3D_TEX_SIZE1_DEPTH__SHIFT) | (uint32_t)texture.pitch);
+	gcm_emit(&buffer,0);
 
-	gcm_emit_method(&buffer,NV30_3D_TEX_SWIZZLE(index),1);
-	gcm_emit(&buffer,texture.remap);
-	
 	gcm_finish_commands(context,&buffer);
       }
 
@@ -2429,6 +3762,21 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
     }
   }
 
+  // Invalidate the texture cache:
+  if(flush) {
+    uint32_t * buffer = gcm_reserve(context,4);
+
+    // Fragment program textures:
+    gcm_emit_method_at(buffer,0,NV40_3D_TEX_CACHE_CTL,1);
+    gcm_emit_at(buffer,1,1);
+
+    // Vertex program textures:
+    gcm_emit_method_at(buffer,2,NV40_3D_TEX_CACHE_CTL,1);
+    gcm_emit_at(buffer,3,2);
+
+    gcm_finish_n_commands(context,4);
+  }
+
   ctx -> invalid_texture_assignments.reset();
   ctx -> invalid_samplers &= ~validated;
   ctx -> invalid_textures &= ~validated;
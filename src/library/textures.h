@@ -63,6 +63,10 @@ struct sampler_t {
 
   float lodBias, minLod, maxLod;
 
+  // Different every time the sampler's state changes, and different from every other sampler's;
+  // identifies the state that textures' register packets were built with:
+  uint32_t serial;
+
   sampler_t();
   void destroy() {}
 };
@@ -101,8 +105,10 @@ struct texture_t {
   typedef boost::uint_value_t< RSXGL_MAX_TEXTURE_SIZE - 1 >::least dimension_size_type;
 
   // --- Cold:
+  // A level's image is in memory of its own until it's stored (copied into, or written directly
+  // to, the texture's storage); its memory is freed once the RSX is done with it:
   struct level_t {
-    uint8_t dims:2, cube:1, rect:1;
+    uint8_t dims:2, cube:1, rect:1, stored:1;
     pipe_format pformat;
     dimension_size_type size[3];
     uint32_t pitch;
@@ -113,10 +119,13 @@ struct texture_t {
     ~level_t();
   } levels[max_levels];
 
-  uint16_t invalid:1, invalid_complete:1,
+  // invalid_contents is set when the texture's storage is written, by the CPU or the RSX, so that
+  // the RSX's texture cache is invalidated before the texture is next sampled:
+  uint32_t invalid:1, invalid_complete:1, invalid_contents:1,
     complete:1, immutable:1,
     dims:2, cube:1, rect:1,
-    num_levels:4;
+    num_levels:4, storage_levels:4,
+    swizzled:1, linear:1;
 
   struct {
     uint16_t r:3, g:3, b:3, a:3;
@@ -125,11 +134,28 @@ struct texture_t {
   pipe_format pformat;
 
   // --- Hot:
+  // NV30_3D_TEX_OFFSET through NV30_3D_TEX_BORDER_COLOR, then NV40_3D_TEX_SIZE1, for the sampler
+  // whose serial is packet_serial; 0 if they need to be built again:
+  uint32_t packet_serial;
+  uint32_t packet[9];
+
   uint32_t format;
   dimension_size_type size[3], pad;
   uint32_t pitch;
   uint32_t remap;
 
+  // GL_TEXTURE_MIN_RESIDENT_LEVEL_RSX. A finer level that's been asked for becomes resident when
+  // the RSX passes resident_timestamp, which is 0 if none has been:
+  uint8_t resident_level:4, requested_resident_level:4;
+  uint32_t resident_timestamp;
+
+  // Stored levels' own memory is freed when the RSX passes release_timestamp, which is 0 if
+  // there's none to free. Storage that's been replaced by larger storage is freed when the RSX
+  // passes replaced_timestamp, once it's copied the levels out of it:
+  uint32_t release_timestamp;
+  uint32_t replaced_timestamp;
+  memory_t replaced_memory;
+
   memory_t memory;
   memory_arena_t::name_type arena;
 
@@ -140,6 +166,7 @@ struct rsxgl_context_t;
 
 bool rsxgl_texture_validate_complete(rsxgl_context_t *,texture_t &);
 void rsxgl_texture_validate(rsxgl_context_t *,texture_t &,uint32_t);
+void rsxgl_texture_require_linear(rsxgl_context_t *,texture_t &);
 void rsxgl_textures_validate(rsxgl_context_t *,program_t &,uint32_t);
 
 #endif
@@ -22,6 +22,21 @@
 // Should not return 0, because this is reserved for indicating that an object is not waiting
 // on a GPU operation.
 
+// The timeline of the context that issued a timestamp (see rsxgl_object_context_t::acquire_timeline()):
+static inline uint32_t
+rsxgl_timestamp_timeline(const uint32_t timestamp)
+{
+  return timestamp >> RSXGL_TIMESTAMP_TIMELINE_SHIFT;
+}
+
+// Timestamps from different timelines can't be ordered; for asserting that an object's timestamp
+// doesn't come after one that's about to replace it:
+static inline bool
+rsxgl_timestamp_ordered(const uint32_t previous,const uint32_t timestamp)
+{
+  return rsxgl_timestamp_timeline(previous) != rsxgl_timestamp_timeline(timestamp) || previous <= timestamp;
+}
+
 // Add the previously allocated timestamp to the command stream.
 // See if a timestamp has been passed by the GPU:
 static inline bool
@@ -96,6 +96,33 @@ get_gpu_data(const ieee32_t & lhs,float & rhs) {
   rhs = lhs.f;
 }
 
+// Copy n words of uniform data into a program's uniform values array, and report whether
+// any of them changed. Words are compared as integers, a vec4 at a time, without branching
+// on each one; most calls re-send the same matrices every frame, so it is cheaper to always
+// store than to test first:
+static inline bool
+rsxgl_uniform_values_update(ieee32_t * values,const ieee32_t * src,size_t n)
+{
+  uint32_t diff0 = 0, diff1 = 0, diff2 = 0, diff3 = 0;
+
+  for(;n >= 4;n -= 4,values += 4,src += 4) {
+    diff0 |= values[0].u ^ src[0].u;
+    diff1 |= values[1].u ^ src[1].u;
+    diff2 |= values[2].u ^ src[2].u;
+    diff3 |= values[3].u ^ src[3].u;
+    values[0] = src[0];
+    values[1] = src[1];
+    values[2] = src[2];
+    values[3] = src[3];
+  }
+  for(;n > 0;--n,++values,++src) {
+    diff0 |= values[0].u ^ src[0].u;
+    values[0] = src[0];
+  }
+
+  return (diff0 | diff1 | diff2 | diff3) != 0;
+}
+
 template< typename Type, size_t Width, rsxgl_data_types RSXGLType >
 static inline void
 rsxgl_uniform(rsxgl_context_t * ctx,
@@ -112,6 +139,7 @@ rsxgl_uniform(rsxgl_context_t * ctx,
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(location >= program.uniforms.size()) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
@@ -123,14 +151,17 @@ rsxgl_uniform(rsxgl_context_t * ctx,
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
-  program.invalid_uniforms = 1;
-  uniform.invalid = uniform.enabled;
+  ieee32_t tmp[Width];
+  set_gpu_data(tmp[0],v0);
+  if(Width > 1) set_gpu_data(tmp[1],v1);
+  if(Width > 2) set_gpu_data(tmp[2],v2);
+  if(Width > 3) set_gpu_data(tmp[3],v3);
 
-  ieee32_t * values = program.uniform_values.get() + uniform.values_index;
-  set_gpu_data(values[0],v0);
-  if(Width > 1) set_gpu_data(values[1],v1);
-  if(Width > 2) set_gpu_data(values[2],v2);
-  if(Width > 3) set_gpu_data(values[3],v3);
+  // Only send the uniform to the GPU if its value changed:
+  if(rsxgl_uniform_values_update(program.uniform_values.get() + uniform.values_index,tmp,Width)) {
+    program.invalid_uniforms = 1;
+    uniform.invalid = uniform.enabled;
+  }
 
   RSXGL_NOERROR_();
 }
@@ -151,6 +182,7 @@ rsxgl_uniform(rsxgl_context_t * ctx,
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(location >= program.uniforms.size()) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
@@ -166,32 +198,41 @@ rsxgl_uniform(rsxgl_context_t * ctx,
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
-  program.invalid_uniforms = 1;
-  uniform.invalid = uniform.enabled;
-
   ieee32_t * values = program.uniform_values.get() + uniform.values_index;
 
   //rsxgl_debug_printf("%s: %u: ",__PRETTY_FUNCTION__,uniform.values_index);
 
-  if(Height > 1 && transpose) {
-    for(program_t::uniform_size_type n = count;n > 0;--n) {
+  // Convert one array element (a whole matrix, for matrix types) at a time, and compare it
+  // with the current value as a block:
+  bool changed = false;
+  ieee32_t tmp[Width * Height];
+
+  for(program_t::uniform_size_type n = count;n > 0;--n,values += Width * Height,v += Width * Height) {
+    if(Height > 1 && transpose) {
       for(size_t i = 0;i < Width;++i) {
-	for(size_t j = 0;j < Height;++j,++values) {
-	  set_gpu_data(*values,v[(j * Width) + i]);
+	for(size_t j = 0;j < Height;++j) {
+	  set_gpu_data(tmp[(i * Height) + j],v[(j * Width) + i]);
 	}
       }
-      v += Width * Height;
     }
-  }
-  else {
-    for(program_t::uniform_size_type n = Width * Height * count;n > 0;--n,++values,++v) {
-      //rsxgl_debug_printf("%f ",*v);
-      set_gpu_data(*values,*v);
+    else {
+      for(size_t i = 0;i < (Width * Height);++i) {
+	//rsxgl_debug_printf("%f ",v[i]);
+	set_gpu_data(tmp[i],v[i]);
+      }
     }
+
+    changed |= rsxgl_uniform_values_update(values,tmp,Width * Height);
   }
 
   //rsxgl_debug_printf("\n");
 
+  // Only send the uniform to the GPU if its value changed:
+  if(changed) {
+    program.invalid_uniforms = 1;
+    uniform.invalid = uniform.enabled;
+  }
+
   RSXGL_NOERROR_();
 }
 
@@ -210,6 +251,7 @@ rsxgl_sampler_uniform(rsxgl_context_t * ctx,
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   const GLint texture_location = location - program.uniforms.size();
 
@@ -434,6 +476,7 @@ glGetUniformufv (GLuint program_name, GLint location, GLfloat *params)
   }
 
   program_t & program = program_t::storage().at(program_name);
+  rsxgl_program_complete(program);
 
   if(location >= program.uniforms.size()) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
@@ -503,15 +546,14 @@ rsxgl_rsx_ucode_offset(program_t::ucode_offset_type off)
   return (off * sizeof(uint32_t) * 4) + rsx_ucode_offset;
 }
 
+// Have the RSX write a fragment program immediate, behind the draws that may still be reading it:
 static inline void
-rsxgl_inline_transfer(gcmContextData * context,const uint32_t offset,const uint32_t width,const ieee32_t * pvalues)
+rsxgl_inline_transfer(gcmContextData * context,const uint32_t offset,const uint32_t width,const ieee32_t * pucode)
 {
   const uint32_t offset_aligned = offset & ~0x3f;
   const uint32_t shift = (offset & 0x3f) >> 2;
   const uint32_t width_pad = (width + 1) & ~0x01;
   
-  //rsxgl_debug_printf("\toffset: %u offset_aligned:%u shift:%u width_pad:%u\n",offset,offset_aligned,shift,width_pad);
-  
   //
   uint32_t * buffer = gcm_reserve(context,12 + width_pad);
   
@@ -534,11 +576,7 @@ rsxgl_inline_transfer(gcmContextData * context,const uint32_t offset,const uint3
   
   size_t i_word = 0;
   for(;i_word < width;++i_word) {
-    ieee32_t tmp;
-    tmp.h.a[0] = pvalues[i_word].h.a[1];
-    tmp.h.a[1] = pvalues[i_word].h.a[0];
-    
-    gcm_emit(&buffer,tmp.u);
+    gcm_emit(&buffer,pucode[i_word].u);
   }
   for(;i_word < width_pad;++i_word) {
     gcm_emit(&buffer,0);
@@ -547,6 +585,25 @@ rsxgl_inline_transfer(gcmContextData * context,const uint32_t offset,const uint3
   gcm_finish_commands(context,&buffer);
 }
 
+static inline program_t::uniform_size_type
+rsxgl_uniform_width(const uint8_t type)
+{
+  switch(type) {
+  case RSXGL_DATA_TYPE_FLOAT:
+    return 1;
+  case RSXGL_DATA_TYPE_FLOAT2:
+    return 2;
+  case RSXGL_DATA_TYPE_FLOAT3:
+    return 3;
+  case RSXGL_DATA_TYPE_FLOAT4:
+    return 4;
+  case RSXGL_DATA_TYPE_FLOAT4x4:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
 void
 rsxgl_uniforms_validate(rsxgl_context_t * ctx,program_t & program)
 {
@@ -555,106 +612,116 @@ rsxgl_uniforms_validate(rsxgl_context_t * ctx,program_t & program)
 
     //rsxgl_debug_printf("invalid uniforms:\n");
     
-    auto puniform = program.uniforms.begin();
-    //const char * names = program.names_data;
-
     const ieee32_t * values = program.uniform_values.get();
 
+    // Vertex program constants. Uniforms are visited in the order of the registers that they
+    // occupy, so that adjacent ones are sent with the same method:
+    {
+      rsxgl_vp_constant_batch_t batch(context);
+
+      const program_t::uniform_size_type * pvp_uniforms = program.vp_uniforms.get();
+      for(program_t::uniform_size_type i = 0,n = program.num_vp_uniforms;i < n;++i,++pvp_uniforms) {
+	program_t::uniform_t & uniform = program.uniforms[*pvp_uniforms].second;
+
+	if(!uniform.invalid.test(RSXGL_VERTEX_SHADER)) continue;
+
+	const program_t::uniform_size_type width = rsxgl_uniform_width(uniform.type);
+	const ieee32_t * pvalues = values + uniform.values_index;
+	program_t::uniform_size_type index = uniform.vp_index;
+
+	//rsxgl_debug_printf("vp constant %u (count:%u width:%u)\n",index,uniform.count,width);
+
+	for(program_t::uniform_size_type j = 0,count = uniform.count;j < count;++j,++index,pvalues += width) {
+	  batch.push(index,pvalues,width);
+	}
+
+	uniform.invalid.reset(RSXGL_VERTEX_SHADER);
+      }
+
+      batch.flush();
+    }
+
+    // Fragment program constants are immediates in the program's microcode. They're patched
+    // into the copy of it in main memory, which is then written to the next of the program's
+    // copies in RSX memory; copies still in use by earlier draws are left alone. If every copy
+    // is still in use, the RSX patches the current one instead, behind the draws using it:
     program_t::uniform_size_type n_validated_fp_uniforms = 0;
+    bool fp_inline = false;
 
+    auto puniform = program.uniforms.begin();
     for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i,++puniform) {
       program_t::uniform_t & uniform = puniform -> second;
 
-      program_t::uniform_size_type width = 0;
-      switch(uniform.type) {
-      case RSXGL_DATA_TYPE_FLOAT:
-	width = 1;
-	break;
-      case RSXGL_DATA_TYPE_FLOAT2:
-	width = 2;
-	break;
-      case RSXGL_DATA_TYPE_FLOAT3:
-	width = 3;
-	break;
-      case RSXGL_DATA_TYPE_FLOAT4:
-	width = 4;
-	break;
-      case RSXGL_DATA_TYPE_FLOAT4x4:
-	width = 4;
-	break;
-      case RSXGL_DATA_TYPE_SAMPLER1D:
-      case RSXGL_DATA_TYPE_SAMPLER2D:
-      case RSXGL_DATA_TYPE_SAMPLER3D:
-      case RSXGL_DATA_TYPE_SAMPLERCUBE:
-      case RSXGL_DATA_TYPE_SAMPLERRECT:
-	width = 1;
-      default:
-	width = 0;
-	break;
-      }
+      if(uniform.invalid.test(RSXGL_FRAGMENT_SHADER)) {
+	//rsxgl_debug_printf("fp ");
 
-      const program_t::uniform_size_type count = uniform.count;
-
-      if(uniform.invalid.any()) {
-	//rsxgl_debug_printf("\t%u invalid\n",i);
-
-	if(uniform.invalid.test(RSXGL_VERTEX_SHADER)) {
-	  const ieee32_t * pvalues = values + uniform.values_index;
-
-	  program_t::uniform_size_type index = uniform.vp_index;
-	  uint32_t * buffer = gcm_reserve(context,6 * count);
-
-	  //rsxgl_debug_printf("vp constant %u (count:%u width:%u)\n",index,count,width);
-	    
-	  for(program_t::uniform_size_type j = 0;j < count;++j,++index,pvalues += width) {
-	    //rsxgl_debug_printf("%u/%u %u: %u: %f %f %f %f\n",
-	    //	 j,count,width,
-	    //	 pvalues - values,
-	    //	 pvalues[0].f,pvalues[1].f,pvalues[2].f,pvalues[3].f);
-
-	    //rsxgl_debug_printf("\t%04u: %x %x %x %x\n",index,
-	    //		       width > 0 ? pvalues[0].u : 0,width > 0 ? pvalues[1].u : 0,width > 0 ? pvalues[2].u : 0,width > 0 ? pvalues[3].u : 0);
-
-	    //rsxgl_debug_printf("\t%04u: %f %f %f %f\n",index,
-	    //		       width > 0 ? pvalues[0].f : 0,
-	    //		       width > 1 ? pvalues[1].f : 0,
-	    //		       width > 2 ? pvalues[2].f : 0,
-	    //		       width > 3 ? pvalues[3].f : 0);
-	    
-	    gcm_emit_method(&buffer,NV30_3D_VP_UPLOAD_CONST_ID,5);
-	    gcm_emit(&buffer,index);
-	    
-	    gcm_emit(&buffer,width > 0 ? pvalues[0].u : 0);
-	    gcm_emit(&buffer,width > 1 ? pvalues[1].u : 0);
-	    gcm_emit(&buffer,width > 2 ? pvalues[2].u : 0);
-	    gcm_emit(&buffer,width > 3 ? pvalues[3].u : 0);
-	  }
-	  
-	  gcm_finish_commands(context,&buffer);
+	if(n_validated_fp_uniforms == 0) {
+	  // program.timestamp already belongs to the draw that's being validated, so this is
+	  // conservative:
+	  program.fp_ucode_timestamps[program.fp_ucode_copy] = program.timestamp;
+
+	  const uint32_t next_timestamp = program.fp_ucode_timestamps[(program.fp_ucode_copy + 1) % RSXGL_FP_UCODE_COPIES];
+	  fp_inline = next_timestamp != 0 && !rsxgl_timestamp_check(ctx,next_timestamp);
 	}
-	
-	if(uniform.invalid.test(RSXGL_FRAGMENT_SHADER)) {
-	  //rsxgl_debug_printf("fp ");
 
-	  const ieee32_t * pvalues = values + uniform.values_index;
-	  const program_t::instruction_size_type * pfp_offsets = program.program_offsets.get() + uniform.program_offsets_index;
+	const program_t::uniform_size_type width = rsxgl_uniform_width(uniform.type);
+	const program_t::uniform_size_type count = uniform.count;
+	const ieee32_t * pvalues = values + uniform.values_index;
+	const program_t::instruction_size_type * pfp_offsets = program.program_offsets.get() + uniform.program_offsets_index;
+
+	for(program_t::uniform_size_type j = 0;j < count;++j,pvalues += width) {
+	  for(program_t::instruction_size_type offsets_count = *pfp_offsets++;offsets_count > 0;--offsets_count) {
+	    ieee32_t * pucode = (ieee32_t *)(program.fp_ucode.get() + (*pfp_offsets++ * 4));
 
-	  for(program_t::uniform_size_type j = 0;j < count;++j,pvalues += width) {
-	    for(program_t::instruction_size_type offsets_count = *pfp_offsets++;offsets_count > 0;--offsets_count,++pfp_offsets) {
-	      rsxgl_inline_transfer(context,rsxgl_rsx_ucode_offset(program.fp_ucode_offset + *pfp_offsets++),width,pvalues);
+	    // The fragment program's immediates have their half-words swapped:
+	    for(program_t::uniform_size_type k = 0;k < width;++k) {
+	      pucode[k].h.a[0] = pvalues[k].h.a[1];
+	      pucode[k].h.a[1] = pvalues[k].h.a[0];
 	    }
-	  }
 
-	  ++n_validated_fp_uniforms;
+	    if(fp_inline) {
+	      rsxgl_inline_transfer(context,rsxgl_rsx_ucode_offset(program.fp_ucode_offset + pfp_offsets[-1]),width,pucode);
+	    }
+	  }
 	}
 
-	//rsxgl_debug_printf("\n");
-
-	uniform.invalid.reset();
+	++n_validated_fp_uniforms;
       }
+
+      uniform.invalid.reset();
     }
 
     if(n_validated_fp_uniforms > 0) {
+      if(!fp_inline) {
+	const uint32_t copy = (program.fp_ucode_copy + 1) % RSXGL_FP_UCODE_COPIES;
+	program.fp_ucode_timestamps[copy] = 0;
+
+	program.fp_ucode_copy = copy;
+	program.fp_ucode_offset = program.fp_ucode_copies_offset + (copy * program.fp_ucode_stride);
+	uint32_t * dst = rsxgl_rsx_ucode_address(program.fp_ucode_offset);
+
+	// Only the immediates differ between copies, once a copy has been written in full:
+	if(program.fp_ucode_copies_written & (1U << copy)) {
+	  auto puniform = program.uniforms.begin();
+	  for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i,++puniform) {
+	    const program_t::uniform_t & uniform = puniform -> second;
+	    if(!uniform.enabled.test(RSXGL_FRAGMENT_SHADER)) continue;
+
+	    const program_t::instruction_size_type * pfp_offsets = program.program_offsets.get() + uniform.program_offsets_index;
+	    for(program_t::uniform_size_type j = 0,count = uniform.count;j < count;++j) {
+	      for(program_t::instruction_size_type offsets_count = *pfp_offsets++;offsets_count > 0;--offsets_count) {
+		const uint32_t offset = *pfp_offsets++ * 4;
+		memcpy(dst + offset,program.fp_ucode.get() + offset,sizeof(uint32_t) * 4);
+	      }
+	    }
+	  }
+	}
+	else {
+	  memcpy(dst,program.fp_ucode.get(),program.fp_num_insn * sizeof(uint32_t) * 4);
+	  program.fp_ucode_copies_written |= (1U << copy);
+	}
+      }
+
       uint32_t * buffer = gcm_reserve(context,2);
 
       gcm_emit_method(&buffer,NV30_3D_FP_ACTIVE_PROGRAM,1);
@@ -11,9 +11,64 @@
 #include "gl_constants.h"
 #include "rsxgl_limits.h"
 #include "program.h"
+#include "ieee32_t.h"
+#include "gl_fifo.h"
+#include "nv40.h"
 
 struct rsxgl_context_t;
 
+// Number of vec4's that a single NV30_3D_VP_UPLOAD_CONST_ID method can carry after the
+// starting index (the method's data window is 32 words long):
+#define RSXGL_VP_UPLOAD_CONST_MAX 8
+
+// Collects vertex program constants that occupy consecutive registers, and uploads each run
+// of them with one method instead of one method per vec4. Nothing else may be emitted to the
+// command buffer between push() and flush():
+struct rsxgl_vp_constant_batch_t {
+  gcmContextData * context;
+  uint32_t * buffer;
+  uint32_t index, count;
+
+  rsxgl_vp_constant_batch_t(gcmContextData * _context)
+    : context(_context), buffer(0), index(0), count(0) {
+  }
+
+  ~rsxgl_vp_constant_batch_t() {
+    rsxgl_assert(count == 0);
+  }
+
+  // Add the constant stored in register i. width is the number of components present in
+  // values; the rest are set to 0:
+  void push(const uint32_t i,const ieee32_t * values,const uint32_t width) {
+    if(count > 0 && (i != (index + count) || count == RSXGL_VP_UPLOAD_CONST_MAX)) {
+      flush();
+    }
+
+    if(count == 0) {
+      buffer = gcm_reserve(context,2 + (4 * RSXGL_VP_UPLOAD_CONST_MAX));
+      index = i;
+      gcm_emit_at(buffer,1,i);
+    }
+
+    uint32_t * p = buffer + 2 + (4 * count);
+    p[0] = width > 0 ? values[0].u : 0;
+    p[1] = width > 1 ? values[1].u : 0;
+    p[2] = width > 2 ? values[2].u : 0;
+    p[3] = width > 3 ? values[3].u : 0;
+
+    ++count;
+  }
+
+  void flush() {
+    if(count == 0) return;
+
+    gcm_emit_method_at(buffer,0,NV30_3D_VP_UPLOAD_CONST_ID,1 + (4 * count));
+    gcm_finish_n_commands(context,2 + (4 * count));
+
+    count = 0;
+  }
+};
+
 void rsxgl_uniforms_validate(rsxgl_context_t *,program_t &);
 
 #endif
@@ -0,0 +1,90 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// vp_cache.cc - Keep several vertex programs resident in the RSX's vertex program memory.
+
+#include "vp_cache.h"
+#include "rsxgl_assert.h"
+
+rsxgl_vp_cache_t::rsxgl_vp_cache_t()
+  : num_entries(0), clock(0)
+{
+}
+
+void
+rsxgl_vp_cache_t::clear()
+{
+  num_entries = 0;
+}
+
+void
+rsxgl_vp_cache_t::erase(const uint32_t i)
+{
+  rsxgl_assert(i < num_entries);
+
+  for(uint32_t j = i + 1;j < num_entries;++j) {
+    entries[j - 1] = entries[j];
+  }
+  --num_entries;
+}
+
+bool
+rsxgl_vp_cache_t::lookup(const uint32_t serial,const uint32_t length,uint32_t & start)
+{
+  static const uint32_t capacity = RSXGL__VERTEX__MAX_PROGRAM_INSTRUCTIONS;
+
+  rsxgl_assert(serial != 0);
+  rsxgl_assert(length > 0 && length <= capacity);
+
+  ++clock;
+
+  for(uint32_t i = 0;i < num_entries;++i) {
+    if(entries[i].serial == serial) {
+      entries[i].last_use = clock;
+      start = entries[i].start;
+      return true;
+    }
+  }
+
+  for(;;) {
+    // First gap that's large enough:
+    if(num_entries < RSXGL_MAX_RESIDENT_VERTEX_PROGRAMS) {
+      uint32_t gap_start = 0;
+      for(uint32_t i = 0;i <= num_entries;++i) {
+	const uint32_t gap_end = (i < num_entries) ? entries[i].start : capacity;
+
+	if((gap_end - gap_start) >= length) {
+	  for(uint32_t j = num_entries;j > i;--j) {
+	    entries[j] = entries[j - 1];
+	  }
+	  ++num_entries;
+
+	  entries[i].serial = serial;
+	  entries[i].last_use = clock;
+	  entries[i].start = gap_start;
+	  entries[i].length = length;
+
+	  start = gap_start;
+	  return false;
+	}
+
+	if(i < num_entries) {
+	  gap_start = entries[i].start + entries[i].length;
+	}
+      }
+    }
+
+    // Evict the least recently used program and try again; this terminates, since an empty
+    // cache has room for any program:
+    rsxgl_assert(num_entries > 0);
+
+    uint32_t lru = 0;
+    for(uint32_t i = 1;i < num_entries;++i) {
+      if((clock - entries[i].last_use) > (clock - entries[lru].last_use)) {
+	lru = i;
+      }
+    }
+    erase(lru);
+  }
+}
@@ -0,0 +1,53 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// vp_cache.h - Keep several vertex programs resident in the RSX's vertex program memory.
+//
+// The RSX has room for RSXGL__VERTEX__MAX_PROGRAM_INSTRUCTIONS vertex program instructions,
+// and can start executing at any of them. Rather than uploading each program at instruction
+// 0 every time it's made active, programs are given their own ranges of instruction slots,
+// and stay there until space is needed for another one; the least recently used programs are
+// evicted first. Programs are identified by a serial number that's assigned when they are
+// linked, so relinked and deleted programs simply fall out of the cache.
+
+#ifndef rsxgl_vp_cache_H
+#define rsxgl_vp_cache_H
+
+#include "gl_constants.h"
+#include "rsxgl_limits.h"
+
+#include <stdint.h>
+
+struct rsxgl_vp_cache_t {
+  struct entry_t {
+    uint32_t serial;
+    uint32_t last_use;
+    uint16_t start, length;
+  };
+
+  // Sorted by start:
+  entry_t entries[RSXGL_MAX_RESIDENT_VERTEX_PROGRAMS];
+  uint32_t num_entries;
+
+  // Incremented on every lookup; stands in for time when choosing a program to evict:
+  uint32_t clock;
+
+  rsxgl_vp_cache_t();
+
+  // Forget every program, because the RSX's vertex program memory has been overwritten:
+  void clear();
+
+  // Find the program with the given serial number. Returns true, and its first slot in
+  // start, if it's resident. Otherwise, makes room for length instructions, evicting other
+  // programs if necessary, and returns false and the first slot where the program should
+  // be uploaded:
+  bool lookup(const uint32_t serial,const uint32_t length,uint32_t & start);
+
+private:
+
+  void erase(const uint32_t i);
+};
+
+#endif
@@ -285,6 +285,12 @@ nv40_sampler_view_init(struct pipe_context *pipe,
 			  struct nvfx_sampler_view *sv);
 extern void nv40_fragtex_set(struct nvfx_context *nvfx, int unit);
 
+/* nvfx_optimize.c */
+extern void nvfx_vertprog_optimize(struct nvfx_context *nvfx,
+				   struct nvfx_vertex_program *vp);
+extern void nvfx_fragprog_optimize(struct nvfx_context *nvfx,
+				   struct nvfx_fragment_program *fp);
+
 /* nvfx_state.c */
 extern void nvfx_init_state_functions(struct nvfx_context *nvfx);
 extern void nvfx_state_scissor_validate(struct nvfx_context *nvfx);
@@ -0,0 +1,611 @@
+/* Disassembly of NV40 vertex & fragment program microcode, as it's left by linking (after
+ * nvfx_optimize.c has run), along with a static estimate of each program's cost.
+ *
+ * The syntax loosely follows NV_vertex_program3 & NV_fragment_program2: registers are R (full
+ * precision temps), H (half precision temps), v[] & f[] (vertex & fragment inputs), c[] or an
+ * inline {x, y, z, w} (constants) and o[] (vertex outputs). Each line begins with the
+ * instruction's number and its raw words; branch targets are given as instruction numbers.
+ * Fragment programs number their embedded constants as instructions too, since branch offsets
+ * count them.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "nvfx_disasm.h"
+#include "nvfx_shader.h"
+#include "nv40_vertprog.h"
+
+#define NVFX_DISASM_LINE 256
+
+struct nvfx_disasm_line {
+	char text[NVFX_DISASM_LINE];
+	unsigned len;
+};
+
+static void
+line_printf(struct nvfx_disasm_line *line, const char *format, ...)
+{
+	va_list ap;
+	int n;
+
+	if (line->len >= NVFX_DISASM_LINE - 1)
+		return;
+
+	va_start(ap, format);
+	n = vsnprintf(line->text + line->len, NVFX_DISASM_LINE - line->len, format, ap);
+	va_end(ap);
+
+	if (n > 0)
+		line->len += (unsigned)n;
+	if (line->len > NVFX_DISASM_LINE - 1)
+		line->len = NVFX_DISASM_LINE - 1;
+}
+
+static const char comp_names[4] = { 'x', 'y', 'z', 'w' };
+
+static const char *cond_names[8] = {
+	"FL", "LT", "EQ", "LE", "GT", "NE", "GE", "TR"
+};
+
+/* comps[] are the component that each of x, y, z & w is taken from; identity swizzles are
+ * left out, and those that replicate one component are shortened to it:
+ */
+static void
+line_swizzle(struct nvfx_disasm_line *line, const unsigned comps[4])
+{
+	unsigned c;
+
+	if (comps[0] == 0 && comps[1] == 1 && comps[2] == 2 && comps[3] == 3)
+		return;
+
+	if (comps[0] == comps[1] && comps[0] == comps[2] && comps[0] == comps[3]) {
+		line_printf(line, ".%c", comp_names[comps[0]]);
+		return;
+	}
+
+	line_printf(line, ".");
+	for (c = 0; c < 4; ++c)
+		line_printf(line, "%c", comp_names[comps[c]]);
+}
+
+/* mask has x in bit 0: */
+static void
+line_mask(struct nvfx_disasm_line *line, unsigned mask)
+{
+	unsigned c;
+
+	if (mask == 0xf)
+		return;
+
+	line_printf(line, ".");
+	for (c = 0; c < 4; ++c) {
+		if (mask & (1 << c))
+			line_printf(line, "%c", comp_names[c]);
+	}
+}
+
+static void
+line_cond(struct nvfx_disasm_line *line, unsigned cond, const unsigned comps[4])
+{
+	if (cond == NVFX_COND_TR)
+		return;
+
+	line_printf(line, " (%s", cond_names[cond]);
+	line_swizzle(line, comps);
+	line_printf(line, ")");
+}
+
+static void
+line_end(struct nvfx_disasm_line *line, FILE *out)
+{
+	fprintf(out, "%s\n", line->text);
+}
+
+/* ---- vertex programs ---- */
+
+static const char *vp_vec_names[32] = {
+	"NOP", "MOV", "MUL", "ADD", "MAD", "DP3", "DPH", "DP4",
+	"DST", "MIN", "MAX", "SLT", "SGE", "ARL", "FRC", "FLR",
+	"SEQ", "SFL", "SGT", "SLE", "SNE", "STR", "SSG", "ARR",
+	"ARA", "TXL"
+};
+
+/* Sources that each vector op reads, as a mask: */
+static const unsigned vp_vec_srcs[32] = {
+	0x0, 0x1, 0x3, 0x5, 0x7, 0x3, 0x3, 0x3,
+	0x3, 0x3, 0x3, 0x3, 0x3, 0x1, 0x1, 0x1,
+	0x3, 0x0, 0x3, 0x3, 0x3, 0x0, 0x1, 0x1,
+	0x1, 0x1
+};
+
+static const char *vp_sca_names[32] = {
+	"NOP", "MOV", "RCP", "RCC", "RSQ", "EXP", "LOG", "LIT",
+	NULL, "BRA", NULL, "CAL", "RET", "LG2", "EX2", "SIN",
+	"COS", NULL, NULL, "PUSHA", "POPA"
+};
+
+static const char *vp_output_names[16] = {
+	"HPOS", "COL0", "COL1", "BFC0", "BFC1", "FOGC", "PSIZ", "TEX0",
+	"TEX1", "TEX2", "TEX3", "TEX4", "TEX5", "TEX6", "TEX7", NULL
+};
+
+static uint32_t
+vp_src_get(const uint32_t *hw, unsigned pos)
+{
+	switch (pos) {
+	case 0:
+		return (((hw[1] & NV40_VP_INST_SRC0H_MASK) >> NV40_VP_INST_SRC0H_SHIFT) << NV40_VP_SRC0_HIGH_SHIFT) |
+			((hw[2] & NV40_VP_INST_SRC0L_MASK) >> NV40_VP_INST_SRC0L_SHIFT);
+	case 1:
+		return (hw[2] & NV40_VP_INST_SRC1_MASK) >> NV40_VP_INST_SRC1_SHIFT;
+	default:
+		return (((hw[2] & NV40_VP_INST_SRC2H_MASK) >> NV40_VP_INST_SRC2H_SHIFT) << NV40_VP_SRC2_HIGH_SHIFT) |
+			((hw[3] & NV40_VP_INST_SRC2L_MASK) >> NV40_VP_INST_SRC2L_SHIFT);
+	}
+}
+
+/* Write masks have x in bit 3: */
+static INLINE unsigned
+vp_mask(unsigned mask)
+{
+	return ((mask >> 3) & 1) | ((mask >> 1) & 2) | ((mask << 1) & 4) | ((mask << 3) & 8);
+}
+
+static void
+vp_line_src(struct nvfx_disasm_line *line, const uint32_t *hw, unsigned pos)
+{
+	const uint32_t sr = vp_src_get(hw, pos);
+	const boolean neg = (sr & NV40_VP_SRC_NEGATE) ? TRUE : FALSE;
+	const boolean abs = (hw[0] & (NV40_VP_INST_SRC0_ABS << pos)) ? TRUE : FALSE;
+	const char addr = (hw[0] & NV40_VP_INST_ADDR_REG_SELECT_1) ? '1' : '0';
+	const char addr_comp = comp_names[(hw[0] & NV40_VP_INST_ADDR_SWZ_MASK) >> NV40_VP_INST_ADDR_SWZ_SHIFT];
+	unsigned comps[4];
+
+	comps[0] = (sr & NV40_VP_SRC_SWZ_X_MASK) >> NV40_VP_SRC_SWZ_X_SHIFT;
+	comps[1] = (sr & NV40_VP_SRC_SWZ_Y_MASK) >> NV40_VP_SRC_SWZ_Y_SHIFT;
+	comps[2] = (sr & NV40_VP_SRC_SWZ_Z_MASK) >> NV40_VP_SRC_SWZ_Z_SHIFT;
+	comps[3] = (sr & NV40_VP_SRC_SWZ_W_MASK) >> NV40_VP_SRC_SWZ_W_SHIFT;
+
+	line_printf(line, "%s%s", neg ? "-" : "", abs ? "|" : "");
+
+	switch ((sr & NV40_VP_SRC_REG_TYPE_MASK) >> NV40_VP_SRC_REG_TYPE_SHIFT) {
+	case NV40_VP_SRC_REG_TYPE_TEMP:
+		line_printf(line, "R%u", (sr & NV40_VP_SRC_TEMP_SRC_MASK) >> NV40_VP_SRC_TEMP_SRC_SHIFT);
+		break;
+	case NV40_VP_SRC_REG_TYPE_INPUT:
+		if (hw[0] & NV40_VP_INST_INDEX_INPUT)
+			line_printf(line, "v[A%c.%c + %u]", addr, addr_comp,
+				    (hw[1] & NV40_VP_INST_INPUT_SRC_MASK) >> NV40_VP_INST_INPUT_SRC_SHIFT);
+		else
+			line_printf(line, "v[%u]", (hw[1] & NV40_VP_INST_INPUT_SRC_MASK) >> NV40_VP_INST_INPUT_SRC_SHIFT);
+		break;
+	case NV40_VP_SRC_REG_TYPE_CONST:
+		if (hw[3] & NV40_VP_INST_INDEX_CONST)
+			line_printf(line, "c[A%c.%c + %u]", addr, addr_comp,
+				    (hw[1] & NV40_VP_INST_CONST_SRC_MASK) >> NV40_VP_INST_CONST_SRC_SHIFT);
+		else
+			line_printf(line, "c[%u]", (hw[1] & NV40_VP_INST_CONST_SRC_MASK) >> NV40_VP_INST_CONST_SRC_SHIFT);
+		break;
+	default:
+		line_printf(line, "?");
+		break;
+	}
+
+	line_swizzle(line, comps);
+	line_printf(line, "%s", abs ? "|" : "");
+}
+
+static void
+vp_line_dst(struct nvfx_disasm_line *line, const uint32_t *hw, boolean result, int temp, unsigned mask)
+{
+	const unsigned dest = (hw[3] & NV40_VP_INST_DEST_MASK) >> NV40_VP_INST_DEST_SHIFT;
+
+	if (result) {
+		if (dest < 16 && vp_output_names[dest])
+			line_printf(line, " o[%s]", vp_output_names[dest]);
+		else
+			line_printf(line, " o[%u]", dest);
+	}
+	else if (temp >= 0)
+		line_printf(line, " R%d", temp);
+	else
+		line_printf(line, " RC");
+
+	line_mask(line, mask);
+}
+
+static void
+vp_line_cond(struct nvfx_disasm_line *line, const uint32_t *hw)
+{
+	unsigned comps[4];
+
+	comps[0] = (hw[0] & NV40_VP_INST_COND_SWZ_X_MASK) >> NV40_VP_INST_COND_SWZ_X_SHIFT;
+	comps[1] = (hw[0] & NV40_VP_INST_COND_SWZ_Y_MASK) >> NV40_VP_INST_COND_SWZ_Y_SHIFT;
+	comps[2] = (hw[0] & NV40_VP_INST_COND_SWZ_Z_MASK) >> NV40_VP_INST_COND_SWZ_Z_SHIFT;
+	comps[3] = (hw[0] & NV40_VP_INST_COND_SWZ_W_MASK) >> NV40_VP_INST_COND_SWZ_W_SHIFT;
+
+	line_cond(line, (hw[0] & NV40_VP_INST_COND_MASK) >> NV40_VP_INST_COND_SHIFT, comps);
+}
+
+static void
+vp_line_op(struct nvfx_disasm_line *line, const char *name, unsigned op, boolean cc, boolean sat)
+{
+	if (name)
+		line_printf(line, "%s", name);
+	else
+		line_printf(line, "OP%02x", op);
+	line_printf(line, "%s%s", cc ? "C" : "", sat ? "_SAT" : "");
+}
+
+void
+nvfx_vertprog_disasm(const uint32_t *insns, unsigned nr_insns, FILE *out,
+		     struct nvfx_program_cost *cost)
+{
+	unsigned i, pos, registers = 0;
+
+	if (cost)
+		memset(cost, 0, sizeof(*cost));
+
+	for (i = 0; i < nr_insns; ++i) {
+		const uint32_t *hw = insns + i * 4;
+		const unsigned vec_op = (hw[1] & NV40_VP_INST_VEC_OPCODE_MASK) >> NV40_VP_INST_VEC_OPCODE_SHIFT;
+		const unsigned sca_op = (hw[1] & NV40_VP_INST_SCA_OPCODE_MASK) >> NV40_VP_INST_SCA_OPCODE_SHIFT;
+		const unsigned vec_temp = (hw[0] & NV40_VP_INST_VEC_DEST_TEMP_MASK) >> NV40_VP_INST_VEC_DEST_TEMP_SHIFT;
+		const unsigned sca_temp = (hw[3] & NV40_VP_INST_SCA_DEST_TEMP_MASK) >> NV40_VP_INST_SCA_DEST_TEMP_SHIFT;
+		const boolean cc = (hw[0] & NV40_VP_INST_COND_UPDATE_ENABLE) ? TRUE : FALSE;
+		const boolean sat = (hw[0] & NV40_VP_INST_SATURATE) ? TRUE : FALSE;
+		const boolean branch = sca_op == NVFX_VP_INST_SCA_OP_BRA ||
+			sca_op == NVFX_VP_INST_SCA_OP_CAL || sca_op == NVFX_VP_INST_SCA_OP_RET;
+
+		if (vec_op != NVFX_VP_INST_VEC_OP_NOP && vec_temp != 0x3f && vec_temp + 1 > registers)
+			registers = vec_temp + 1;
+		if (sca_op != NVFX_VP_INST_SCA_OP_NOP && !branch && sca_temp != 0x1f && sca_temp + 1 > registers)
+			registers = sca_temp + 1;
+
+		if (cost) {
+			++cost->instructions;
+			if (vec_op == NVFX_VP_INST_VEC_OP_TXL)
+				++cost->texture_fetches;
+			if (branch)
+				++cost->branches;
+		}
+
+		if (out) {
+			struct nvfx_disasm_line line;
+
+			line.len = 0;
+			line.text[0] = 0;
+			line_printf(&line, "%4u: %08x %08x %08x %08x  ", i, hw[0], hw[1], hw[2], hw[3]);
+
+			if (vec_op != NVFX_VP_INST_VEC_OP_NOP || sca_op == NVFX_VP_INST_SCA_OP_NOP) {
+				unsigned srcs = vp_vec_srcs[vec_op];
+
+				vp_line_op(&line, vp_vec_names[vec_op], vec_op, cc, sat);
+				if (vec_op != NVFX_VP_INST_VEC_OP_NOP) {
+					vp_line_dst(&line, hw, (hw[0] & NV40_VP_INST_VEC_RESULT) ? TRUE : FALSE,
+						    (vec_temp == 0x3f) ? -1 : (int)vec_temp,
+						    vp_mask((hw[3] & NV40_VP_INST_VEC_WRITEMASK_MASK) >> NV40_VP_INST_VEC_WRITEMASK_SHIFT));
+					vp_line_cond(&line, hw);
+				}
+				for (pos = 0; pos < 3; ++pos) {
+					if (!(srcs & (1 << pos)))
+						continue;
+					line_printf(&line, ", ");
+					vp_line_src(&line, hw, pos);
+				}
+			}
+
+			if (sca_op != NVFX_VP_INST_SCA_OP_NOP) {
+				if (vec_op != NVFX_VP_INST_VEC_OP_NOP)
+					line_printf(&line, " + ");
+				vp_line_op(&line, vp_sca_names[sca_op], sca_op,
+					   (vec_op == NVFX_VP_INST_VEC_OP_NOP) ? cc : FALSE, sat);
+
+				if (sca_op == NVFX_VP_INST_SCA_OP_BRA || sca_op == NVFX_VP_INST_SCA_OP_CAL) {
+					line_printf(&line, " @%u",
+						    (((hw[2] & NV40_VP_INST_IADDRH_MASK) >> NV40_VP_INST_IADDRH_SHIFT) << 3) |
+						    ((hw[3] & NV40_VP_INST_IADDRL_MASK) >> NV40_VP_INST_IADDRL_SHIFT));
+					vp_line_cond(&line, hw);
+				}
+				else if (sca_op == NVFX_VP_INST_SCA_OP_RET) {
+					vp_line_cond(&line, hw);
+				}
+				else {
+					vp_line_dst(&line, hw, (hw[3] & NV40_VP_INST_SCA_RESULT) ? TRUE : FALSE,
+						    (sca_temp == 0x1f) ? -1 : (int)sca_temp,
+						    vp_mask((hw[3] & NV40_VP_INST_SCA_WRITEMASK_MASK) >> NV40_VP_INST_SCA_WRITEMASK_SHIFT));
+					vp_line_cond(&line, hw);
+					if (sca_op != NV40_VP_INST_SCA_OP_POPA) {
+						line_printf(&line, ", ");
+						vp_line_src(&line, hw, 2);
+					}
+				}
+			}
+
+			line_printf(&line, ";%s", (hw[3] & NVFX_VP_INST_LAST) ? " # last" : "");
+			line_end(&line, out);
+		}
+	}
+
+	if (cost)
+		cost->registers = registers;
+}
+
+/* ---- fragment programs ---- */
+
+static const char *fp_names[64] = {
+	"NOP", "MOV", "MUL", "ADD", "MAD", "DP3", "DP4", "DST",
+	"MIN", "MAX", "SLT", "SGE", "SLE", "SGT", "SNE", "SEQ",
+	"FRC", "FLR", "KIL", "PK4B", "UP4B", "DDX", "DDY", "TEX",
+	"TXP", "TXD", "RCP", "RSQ", "EX2", "LG2", "LIT", "LRP",
+	"STR", "SFL", "COS", "SIN", "PK2H", "UP2H", "POW", "PK4UB",
+	"UP4UB", "PK2US", "UP2US", NULL, NULL, NULL, "DP2A", "TXL",
+	NULL, "TXB", NULL, NULL, NULL, NULL, "RFL", NULL,
+	NULL, NULL, "DIV", NULL, "LITEX2"
+};
+
+/* Number of sources that each op reads: */
+static const unsigned fp_nr_srcs[64] = {
+	0, 1, 2, 2, 3, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2,
+	1, 1, 0, 1, 1, 1, 1, 1,
+	1, 3, 1, 1, 1, 1, 1, 3,
+	0, 0, 1, 1, 1, 1, 2, 1,
+	1, 1, 1, 0, 0, 0, 3, 1,
+	0, 1, 0, 0, 0, 0, 2, 0,
+	0, 0, 2, 0, 1
+};
+
+static const char *fp_branch_names[8] = {
+	"BRK", "CAL", "IF", "LOOP", "REP", "RET", NULL, NULL
+};
+
+static const char *fp_scale_names[8] = {
+	"", "_x2", "_x4", "_x8", "", "_d2", "_d4", "_d8"
+};
+
+static INLINE boolean
+fp_is_tex(unsigned op)
+{
+	return op == NVFX_FP_OP_OPCODE_TEX || op == NVFX_FP_OP_OPCODE_TXP ||
+		op == NVFX_FP_OP_OPCODE_TXD || op == NVFX_FP_OP_OPCODE_TXB ||
+		op == NVFX_FP_OP_OPCODE_TXL_NV40;
+}
+
+static INLINE boolean
+fp_has_cst(const uint32_t *hw)
+{
+	unsigned pos;
+
+	if (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH)
+		return FALSE;
+	for (pos = 0; pos < 3; ++pos) {
+		if (((hw[pos + 1] & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT) == NVFX_FP_REG_TYPE_CONST)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void
+fp_line_input(struct nvfx_disasm_line *line, unsigned input)
+{
+	if (input == NVFX_FP_OP_INPUT_SRC_POSITION)
+		line_printf(line, "WPOS");
+	else if (input == NVFX_FP_OP_INPUT_SRC_COL0)
+		line_printf(line, "COL0");
+	else if (input == NVFX_FP_OP_INPUT_SRC_COL1)
+		line_printf(line, "COL1");
+	else if (input == NVFX_FP_OP_INPUT_SRC_FOGC)
+		line_printf(line, "FOGC");
+	else if (input == NV40_FP_OP_INPUT_SRC_FACING)
+		line_printf(line, "FACE");
+	else
+		line_printf(line, "TEX%u", input - NVFX_FP_OP_INPUT_SRC_TC0);
+}
+
+static void
+fp_line_src(struct nvfx_disasm_line *line, const uint32_t *hw, const uint32_t *cst, unsigned pos)
+{
+	const uint32_t sr = hw[pos + 1];
+	const boolean abs = (hw[1] & (NVFX_FP_OP_SRC0_ABS << pos)) ? TRUE : FALSE;
+	const unsigned index = (sr & NV40_FP_REG_SRC_MASK) >> NVFX_FP_REG_SRC_SHIFT;
+	unsigned comps[4];
+
+	comps[0] = (sr & NVFX_FP_REG_SWZ_X_MASK) >> NVFX_FP_REG_SWZ_X_SHIFT;
+	comps[1] = (sr & NVFX_FP_REG_SWZ_Y_MASK) >> NVFX_FP_REG_SWZ_Y_SHIFT;
+	comps[2] = (sr & NVFX_FP_REG_SWZ_Z_MASK) >> NVFX_FP_REG_SWZ_Z_SHIFT;
+	comps[3] = (sr & NVFX_FP_REG_SWZ_W_MASK) >> NVFX_FP_REG_SWZ_W_SHIFT;
+
+	line_printf(line, "%s%s", (sr & NVFX_FP_REG_NEGATE) ? "-" : "", abs ? "|" : "");
+
+	switch ((sr & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT) {
+	case NVFX_FP_REG_TYPE_TEMP:
+		line_printf(line, "%c%u", (sr & NVFX_FP_REG_SRC_HALF) ? 'H' : 'R', index);
+		break;
+	case NVFX_FP_REG_TYPE_INPUT:
+		line_printf(line, "f[");
+		if (hw[3] & NVFX_FP_OP_INDEX_INPUT)
+			line_printf(line, "aL + ");
+		fp_line_input(line, (hw[0] & NVFX_FP_OP_INPUT_SRC_MASK) >> NVFX_FP_OP_INPUT_SRC_SHIFT);
+		line_printf(line, "]");
+		break;
+	case NVFX_FP_REG_TYPE_CONST:
+		if (cst) {
+			union { uint32_t u; float f; } v[4];
+			unsigned c;
+
+			for (c = 0; c < 4; ++c)
+				v[c].u = cst[c];
+			line_printf(line, "{%g, %g, %g, %g}", v[0].f, v[1].f, v[2].f, v[3].f);
+		}
+		else
+			line_printf(line, "c[?]");
+		break;
+	default:
+		line_printf(line, "?");
+		break;
+	}
+
+	line_swizzle(line, comps);
+	line_printf(line, "%s", abs ? "|" : "");
+}
+
+static void
+fp_line_cond(struct nvfx_disasm_line *line, const uint32_t *hw)
+{
+	unsigned comps[4];
+
+	comps[0] = (hw[1] & NVFX_FP_OP_COND_SWZ_X_MASK) >> NVFX_FP_OP_COND_SWZ_X_SHIFT;
+	comps[1] = (hw[1] & NVFX_FP_OP_COND_SWZ_Y_MASK) >> NVFX_FP_OP_COND_SWZ_Y_SHIFT;
+	comps[2] = (hw[1] & NVFX_FP_OP_COND_SWZ_Z_MASK) >> NVFX_FP_OP_COND_SWZ_Z_SHIFT;
+	comps[3] = (hw[1] & NVFX_FP_OP_COND_SWZ_W_MASK) >> NVFX_FP_OP_COND_SWZ_W_SHIFT;
+
+	line_cond(line, (hw[1] & NVFX_FP_OP_COND_MASK) >> NVFX_FP_OP_COND_SHIFT, comps);
+}
+
+static void
+fp_line_branch(struct nvfx_disasm_line *line, const uint32_t *hw)
+{
+	const unsigned op = (hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
+
+	if (op < 8 && fp_branch_names[op])
+		line_printf(line, "%s", fp_branch_names[op]);
+	else
+		line_printf(line, "BRANCH%02x", op);
+
+	switch (op) {
+	case NV40_FP_OP_BRA_OPCODE_CAL:
+		line_printf(line, " @%u", ((hw[2] & NV40_FP_OP_SUB_OFFSET_MASK) >> NV40_FP_OP_SUB_OFFSET_SHIFT) / 4);
+		break;
+	case NV40_FP_OP_BRA_OPCODE_IF:
+		line_printf(line, " else @%u, endif @%u",
+			    ((hw[2] & NV40_FP_OP_ELSE_OFFSET_MASK) >> NV40_FP_OP_ELSE_OFFSET_SHIFT) / 4,
+			    ((hw[3] & NV40_FP_OP_END_OFFSET_MASK) >> NV40_FP_OP_END_OFFSET_SHIFT) / 4);
+		break;
+	case NV40_FP_OP_BRA_OPCODE_LOOP:
+		line_printf(line, " {%u, %u, %u}, end @%u",
+			    (hw[2] & NV40_FP_OP_LOOP_COUNT_MASK) >> NV40_FP_OP_LOOP_COUNT_SHIFT,
+			    (hw[2] & NV40_FP_OP_LOOP_INDEX_MASK) >> NV40_FP_OP_LOOP_INDEX_SHIFT,
+			    (hw[2] & NV40_FP_OP_LOOP_INCR_MASK) >> NV40_FP_OP_LOOP_INCR_SHIFT,
+			    ((hw[3] & NV40_FP_OP_END_OFFSET_MASK) >> NV40_FP_OP_END_OFFSET_SHIFT) / 4);
+		break;
+	case NV40_FP_OP_BRA_OPCODE_REP:
+		line_printf(line, " %u, end @%u",
+			    (hw[2] & NV40_FP_OP_REP_COUNT1_MASK) >> NV40_FP_OP_REP_COUNT1_SHIFT,
+			    ((hw[3] & NV40_FP_OP_END_OFFSET_MASK) >> NV40_FP_OP_END_OFFSET_SHIFT) / 4);
+		break;
+	default:
+		break;
+	}
+
+	fp_line_cond(line, hw);
+}
+
+static void
+fp_line_insn(struct nvfx_disasm_line *line, const uint32_t *hw, const uint32_t *cst)
+{
+	const unsigned op = (hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
+	const unsigned precision = (hw[0] & NVFX_FP_OP_PRECISION_MASK) >> NVFX_FP_OP_PRECISION_SHIFT;
+	const unsigned scale = (hw[2] & NVFX_FP_OP_DST_SCALE_MASK) >> NVFX_FP_OP_DST_SCALE_SHIFT;
+	unsigned pos;
+
+	if (fp_names[op])
+		line_printf(line, "%s", fp_names[op]);
+	else
+		line_printf(line, "OP%02x", op);
+	line_printf(line, "%s%s%s%s",
+		    (precision == NVFX_FP_PRECISION_FP16) ? "H" : (precision == NVFX_FP_PRECISION_FX12) ? "X" : "",
+		    (hw[0] & NVFX_FP_OP_COND_WRITE_ENABLE) ? "C" : "",
+		    fp_scale_names[scale],
+		    (hw[0] & NVFX_FP_OP_OUT_SAT) ? "_SAT" : "");
+
+	if (op == NVFX_FP_OP_OPCODE_NOP)
+		return;
+
+	if (op == NVFX_FP_OP_OPCODE_KIL) {
+		fp_line_cond(line, hw);
+		return;
+	}
+
+	if (hw[0] & NV40_FP_OP_OUT_NONE)
+		line_printf(line, " RC");
+	else
+		line_printf(line, " %c%u", (hw[0] & NVFX_FP_OP_OUT_REG_HALF) ? 'H' : 'R',
+			    (hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT);
+	line_mask(line, (hw[0] & NVFX_FP_OP_OUTMASK_MASK) >> NVFX_FP_OP_OUTMASK_SHIFT);
+	fp_line_cond(line, hw);
+
+	for (pos = 0; pos < fp_nr_srcs[op]; ++pos) {
+		line_printf(line, ", ");
+		fp_line_src(line, hw, cst, pos);
+	}
+
+	if (fp_is_tex(op))
+		line_printf(line, ", TEX%u", (hw[0] & NVFX_FP_OP_TEX_UNIT_MASK) >> NVFX_FP_OP_TEX_UNIT_SHIFT);
+}
+
+void
+nvfx_fragprog_disasm(const uint32_t *insns, unsigned insn_len, FILE *out,
+		     struct nvfx_program_cost *cost)
+{
+	unsigned off, registers = 0;
+
+	if (cost)
+		memset(cost, 0, sizeof(*cost));
+
+	for (off = 0; off + 4 <= insn_len;) {
+		const uint32_t *hw = insns + off;
+		const boolean branch = (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH) ? TRUE : FALSE;
+		const unsigned op = (hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
+		const uint32_t *cst = (fp_has_cst(hw) && off + 8 <= insn_len) ? hw + 4 : NULL;
+
+		if (!branch && !(hw[0] & NV40_FP_OP_OUT_NONE) && op != NVFX_FP_OP_OPCODE_NOP &&
+		    op != NVFX_FP_OP_OPCODE_KIL) {
+			unsigned reg = (hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT;
+
+			/* Half precision registers are halves of the full precision ones: */
+			if (hw[0] & NVFX_FP_OP_OUT_REG_HALF)
+				reg >>= 1;
+			if (reg + 1 > registers)
+				registers = reg + 1;
+		}
+
+		if (cost) {
+			++cost->instructions;
+			if (branch)
+				++cost->branches;
+			else if (fp_is_tex(op))
+				++cost->texture_fetches;
+		}
+
+		if (out) {
+			struct nvfx_disasm_line line;
+
+			line.len = 0;
+			line.text[0] = 0;
+			line_printf(&line, "%4u: %08x %08x %08x %08x  ", off / 4, hw[0], hw[1], hw[2], hw[3]);
+			if (branch)
+				fp_line_branch(&line, hw);
+			else
+				fp_line_insn(&line, hw, cst);
+			line_printf(&line, ";%s", (hw[0] & NVFX_FP_OP_PROGRAM_END) ? " # end" : "");
+			line_end(&line, out);
+
+			if (cst)
+				fprintf(out, "%4u: %08x %08x %08x %08x  # constant\n", off / 4 + 1, cst[0], cst[1], cst[2], cst[3]);
+		}
+
+		off += cst ? 8 : 4;
+	}
+
+	if (cost)
+		cost->registers = registers;
+}
+
+void
+nvfx_program_cost_dump(FILE *out, const char *name, const struct nvfx_program_cost *cost)
+{
+	fprintf(out, "%s: %u instructions, %u texture fetches, %u registers, %u branches\n", name,
+		cost->instructions, cost->texture_fetches, cost->registers, cost->branches);
+}
@@ -0,0 +1,33 @@
+#ifndef __NVFX_DISASM_H__
+#define __NVFX_DISASM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Static estimate of what a program costs to run, counted from its microcode. Nothing is known
+ * about flow control, so every instruction is counted once:
+ */
+struct nvfx_program_cost {
+	unsigned instructions;		/* not counting the constants embedded in fragment programs */
+	unsigned texture_fetches;
+	unsigned registers;		/* temps, as full precision registers */
+	unsigned branches;		/* flow control instructions */
+};
+
+/* Either out or cost may be NULL. Vertex programs are nr_insns instructions of 4 words each;
+ * fragment programs are insn_len words, in the order that the driver builds them (not the
+ * half-word swapped order that the RSX reads them in).
+ */
+void
+nvfx_vertprog_disasm(const uint32_t *insns, unsigned nr_insns, FILE *out,
+		     struct nvfx_program_cost *cost);
+
+void
+nvfx_fragprog_disasm(const uint32_t *insns, unsigned insn_len, FILE *out,
+		     struct nvfx_program_cost *cost);
+
+/* One line summary of a cost estimate, labelled with name: */
+void
+nvfx_program_cost_dump(FILE *out, const char *name, const struct nvfx_program_cost *cost);
+
+#endif
@@ -1141,6 +1141,8 @@ nvfx_fragprog_translate(struct nvfx_context *nvfx,
 	fp->insn[fpc->inst_offset + 2] = 0x00000000;
 	fp->insn[fpc->inst_offset + 3] = 0x00000000;
 
+	nvfx_fragprog_optimize(nvfx, fp);
+
 	if(debug_get_option_nvfx_dump_fp())
 	{
 		debug_printf("\n");
@@ -0,0 +1,1795 @@
+/* Peephole optimization of NV40 vertex & fragment program microcode.
+ *
+ * The translators map TGSI onto hardware instructions nearly one for one, which leaves behind
+ * MOVs that only exist to satisfy the one input & one constant per instruction rules, results
+ * that are never read, and MUL/ADD pairs. These passes run over the finished microcode:
+ *
+ *  - copy propagation: reads of a MOV's destination read its source instead, wherever the
+ *    reading instruction is still encodable
+ *  - MAD fusion: MUL t, a, b; ADD d, t, c becomes MAD d, a, b, c when t isn't read again
+ *  - dead code elimination: instructions whose results are never read are removed
+ *  - vertex programs only: a vector-only instruction and a later scalar-only one are issued
+ *    together, as a single instruction
+ *  - fragment programs only: temps are reallocated from their live ranges, since the number of
+ *    registers that a program uses limits how many fragments the RSX keeps in flight
+ *
+ * Only straight-line programs are optimized; anything with flow control is left as it is, and
+ * so is any instruction that uses relative addressing or an opcode that isn't understood here.
+ * Set NVFX_NOOPT to turn the passes off.
+ */
+
+#include "pipe/p_compiler.h"
+#include "util/u_debug.h"
+#include "util/u_memory.h"
+#include "util/u_dynarray.h"
+
+#include "nvfx_context.h"
+#include "nvfx_state.h"
+#include "nvfx_shader.h"
+#include "nv40_vertprog.h"
+
+/* Each pass can expose more work for the others; give up after this many rounds: */
+#define NVFX_OPT_MAX_ROUNDS 8
+
+/* How far ahead to look for an instruction to co-issue with: */
+#define NVFX_OPT_COISSUE_WINDOW 8
+
+/* Registers are tracked as masks of the components they hold, x in bit 0: */
+#define NVFX_OPT_ALL 0xf
+
+#define NVFX_OPT_MAX_TEMPS 64
+
+/* R0 to R4 are the fragment program's results (colors & depth): */
+#define NVFX_OPT_FP_OUTPUTS 5
+
+DEBUG_GET_ONCE_BOOL_OPTION(nvfx_noopt, "NVFX_NOOPT", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(nvfx_dump_fp_regs, "NVFX_DUMP_FP_REGS", FALSE)
+
+static const unsigned vp_swz_shift[4] = {
+	NV40_VP_SRC_SWZ_X_SHIFT, NV40_VP_SRC_SWZ_Y_SHIFT,
+	NV40_VP_SRC_SWZ_Z_SHIFT, NV40_VP_SRC_SWZ_W_SHIFT
+};
+
+static const unsigned fp_swz_shift[4] = {
+	NVFX_FP_REG_SWZ_X_SHIFT, NVFX_FP_REG_SWZ_Y_SHIFT,
+	NVFX_FP_REG_SWZ_Z_SHIFT, NVFX_FP_REG_SWZ_W_SHIFT
+};
+
+static INLINE unsigned
+swz_get(uint32_t sr, const unsigned *shift, unsigned c)
+{
+	return (sr >> shift[c]) & 3;
+}
+
+/* Components of a register that a source reads, for the components in mask: */
+static INLINE unsigned
+swz_comps(uint32_t sr, const unsigned *shift, unsigned mask)
+{
+	unsigned c, comps = 0;
+
+	for (c = 0; c < 4; ++c) {
+		if (mask & (1 << c))
+			comps |= 1 << swz_get(sr, shift, c);
+	}
+	return comps;
+}
+
+/* The swizzle of a source that reads, through use's swizzle, a register that was
+ * copied from sr:
+ */
+static INLINE uint32_t
+swz_compose(uint32_t sr, uint32_t use, const unsigned *shift)
+{
+	uint32_t result = sr;
+	unsigned c;
+
+	for (c = 0; c < 4; ++c) {
+		result &= ~(3 << shift[c]);
+		result |= swz_get(sr, shift, swz_get(use, shift, c)) << shift[c];
+	}
+	return result;
+}
+
+/* Likewise for the modifiers; the hardware applies abs before negation: */
+static INLINE void
+mod_compose(boolean sr_neg, boolean sr_abs, boolean use_neg, boolean use_abs,
+	    boolean *neg, boolean *abs)
+{
+	if (use_abs) {
+		*abs = TRUE;
+		*neg = use_neg;
+	} else {
+		*abs = sr_abs;
+		*neg = use_neg ^ sr_neg;
+	}
+}
+
+/*
+ * Vertex programs
+ */
+
+struct nvfx_vp_opt_insn {
+	uint32_t hw[4];
+	int cst;		/* constant that the instruction reads, -1 if none */
+	boolean dead;
+};
+
+struct nvfx_vp_opt_info {
+	unsigned vec_op, sca_op;
+	unsigned vec_srcs;	/* sources read by the vector op, as a mask */
+	unsigned sca_srcs;	/* likewise the scalar op */
+	boolean vec_percomp;	/* the vector op only reads the components that it writes */
+	boolean opaque;		/* can't be changed, moved or removed */
+	boolean result;		/* writes an output */
+	boolean cc;		/* updates the condition code */
+	boolean cond;		/* writes are conditional */
+	int vec_temp, sca_temp;	/* destination temps, -1 if none */
+	unsigned vec_mask, sca_mask;
+};
+
+/* Write masks are stored with x in bit 3: */
+static INLINE unsigned
+vp_mask_to_comps(unsigned mask)
+{
+	return ((mask >> 3) & 1) | ((mask >> 1) & 2) | ((mask << 1) & 4) | ((mask << 3) & 8);
+}
+
+static INLINE uint32_t
+vp_src_get(const uint32_t *hw, unsigned pos)
+{
+	switch (pos) {
+	case 0:
+		return (((hw[1] & NV40_VP_INST_SRC0H_MASK) >> NV40_VP_INST_SRC0H_SHIFT) << NV40_VP_SRC0_HIGH_SHIFT) |
+			((hw[2] & NV40_VP_INST_SRC0L_MASK) >> NV40_VP_INST_SRC0L_SHIFT);
+	case 1:
+		return (hw[2] & NV40_VP_INST_SRC1_MASK) >> NV40_VP_INST_SRC1_SHIFT;
+	default:
+		return (((hw[2] & NV40_VP_INST_SRC2H_MASK) >> NV40_VP_INST_SRC2H_SHIFT) << NV40_VP_SRC2_HIGH_SHIFT) |
+			((hw[3] & NV40_VP_INST_SRC2L_MASK) >> NV40_VP_INST_SRC2L_SHIFT);
+	}
+}
+
+static INLINE void
+vp_src_set(uint32_t *hw, unsigned pos, uint32_t sr)
+{
+	switch (pos) {
+	case 0:
+		hw[1] = (hw[1] & ~NV40_VP_INST_SRC0H_MASK) |
+			(((sr & NV40_VP_SRC0_HIGH_MASK) >> NV40_VP_SRC0_HIGH_SHIFT) << NV40_VP_INST_SRC0H_SHIFT);
+		hw[2] = (hw[2] & ~NV40_VP_INST_SRC0L_MASK) |
+			((sr & NV40_VP_SRC0_LOW_MASK) << NV40_VP_INST_SRC0L_SHIFT);
+		break;
+	case 1:
+		hw[2] = (hw[2] & ~NV40_VP_INST_SRC1_MASK) | (sr << NV40_VP_INST_SRC1_SHIFT);
+		break;
+	default:
+		hw[2] = (hw[2] & ~NV40_VP_INST_SRC2H_MASK) |
+			(((sr & NV40_VP_SRC2_HIGH_MASK) >> NV40_VP_SRC2_HIGH_SHIFT) << NV40_VP_INST_SRC2H_SHIFT);
+		hw[3] = (hw[3] & ~NV40_VP_INST_SRC2L_MASK) |
+			((sr & NV40_VP_SRC2_LOW_MASK) << NV40_VP_INST_SRC2L_SHIFT);
+		break;
+	}
+}
+
+static INLINE boolean
+vp_abs_get(const uint32_t *hw, unsigned pos)
+{
+	return (hw[0] & (NV40_VP_INST_SRC0_ABS << pos)) ? TRUE : FALSE;
+}
+
+static INLINE void
+vp_abs_set(uint32_t *hw, unsigned pos, boolean abs)
+{
+	hw[0] &= ~(NV40_VP_INST_SRC0_ABS << pos);
+	if (abs)
+		hw[0] |= NV40_VP_INST_SRC0_ABS << pos;
+}
+
+static INLINE unsigned
+vp_src_type(uint32_t sr)
+{
+	return (sr & NV40_VP_SRC_REG_TYPE_MASK) >> NV40_VP_SRC_REG_TYPE_SHIFT;
+}
+
+static INLINE unsigned
+vp_src_temp(uint32_t sr)
+{
+	return (sr & NV40_VP_SRC_TEMP_SRC_MASK) >> NV40_VP_SRC_TEMP_SRC_SHIFT;
+}
+
+static INLINE int
+vp_input(const uint32_t *hw)
+{
+	return (hw[1] & NV40_VP_INST_INPUT_SRC_MASK) >> NV40_VP_INST_INPUT_SRC_SHIFT;
+}
+
+static INLINE void
+vp_input_set(uint32_t *hw, int input)
+{
+	hw[1] = (hw[1] & ~NV40_VP_INST_INPUT_SRC_MASK) | (input << NV40_VP_INST_INPUT_SRC_SHIFT);
+}
+
+static void
+vp_decode(const uint32_t *hw, struct nvfx_vp_opt_info *info)
+{
+	unsigned t;
+
+	memset(info, 0, sizeof(*info));
+	info->vec_op = (hw[1] & NV40_VP_INST_VEC_OPCODE_MASK) >> NV40_VP_INST_VEC_OPCODE_SHIFT;
+	info->sca_op = (hw[1] & NV40_VP_INST_SCA_OPCODE_MASK) >> NV40_VP_INST_SCA_OPCODE_SHIFT;
+
+	switch (info->vec_op) {
+	case NVFX_VP_INST_VEC_OP_NOP:
+		break;
+	case NVFX_VP_INST_VEC_OP_MOV:
+	case NVFX_VP_INST_VEC_OP_FRC:
+	case NVFX_VP_INST_VEC_OP_FLR:
+		info->vec_srcs = 0x1;
+		info->vec_percomp = TRUE;
+		break;
+	case NVFX_VP_INST_VEC_OP_MUL:
+	case NVFX_VP_INST_VEC_OP_MIN:
+	case NVFX_VP_INST_VEC_OP_MAX:
+	case NVFX_VP_INST_VEC_OP_SLT:
+	case NVFX_VP_INST_VEC_OP_SGE:
+	case NVFX_VP_INST_VEC_OP_SEQ:
+	case NVFX_VP_INST_VEC_OP_SGT:
+	case NVFX_VP_INST_VEC_OP_SLE:
+	case NVFX_VP_INST_VEC_OP_SNE:
+		info->vec_srcs = 0x3;
+		info->vec_percomp = TRUE;
+		break;
+	case NVFX_VP_INST_VEC_OP_ADD:
+		info->vec_srcs = 0x5;
+		info->vec_percomp = TRUE;
+		break;
+	case NVFX_VP_INST_VEC_OP_MAD:
+		info->vec_srcs = 0x7;
+		info->vec_percomp = TRUE;
+		break;
+	case NVFX_VP_INST_VEC_OP_DP3:
+	case NVFX_VP_INST_VEC_OP_DPH:
+	case NVFX_VP_INST_VEC_OP_DP4:
+	case NVFX_VP_INST_VEC_OP_DST:
+		info->vec_srcs = 0x3;
+		break;
+	default:
+		info->opaque = TRUE;
+		break;
+	}
+
+	switch (info->sca_op) {
+	case NVFX_VP_INST_SCA_OP_NOP:
+		break;
+	case NVFX_VP_INST_SCA_OP_MOV:
+	case NVFX_VP_INST_SCA_OP_RCP:
+	case NVFX_VP_INST_SCA_OP_RCC:
+	case NVFX_VP_INST_SCA_OP_RSQ:
+	case NVFX_VP_INST_SCA_OP_EXP:
+	case NVFX_VP_INST_SCA_OP_LOG:
+	case NVFX_VP_INST_SCA_OP_LIT:
+	case NVFX_VP_INST_SCA_OP_LG2:
+	case NVFX_VP_INST_SCA_OP_EX2:
+	case NVFX_VP_INST_SCA_OP_SIN:
+	case NVFX_VP_INST_SCA_OP_COS:
+		info->sca_srcs = 0x4;
+		break;
+	default:
+		info->opaque = TRUE;
+		break;
+	}
+
+	if ((hw[0] & NV40_VP_INST_INDEX_INPUT) || (hw[3] & NV40_VP_INST_INDEX_CONST))
+		info->opaque = TRUE;
+
+	info->result = (hw[0] & NV40_VP_INST_VEC_RESULT) || (hw[3] & NV40_VP_INST_SCA_RESULT);
+	info->cc = (hw[0] & NV40_VP_INST_COND_UPDATE_ENABLE) ? TRUE : FALSE;
+	info->cond = ((hw[0] & NV40_VP_INST_COND_MASK) >> NV40_VP_INST_COND_SHIFT) != NVFX_COND_TR;
+
+	t = (hw[0] & NV40_VP_INST_VEC_DEST_TEMP_MASK) >> NV40_VP_INST_VEC_DEST_TEMP_SHIFT;
+	info->vec_temp = (t == 0x3f) ? -1 : (int)t;
+	info->vec_mask = vp_mask_to_comps((hw[3] & NV40_VP_INST_VEC_WRITEMASK_MASK) >> NV40_VP_INST_VEC_WRITEMASK_SHIFT);
+
+	t = (hw[3] & NV40_VP_INST_SCA_DEST_TEMP_MASK) >> NV40_VP_INST_SCA_DEST_TEMP_SHIFT;
+	info->sca_temp = (t == 0x1f) ? -1 : (int)t;
+	info->sca_mask = vp_mask_to_comps((hw[3] & NV40_VP_INST_SCA_WRITEMASK_MASK) >> NV40_VP_INST_SCA_WRITEMASK_SHIFT);
+}
+
+static INLINE boolean
+vp_reads_src(const struct nvfx_vp_opt_info *info, unsigned pos)
+{
+	return info->opaque || ((info->vec_srcs | info->sca_srcs) & (1 << pos));
+}
+
+/* Components of its register that a source reads: */
+static unsigned
+vp_src_comps(const uint32_t *hw, const struct nvfx_vp_opt_info *info, unsigned pos)
+{
+	uint32_t sr = vp_src_get(hw, pos);
+	unsigned comps = 0;
+
+	if (info->opaque || (info->sca_srcs & (1 << pos)))
+		return NVFX_OPT_ALL;
+	if (info->vec_srcs & (1 << pos))
+		comps |= swz_comps(sr, vp_swz_shift, info->vec_percomp ? info->vec_mask : NVFX_OPT_ALL);
+	return comps;
+}
+
+static unsigned
+vp_temp_reads(const uint32_t *hw, const struct nvfx_vp_opt_info *info, unsigned t)
+{
+	unsigned pos, comps = 0;
+
+	for (pos = 0; pos < 3; ++pos) {
+		uint32_t sr = vp_src_get(hw, pos);
+
+		if (!vp_reads_src(info, pos) || vp_src_type(sr) != NV40_VP_SRC_REG_TYPE_TEMP ||
+		    vp_src_temp(sr) != t)
+			continue;
+		comps |= vp_src_comps(hw, info, pos);
+	}
+	return comps;
+}
+
+static unsigned
+vp_temp_writes(const struct nvfx_vp_opt_info *info, int t)
+{
+	unsigned comps = 0;
+
+	if (info->vec_temp == t)
+		comps |= info->opaque ? NVFX_OPT_ALL : info->vec_mask;
+	if (info->sca_temp == t)
+		comps |= info->opaque ? NVFX_OPT_ALL : info->sca_mask;
+	return comps;
+}
+
+/* Components that are certainly overwritten: */
+static INLINE unsigned
+vp_temp_kills(const struct nvfx_vp_opt_info *info, int t)
+{
+	return (info->opaque || info->cond) ? 0 : vp_temp_writes(info, t);
+}
+
+/* Input & constant used by an instruction; only one of each can be encoded. -1 if
+ * none is used yet:
+ */
+struct nvfx_vp_opt_operands {
+	int input;
+	int cst;
+};
+
+static INLINE boolean
+vp_operands_input(struct nvfx_vp_opt_operands *ops, int input)
+{
+	if (ops->input >= 0 && ops->input != input)
+		return FALSE;
+	ops->input = input;
+	return TRUE;
+}
+
+static INLINE boolean
+vp_operands_cst(struct nvfx_vp_opt_operands *ops, int cst)
+{
+	if (cst < 0 || (ops->cst >= 0 && ops->cst != cst))
+		return FALSE;
+	ops->cst = cst;
+	return TRUE;
+}
+
+/* Adds the inputs & constants that an instruction's sources read, other than those in skip: */
+static boolean
+vp_operands_add(struct nvfx_vp_opt_operands *ops, const struct nvfx_vp_opt_insn *insn,
+		const struct nvfx_vp_opt_info *info, unsigned skip)
+{
+	unsigned pos;
+
+	for (pos = 0; pos < 3; ++pos) {
+		uint32_t sr = vp_src_get(insn->hw, pos);
+
+		if (!vp_reads_src(info, pos) || (skip & (1 << pos)))
+			continue;
+		switch (vp_src_type(sr)) {
+		case NV40_VP_SRC_REG_TYPE_INPUT:
+			if (!vp_operands_input(ops, vp_input(insn->hw)))
+				return FALSE;
+			break;
+		case NV40_VP_SRC_REG_TYPE_CONST:
+			if (!vp_operands_cst(ops, insn->cst))
+				return FALSE;
+			break;
+		}
+	}
+	return TRUE;
+}
+
+/* Adds a source that's moved from another instruction: */
+static boolean
+vp_operands_add_src(struct nvfx_vp_opt_operands *ops, const struct nvfx_vp_opt_insn *from, uint32_t sr)
+{
+	switch (vp_src_type(sr)) {
+	case NV40_VP_SRC_REG_TYPE_INPUT:
+		return vp_operands_input(ops, vp_input(from->hw));
+	case NV40_VP_SRC_REG_TYPE_CONST:
+		return vp_operands_cst(ops, from->cst);
+	default:
+		return TRUE;
+	}
+}
+
+static void
+vp_operands_apply(struct nvfx_vp_opt_insn *insn, const struct nvfx_vp_opt_operands *ops)
+{
+	if (ops->input >= 0)
+		vp_input_set(insn->hw, ops->input);
+	insn->cst = ops->cst;
+}
+
+/* Source of a MOV, as read by a later instruction's source use: */
+static uint32_t
+vp_src_compose(uint32_t sr, boolean sr_abs, uint32_t use, boolean use_abs, boolean *abs)
+{
+	uint32_t result = swz_compose(sr, use, vp_swz_shift) & ~NV40_VP_SRC_NEGATE;
+	boolean neg;
+
+	mod_compose((sr & NV40_VP_SRC_NEGATE) ? TRUE : FALSE, sr_abs,
+		    (use & NV40_VP_SRC_NEGATE) ? TRUE : FALSE, use_abs, &neg, abs);
+	if (neg)
+		result |= NV40_VP_SRC_NEGATE;
+	return result;
+}
+
+/* Whether an unconditional, unsaturated vector op without a scalar part, that writes only to
+ * a temp:
+ */
+static boolean
+vp_is_plain(const uint32_t *hw, const struct nvfx_vp_opt_info *info, unsigned vec_op)
+{
+	return !info->opaque && info->vec_op == vec_op && info->sca_op == NVFX_VP_INST_SCA_OP_NOP &&
+		info->sca_temp < 0 && info->vec_temp >= 0 && !info->result && !info->cc && !info->cond &&
+		!(hw[0] & NV40_VP_INST_SATURATE);
+}
+
+static boolean
+vp_temp_live_after(const struct nvfx_vp_opt_insn *insns, unsigned n, unsigned i, unsigned t, unsigned comps)
+{
+	unsigned j;
+
+	for (j = i + 1; j < n && comps; ++j) {
+		struct nvfx_vp_opt_info info;
+
+		if (insns[j].dead)
+			continue;
+		vp_decode(insns[j].hw, &info);
+		if (vp_temp_reads(insns[j].hw, &info, t) & comps)
+			return TRUE;
+		comps &= ~vp_temp_kills(&info, t);
+	}
+
+	/* Temps aren't kept between vertices: */
+	return FALSE;
+}
+
+static boolean
+vp_copy_propagate(struct nvfx_vp_opt_insn *insns, unsigned n)
+{
+	boolean progress = FALSE;
+	unsigned i, j, pos;
+
+	for (i = 0; i < n; ++i) {
+		struct nvfx_vp_opt_insn *mov = &insns[i];
+		struct nvfx_vp_opt_info info;
+		uint32_t sr;
+		boolean sr_abs;
+		unsigned t, type;
+
+		if (mov->dead)
+			continue;
+		vp_decode(mov->hw, &info);
+		if (!vp_is_plain(mov->hw, &info, NVFX_VP_INST_VEC_OP_MOV))
+			continue;
+
+		t = info.vec_temp;
+		sr = vp_src_get(mov->hw, 0);
+		sr_abs = vp_abs_get(mov->hw, 0);
+		type = vp_src_type(sr);
+		if (type == NV40_VP_SRC_REG_TYPE_UNK0 ||
+		    (type == NV40_VP_SRC_REG_TYPE_TEMP && vp_src_temp(sr) == t))
+			continue;
+
+		for (j = i + 1; j < n; ++j) {
+			struct nvfx_vp_opt_insn *use = &insns[j];
+			struct nvfx_vp_opt_info uinfo;
+
+			if (use->dead)
+				continue;
+			vp_decode(use->hw, &uinfo);
+
+			for (pos = 0; pos < 3 && !uinfo.opaque; ++pos) {
+				uint32_t usr = vp_src_get(use->hw, pos);
+				struct nvfx_vp_opt_operands ops = { -1, -1 };
+				boolean abs;
+
+				if (!vp_reads_src(&uinfo, pos) || vp_src_type(usr) != NV40_VP_SRC_REG_TYPE_TEMP ||
+				    vp_src_temp(usr) != t)
+					continue;
+				if (vp_src_comps(use->hw, &uinfo, pos) & ~info.vec_mask)
+					continue;
+				if (!vp_operands_add(&ops, use, &uinfo, 1 << pos) ||
+				    !vp_operands_add_src(&ops, mov, sr))
+					continue;
+
+				vp_src_set(use->hw, pos, vp_src_compose(sr, sr_abs, usr, vp_abs_get(use->hw, pos), &abs));
+				vp_abs_set(use->hw, pos, abs);
+				vp_operands_apply(use, &ops);
+				progress = TRUE;
+			}
+
+			if (vp_temp_writes(&uinfo, t) ||
+			    (type == NV40_VP_SRC_REG_TYPE_TEMP && vp_temp_writes(&uinfo, vp_src_temp(sr))))
+				break;
+		}
+	}
+	return progress;
+}
+
+static boolean
+vp_fuse_mad(struct nvfx_vp_opt_insn *insns, unsigned n)
+{
+	boolean progress = FALSE;
+	unsigned i, j;
+
+	for (i = 0; i < n; ++i) {
+		struct nvfx_vp_opt_insn *mul = &insns[i], *add;
+		struct nvfx_vp_opt_info info, ainfo;
+		struct nvfx_vp_opt_operands ops = { -1, -1 };
+		uint32_t a, b, c, tsr;
+		boolean a_abs, b_abs, c_abs;
+		unsigned t, tpos, cpos;
+		boolean r0, r2;
+
+		if (mul->dead)
+			continue;
+		vp_decode(mul->hw, &info);
+		if (!vp_is_plain(mul->hw, &info, NVFX_VP_INST_VEC_OP_MUL))
+			continue;
+
+		t = info.vec_temp;
+		a = vp_src_get(mul->hw, 0);
+		b = vp_src_get(mul->hw, 1);
+		a_abs = vp_abs_get(mul->hw, 0);
+		b_abs = vp_abs_get(mul->hw, 1);
+		if ((vp_src_type(a) == NV40_VP_SRC_REG_TYPE_TEMP && vp_src_temp(a) == t) ||
+		    (vp_src_type(b) == NV40_VP_SRC_REG_TYPE_TEMP && vp_src_temp(b) == t))
+			continue;
+
+		/* The first instruction to read t, if a and b are still intact there: */
+		for (j = i + 1; j < n; ++j) {
+			struct nvfx_vp_opt_info uinfo;
+
+			if (insns[j].dead)
+				continue;
+			vp_decode(insns[j].hw, &uinfo);
+			if (vp_temp_reads(insns[j].hw, &uinfo, t))
+				break;
+			if (vp_temp_writes(&uinfo, t) ||
+			    (vp_src_type(a) == NV40_VP_SRC_REG_TYPE_TEMP && vp_temp_writes(&uinfo, vp_src_temp(a))) ||
+			    (vp_src_type(b) == NV40_VP_SRC_REG_TYPE_TEMP && vp_temp_writes(&uinfo, vp_src_temp(b)))) {
+				j = n;
+				break;
+			}
+		}
+		if (j >= n)
+			continue;
+
+		add = &insns[j];
+		vp_decode(add->hw, &ainfo);
+		if (ainfo.opaque || ainfo.vec_op != NVFX_VP_INST_VEC_OP_ADD ||
+		    ainfo.sca_op != NVFX_VP_INST_SCA_OP_NOP || ainfo.sca_temp >= 0)
+			continue;
+
+		r0 = vp_src_type(vp_src_get(add->hw, 0)) == NV40_VP_SRC_REG_TYPE_TEMP &&
+			vp_src_temp(vp_src_get(add->hw, 0)) == t;
+		r2 = vp_src_type(vp_src_get(add->hw, 2)) == NV40_VP_SRC_REG_TYPE_TEMP &&
+			vp_src_temp(vp_src_get(add->hw, 2)) == t;
+		if (r0 == r2)
+			continue;
+		tpos = r0 ? 0 : 2;
+		cpos = r0 ? 2 : 0;
+
+		tsr = vp_src_get(add->hw, tpos);
+		if (vp_abs_get(add->hw, tpos) || (vp_src_comps(add->hw, &ainfo, tpos) & ~info.vec_mask))
+			continue;
+		if (vp_temp_live_after(insns, n, j, t, info.vec_mask & ~vp_temp_kills(&ainfo, t)))
+			continue;
+
+		c = vp_src_get(add->hw, cpos);
+		c_abs = vp_abs_get(add->hw, cpos);
+		if (!vp_operands_add_src(&ops, mul, a) || !vp_operands_add_src(&ops, mul, b) ||
+		    !vp_operands_add_src(&ops, add, c))
+			continue;
+
+		/* The ADD's negation of t goes onto a: */
+		a = vp_src_compose(a, a_abs, tsr, FALSE, &a_abs);
+		b = vp_src_compose(b, b_abs, tsr & ~NV40_VP_SRC_NEGATE, FALSE, &b_abs);
+
+		add->hw[1] = (add->hw[1] & ~NV40_VP_INST_VEC_OPCODE_MASK) |
+			(NVFX_VP_INST_VEC_OP_MAD << NV40_VP_INST_VEC_OPCODE_SHIFT);
+		vp_src_set(add->hw, 0, a);
+		vp_src_set(add->hw, 1, b);
+		vp_src_set(add->hw, 2, c);
+		vp_abs_set(add->hw, 0, a_abs);
+		vp_abs_set(add->hw, 1, b_abs);
+		vp_abs_set(add->hw, 2, c_abs);
+		vp_operands_apply(add, &ops);
+
+		mul->dead = TRUE;
+		progress = TRUE;
+	}
+	return progress;
+}
+
+static boolean
+vp_eliminate_dead(struct nvfx_vp_opt_insn *insns, unsigned n)
+{
+	unsigned live[NVFX_OPT_MAX_TEMPS];
+	boolean progress = FALSE;
+	unsigned i, pos;
+
+	memset(live, 0, sizeof(live));
+
+	for (i = n; i-- > 0;) {
+		struct nvfx_vp_opt_insn *insn = &insns[i];
+		struct nvfx_vp_opt_info info;
+
+		if (insn->dead)
+			continue;
+		vp_decode(insn->hw, &info);
+
+		if (!info.opaque && !info.result && !info.cc) {
+			unsigned needed = 0;
+
+			if (info.vec_temp >= 0)
+				needed |= live[info.vec_temp] & info.vec_mask;
+			if (info.sca_temp >= 0)
+				needed |= live[info.sca_temp] & info.sca_mask;
+			if (!needed) {
+				insn->dead = TRUE;
+				progress = TRUE;
+				continue;
+			}
+		}
+
+		if (info.vec_temp >= 0)
+			live[info.vec_temp] &= ~vp_temp_kills(&info, info.vec_temp);
+		if (info.sca_temp >= 0)
+			live[info.sca_temp] &= ~vp_temp_kills(&info, info.sca_temp);
+
+		for (pos = 0; pos < 3; ++pos) {
+			uint32_t sr = vp_src_get(insn->hw, pos);
+
+			if (vp_reads_src(&info, pos) && vp_src_type(sr) == NV40_VP_SRC_REG_TYPE_TEMP)
+				live[vp_src_temp(sr)] |= vp_src_comps(insn->hw, &info, pos);
+		}
+	}
+	return progress;
+}
+
+/* Whether a vector-only instruction that could take on a scalar op: */
+static boolean
+vp_is_vec_only(const uint32_t *hw, const struct nvfx_vp_opt_info *info)
+{
+	return !info->opaque && !info->cc && !info->cond && info->vec_op != NVFX_VP_INST_VEC_OP_NOP &&
+		!(info->vec_srcs & 0x4) && info->sca_op == NVFX_VP_INST_SCA_OP_NOP &&
+		info->sca_temp < 0 && !(hw[3] & NV40_VP_INST_SCA_RESULT);
+}
+
+static boolean
+vp_is_sca_only(const uint32_t *hw, const struct nvfx_vp_opt_info *info)
+{
+	return !info->opaque && !info->cc && !info->cond && info->sca_op != NVFX_VP_INST_SCA_OP_NOP &&
+		info->vec_op == NVFX_VP_INST_VEC_OP_NOP && info->vec_temp < 0 &&
+		!(hw[0] & NV40_VP_INST_VEC_RESULT);
+}
+
+/* Whether instruction j can be moved up to issue alongside instruction i: */
+static boolean
+vp_can_hoist(const struct nvfx_vp_opt_insn *insns, unsigned i, unsigned j)
+{
+	struct nvfx_vp_opt_info jinfo;
+	unsigned k, pos;
+
+	vp_decode(insns[j].hw, &jinfo);
+
+	for (k = i; k < j; ++k) {
+		struct nvfx_vp_opt_info kinfo;
+
+		if (insns[k].dead)
+			continue;
+		vp_decode(insns[k].hw, &kinfo);
+		if (kinfo.opaque || (kinfo.result && jinfo.result))
+			return FALSE;
+
+		for (pos = 0; pos < 3; ++pos) {
+			uint32_t sr = vp_src_get(insns[j].hw, pos);
+
+			if (vp_reads_src(&jinfo, pos) && vp_src_type(sr) == NV40_VP_SRC_REG_TYPE_TEMP &&
+			    (vp_temp_writes(&kinfo, vp_src_temp(sr)) & vp_src_comps(insns[j].hw, &jinfo, pos)))
+				return FALSE;
+		}
+		if (jinfo.vec_temp >= 0 &&
+		    ((vp_temp_reads(insns[k].hw, &kinfo, jinfo.vec_temp) |
+		      vp_temp_writes(&kinfo, jinfo.vec_temp)) & jinfo.vec_mask))
+			return FALSE;
+		if (jinfo.sca_temp >= 0 &&
+		    ((vp_temp_reads(insns[k].hw, &kinfo, jinfo.sca_temp) |
+		      vp_temp_writes(&kinfo, jinfo.sca_temp)) & jinfo.sca_mask))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+vp_coissue(struct nvfx_vp_opt_insn *insns, unsigned n)
+{
+	unsigned i, j;
+
+	for (i = 0; i < n; ++i) {
+		struct nvfx_vp_opt_info info;
+		boolean vec_only, sca_only;
+
+		if (insns[i].dead)
+			continue;
+		vp_decode(insns[i].hw, &info);
+		vec_only = vp_is_vec_only(insns[i].hw, &info);
+		sca_only = vp_is_sca_only(insns[i].hw, &info);
+		if (!vec_only && !sca_only)
+			continue;
+
+		for (j = i + 1; j < n && j <= i + NVFX_OPT_COISSUE_WINDOW; ++j) {
+			struct nvfx_vp_opt_insn *vec, *sca;
+			struct nvfx_vp_opt_info jinfo, vinfo, sinfo;
+			struct nvfx_vp_opt_operands ops = { -1, -1 };
+			uint32_t hw[4];
+
+			if (insns[j].dead)
+				continue;
+			vp_decode(insns[j].hw, &jinfo);
+			if (jinfo.opaque)
+				break;
+			if (vec_only ? !vp_is_sca_only(insns[j].hw, &jinfo) : !vp_is_vec_only(insns[j].hw, &jinfo))
+				continue;
+			if (info.result && jinfo.result)
+				continue;
+			if ((insns[i].hw[0] ^ insns[j].hw[0]) & NV40_VP_INST_SATURATE)
+				continue;
+
+			vec = vec_only ? &insns[i] : &insns[j];
+			sca = vec_only ? &insns[j] : &insns[i];
+			vinfo = vec_only ? info : jinfo;
+			sinfo = vec_only ? jinfo : info;
+			if (!vp_operands_add(&ops, vec, &vinfo, 0) || !vp_operands_add(&ops, sca, &sinfo, 0))
+				continue;
+			if (!vp_can_hoist(insns, i, j))
+				continue;
+
+			memcpy(hw, vec->hw, sizeof(hw));
+			hw[1] = (hw[1] & ~NV40_VP_INST_SCA_OPCODE_MASK) | (sca->hw[1] & NV40_VP_INST_SCA_OPCODE_MASK);
+			vp_src_set(hw, 2, vp_src_get(sca->hw, 2));
+			vp_abs_set(hw, 2, vp_abs_get(sca->hw, 2));
+			hw[3] = (hw[3] & ~(NV40_VP_INST_SCA_DEST_TEMP_MASK | NV40_VP_INST_SCA_WRITEMASK_MASK | NV40_VP_INST_SCA_RESULT)) |
+				(sca->hw[3] & (NV40_VP_INST_SCA_DEST_TEMP_MASK | NV40_VP_INST_SCA_WRITEMASK_MASK | NV40_VP_INST_SCA_RESULT));
+			if (sinfo.result)
+				hw[3] = (hw[3] & ~NV40_VP_INST_DEST_MASK) | (sca->hw[3] & NV40_VP_INST_DEST_MASK);
+
+			memcpy(insns[i].hw, hw, sizeof(hw));
+			vp_operands_apply(&insns[i], &ops);
+			insns[j].dead = TRUE;
+			break;
+		}
+	}
+}
+
+void
+nvfx_vertprog_optimize(struct nvfx_context *nvfx, struct nvfx_vertex_program *vp)
+{
+	struct nvfx_vp_opt_insn *insns;
+	unsigned n = vp->nr_insns, region = n, i, count, last;
+	boolean had_last = FALSE, progress;
+	int rounds;
+
+	if (!nvfx->is_nv4x || debug_get_option_nvfx_noopt() || !n || vp->branch_relocs.size)
+		return;
+
+	insns = MALLOC(n * sizeof(*insns));
+	if (!insns)
+		return;
+
+	for (i = 0; i < n; ++i) {
+		unsigned sca_op = (vp->insns[i].data[1] & NV40_VP_INST_SCA_OPCODE_MASK) >> NV40_VP_INST_SCA_OPCODE_SHIFT;
+
+		if (sca_op == NVFX_VP_INST_SCA_OP_BRA || sca_op == NVFX_VP_INST_SCA_OP_CAL ||
+		    sca_op == NVFX_VP_INST_SCA_OP_RET)
+			goto out;
+
+		memcpy(insns[i].hw, vp->insns[i].data, sizeof(insns[i].hw));
+		insns[i].cst = -1;
+		insns[i].dead = FALSE;
+
+		if (region == n && (insns[i].hw[3] & NVFX_VP_INST_LAST)) {
+			region = i + 1;
+			had_last = TRUE;
+		}
+	}
+
+	for (i = 0; i < vp->const_relocs.size; i += sizeof(struct nvfx_relocation)) {
+		struct nvfx_relocation *reloc = (struct nvfx_relocation *)((char *)vp->const_relocs.data + i);
+
+		if (reloc->location >= n ||
+		    (insns[reloc->location].cst >= 0 && insns[reloc->location].cst != (int)reloc->target))
+			goto out;
+		insns[reloc->location].cst = reloc->target;
+	}
+
+	/* Instructions after the end of the program are kept as they are: */
+	for (rounds = 0, progress = TRUE; progress && rounds < NVFX_OPT_MAX_ROUNDS; ++rounds) {
+		progress = vp_copy_propagate(insns, region);
+		progress |= vp_fuse_mad(insns, region);
+		progress |= vp_eliminate_dead(insns, region);
+	}
+	vp_coissue(insns, region);
+
+	/* A program has at least one instruction: */
+	for (i = 0; i < region && insns[i].dead; ++i);
+	if (i == region)
+		insns[region - 1].dead = FALSE;
+
+	util_dynarray_fini(&vp->const_relocs);
+	for (i = 0, count = 0, last = 0; i < n; ++i) {
+		if (insns[i].dead)
+			continue;
+
+		if (i < region) {
+			insns[i].hw[3] &= ~NVFX_VP_INST_LAST;
+			last = count;
+		}
+		memcpy(vp->insns[count].data, insns[i].hw, sizeof(insns[i].hw));
+
+		if (insns[i].cst >= 0) {
+			struct nvfx_relocation reloc;
+
+			reloc.location = count;
+			reloc.target = insns[i].cst;
+			util_dynarray_append(&vp->const_relocs, struct nvfx_relocation, reloc);
+		}
+		++count;
+	}
+	if (had_last)
+		vp->insns[last].data[3] |= NVFX_VP_INST_LAST;
+	vp->nr_insns = count;
+
+out:
+	FREE(insns);
+}
+
+/*
+ * Fragment programs
+ */
+
+struct nvfx_fp_opt_insn {
+	unsigned offset;	/* in the translated program */
+	uint32_t hw[4];
+	boolean has_cst;
+	uint32_t cst[4];	/* words of the constant that follows the instruction */
+	int cst_index;		/* uniform that's loaded into them, -1 for an immediate */
+	int reloc[3];		/* for each source, the input slot that's relocated into it, or -1 */
+	boolean dead;
+};
+
+struct nvfx_fp_opt_info {
+	unsigned op;
+	unsigned srcs;		/* sources read, as a mask */
+	boolean percomp;	/* only reads the components that it writes */
+	boolean opaque;		/* can't be changed, moved or removed */
+	boolean effects;	/* KIL, or updates the condition code */
+	boolean cond;		/* writes are conditional */
+	int temp;		/* full precision destination register, -1 if none */
+	int half;		/* half precision destination register, -1 if none */
+	unsigned mask;
+};
+
+static INLINE uint32_t
+fp_src_get(const uint32_t *hw, unsigned pos)
+{
+	return hw[pos + 1] & 0x3ffff;
+}
+
+static INLINE void
+fp_src_set(uint32_t *hw, unsigned pos, uint32_t sr)
+{
+	hw[pos + 1] = (hw[pos + 1] & ~0x3ffff) | sr;
+}
+
+static INLINE boolean
+fp_abs_get(const uint32_t *hw, unsigned pos)
+{
+	return (hw[1] & (NVFX_FP_OP_SRC0_ABS << pos)) ? TRUE : FALSE;
+}
+
+static INLINE void
+fp_abs_set(uint32_t *hw, unsigned pos, boolean abs)
+{
+	hw[1] &= ~(NVFX_FP_OP_SRC0_ABS << pos);
+	if (abs)
+		hw[1] |= NVFX_FP_OP_SRC0_ABS << pos;
+}
+
+static INLINE unsigned
+fp_src_type(uint32_t sr)
+{
+	return (sr & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT;
+}
+
+static INLINE unsigned
+fp_src_index(uint32_t sr)
+{
+	return (sr & NV40_FP_REG_SRC_MASK) >> NVFX_FP_REG_SRC_SHIFT;
+}
+
+static INLINE int
+fp_input(const uint32_t *hw)
+{
+	return (hw[0] & NVFX_FP_OP_INPUT_SRC_MASK) >> NVFX_FP_OP_INPUT_SRC_SHIFT;
+}
+
+static INLINE boolean
+fp_has_cst(const uint32_t *hw)
+{
+	return fp_src_type(fp_src_get(hw, 0)) == NVFX_FP_REG_TYPE_CONST ||
+		fp_src_type(fp_src_get(hw, 1)) == NVFX_FP_REG_TYPE_CONST ||
+		fp_src_type(fp_src_get(hw, 2)) == NVFX_FP_REG_TYPE_CONST;
+}
+
+/* The perspective correction bit, which applies to the instruction's input: */
+#define NVFX_FP_OPT_INPUT_BITS (1U << 31)
+
+static void
+fp_decode(const uint32_t *hw, struct nvfx_fp_opt_info *info)
+{
+	memset(info, 0, sizeof(*info));
+	info->op = (hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
+
+	switch (info->op) {
+	case NVFX_FP_OP_OPCODE_NOP:
+		break;
+	case NVFX_FP_OP_OPCODE_MOV:
+	case NVFX_FP_OP_OPCODE_FRC:
+	case NVFX_FP_OP_OPCODE_FLR:
+		info->srcs = 0x1;
+		info->percomp = TRUE;
+		break;
+	case NVFX_FP_OP_OPCODE_MUL:
+	case NVFX_FP_OP_OPCODE_ADD:
+	case NVFX_FP_OP_OPCODE_MIN:
+	case NVFX_FP_OP_OPCODE_MAX:
+	case NVFX_FP_OP_OPCODE_SLT:
+	case NVFX_FP_OP_OPCODE_SGE:
+	case NVFX_FP_OP_OPCODE_SLE:
+	case NVFX_FP_OP_OPCODE_SGT:
+	case NVFX_FP_OP_OPCODE_SNE:
+	case NVFX_FP_OP_OPCODE_SEQ:
+		info->srcs = 0x3;
+		info->percomp = TRUE;
+		break;
+	case NVFX_FP_OP_OPCODE_MAD:
+		info->srcs = 0x7;
+		info->percomp = TRUE;
+		break;
+	case NVFX_FP_OP_OPCODE_DP3:
+	case NVFX_FP_OP_OPCODE_DP4:
+	case NVFX_FP_OP_OPCODE_DST:
+		info->srcs = 0x3;
+		break;
+	case NVFX_FP_OP_OPCODE_RCP:
+	case NVFX_FP_OP_OPCODE_EX2:
+	case NVFX_FP_OP_OPCODE_LG2:
+	case NVFX_FP_OP_OPCODE_COS:
+	case NVFX_FP_OP_OPCODE_SIN:
+	case NVFX_FP_OP_OPCODE_TEX:
+	case NVFX_FP_OP_OPCODE_TXP:
+	case NVFX_FP_OP_OPCODE_TXB:
+	case NVFX_FP_OP_OPCODE_TXL_NV40:
+		info->srcs = 0x1;
+		break;
+	case NVFX_FP_OP_OPCODE_KIL:
+		info->effects = TRUE;
+		break;
+	default:
+		info->opaque = TRUE;
+		break;
+	}
+
+	if ((hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH) || (hw[3] & NVFX_FP_OP_INDEX_INPUT))
+		info->opaque = TRUE;
+	if (hw[0] & NVFX_FP_OP_COND_WRITE_ENABLE)
+		info->effects = TRUE;
+	info->cond = ((hw[1] & NVFX_FP_OP_COND_MASK) >> NVFX_FP_OP_COND_SHIFT) != NVFX_FP_OP_COND_TR;
+
+	info->temp = info->half = -1;
+	if (!(hw[0] & NV40_FP_OP_OUT_NONE)) {
+		unsigned reg = (hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT;
+
+		if (hw[0] & NVFX_FP_OP_OUT_REG_HALF)
+			info->half = reg;
+		else
+			info->temp = reg;
+	}
+	info->mask = (hw[0] & NVFX_FP_OP_OUTMASK_MASK) >> NVFX_FP_OP_OUTMASK_SHIFT;
+}
+
+static INLINE boolean
+fp_reads_src(const struct nvfx_fp_opt_info *info, unsigned pos)
+{
+	return info->opaque || (info->srcs & (1 << pos));
+}
+
+/* The register that a source reads, as a full precision temp; -1 if it isn't one. Half
+ * registers are halves of the full precision ones. A relocated input may turn out to be read
+ * from a temp:
+ */
+static INLINE int
+fp_src_temp(const struct nvfx_fp_opt_insn *insn, unsigned pos)
+{
+	uint32_t sr = fp_src_get(insn->hw, pos);
+
+	if (fp_src_type(sr) != NVFX_FP_REG_TYPE_TEMP)
+		return -1;
+	if (sr & NVFX_FP_REG_SRC_HALF)
+		return fp_src_index(sr) >> 1;
+	return fp_src_index(sr);
+}
+
+static unsigned
+fp_src_comps(const struct nvfx_fp_opt_insn *insn, const struct nvfx_fp_opt_info *info, unsigned pos)
+{
+	uint32_t sr = fp_src_get(insn->hw, pos);
+
+	if (info->opaque || !info->percomp || insn->reloc[pos] >= 0 || (sr & NVFX_FP_REG_SRC_HALF))
+		return NVFX_OPT_ALL;
+	return swz_comps(sr, fp_swz_shift, info->mask);
+}
+
+static unsigned
+fp_temp_reads(const struct nvfx_fp_opt_insn *insn, const struct nvfx_fp_opt_info *info, int t)
+{
+	unsigned pos, comps = 0;
+
+	for (pos = 0; pos < 3; ++pos) {
+		if (fp_reads_src(info, pos) && fp_src_temp(insn, pos) == t)
+			comps |= fp_src_comps(insn, info, pos);
+	}
+	return comps;
+}
+
+static unsigned
+fp_temp_writes(const struct nvfx_fp_opt_info *info, int t)
+{
+	if (info->half >= 0 && (info->half >> 1) == t)
+		return NVFX_OPT_ALL;
+	if (info->temp == t)
+		return info->opaque ? NVFX_OPT_ALL : info->mask;
+	return 0;
+}
+
+static INLINE unsigned
+fp_temp_kills(const struct nvfx_fp_opt_info *info, int t)
+{
+	return (info->opaque || info->cond || info->temp != t) ? 0 : info->mask;
+}
+
+/* Inputs are identified by their index, or by their slot if they're relocated: */
+static INLINE int
+fp_input_key(const struct nvfx_fp_opt_insn *insn, unsigned pos)
+{
+	return insn->reloc[pos] >= 0 ? 0x100 | insn->reloc[pos] : fp_input(insn->hw);
+}
+
+/* Constants are identified by the instruction that holds them; two instructions hold the same
+ * one if they load the same uniform, or the same immediate:
+ */
+struct nvfx_fp_opt_operands {
+	int input;
+	const struct nvfx_fp_opt_insn *cst;
+};
+
+static boolean
+fp_operands_add_src(struct nvfx_fp_opt_operands *ops, const struct nvfx_fp_opt_insn *from, unsigned pos)
+{
+	uint32_t sr = fp_src_get(from->hw, pos);
+
+	if (from->reloc[pos] >= 0 || fp_src_type(sr) == NVFX_FP_REG_TYPE_INPUT) {
+		if (ops->input >= 0 && ops->input != fp_input_key(from, pos))
+			return FALSE;
+		ops->input = fp_input_key(from, pos);
+	} else if (fp_src_type(sr) == NVFX_FP_REG_TYPE_CONST) {
+		if (ops->cst && ops->cst != from &&
+		    (ops->cst->cst_index != from->cst_index ||
+		     (from->cst_index < 0 && memcmp(ops->cst->cst, from->cst, sizeof(from->cst)))))
+			return FALSE;
+		ops->cst = from;
+	}
+	return TRUE;
+}
+
+/* Adds the inputs & constants that an instruction's sources read, other than those in skip: */
+static boolean
+fp_operands_add(struct nvfx_fp_opt_operands *ops, const struct nvfx_fp_opt_insn *insn,
+		const struct nvfx_fp_opt_info *info, unsigned skip)
+{
+	unsigned pos;
+
+	for (pos = 0; pos < 3; ++pos) {
+		if (!fp_reads_src(info, pos) || (skip & (1 << pos)))
+			continue;
+		if (!fp_operands_add_src(ops, insn, pos))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Moves a source from one instruction into another; the caller has checked that the
+ * result can be encoded:
+ */
+static void
+fp_src_move(struct nvfx_fp_opt_insn *to, unsigned pos, const struct nvfx_fp_opt_insn *from,
+	    unsigned from_pos, uint32_t sr)
+{
+	fp_src_set(to->hw, pos, sr);
+	to->reloc[pos] = from->reloc[from_pos];
+
+	if (from->reloc[from_pos] < 0 && fp_src_type(sr) == NVFX_FP_REG_TYPE_INPUT) {
+		to->hw[0] = (to->hw[0] & ~NVFX_FP_OP_INPUT_SRC_MASK) | (from->hw[0] & NVFX_FP_OP_INPUT_SRC_MASK);
+	} else if (fp_src_type(sr) == NVFX_FP_REG_TYPE_CONST && to != from) {
+		to->has_cst = TRUE;
+		memcpy(to->cst, from->cst, sizeof(to->cst));
+		to->cst_index = from->cst_index;
+	}
+}
+
+static INLINE boolean
+fp_reads_input(const struct nvfx_fp_opt_insn *insn, unsigned pos)
+{
+	return insn->reloc[pos] >= 0 || fp_src_type(fp_src_get(insn->hw, pos)) == NVFX_FP_REG_TYPE_INPUT;
+}
+
+static uint32_t
+fp_src_compose(uint32_t sr, boolean sr_abs, uint32_t use, boolean use_abs, boolean *abs)
+{
+	uint32_t result = swz_compose(sr, use, fp_swz_shift) & ~NVFX_FP_REG_NEGATE;
+	boolean neg;
+
+	mod_compose((sr & NVFX_FP_REG_NEGATE) ? TRUE : FALSE, sr_abs,
+		    (use & NVFX_FP_REG_NEGATE) ? TRUE : FALSE, use_abs, &neg, abs);
+	if (neg)
+		result |= NVFX_FP_REG_NEGATE;
+	return result;
+}
+
+/* Whether an unconditional, unsaturated & unscaled fp32 op that writes a full precision
+ * register:
+ */
+static boolean
+fp_is_plain(const uint32_t *hw, const struct nvfx_fp_opt_info *info, unsigned op)
+{
+	return !info->opaque && info->op == op && !info->effects && !info->cond && info->temp >= 0 &&
+		!(hw[0] & (NVFX_FP_OP_OUT_SAT | NVFX_FP_OP_PRECISION_MASK)) &&
+		!(hw[2] & (7 << NVFX_FP_OP_DST_SCALE_SHIFT));
+}
+
+static boolean
+fp_temp_live_after(const struct nvfx_fp_opt_insn *insns, unsigned n, unsigned i, int t, unsigned comps)
+{
+	unsigned j;
+
+	for (j = i + 1; j < n && comps; ++j) {
+		struct nvfx_fp_opt_info info;
+
+		if (insns[j].dead)
+			continue;
+		fp_decode(insns[j].hw, &info);
+		if (fp_temp_reads(&insns[j], &info, t) & comps)
+			return TRUE;
+		comps &= ~fp_temp_kills(&info, t);
+	}
+	return comps && t < NVFX_OPT_FP_OUTPUTS;
+}
+
+/* Rewrites reads of a MOV's destination to read its source instead. Returns FALSE if a read
+ * couldn't be rewritten, so that the MOV is still needed:
+ */
+static boolean
+fp_propagate_mov(struct nvfx_fp_opt_insn *insns, unsigned n, unsigned i, boolean apply, boolean *progress)
+{
+	const struct nvfx_fp_opt_insn *mov = &insns[i];
+	struct nvfx_fp_opt_info info;
+	uint32_t sr = fp_src_get(mov->hw, 0);
+	boolean sr_abs = fp_abs_get(mov->hw, 0), complete = TRUE;
+	int t, s;
+	unsigned j, pos;
+
+	fp_decode(mov->hw, &info);
+	t = info.temp;
+	s = fp_src_temp(mov, 0);
+
+	for (j = i + 1; j < n; ++j) {
+		struct nvfx_fp_opt_insn *use = &insns[j];
+		struct nvfx_fp_opt_info uinfo;
+
+		if (use->dead)
+			continue;
+		fp_decode(use->hw, &uinfo);
+
+		for (pos = 0; pos < 3; ++pos) {
+			uint32_t usr = fp_src_get(use->hw, pos);
+			struct nvfx_fp_opt_operands ops = { -1, NULL };
+			boolean abs;
+
+			if (!fp_reads_src(&uinfo, pos) || fp_src_temp(use, pos) != t)
+				continue;
+			if (uinfo.opaque || use->reloc[pos] >= 0 || (usr & NVFX_FP_REG_SRC_HALF) ||
+			    (fp_src_comps(use, &uinfo, pos) & ~info.mask) ||
+			    !fp_operands_add(&ops, use, &uinfo, 1 << pos) ||
+			    !fp_operands_add_src(&ops, mov, 0) ||
+			    (fp_reads_input(mov, 0) && ((mov->hw[3] ^ use->hw[3]) & NVFX_FP_OPT_INPUT_BITS))) {
+				complete = FALSE;
+				continue;
+			}
+			if (!apply)
+				continue;
+
+			fp_src_move(use, pos, mov, 0, fp_src_compose(sr, sr_abs, usr, fp_abs_get(use->hw, pos), &abs));
+			fp_abs_set(use->hw, pos, abs);
+			*progress = TRUE;
+		}
+
+		if (fp_temp_writes(&uinfo, t) || (s >= 0 && fp_temp_writes(&uinfo, s))) {
+			if (fp_temp_live_after(insns, n, j, t, info.mask & ~fp_temp_kills(&uinfo, t)))
+				complete = FALSE;
+			return complete;
+		}
+	}
+	return complete && t >= NVFX_OPT_FP_OUTPUTS;
+}
+
+static boolean
+fp_copy_propagate(struct nvfx_fp_opt_insn *insns, unsigned n)
+{
+	boolean progress = FALSE;
+	unsigned i;
+
+	for (i = 0; i < n; ++i) {
+		struct nvfx_fp_opt_insn *mov = &insns[i];
+		struct nvfx_fp_opt_info info;
+		uint32_t sr;
+
+		if (mov->dead)
+			continue;
+		fp_decode(mov->hw, &info);
+		if (!fp_is_plain(mov->hw, &info, NVFX_FP_OP_OPCODE_MOV))
+			continue;
+
+		sr = fp_src_get(mov->hw, 0);
+		if ((sr & NVFX_FP_REG_SRC_HALF) || fp_src_temp(mov, 0) == info.temp)
+			continue;
+
+		/* Every copy of a constant makes the program longer, and uniform updates slower,
+		 * so they're only worthwhile if the MOV goes away:
+		 */
+		if (fp_src_type(sr) == NVFX_FP_REG_TYPE_CONST && !fp_propagate_mov(insns, n, i, FALSE, &progress))
+			continue;
+		fp_propagate_mov(insns, n, i, TRUE, &progress);
+	}
+	return progress;
+}
+
+static boolean
+fp_fuse_mad(struct nvfx_fp_opt_insn *insns, unsigned n)
+{
+	boolean progress = FALSE;
+	unsigned i, j;
+
+	for (i = 0; i < n; ++i) {
+		struct nvfx_fp_opt_insn *mul = &insns[i], *add;
+		struct nvfx_fp_opt_info info, ainfo;
+		struct nvfx_fp_opt_operands ops = { -1, NULL };
+		uint32_t a, b, c, tsr;
+		boolean a_abs, b_abs, c_abs;
+		int t, at, bt;
+		unsigned tpos, cpos;
+		boolean r0, r1;
+
+		if (mul->dead)
+			continue;
+		fp_decode(mul->hw, &info);
+		if (!fp_is_plain(mul->hw, &info, NVFX_FP_OP_OPCODE_MUL))
+			continue;
+
+		t = info.temp;
+		at = fp_src_temp(mul, 0);
+		bt = fp_src_temp(mul, 1);
+		if (at == t || bt == t)
+			continue;
+
+		for (j = i + 1; j < n; ++j) {
+			struct nvfx_fp_opt_info uinfo;
+
+			if (insns[j].dead)
+				continue;
+			fp_decode(insns[j].hw, &uinfo);
+			if (fp_temp_reads(&insns[j], &uinfo, t))
+				break;
+			if (fp_temp_writes(&uinfo, t) || (at >= 0 && fp_temp_writes(&uinfo, at)) ||
+			    (bt >= 0 && fp_temp_writes(&uinfo, bt))) {
+				j = n;
+				break;
+			}
+		}
+		if (j >= n)
+			continue;
+
+		add = &insns[j];
+		fp_decode(add->hw, &ainfo);
+		if (ainfo.opaque || ainfo.op != NVFX_FP_OP_OPCODE_ADD || (add->hw[0] & NVFX_FP_OP_PRECISION_MASK))
+			continue;
+
+		r0 = add->reloc[0] < 0 && fp_src_temp(add, 0) == t;
+		r1 = add->reloc[1] < 0 && fp_src_temp(add, 1) == t;
+		if (r0 == r1)
+			continue;
+		tpos = r0 ? 0 : 1;
+		cpos = r0 ? 1 : 0;
+
+		tsr = fp_src_get(add->hw, tpos);
+		if ((tsr & NVFX_FP_REG_SRC_HALF) || fp_abs_get(add->hw, tpos) ||
+		    (fp_src_comps(add, &ainfo, tpos) & ~info.mask))
+			continue;
+		if (fp_temp_live_after(insns, n, j, t, info.mask & ~fp_temp_kills(&ainfo, t)))
+			continue;
+
+		if (!fp_operands_add_src(&ops, mul, 0) || !fp_operands_add_src(&ops, mul, 1) ||
+		    !fp_operands_add_src(&ops, add, cpos))
+			continue;
+		if ((fp_reads_input(mul, 0) || fp_reads_input(mul, 1)) &&
+		    ((mul->hw[3] ^ add->hw[3]) & NVFX_FP_OPT_INPUT_BITS))
+			continue;
+
+		a = fp_src_get(mul->hw, 0);
+		b = fp_src_get(mul->hw, 1);
+		c = fp_src_get(add->hw, cpos);
+		a_abs = fp_abs_get(mul->hw, 0);
+		b_abs = fp_abs_get(mul->hw, 1);
+		c_abs = fp_abs_get(add->hw, cpos);
+
+		/* The ADD's negation of t goes onto a: */
+		a = fp_src_compose(a, a_abs, tsr, FALSE, &a_abs);
+		b = fp_src_compose(b, b_abs, tsr & ~NVFX_FP_REG_NEGATE, FALSE, &b_abs);
+
+		add->hw[0] = (add->hw[0] & ~NVFX_FP_OP_OPCODE_MASK) | (NVFX_FP_OP_OPCODE_MAD << NVFX_FP_OP_OPCODE_SHIFT);
+		fp_src_move(add, 2, add, cpos, c);
+		fp_src_move(add, 0, mul, 0, a);
+		fp_src_move(add, 1, mul, 1, b);
+		fp_abs_set(add->hw, 0, a_abs);
+		fp_abs_set(add->hw, 1, b_abs);
+		fp_abs_set(add->hw, 2, c_abs);
+
+		mul->dead = TRUE;
+		progress = TRUE;
+	}
+	return progress;
+}
+
+static boolean
+fp_eliminate_dead(struct nvfx_fp_opt_insn *insns, unsigned n)
+{
+	unsigned live[NVFX_OPT_MAX_TEMPS];
+	boolean progress = FALSE;
+	unsigned i, pos;
+
+	memset(live, 0, sizeof(live));
+	for (i = 0; i < NVFX_OPT_FP_OUTPUTS; ++i)
+		live[i] = NVFX_OPT_ALL;
+
+	for (i = n; i-- > 0;) {
+		struct nvfx_fp_opt_insn *insn = &insns[i];
+		struct nvfx_fp_opt_info info;
+
+		if (insn->dead)
+			continue;
+		fp_decode(insn->hw, &info);
+
+		if (!info.opaque && !info.effects && info.half < 0 &&
+		    (info.temp < 0 || !(live[info.temp] & info.mask))) {
+			insn->dead = TRUE;
+			progress = TRUE;
+			continue;
+		}
+
+		if (info.temp >= 0)
+			live[info.temp] &= ~fp_temp_kills(&info, info.temp);
+
+		for (pos = 0; pos < 3; ++pos) {
+			int t;
+
+			if (!fp_reads_src(&info, pos))
+				continue;
+			t = fp_src_temp(insn, pos);
+			if (t >= 0)
+				live[t] |= fp_src_comps(insn, &info, pos);
+		}
+	}
+	return progress;
+}
+
+/* A value held by a temp, from the instruction that starts it to the last one that reads it.
+ * Positions are counted in half-instructions, so that a value that's read by an instruction
+ * and one that's written by it can share a register:
+ */
+struct nvfx_fp_opt_range {
+	unsigned temp;
+	unsigned start;		/* 2i + 1 for the write by instruction i */
+	unsigned end;		/* 2i for a read by instruction i */
+	int reg;
+};
+
+/* Temps that keep their register: outputs, halves of registers that are accessed as half
+ * precision, those that relocated inputs may be read from, and any used by an instruction
+ * that isn't understood:
+ */
+static uint64_t
+fp_fixed_temps(const struct nvfx_fp_opt_insn *insns, unsigned n)
+{
+	uint64_t fixed = (1ULL << NVFX_OPT_FP_OUTPUTS) - 1;
+	unsigned i, pos;
+
+	for (i = 0; i < n; ++i) {
+		const struct nvfx_fp_opt_insn *insn = &insns[i];
+		struct nvfx_fp_opt_info info;
+
+		if (insn->dead)
+			continue;
+		fp_decode(insn->hw, &info);
+
+		if (info.half >= 0)
+			fixed |= 1ULL << (info.half >> 1);
+		if (info.opaque && info.temp >= 0)
+			fixed |= 1ULL << info.temp;
+		for (pos = 0; pos < 3; ++pos) {
+			int t = fp_src_temp(insn, pos);
+
+			if (t >= 0 && (info.opaque || insn->reloc[pos] >= 0 ||
+				       (fp_src_get(insn->hw, pos) & NVFX_FP_REG_SRC_HALF)))
+				fixed |= 1ULL << t;
+		}
+	}
+	return fixed;
+}
+
+/* Walks the program, finding the live ranges of temps that aren't fixed. If ranges is
+ * NULL, the instructions are rewritten to use the registers that were assigned to them:
+ */
+static boolean
+fp_walk_ranges(struct nvfx_fp_opt_insn *insns, unsigned n, unsigned (*live)[NVFX_OPT_MAX_TEMPS],
+	       uint64_t fixed, struct nvfx_fp_opt_range *ranges, unsigned *nr_ranges,
+	       const struct nvfx_fp_opt_range *assigned)
+{
+	int cur[NVFX_OPT_MAX_TEMPS];
+	unsigned i, pos, t, nr = 0;
+
+	for (t = 0; t < NVFX_OPT_MAX_TEMPS; ++t)
+		cur[t] = -1;
+
+	for (i = 0; i < n; ++i) {
+		struct nvfx_fp_opt_insn *insn = &insns[i];
+		struct nvfx_fp_opt_info info;
+
+		if (insn->dead)
+			continue;
+		fp_decode(insn->hw, &info);
+
+		for (pos = 0; pos < 3; ++pos) {
+			int s = fp_src_temp(insn, pos);
+
+			if (!fp_reads_src(&info, pos) || s < 0 || (fixed & (1ULL << s)))
+				continue;
+			if (cur[s] < 0)
+				return FALSE;
+			if (ranges)
+				ranges[cur[s]].end = 2 * i;
+			else
+				fp_src_set(insn->hw, pos, (fp_src_get(insn->hw, pos) & ~NV40_FP_REG_SRC_MASK) |
+					   (assigned[cur[s]].reg << NVFX_FP_REG_SRC_SHIFT));
+		}
+
+		if (info.temp < 0 || (fixed & (1ULL << info.temp)))
+			continue;
+		t = info.temp;
+
+		/* A new value begins unless some of the old one is read afterwards: */
+		if (cur[t] < 0 || !(live[i + 1][t] & ~fp_temp_kills(&info, t))) {
+			if (ranges) {
+				ranges[nr].temp = t;
+				ranges[nr].start = ranges[nr].end = 2 * i + 1;
+				ranges[nr].reg = -1;
+			}
+			cur[t] = nr++;
+		} else if (ranges) {
+			ranges[cur[t]].end = 2 * i + 1;
+		}
+
+		if (!ranges)
+			insn->hw[0] = (insn->hw[0] & ~NV40_FP_OP_OUT_REG_MASK) |
+				(assigned[cur[t]].reg << NVFX_FP_OP_OUT_REG_SHIFT);
+	}
+
+	if (ranges)
+		*nr_ranges = nr;
+	return TRUE;
+}
+
+/* Gives each live range the lowest register that's free for all of it. Ranges are found in
+ * the order that they start, so this packs them as tightly as the program allows:
+ */
+static void
+fp_allocate_registers(struct nvfx_fp_opt_insn *insns, unsigned n)
+{
+	unsigned (*live)[NVFX_OPT_MAX_TEMPS] = NULL;
+	struct nvfx_fp_opt_range *ranges = NULL;
+	unsigned busy[NVFX_OPT_MAX_TEMPS];
+	uint64_t fixed;
+	unsigned nr_ranges, i, t, pos, r;
+
+	live = MALLOC((n + 1) * sizeof(*live));
+	ranges = MALLOC(n * sizeof(*ranges));
+	if (!live || !ranges)
+		goto out;
+
+	/* live[i] is what's live before instruction i: */
+	memset(live[n], 0, sizeof(live[n]));
+	for (t = 0; t < NVFX_OPT_FP_OUTPUTS; ++t)
+		live[n][t] = NVFX_OPT_ALL;
+	for (i = n; i-- > 0;) {
+		struct nvfx_fp_opt_info info;
+
+		memcpy(live[i], live[i + 1], sizeof(live[i]));
+		if (insns[i].dead)
+			continue;
+		fp_decode(insns[i].hw, &info);
+
+		if (info.temp >= 0)
+			live[i][info.temp] &= ~fp_temp_kills(&info, info.temp);
+		for (pos = 0; pos < 3; ++pos) {
+			int s = fp_src_temp(&insns[i], pos);
+
+			if (fp_reads_src(&info, pos) && s >= 0)
+				live[i][s] |= fp_src_comps(&insns[i], &info, pos);
+		}
+	}
+
+	/* Temps that are read before they're written keep their registers too: */
+	fixed = fp_fixed_temps(insns, n);
+	for (t = 0; t < NVFX_OPT_MAX_TEMPS; ++t) {
+		if (live[0][t])
+			fixed |= 1ULL << t;
+	}
+
+	if (!fp_walk_ranges(insns, n, live, fixed, ranges, &nr_ranges, NULL))
+		goto out;
+
+	memset(busy, 0, sizeof(busy));
+	for (i = 0; i < nr_ranges; ++i) {
+		for (r = 0; r < NVFX_OPT_MAX_TEMPS; ++r) {
+			if (!(fixed & (1ULL << r)) && busy[r] <= ranges[i].start)
+				break;
+		}
+		assert(r < NVFX_OPT_MAX_TEMPS);
+		ranges[i].reg = r;
+		busy[r] = ranges[i].end + 1;
+	}
+
+	fp_walk_ranges(insns, n, live, fixed, NULL, NULL, ranges);
+
+out:
+	FREE(ranges);
+	FREE(live);
+}
+
+/* Number of full precision registers that a program writes, for fp_control; like the
+ * translator, R0 & R1 are always counted:
+ */
+static unsigned
+fp_count_registers(const struct nvfx_fp_opt_insn *insns, unsigned n)
+{
+	unsigned i, count = 2;
+
+	for (i = 0; i < n; ++i) {
+		struct nvfx_fp_opt_info info;
+
+		if (insns[i].dead)
+			continue;
+		fp_decode(insns[i].hw, &info);
+
+		if (info.temp >= 0)
+			count = MAX2(count, (unsigned)info.temp + 1);
+		if (info.half >= 0)
+			count = MAX2(count, (unsigned)(info.half >> 1) + 1);
+	}
+	return count;
+}
+
+void
+nvfx_fragprog_optimize(struct nvfx_context *nvfx, struct nvfx_fragment_program *fp)
+{
+	struct nvfx_fp_opt_insn *insns = NULL;
+	int *word_insn = NULL;
+	uint32_t *words = NULL;
+	struct nvfx_fragment_program_data *consts = NULL;
+	unsigned n = 0, region, len, nr_consts, i, s, last, regs;
+	boolean progress;
+	int off, rounds;
+
+	if (!nvfx->is_nv4x || debug_get_option_nvfx_noopt() || !fp->insn_len)
+		return;
+
+	insns = MALLOC((fp->insn_len / 4) * sizeof(*insns));
+	word_insn = MALLOC(fp->insn_len * sizeof(*word_insn));
+	if (!insns || !word_insn)
+		goto out;
+
+	for (off = 0; off < fp->insn_len; ++n) {
+		const uint32_t *hw = &fp->insn[off];
+		struct nvfx_fp_opt_insn *insn = &insns[n];
+		unsigned size;
+
+		if (off + 4 > fp->insn_len || (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH))
+			goto out;
+
+		insn->offset = off;
+		memcpy(insn->hw, hw, sizeof(insn->hw));
+		insn->has_cst = fp_has_cst(hw);
+		insn->cst_index = -1;
+		insn->reloc[0] = insn->reloc[1] = insn->reloc[2] = -1;
+		insn->dead = FALSE;
+
+		size = insn->has_cst ? 8 : 4;
+		if (off + size > fp->insn_len)
+			goto out;
+		if (insn->has_cst)
+			memcpy(insn->cst, hw + 4, sizeof(insn->cst));
+
+		for (i = 0; i < size; ++i)
+			word_insn[off + i] = n;
+		off += size;
+	}
+
+	for (i = 0; i < fp->nr_consts; ++i) {
+		unsigned offset = fp->consts[i].offset;
+		struct nvfx_fp_opt_insn *insn;
+
+		if (offset >= fp->insn_len)
+			goto out;
+		insn = &insns[word_insn[offset]];
+		if (!insn->has_cst || offset != insn->offset + 4 ||
+		    (insn->cst_index >= 0 && insn->cst_index != (int)fp->consts[i].index))
+			goto out;
+		insn->cst_index = fp->consts[i].index;
+	}
+
+	for (s = 0; s < Elements(fp->slot_relocations); ++s) {
+		const unsigned *p = (const unsigned *)fp->slot_relocations[s].data;
+		const unsigned *end = (const unsigned *)((const char *)fp->slot_relocations[s].data + fp->slot_relocations[s].size);
+
+		for (; p != end; ++p) {
+			struct nvfx_fp_opt_insn *insn;
+			unsigned pos;
+
+			if (*p >= fp->insn_len)
+				goto out;
+			insn = &insns[word_insn[*p]];
+			pos = *p - insn->offset - 1;
+			if (pos >= 3 || (insn->reloc[pos] >= 0 && insn->reloc[pos] != (int)s))
+				goto out;
+			insn->reloc[pos] = s;
+		}
+	}
+
+	for (region = 0; region < n && !(insns[region].hw[0] & NVFX_FP_OP_PROGRAM_END); ++region);
+	region = (region < n) ? region + 1 : n;
+
+	/* Instructions after the end of the program are kept as they are: */
+	for (rounds = 0, progress = TRUE; progress && rounds < NVFX_OPT_MAX_ROUNDS; ++rounds) {
+		progress = fp_copy_propagate(insns, region);
+		progress |= fp_fuse_mad(insns, region);
+		progress |= fp_eliminate_dead(insns, region);
+	}
+
+	for (i = 0; i < region && insns[i].dead; ++i);
+	if (i == region)
+		insns[region - 1].dead = FALSE;
+
+	fp_allocate_registers(insns, region);
+	regs = fp_count_registers(insns, n);
+	if (debug_get_option_nvfx_dump_fp_regs())
+		debug_printf("nvfx: fragment program uses %u registers, %u before optimization\n", regs,
+			     (fp->fp_control & NV40_3D_FP_CONTROL_TEMP_COUNT__MASK) >> NV40_3D_FP_CONTROL_TEMP_COUNT__SHIFT);
+
+	for (i = 0, len = 0, nr_consts = 0; i < n; ++i) {
+		if (insns[i].dead)
+			continue;
+		len += fp_has_cst(insns[i].hw) ? 8 : 4;
+		if (fp_has_cst(insns[i].hw) && insns[i].cst_index >= 0)
+			++nr_consts;
+	}
+
+	words = MALLOC(len * sizeof(*words));
+	if (nr_consts)
+		consts = MALLOC(nr_consts * sizeof(*consts));
+	if (!words || (nr_consts && !consts))
+		goto out;
+
+	for (s = 0; s < Elements(fp->slot_relocations); ++s)
+		fp->slot_relocations[s].size = 0;
+
+	for (i = 0, off = 0, nr_consts = 0, last = 0; i < n; ++i) {
+		struct nvfx_fp_opt_insn *insn = &insns[i];
+		unsigned pos;
+
+		if (insn->dead)
+			continue;
+
+		if (i < region) {
+			insn->hw[0] &= ~NVFX_FP_OP_PROGRAM_END;
+			last = off;
+		}
+		memcpy(&words[off], insn->hw, sizeof(insn->hw));
+
+		for (pos = 0; pos < 3; ++pos) {
+			if (insn->reloc[pos] >= 0)
+				util_dynarray_append(&fp->slot_relocations[insn->reloc[pos]], unsigned, off + pos + 1);
+		}
+
+		if (fp_has_cst(insn->hw)) {
+			assert(insn->has_cst);
+			memcpy(&words[off + 4], insn->cst, sizeof(insn->cst));
+			if (insn->cst_index >= 0) {
+				consts[nr_consts].offset = off + 4;
+				consts[nr_consts].index = insn->cst_index;
+				++nr_consts;
+			}
+			off += 8;
+		} else {
+			off += 4;
+		}
+	}
+	words[last] |= NVFX_FP_OP_PROGRAM_END;
+
+	fp->insn = realloc(fp->insn, len * sizeof(uint32_t));
+	memcpy(fp->insn, words, len * sizeof(uint32_t));
+	fp->insn_len = len;
+
+	if (nr_consts) {
+		fp->consts = realloc(fp->consts, nr_consts * sizeof(*consts));
+		memcpy(fp->consts, consts, nr_consts * sizeof(*consts));
+	} else {
+		free(fp->consts);
+		fp->consts = NULL;
+	}
+	fp->nr_consts = nr_consts;
+
+	fp->fp_control = (fp->fp_control & ~NV40_3D_FP_CONTROL_TEMP_COUNT__MASK) |
+		(regs << NV40_3D_FP_CONTROL_TEMP_COUNT__SHIFT);
+
+out:
+	FREE(consts);
+	FREE(words);
+	FREE(word_insn);
+	FREE(insns);
+}
@@ -457,13 +457,13 @@ nvfx_insn(boolean sat, unsigned op, int unit, struct nvfx_reg dst, unsigned mask
 		.op = op,
 		.scale = 0,
 		.unit = unit,
-		.sat = sat,
 		.mask = mask,
+		.cc_swz = { 0, 1, 2, 3 },
+		.sat = sat,
 		.cc_update = 0,
 		.cc_update_reg = 0,
 		.cc_test = NVFX_COND_TR,
 		.cc_test_reg = 0,
-		.cc_swz = { 0, 1, 2, 3 },
 		.dst = dst,
 		.src = {s0, s1, s2}
 	};
@@ -485,10 +485,10 @@ nvfx_src(struct nvfx_reg reg)
 {
 	struct nvfx_src temp = {
 		.reg = reg,
-		.abs = 0,
+		.indirect = 0,
 		.negate = 0,
+		.abs = 0,
 		.swz = { 0, 1, 2, 3 },
-		.indirect = 0,
 	};
 	return temp;
 }
@@ -1131,6 +1131,8 @@ nvfx_vertprog_translate(struct nvfx_context *nvfx, const struct pipe_shader_stat
 		}
 	}
 
+	nvfx_vertprog_optimize(nvfx, vp);
+
 	if(debug_get_option_nvfx_dump_vp())
 	{
 		debug_printf("\n");
@@ -1,5 +1,9 @@
 /*
  * rsxgltest - framebuffer object demo. A cube within a cube, maaaaaaan!
+ *
+ * The inner cube is copied out of the framebuffer every frame, into a texture with the
+ * framebuffer's format, and into a GL_RGB5 one (which the RSX converts to as it copies); the
+ * outer cube takes turns between them. Reports how long each copy takes the CPU.
  */
 
 #define GL3_PROTOTYPES
@@ -17,6 +21,7 @@
 #include <io/pad.h>
 
 #include <math.h>
+#include <sys/time.h>
 #include <Eigen/Geometry>
 
 #include "texture.h"
@@ -58,7 +63,8 @@ GLuint vao = 0;
 GLuint buffers[2] = { 0,0 };
 
 Image image;
-GLuint textures[2] = { 0,0 };
+// 0: the image asset, 1: the framebuffer's format, 2: R5G6B5
+GLuint textures[3] = { 0,0,0 };
 GLuint program = 0;
 
 GLint ProjMatrix_location = -1, TransMatrix_location = -1, NormalMatrix_location = -1,
@@ -337,7 +343,7 @@ rsxgltest_init(int argc,const char ** argv)
   image = loadPng(nagel_bin);
   tcp_printf("image size: %u %u\n",image.width,image.height);
 
-  glGenTextures(2,textures);
+  glGenTextures(3,textures);
 
   // image asset:
   glBindTexture(GL_TEXTURE_2D,textures[0]);
@@ -356,6 +362,12 @@ rsxgltest_init(int argc,const char ** argv)
   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
 
+  // converted rendering surface, specified by glCopyTexImage2D:
+  glBindTexture(GL_TEXTURE_2D,textures[2]);
+
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+
   glBindTexture(GL_TEXTURE_2D,0);
 }
 
@@ -416,17 +428,28 @@ rsxgltest_draw()
     glDrawElements(GL_TRIANGLES,36,GL_UNSIGNED_INT,0 /*client_indices*/);
   }
 
+  struct timeval t[3];
+
+  gettimeofday(&t[0],0);
   glBindTexture(GL_TEXTURE_2D,textures[1]);
   //glCopyTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,0,0,image.width,image.height,0);
   glCopyTexSubImage2D(GL_TEXTURE_2D,0,0,0,0,0,image.width,image.height);
 
+  // Only the first frame's copy respecifies the texture:
+  gettimeofday(&t[1],0);
+  glBindTexture(GL_TEXTURE_2D,textures[2]);
+  glCopyTexImage2D(GL_TEXTURE_2D,0,GL_RGB5,0,0,image.width,image.height,0);
+  gettimeofday(&t[2],0);
+
+  tcp_printf("copy: %f usec RGB5: %f usec\n",rsxgltest_elapsed_usec(&t[0],&t[1]),rsxgltest_elapsed_usec(&t[1],&t[2]));
+
   //
   glViewport(0,0,rsxgltest_width,rsxgltest_height);
 
   glClearColor(rgb[0],rgb[1],rgb[2],1.0);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glBindTexture(GL_TEXTURE_2D,textures[1]);
+  glBindTexture(GL_TEXTURE_2D,textures[(modff(rsxgltest_elapsed_time / 4.0f,&tmp) < 0.5f) ? 1 : 2]);
 
   {
     glUniformMatrix4fv(ProjMatrix_location,1,GL_FALSE,ProjMatrix.data());
@@ -447,6 +470,7 @@ rsxgltest_exit()
   glVertexAttribPointer(tc_location,2,GL_FLOAT,GL_FALSE,0,0);
 
   glDeleteBuffers(2,buffers);
+  glDeleteTextures(3,textures);
 
   glDeleteProgram(program);
 }
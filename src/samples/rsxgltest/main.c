@@ -320,6 +320,15 @@ appCleanup()
     }									      \
   } while (0)
 
+// Microseconds from start to end, for the tests that time themselves:
+float
+rsxgltest_elapsed_usec(const struct timeval * start,const struct timeval * end)
+{
+  struct timeval t;
+  timersub(end,start,&t);
+  return ((float)t.tv_sec * 1.0e6f) + (float)t.tv_usec;
+}
+
 int
 main(int argc, const char ** argv)
 {
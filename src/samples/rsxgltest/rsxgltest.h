@@ -7,9 +7,12 @@
 extern "C" {
 #endif
 
+struct timeval;
+
 void tcp_printf(const char * fmt,...);
 void report_glerror(const char *);
 void summarize_program(const char *,GLuint);
+float rsxgltest_elapsed_usec(const struct timeval *,const struct timeval *);
 extern int rsxgltest_width, rsxgltest_height;
 extern float rsxgltest_elapsed_time, rsxgltest_last_time, rsxgltest_delta_time;
 
@@ -0,0 +1,216 @@
+/*
+ * rsxgltest - texswizzle
+ *
+ * Samples the same 1024x1024 texture stored swizzled and linear (GL_TEXTURE_LINEAR_RSX), rotated
+ * and minified so that neighbouring fragments fetch texels from different rows, and reports how
+ * long each layout takes to draw. The swizzled texture is uploaded from a pixel buffer, so that
+ * the RSX swizzles it; upload times are reported too.
+ */
+
+#define GL3_PROTOTYPES
+#include <GL3/gl3.h>
+#include <GL3/gl3ext.h>
+#include <GL3/rsxgl3ext.h>
+
+#include "rsxgltest.h"
+
+#include <io/pad.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+const char * rsxgltest_name = "texswizzle";
+
+const GLsizei texture_size = 1024;
+const GLuint ndraws = 20;
+
+GLuint shaders[2] = { 0,0 };
+GLuint program = 0;
+GLint vertex_location = -1, angle_location = -1, scale_location = -1, image_location = -1;
+
+GLuint buffers[2] = { 0,0 };
+
+// 0: swizzled, 1: linear
+GLuint textures[2] = { 0,0 };
+
+const char * vert_src =
+  "#version 130\n"
+  "in vec2 vertex;\n"
+  "uniform float angle;\n"
+  "uniform float scale;\n"
+  "out vec2 uv;\n"
+  "void main() {\n"
+  "  mat2 r = mat2(cos(angle),sin(angle),-sin(angle),cos(angle));\n"
+  "  uv = (r * vertex) * scale;\n"
+  "  gl_Position = vec4(vertex,0,1);\n"
+  "}\n";
+
+const char * frag_src =
+  "#version 130\n"
+  "in vec2 uv;\n"
+  "uniform sampler2D image;\n"
+  "out vec4 color;\n"
+  "void main() {\n"
+  "  color = texture(image,uv);\n"
+  "}\n";
+
+extern "C"
+void
+rsxgltest_pad(unsigned int,const padData * paddata)
+{
+}
+
+extern "C"
+void
+rsxgltest_init(int argc,const char ** argv)
+{
+  tcp_printf("%s\n",__PRETTY_FUNCTION__);
+
+  shaders[0] = glCreateShader(GL_VERTEX_SHADER);
+  shaders[1] = glCreateShader(GL_FRAGMENT_SHADER);
+
+  program = glCreateProgram();
+
+  glAttachShader(program,shaders[0]);
+  glAttachShader(program,shaders[1]);
+
+  char szInfo[2048];
+  GLint compiled = 0;
+
+  const GLchar * shader_srcs[] = { vert_src, frag_src };
+
+  glShaderSource(shaders[0],1,shader_srcs,0);
+  glCompileShader(shaders[0]);
+
+  glGetShaderiv(shaders[0],GL_COMPILE_STATUS,&compiled);
+  tcp_printf("shader compile status: %i\n",compiled);
+
+  glGetShaderInfoLog(shaders[0],2048,0,szInfo);
+  tcp_printf("%s\n",szInfo);
+
+  glShaderSource(shaders[1],1,shader_srcs + 1,0);
+  glCompileShader(shaders[1]);
+
+  glGetShaderiv(shaders[1],GL_COMPILE_STATUS,&compiled);
+  tcp_printf("shader compile status: %i\n",compiled);
+
+  glGetShaderInfoLog(shaders[1],2048,0,szInfo);
+  tcp_printf("%s\n",szInfo);
+
+  glLinkProgram(program);
+  glValidateProgram(program);
+
+  summarize_program("texswizzle",program);
+
+  vertex_location = glGetAttribLocation(program,"vertex");
+  angle_location = glGetUniformLocation(program,"angle");
+  scale_location = glGetUniformLocation(program,"scale");
+  image_location = glGetUniformLocation(program,"image");
+
+  glUseProgram(program);
+  glUniform1i(image_location,0);
+
+  // A full-screen quad:
+  const float geometry[] = {
+    -1,-1, 1,-1, 1,1,
+    -1,-1, 1,1, -1,1
+  };
+
+  glGenBuffers(2,buffers);
+
+  glBindBuffer(GL_ARRAY_BUFFER,buffers[0]);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(geometry),geometry,GL_STATIC_DRAW);
+
+  glEnableVertexAttribArray(vertex_location);
+  glVertexAttribPointer(vertex_location,2,GL_FLOAT,GL_FALSE,0,0);
+
+  // Noise, so that the texture cache can't get away with anything:
+  const size_t nbytes = texture_size * texture_size * 4;
+  GLubyte * pixels = (GLubyte *)malloc(nbytes);
+  for(size_t i = 0;i < nbytes;++i) {
+    pixels[i] = (GLubyte)rand();
+  }
+
+  glGenTextures(2,textures);
+  glActiveTexture(GL_TEXTURE0);
+
+  struct timeval t0, t1, t2;
+
+  // Swizzled, from a pixel buffer:
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER,buffers[1]);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER,nbytes,pixels,GL_STATIC_DRAW);
+
+  glBindTexture(GL_TEXTURE_2D,textures[0]);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+  glTexStorage2D(GL_TEXTURE_2D,1,GL_RGBA8,texture_size,texture_size);
+
+  glFinish();
+  gettimeofday(&t0,0);
+  glTexSubImage2D(GL_TEXTURE_2D,0,0,0,texture_size,texture_size,GL_RGBA,GL_UNSIGNED_BYTE,0);
+  glFinish();
+  gettimeofday(&t1,0);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+
+  // Linear, from client memory:
+  glBindTexture(GL_TEXTURE_2D,textures[1]);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_LINEAR_RSX,GL_TRUE);
+  glTexStorage2D(GL_TEXTURE_2D,1,GL_RGBA8,texture_size,texture_size);
+
+  glTexSubImage2D(GL_TEXTURE_2D,0,0,0,texture_size,texture_size,GL_RGBA,GL_UNSIGNED_BYTE,pixels);
+  glFinish();
+  gettimeofday(&t2,0);
+
+  free(pixels);
+
+  tcp_printf("upload: swizzled (pixel buffer) %f usec, linear (client memory) %f usec\n",
+	     rsxgltest_elapsed_usec(&t0,&t1),rsxgltest_elapsed_usec(&t1,&t2));
+}
+
+extern "C"
+int
+rsxgltest_draw()
+{
+  struct timeval t[3];
+  const float angle = rsxgltest_elapsed_time * 0.25f;
+
+  glClearColor(0,0,0,1);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  glUniform1f(angle_location,angle);
+  glUniform1f(scale_location,2.0f + sinf(angle));
+
+  glFinish();
+  gettimeofday(&t[0],0);
+
+  for(int i = 0;i < 2;++i) {
+    glBindTexture(GL_TEXTURE_2D,textures[i]);
+    for(GLuint j = 0;j < ndraws;++j) {
+      glDrawArrays(GL_TRIANGLES,0,6);
+    }
+    glFinish();
+    gettimeofday(&t[i + 1],0);
+  }
+
+  tcp_printf("swizzled: %f usec linear: %f usec (per draw)\n",
+	     rsxgltest_elapsed_usec(&t[0],&t[1]) / (float)ndraws,rsxgltest_elapsed_usec(&t[1],&t[2]) / (float)ndraws);
+
+  return 1;
+}
+
+extern "C"
+void
+rsxgltest_exit()
+{
+  glDeleteTextures(2,textures);
+  glDeleteBuffers(2,buffers);
+
+  glDeleteShader(shaders[0]);
+  glDeleteShader(shaders[1]);
+  glDeleteProgram(program);
+}
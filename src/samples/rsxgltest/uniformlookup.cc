@@ -0,0 +1,148 @@
+/*
+ * rsxgltest - uniformlookup
+ *
+ * Times glGetUniformLocation() against glGetUniformLocationHashRSX() on a program
+ * with many uniforms.
+ */
+
+#define GL3_PROTOTYPES
+#include <GL3/gl3.h>
+#include <GL3/rsxgl3ext.h>
+
+#include "rsxgltest.h"
+
+#include <io/pad.h>
+
+#include <stdio.h>
+#include <string>
+#include <sys/time.h>
+
+const char * rsxgltest_name = "uniformlookup";
+
+const GLuint nuniforms = 200;
+const GLuint nlookups = 100;
+
+GLuint shaders[2] = { 0,0 };
+GLuint program = 0;
+
+char uniform_names[nuniforms][8];
+GLuint uniform_hashes[nuniforms];
+
+extern "C"
+void
+rsxgltest_pad(unsigned int,const padData * paddata)
+{
+}
+
+extern "C"
+void
+rsxgltest_init(int argc,const char ** argv)
+{
+  tcp_printf("%s\n",__PRETTY_FUNCTION__);
+
+  // A vertex shader that uses every one of the uniforms:
+  std::string vert_src = "#version 130\nin vec4 position;\n";
+  std::string vert_sum = "  gl_Position = position";
+  for(GLuint i = 0;i < nuniforms;++i) {
+    snprintf(uniform_names[i],sizeof(uniform_names[i]),"u%u",i);
+    uniform_hashes[i] = glGetNameHashRSX(uniform_names[i]);
+
+    vert_src += std::string("uniform vec4 ") + uniform_names[i] + ";\n";
+    vert_sum += std::string(" + ") + uniform_names[i];
+  }
+  vert_src += "void main() {\n" + vert_sum + ";\n}\n";
+
+  const char * frag_src = "#version 130\nout vec4 color;\nvoid main() {\n  color = vec4(1,1,1,1);\n}\n";
+
+  shaders[0] = glCreateShader(GL_VERTEX_SHADER);
+  shaders[1] = glCreateShader(GL_FRAGMENT_SHADER);
+
+  program = glCreateProgram();
+
+  glAttachShader(program,shaders[0]);
+  glAttachShader(program,shaders[1]);
+
+  char szInfo[2048];
+  GLint compiled = 0;
+
+  const GLchar * shader_srcs[] = { vert_src.c_str(), frag_src };
+
+  glShaderSource(shaders[0],1,shader_srcs,0);
+  glCompileShader(shaders[0]);
+
+  glGetShaderiv(shaders[0],GL_COMPILE_STATUS,&compiled);
+  tcp_printf("shader compile status: %i\n",compiled);
+
+  glGetShaderInfoLog(shaders[0],2048,0,szInfo);
+  tcp_printf("%s\n",szInfo);
+
+  glShaderSource(shaders[1],1,shader_srcs + 1,0);
+  glCompileShader(shaders[1]);
+
+  glGetShaderiv(shaders[1],GL_COMPILE_STATUS,&compiled);
+  tcp_printf("shader compile status: %i\n",compiled);
+
+  glGetShaderInfoLog(shaders[1],2048,0,szInfo);
+  tcp_printf("%s\n",szInfo);
+
+  glLinkProgram(program);
+  glValidateProgram(program);
+
+  summarize_program("uniformlookup",program);
+
+  // Check that both paths agree:
+  for(GLuint i = 0;i < nuniforms;++i) {
+    const GLint a = glGetUniformLocation(program,uniform_names[i]);
+    const GLint b = glGetUniformLocationHashRSX(program,uniform_hashes[i],uniform_names[i]);
+    if(a == -1 || a != b) {
+      tcp_printf("mismatched location for %s: %i %i\n",uniform_names[i],a,b);
+    }
+  }
+}
+
+extern "C"
+int
+rsxgltest_draw()
+{
+  struct timeval t0, t1, t2, t3;
+  GLint sum[3] = { 0,0,0 };
+
+  gettimeofday(&t0,0);
+  for(GLuint j = 0;j < nlookups;++j) {
+    for(GLuint i = 0;i < nuniforms;++i) {
+      sum[0] += glGetUniformLocation(program,uniform_names[i]);
+    }
+  }
+  gettimeofday(&t1,0);
+  for(GLuint j = 0;j < nlookups;++j) {
+    for(GLuint i = 0;i < nuniforms;++i) {
+      sum[1] += glGetUniformLocationHashRSX(program,uniform_hashes[i],uniform_names[i]);
+    }
+  }
+  gettimeofday(&t2,0);
+  for(GLuint j = 0;j < nlookups;++j) {
+    for(GLuint i = 0;i < nuniforms;++i) {
+      sum[2] += glGetUniformLocationHashRSX(program,uniform_hashes[i],0);
+    }
+  }
+  gettimeofday(&t3,0);
+
+  const float n = (float)(nlookups * nuniforms);
+  tcp_printf("by name: %f usec hash+name: %f usec hash only: %f usec (per lookup; %i %i %i)\n",
+	     rsxgltest_elapsed_usec(&t0,&t1) / n,rsxgltest_elapsed_usec(&t1,&t2) / n,rsxgltest_elapsed_usec(&t2,&t3) / n,
+	     sum[0],sum[1],sum[2]);
+
+  glClearColor(0,0,0,1);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  return 1;
+}
+
+extern "C"
+void
+rsxgltest_exit()
+{
+  glDeleteShader(shaders[0]);
+  glDeleteShader(shaders[1]);
+  glDeleteProgram(program);
+}